@@ -0,0 +1,3643 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "absl/cleanup/cleanup.h"
+#include "tfdml/core/dml_binding_table_pool.h"
+#include "tfdml/core/dml_command_list.h"
+#include "tfdml/core/dml_command_queue.h"
+#include "tfdml/core/dml_compile_pool.h"
+#include "tfdml/core/dml_counters.h"
+#include "tfdml/core/dml_descriptor_bfc_allocator.h"
+#include "tfdml/core/dml_descriptor_ring.h"
+#include "tfdml/core/dml_device_context.h"
+#include "tfdml/core/dml_execution_context.h"
+#include "tfdml/core/dml_flush_policy.h"
+#include "tfdml/core/dml_gpu_timeline.h"
+#include "tfdml/core/dml_heap_allocator.h"
+#include "tfdml/core/dml_host_staging_pool.h"
+#include "tfdml/core/dml_kernel_manager.h"
+#include "tfdml/core/dml_ops_common.h"
+#include "tfdml/core/dml_stream_event.h"
+#include "tfdml/core/dml_temporary_heap.h"
+#include "tfdml/core/dml_trace_file_sink.h"
+#include "tfdml/core/dml_tracing.h"
+#include "tfdml/runtime_adapter/bfc_allocator.h"
+#include "tfdml/runtime_adapter/memory_trace.h"
+#include "tfdml/runtime_adapter/node_def.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <new>
+#include <numeric>
+#include <set>
+#include <thread>
+
+// Counts the heap allocations made by the test process, so that tests can
+// check that hot paths don't allocate.
+static std::atomic<uint64_t> g_allocation_count = {0};
+
+void* operator new(size_t size)
+{
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+// A fence that is only signaled by the test, which stands in for the fences of
+// the GPU queues.
+class FakeFence : public WRL::Base<ID3D12Fence>
+{
+  public:
+    UINT64 STDMETHODCALLTYPE GetCompletedValue() final
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return completed_value_;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetEventOnCompletion(UINT64 value, HANDLE event) final
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        signaled_.wait(lock, [&] { return completed_value_ >= value; });
+#if _WIN32
+        if (event)
+        {
+            SetEvent(event);
+        }
+#endif
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE Signal(UINT64 value) final
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        completed_value_ = value;
+        signaled_.notify_all();
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, const IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(LPCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable signaled_;
+    UINT64 completed_value_ = 0;
+};
+
+TEST(DmlStreamEventTests, UnrecordedEventIsComplete)
+{
+    tfdml::DmlStreamEvent event;
+    EXPECT_FALSE(event.IsRecorded());
+    EXPECT_TRUE(event.IsComplete());
+    event.WaitForCompletion();
+}
+
+TEST(DmlStreamEventTests, RecordAndPoll)
+{
+    auto compute_fence = Microsoft::WRL::Make<FakeFence>();
+    auto copy_fence = Microsoft::WRL::Make<FakeFence>();
+
+    tfdml::DmlGpuEvent gpu_events[] = {
+        tfdml::DmlGpuEvent{1, compute_fence},
+        tfdml::DmlGpuEvent{2, copy_fence}};
+
+    tfdml::DmlStreamEvent event;
+    event.Record(gpu_events, nullptr);
+    EXPECT_TRUE(event.IsRecorded());
+    EXPECT_FALSE(event.IsComplete());
+
+    // The event is pending until the work on every queue has completed
+    compute_fence->Signal(1);
+    EXPECT_FALSE(event.IsComplete());
+    copy_fence->Signal(1);
+    EXPECT_FALSE(event.IsComplete());
+    copy_fence->Signal(2);
+    EXPECT_TRUE(event.IsComplete());
+
+    // Recording the event again tracks the later work instead
+    gpu_events[0].fence_value = 3;
+    event.Record(gpu_events, nullptr);
+    EXPECT_FALSE(event.IsComplete());
+    compute_fence->Signal(3);
+    EXPECT_TRUE(event.IsComplete());
+}
+
+TEST(DmlStreamEventTests, WaitForCompletion)
+{
+    auto fence = Microsoft::WRL::Make<FakeFence>();
+
+    tfdml::DmlGpuEvent gpu_event = {5, fence};
+    tfdml::DmlStreamEvent event;
+    event.Record({gpu_event}, nullptr);
+
+    // The fence may be signaled past the recorded value by later work
+    std::thread signal_thread([&] { fence->Signal(7); });
+    event.WaitForCompletion();
+    signal_thread.join();
+
+    EXPECT_TRUE(event.IsComplete());
+    EXPECT_EQ(fence->GetCompletedValue(), 7u);
+}
+
+// A buffer whose memory is plain host memory, which stands in for the buffers
+// of the host staging pool.
+class FakeBuffer : public WRL::Base<ID3D12Resource>
+{
+  public:
+    explicit FakeBuffer(
+        uint64_t size_in_bytes,
+        int* live_buffer_count = nullptr)
+        : data_(size_in_bytes),
+          live_buffer_count_(live_buffer_count)
+    {
+        if (live_buffer_count_)
+        {
+            ++*live_buffer_count_;
+        }
+    }
+
+    ~FakeBuffer()
+    {
+        if (live_buffer_count_)
+        {
+            --*live_buffer_count_;
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    Map(UINT subresource, const D3D12_RANGE* read_range, void** data) final
+    {
+        *data = data_.data();
+        return S_OK;
+    }
+
+    void STDMETHODCALLTYPE
+    Unmap(UINT subresource, const D3D12_RANGE* written_range) final
+    {
+    }
+
+    D3D12_RESOURCE_DESC STDMETHODCALLTYPE GetDesc() final
+    {
+        return CD3DX12_RESOURCE_DESC::Buffer(data_.size());
+    }
+
+    D3D12_GPU_VIRTUAL_ADDRESS STDMETHODCALLTYPE GetGPUVirtualAddress() final
+    {
+        return 0;
+    }
+
+    HRESULT STDMETHODCALLTYPE WriteToSubresource(
+        UINT dst_subresource,
+        const D3D12_BOX* dst_box,
+        const void* src_data,
+        UINT src_row_pitch,
+        UINT src_depth_pitch) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE ReadFromSubresource(
+        void* dst_data,
+        UINT dst_row_pitch,
+        UINT dst_depth_pitch,
+        UINT src_subresource,
+        const D3D12_BOX* src_box) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetHeapProperties(
+        D3D12_HEAP_PROPERTIES* heap_properties,
+        D3D12_HEAP_FLAGS* heap_flags) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, const IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(LPCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    std::vector<uint8_t> data_;
+    int* live_buffer_count_;
+};
+
+static constexpr uint64_t kBlockSize =
+    tfdml::DmlHostStagingPool::kMinBlockSizeInBytes;
+
+class DmlHostStagingPoolTests : public ::testing::Test
+{
+  protected:
+    std::unique_ptr<tfdml::DmlHostStagingPool> CreatePool(
+        uint64_t retention_limit_in_bytes)
+    {
+        return std::make_unique<tfdml::DmlHostStagingPool>(
+            [this](
+                uint64_t size_in_bytes,
+                Microsoft::WRL::ComPtr<ID3D12Resource>* buffer)
+            {
+                *buffer = Microsoft::WRL::Make<FakeBuffer>(
+                    size_in_bytes,
+                    &live_buffer_count_);
+                return S_OK;
+            },
+            retention_limit_in_bytes);
+    }
+
+    int live_buffer_count_ = 0;
+};
+
+TEST_F(DmlHostStagingPoolTests, RoundsUpToSizeClasses)
+{
+    auto pool = CreatePool(0);
+
+    void* small = pool->Allocate(1);
+    void* large = pool->Allocate(3 * kBlockSize);
+    ASSERT_NE(small, nullptr);
+    ASSERT_NE(large, nullptr);
+    EXPECT_EQ(live_buffer_count_, 2);
+    EXPECT_EQ(pool->GetStats().bytes_in_use, kBlockSize + 4 * kBlockSize);
+
+    // The whole size class is usable, but nothing past it
+    auto buffer = pool->Find(static_cast<uint8_t*>(large) + kBlockSize, 16);
+    ASSERT_TRUE(buffer.has_value());
+    EXPECT_EQ(buffer->offset, kBlockSize);
+    EXPECT_FALSE(pool->Find(small, kBlockSize + 1).has_value());
+
+    int not_from_pool = 0;
+    EXPECT_FALSE(
+        pool->Find(&not_from_pool, sizeof(not_from_pool)).has_value());
+    EXPECT_FALSE(pool->Free(&not_from_pool));
+
+    EXPECT_TRUE(pool->Free(small));
+    EXPECT_TRUE(pool->Free(large));
+}
+
+TEST_F(DmlHostStagingPoolTests, ReusesIdleBlocks)
+{
+    auto pool = CreatePool(kBlockSize);
+    auto fence = Microsoft::WRL::Make<FakeFence>();
+
+    void* first = pool->Allocate(kBlockSize);
+    pool->AddGpuUse(first, tfdml::DmlGpuEvent{1, fence});
+    EXPECT_TRUE(pool->Free(first));
+    EXPECT_EQ(pool->GetStats().bytes_retained, kBlockSize);
+
+    // The GPU is still using the freed block, so it can't be handed out yet
+    void* second = pool->Allocate(kBlockSize);
+    EXPECT_NE(second, first);
+    EXPECT_TRUE(pool->Free(second));
+
+    fence->Signal(1);
+    void* third = pool->Allocate(kBlockSize);
+    EXPECT_EQ(third, first);
+    EXPECT_EQ(pool->GetStats().reuse_count, 1u);
+    EXPECT_TRUE(pool->Free(third));
+}
+
+TEST_F(DmlHostStagingPoolTests, ReleasesBlocksOverRetentionLimit)
+{
+    auto pool = CreatePool(kBlockSize);
+    auto fence = Microsoft::WRL::Make<FakeFence>();
+
+    void* first = pool->Allocate(kBlockSize);
+    void* second = pool->Allocate(kBlockSize);
+    EXPECT_EQ(live_buffer_count_, 2);
+
+    EXPECT_TRUE(pool->Free(first));
+    EXPECT_EQ(live_buffer_count_, 2);
+
+    // Only one block fits in the retention limit, and the other one is only
+    // released once the GPU is done with it
+    pool->AddGpuUse(second, tfdml::DmlGpuEvent{1, fence});
+    EXPECT_TRUE(pool->Free(second));
+    EXPECT_EQ(live_buffer_count_, 2);
+
+    fence->Signal(1);
+    void* third = pool->Allocate(kBlockSize);
+    EXPECT_EQ(live_buffer_count_, 1);
+    EXPECT_EQ(third, first);
+
+    auto stats = pool->GetStats();
+    EXPECT_EQ(stats.allocation_count, 3u);
+    EXPECT_EQ(stats.peak_bytes_in_use, 2 * kBlockSize);
+    EXPECT_TRUE(pool->Free(third));
+}
+
+
+// A calibration where a GPU tick is a microsecond, and GPU timestamp 1000 was
+// sampled at CPU time 1s.
+static const tfdml::DmlGpuTimeline::ClockCalibration kCalibration = {
+    1000,
+    1000000000,
+    1000000};
+
+TEST(DmlGpuTimelineTests, ConvertsTimestampsToCpuClock)
+{
+    using tfdml::DmlGpuTimeline;
+
+    EXPECT_EQ(
+        DmlGpuTimeline::ConvertToCpuTimestampNs(1000, kCalibration),
+        1000000000);
+    EXPECT_EQ(
+        DmlGpuTimeline::ConvertToCpuTimestampNs(1250, kCalibration),
+        1000250000);
+
+    // Timestamps taken before the calibration
+    EXPECT_EQ(
+        DmlGpuTimeline::ConvertToCpuTimestampNs(900, kCalibration),
+        999900000);
+}
+
+TEST(DmlGpuTimelineTests, ResolvesQueryPairs)
+{
+    using tfdml::DmlGpuTimeline;
+
+    // Stands in for the resolved contents of a query heap, where each command
+    // was bracketed by a pair of consecutive queries.
+    std::vector<uint64_t> timestamps = {2000, 2010, 2010, 2050, 2060, 2100};
+    std::vector<DmlGpuTimeline::QueryPair> query_pairs = {
+        {7, 0},
+        {8, 2},
+        {7, 4}};
+
+    std::vector<DmlGpuTimeline::Event> events;
+    DmlGpuTimeline::ResolveEvents(
+        query_pairs,
+        timestamps,
+        kCalibration,
+        &events);
+
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[0].correlation_id, 7u);
+    EXPECT_EQ(events[0].start_timestamp_ns, 1001000000);
+    EXPECT_EQ(events[0].end_timestamp_ns, 1001010000);
+    EXPECT_EQ(events[1].correlation_id, 8u);
+    EXPECT_EQ(events[1].start_timestamp_ns, 1001010000);
+    EXPECT_EQ(events[1].end_timestamp_ns, 1001050000);
+    EXPECT_EQ(events[2].correlation_id, 7u);
+    EXPECT_EQ(events[2].start_timestamp_ns, 1001060000);
+    EXPECT_EQ(events[2].end_timestamp_ns, 1001100000);
+}
+
+TEST(DmlGpuTimelineTests, SkipsInvalidQueryPairs)
+{
+    using tfdml::DmlGpuTimeline;
+
+    // Unwritten queries resolve to zero, and the last pair is out of range.
+    std::vector<uint64_t> timestamps = {0, 0, 3000, 2990, 3000, 3001, 3002};
+    std::vector<DmlGpuTimeline::QueryPair> query_pairs = {
+        {1, 0},
+        {2, 2},
+        {3, 4},
+        {4, 6}};
+
+    std::vector<DmlGpuTimeline::Event> events;
+    DmlGpuTimeline::ResolveEvents(
+        query_pairs,
+        timestamps,
+        kCalibration,
+        &events);
+
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].correlation_id, 3u);
+    EXPECT_EQ(
+        events[0].end_timestamp_ns - events[0].start_timestamp_ns,
+        1000);
+}
+
+// Measures how many kernel compute events each thread records per second while
+// the profiler is active. The rate depends on the machine, so it's reported as
+// a test property instead of being checked.
+TEST(DmlTracingBenchmarks, KernelComputeEventsPerSecondPerThread)
+{
+    constexpr int kThreadCount = 4;
+    constexpr int kEventsPerThread = 50000;
+
+    auto& tracing = DmlTracing::Instance();
+    tracing.StartProfiler();
+
+    std::vector<double> events_per_second(kThreadCount);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreadCount; ++t)
+    {
+        threads.emplace_back(
+            [&tracing, &events_per_second, t]()
+            {
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < kEventsPerThread; ++i)
+                {
+                    auto event_id = tracing.TryLogKernelComputeStart(
+                        0,
+                        "MatMul",
+                        "benchmark/MatMul");
+                    if (event_id)
+                    {
+                        tracing.LogKernelComputeEnd(0, *event_id);
+                    }
+                }
+                std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - start;
+                events_per_second[t] = kEventsPerThread / elapsed.count();
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    tracing.StopProfiler();
+
+    double total_events_per_second = std::accumulate(
+        events_per_second.begin(),
+        events_per_second.end(),
+        0.0);
+    double mean_events_per_second = total_events_per_second / kThreadCount;
+    RecordProperty(
+        "events_per_second_per_thread",
+        static_cast<int>(mean_events_per_second));
+
+    // Every event of every thread makes it into the XSpace
+    const auto& xspace = tracing.GetXSpace();
+    ASSERT_FALSE(xspace.planes().empty());
+    size_t event_count = 0;
+    for (const auto& line : xspace.planes(0).lines())
+    {
+        if (line.name() == "Kernels (CPU Timeline)")
+        {
+            event_count += line.events_size();
+        }
+    }
+    EXPECT_EQ(
+        event_count,
+        static_cast<size_t>(kThreadCount * kEventsPerThread));
+}
+
+TEST(DmlCountersTests, TracksTotalsAndGauges)
+{
+    using tfdml::DmlCounter;
+
+    tfdml::DmlCounters counters;
+    counters.Increment(DmlCounter::BatchesFlushed);
+    counters.Add(DmlCounter::CommandsFlushed, 5);
+    counters.Add(DmlCounter::CommandsFlushed, 3);
+
+    counters.Add(DmlCounter::EventQueueDepth, 4);
+    counters.UpdateMax(DmlCounter::EventQueueMaxDepth, 4);
+    counters.Subtract(DmlCounter::EventQueueDepth, 3);
+    counters.UpdateMax(DmlCounter::EventQueueMaxDepth, 1);
+
+    EXPECT_EQ(counters.GetValue(DmlCounter::BatchesFlushed), 1u);
+    EXPECT_EQ(counters.GetValue(DmlCounter::CommandsFlushed), 8u);
+    EXPECT_EQ(counters.GetValue(DmlCounter::EventQueueDepth), 1u);
+    EXPECT_EQ(counters.GetValue(DmlCounter::EventQueueMaxDepth), 4u);
+    EXPECT_EQ(counters.GetValue(DmlCounter::Uploads), 0u);
+
+    auto values = counters.GetValues();
+    EXPECT_EQ(values[static_cast<size_t>(DmlCounter::CommandsFlushed)], 8u);
+
+    EXPECT_FALSE(tfdml::DmlCounters::IsGauge(DmlCounter::CommandsFlushed));
+    EXPECT_TRUE(tfdml::DmlCounters::IsGauge(DmlCounter::EventQueueMaxDepth));
+}
+
+TEST(DmlCountersTests, NamesAreUnique)
+{
+    std::set<std::string> names;
+    for (size_t i = 0; i < tfdml::DmlCounters::kCounterCount; ++i)
+    {
+        const char* name =
+            tfdml::DmlCounters::GetName(static_cast<tfdml::DmlCounter>(i));
+        ASSERT_NE(name, nullptr);
+        EXPECT_TRUE(names.insert(name).second) << name;
+    }
+
+    EXPECT_STREQ(
+        tfdml::DmlCounters::GetName(tfdml::DmlCounter::BatchesFlushed),
+        "batches_flushed");
+}
+
+// Serves the regions of a BFC allocator from the heap, so that it can be tested
+// without a device.
+class FakeSubAllocator final : public tfdml::SubAllocator
+{
+  public:
+    FakeSubAllocator() : tfdml::SubAllocator({}, {}) {}
+
+    void* Alloc(size_t alignment, size_t num_bytes, size_t* bytes_received)
+        final
+    {
+        *bytes_received = num_bytes;
+        return ::operator new(num_bytes);
+    }
+
+    void Free(void* ptr, size_t num_bytes) final { ::operator delete(ptr); }
+
+    bool SupportsCoalescing() const final { return false; }
+};
+
+class MemoryTraceTests : public ::testing::Test,
+                         public tfdml::MemoryTraceListener
+{
+  protected:
+    void SetUp() override { tfdml::SetMemoryTraceListener(this); }
+    void TearDown() override { tfdml::SetMemoryTraceListener(nullptr); }
+
+    void OnMemoryEvent(tfdml::MemoryTraceEvent&& event) final
+    {
+        events_.push_back(std::move(event));
+    }
+
+    tfdml::BFCAllocator allocator_{
+        std::make_unique<FakeSubAllocator>(),
+        1 << 20,
+        "test_allocator",
+        tfdml::BFCAllocator::Options()};
+    std::vector<tfdml::MemoryTraceEvent> events_;
+};
+
+TEST_F(MemoryTraceTests, RecordsAllocationsAndDeallocations)
+{
+    void* a = nullptr;
+    {
+        tfdml::ScopedMemoryDebugAnnotation annotation("MatMul");
+        a = allocator_.AllocateRaw(64, 1000);
+    }
+    void* b = allocator_.AllocateRaw(64, 3000);
+    allocator_.DeallocateRaw(a);
+
+    ASSERT_EQ(events_.size(), 3u);
+
+    // Sizes are rounded up to multiples of 256 bytes
+    EXPECT_TRUE(events_[0].is_allocation);
+    EXPECT_EQ(events_[0].allocator_name, "test_allocator");
+    EXPECT_EQ(events_[0].tf_op, "MatMul");
+    EXPECT_EQ(events_[0].requested_bytes, 1000);
+    EXPECT_EQ(events_[0].allocation_bytes, 1024);
+    EXPECT_EQ(events_[0].address, reinterpret_cast<uint64_t>(a));
+    EXPECT_EQ(events_[0].bytes_allocated, 1024);
+    EXPECT_EQ(events_[0].bytes_available, (1 << 20) - 1024);
+
+    EXPECT_TRUE(events_[1].is_allocation);
+    EXPECT_EQ(events_[1].tf_op, "");
+    EXPECT_EQ(events_[1].bytes_allocated, 4096);
+    EXPECT_EQ(events_[1].peak_bytes_in_use, 4096);
+
+    EXPECT_FALSE(events_[2].is_allocation);
+    EXPECT_EQ(events_[2].address, reinterpret_cast<uint64_t>(a));
+    EXPECT_EQ(events_[2].allocation_bytes, 1024);
+    EXPECT_EQ(events_[2].bytes_allocated, 3072);
+    EXPECT_EQ(events_[2].peak_bytes_in_use, 4096);
+
+    allocator_.DeallocateRaw(b);
+}
+
+TEST_F(MemoryTraceTests, NestedAnnotationsRestoreTheOuterOp)
+{
+    tfdml::ScopedMemoryDebugAnnotation outer("Outer");
+    {
+        tfdml::ScopedMemoryDebugAnnotation inner("Inner");
+        EXPECT_EQ(tfdml::ScopedMemoryDebugAnnotation::CurrentOpName(), "Inner");
+    }
+    EXPECT_EQ(tfdml::ScopedMemoryDebugAnnotation::CurrentOpName(), "Outer");
+}
+
+TEST_F(MemoryTraceTests, RecordsNothingWithoutListener)
+{
+    tfdml::SetMemoryTraceListener(nullptr);
+    allocator_.DeallocateRaw(allocator_.AllocateRaw(64, 1000));
+    EXPECT_TRUE(events_.empty());
+}
+
+static std::string ReadFileContents(const std::string& path)
+{
+    std::ifstream file(path);
+    return std::string(
+        std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>());
+}
+
+TEST(DmlTraceFileSinkTests, WritesChromeTraceEvents)
+{
+    using Arg = tfdml::DmlTraceFileSink::Arg;
+
+    std::string path = ::testing::TempDir() + "dml_trace_file_sink_test.json";
+    auto cleanup = absl::MakeCleanup([&] { std::remove(path.c_str()); });
+
+    {
+        tfdml::DmlTraceFileSink sink(std::ofstream(path), 16);
+        sink.BeginEvent(
+            "kernel",
+            "MatMul",
+            {Arg("op_name", "dense/\"MatMul\""), Arg("device", uint64_t{0})});
+        sink.BeginEvent("memcpy", "MemcpyH2D", {});
+        sink.EndEvent();
+        sink.EndEvent();
+        sink.AddInstantEvent(
+            "command_queue",
+            "FenceSignal",
+            {Arg("fence_value", uint64_t{7})});
+        sink.Flush();
+
+        std::string contents = ReadFileContents(path);
+        EXPECT_EQ(contents.find("[\n"), 0u);
+        EXPECT_NE(
+            contents.find(
+                "{\"name\":\"MatMul\",\"cat\":\"kernel\",\"ph\":\"X\""),
+            std::string::npos);
+        EXPECT_NE(
+            contents.find("\"op_name\":\"dense/\\\"MatMul\\\"\",\"device\":0"),
+            std::string::npos);
+        EXPECT_NE(
+            contents.find("\"name\":\"FenceSignal\",\"cat\":\"command_queue\","
+                          "\"ph\":\"i\""),
+            std::string::npos);
+        EXPECT_NE(contents.find("\"fence_value\":7"), std::string::npos);
+
+        // Nested events are written when they end
+        EXPECT_LT(contents.find("MemcpyH2D"), contents.find("MatMul"));
+        EXPECT_EQ(sink.GetDroppedEventCount(), 0u);
+    }
+
+    // The array is closed when the sink is destroyed
+    std::string contents = ReadFileContents(path);
+    ASSERT_GE(contents.size(), 3u);
+    EXPECT_EQ(contents.substr(contents.size() - 3), "\n]\n");
+}
+
+// A kernel that doesn't own any GPU objects, so that the kernel manager can be
+// tested without a device.
+class FakeKernel final : public tfdml::DmlKernel
+{
+  public:
+    using InitHelper = tfdml::NoOpInitializationHelper;
+
+    FakeKernel(tfdml::DmlKernelConstruction* ctx, const InitHelper* init_helper)
+    {
+    }
+
+    uint64_t GetPersistentResourceSize() const final { return 0; }
+};
+
+class DmlKernelManagerTests : public ::testing::Test
+{
+  protected:
+    // Returns the key of a FakeOp kernel whose only input is a vector of
+    // `size` elements.
+    tfdml::DmlKernelKey CreateKey(int64_t size) const
+    {
+        tfdml::DmlInputTensorKey input = {};
+        input.tensor = tfdml::TensorShapeAndType{
+            tfdml::TensorShape({size}),
+            TF_FLOAT};
+        input.is_constant_cpu_input = false;
+
+        tfdml::DmlKernelKey key = {};
+        key.op_type_name = "FakeOp";
+        key.node_def = node_def_;
+        key.input_tensors.push_back(std::move(input));
+        key.fingerprint = key.ComputeFingerprint();
+        return key;
+    }
+
+    std::vector<tfdml::DmlKernelKey> CreateCachedKernels(int count)
+    {
+        std::vector<tfdml::DmlKernelKey> keys;
+        for (int i = 0; i < count; ++i)
+        {
+            keys.push_back(CreateKey(i + 1));
+            manager_.CreateCachedKernel<FakeKernel>(
+                nullptr,
+                keys.back(),
+                nullptr);
+        }
+        return keys;
+    }
+
+    std::shared_ptr<const tfdml::NodeDef> node_def_ =
+        std::make_shared<tfdml::NodeDef>();
+    Microsoft::WRL::ComPtr<FakeFence> fence_ =
+        Microsoft::WRL::Make<FakeFence>();
+    tfdml::DmlCounters counters_;
+    tfdml::DmlKernelManager manager_{fence_.Get(), &counters_};
+};
+
+TEST_F(DmlKernelManagerTests, LookupsRaceWithPublishes)
+{
+    constexpr int kKeyCount = 32;
+    constexpr int kReaderCount = 4;
+    constexpr int kPublishRounds = 200;
+
+    std::vector<tfdml::DmlKernelKey> keys;
+    for (int i = 0; i < kKeyCount; ++i)
+    {
+        keys.push_back(CreateKey(i + 1));
+    }
+
+    // Every insertion and every clear publishes a new snapshot, which frees
+    // the previous one while the readers are looking up the same keys. A
+    // reader that used a freed snapshot would read freed kernels here.
+    std::atomic<bool> done = {false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < kReaderCount; ++t)
+    {
+        readers.emplace_back(
+            [&, t]()
+            {
+                for (size_t i = t; !done.load(); ++i)
+                {
+                    auto kernel = manager_.TryGetCachedKernel<FakeKernel>(
+                        keys[i % kKeyCount]);
+                    if (kernel)
+                    {
+                        EXPECT_EQ(kernel->GetPersistentResourceSize(), 0u);
+                    }
+                }
+            });
+    }
+
+    for (int round = 0; round < kPublishRounds; ++round)
+    {
+        for (const auto& key : keys)
+        {
+            manager_.CreateCachedKernel<FakeKernel>(nullptr, key, nullptr);
+        }
+        manager_.ClearCache();
+    }
+
+    done = true;
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+
+    EXPECT_EQ(manager_.GetCacheSize(), 0u);
+    EXPECT_EQ(
+        manager_.GetKernelCreationCount(),
+        static_cast<uint64_t>(kKeyCount * kPublishRounds));
+}
+
+// Measures the throughput of cache hits as the number of threads looking up
+// kernels grows. Hits don't take any locks, so the total throughput should
+// scale with the thread count; the rates depend on the machine, so they're
+// reported as test properties instead of being checked.
+TEST_F(DmlKernelManagerTests, CacheHitsPerSecondByThreadCount)
+{
+    constexpr int kKeyCount = 256;
+    constexpr int kLookupsPerThread = 200000;
+
+    std::vector<tfdml::DmlKernelKey> keys = CreateCachedKernels(kKeyCount);
+
+    for (int thread_count : {1, 2, 4, 8})
+    {
+        std::atomic<uint64_t> miss_count = {0};
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back(
+                [&, t]()
+                {
+                    for (int i = 0; i < kLookupsPerThread; ++i)
+                    {
+                        const auto& key = keys[(i * 7 + t) % kKeyCount];
+                        if (!manager_.TryGetCachedKernel<FakeKernel>(key))
+                        {
+                            miss_count.fetch_add(1);
+                        }
+                    }
+                });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        double hits_per_second =
+            thread_count * kLookupsPerThread / elapsed.count();
+        RecordProperty(
+            "hits_per_second_" + std::to_string(thread_count) + "_threads",
+            static_cast<int>(hits_per_second));
+
+        EXPECT_EQ(miss_count.load(), 0u);
+    }
+}
+
+// Describes the key of a FakeOp kernel by the shape of its input, the way the
+// kernel wrapper describes the inputs of an OpKernelContext, so that the cache
+// can be searched without building a key.
+class FakeOpKeyQuery final : public tfdml::DmlKernelKeyQuery
+{
+  public:
+    FakeOpKeyQuery(uint64_t attribute_hash, const tfdml::TensorShape& shape)
+        : DmlKernelKeyQuery(ComputeFingerprint(attribute_hash, shape)),
+          shape_(shape)
+    {
+    }
+
+    bool Matches(const tfdml::DmlKernelKey& key) const final
+    {
+        if (key.input_tensors.size() != 1 ||
+            key.input_tensors[0].is_constant_cpu_input)
+        {
+            return false;
+        }
+
+        const auto& input = absl::get<tfdml::TensorShapeAndType>(
+            key.input_tensors[0].tensor);
+        return input.dtype == TF_FLOAT && input.shape == shape_;
+    }
+
+  private:
+    static uint64_t ComputeFingerprint(
+        uint64_t attribute_hash,
+        const tfdml::TensorShape& shape)
+    {
+        tfdml::DmlKernelFingerprintBuilder builder(attribute_hash);
+        builder.AddInputShapeAndType(shape, TF_FLOAT);
+        return builder.Finish();
+    }
+
+    const tfdml::TensorShape& shape_;
+};
+
+TEST_F(DmlKernelManagerTests, CacheHitsByQueryDontAllocate)
+{
+    constexpr int kKeyCount = 16;
+    CreateCachedKernels(kKeyCount);
+
+    const uint64_t attribute_hash =
+        tfdml::DmlKernelKey::HashAttributes("FakeOp", node_def_.get());
+
+    std::vector<tfdml::TensorShape> shapes;
+    for (int i = 0; i < kKeyCount; ++i)
+    {
+        shapes.push_back(tfdml::TensorShape({i + 1}));
+    }
+
+    uint64_t allocation_count = g_allocation_count.load();
+    size_t hit_count = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        FakeOpKeyQuery query(attribute_hash, shapes[i % kKeyCount]);
+        if (manager_.TryGetCachedKernel<FakeKernel>(query))
+        {
+            ++hit_count;
+        }
+    }
+
+    EXPECT_EQ(g_allocation_count.load() - allocation_count, 0u);
+    EXPECT_EQ(hit_count, 1000u);
+}
+
+// Compares the cost of a cache hit when the full kernel key is built for the
+// lookup, as kernels used to do on every Compute, against looking the kernel
+// up by a query. The timings depend on the machine, so they're reported as
+// test properties instead of being checked.
+TEST_F(DmlKernelManagerTests, CacheHitCostByKeyAndByQuery)
+{
+    constexpr int kKeyCount = 64;
+    constexpr int kLookupCount = 100000;
+
+    CreateCachedKernels(kKeyCount);
+
+    const uint64_t attribute_hash =
+        tfdml::DmlKernelKey::HashAttributes("FakeOp", node_def_.get());
+
+    std::vector<tfdml::TensorShape> shapes;
+    for (int i = 0; i < kKeyCount; ++i)
+    {
+        shapes.push_back(tfdml::TensorShape({i + 1}));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t allocation_count = g_allocation_count.load();
+    for (int i = 0; i < kLookupCount; ++i)
+    {
+        tfdml::DmlKernelKey key = CreateKey(i % kKeyCount + 1);
+        ASSERT_NE(manager_.TryGetCachedKernel<FakeKernel>(key), nullptr);
+    }
+    uint64_t key_allocations = g_allocation_count.load() - allocation_count;
+    std::chrono::duration<double, std::nano> key_elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    allocation_count = g_allocation_count.load();
+    for (int i = 0; i < kLookupCount; ++i)
+    {
+        FakeOpKeyQuery query(attribute_hash, shapes[i % kKeyCount]);
+        ASSERT_NE(manager_.TryGetCachedKernel<FakeKernel>(query), nullptr);
+    }
+    uint64_t query_allocations = g_allocation_count.load() - allocation_count;
+    std::chrono::duration<double, std::nano> query_elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    RecordProperty(
+        "ns_per_hit_by_key",
+        static_cast<int>(key_elapsed.count() / kLookupCount));
+    RecordProperty(
+        "ns_per_hit_by_query",
+        static_cast<int>(query_elapsed.count() / kLookupCount));
+    RecordProperty(
+        "allocations_per_hit_by_key",
+        static_cast<int>(key_allocations / kLookupCount));
+
+    EXPECT_EQ(query_allocations, 0u);
+}
+
+// Stands in for the operator compilation of a kernel, which keeps a CPU busy
+// for `compile_time`. The compilation runs on `compile_pool` unless it's null.
+struct FakeCompileHelper
+{
+    tfdml::DmlCompilePool* compile_pool;
+    std::chrono::microseconds compile_time;
+};
+
+class FakeCompilingKernel final : public tfdml::DmlKernel
+{
+  public:
+    using InitHelper = FakeCompileHelper;
+
+    FakeCompilingKernel(
+        tfdml::DmlKernelConstruction* ctx,
+        const InitHelper* init_helper)
+    {
+        auto compile = [init_helper]()
+        {
+            auto end =
+                std::chrono::steady_clock::now() + init_helper->compile_time;
+            while (std::chrono::steady_clock::now() < end)
+            {
+            }
+        };
+
+        if (init_helper->compile_pool)
+        {
+            init_helper->compile_pool->Run(compile);
+        }
+        else
+        {
+            compile();
+        }
+    }
+
+    uint64_t GetPersistentResourceSize() const final { return 0; }
+};
+
+TEST(DmlCompilePoolTests, ConcurrentTasksRunConcurrently)
+{
+    tfdml::DmlCompilePool pool(2);
+
+    // Each task waits for the other one to start, which only happens if the
+    // pool runs them at the same time
+    std::mutex mutex;
+    std::condition_variable cv;
+    int started_count = 0;
+    std::atomic<int> overlapped_count = {0};
+
+    std::function<void()> task = [&]()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ++started_count;
+        cv.notify_all();
+        if (cv.wait_for(
+                lock,
+                std::chrono::seconds(10),
+                [&] { return started_count == 2; }))
+        {
+            overlapped_count.fetch_add(1);
+        }
+    };
+
+    std::thread other_thread([&]() { pool.Run(task); });
+    pool.Run(task);
+    other_thread.join();
+
+    EXPECT_EQ(overlapped_count.load(), 2);
+}
+
+// Measures the time to first step of a model whose nodes all miss the kernel
+// cache: a few hundred distinct kernels are created by a fixed number of
+// executor threads, with their compilations running inline or on compile pools
+// of growing sizes. The timings depend on the machine, so they're reported as
+// test properties instead of being checked.
+TEST_F(DmlKernelManagerTests, TimeToFirstStepByCompileThreadCount)
+{
+    constexpr int kKernelCount = 300;
+    constexpr int kExecutorThreadCount = 4;
+    constexpr std::chrono::microseconds kCompileTime(500);
+
+    std::vector<tfdml::DmlKernelKey> keys;
+    for (int i = 0; i < kKernelCount; ++i)
+    {
+        keys.push_back(CreateKey(i + 1));
+    }
+
+    // A compile thread count of 0 compiles on the executor threads
+    for (uint32_t compile_thread_count : {0u, 1u, 2u, 4u, 8u})
+    {
+        std::unique_ptr<tfdml::DmlCompilePool> compile_pool;
+        if (compile_thread_count > 0)
+        {
+            compile_pool =
+                std::make_unique<tfdml::DmlCompilePool>(compile_thread_count);
+        }
+
+        // Every configuration starts with a cold cache
+        tfdml::DmlKernelManager manager(fence_.Get(), &counters_);
+        FakeCompileHelper helper = {compile_pool.get(), kCompileTime};
+
+        std::atomic<int> next_node = {0};
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < kExecutorThreadCount; ++t)
+        {
+            threads.emplace_back(
+                [&]()
+                {
+                    for (int i = next_node.fetch_add(1); i < kKernelCount;
+                         i = next_node.fetch_add(1))
+                    {
+                        manager.CreateCachedKernel<FakeCompilingKernel>(
+                            nullptr,
+                            keys[i],
+                            &helper);
+                    }
+                });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::chrono::duration<double, std::micro> elapsed =
+            std::chrono::steady_clock::now() - start;
+        RecordProperty(
+            "time_to_first_step_us_" + std::to_string(compile_thread_count) +
+                "_compile_threads",
+            static_cast<int>(elapsed.count()));
+
+        EXPECT_EQ(
+            manager.GetKernelCreationCount(),
+            static_cast<uint64_t>(kKernelCount));
+        EXPECT_EQ(manager.GetCacheSize(), static_cast<size_t>(kKernelCount));
+    }
+}
+
+// A heap that doesn't own any memory: the resources placed in it by
+// FakeDevice own their memory instead.
+class FakeHeap : public WRL::Base<ID3D12Heap>
+{
+  public:
+    explicit FakeHeap(const D3D12_HEAP_DESC& desc) : desc_(desc) {}
+
+    D3D12_HEAP_DESC STDMETHODCALLTYPE GetDesc() final { return desc_; }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, const IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(LPCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    D3D12_HEAP_DESC desc_;
+};
+
+// A descriptor heap whose handles are plain numbers, which are never
+// dereferenced by the classes that allocate descriptors.
+class FakeDescriptorHeap : public WRL::Base<ID3D12DescriptorHeap>
+{
+  public:
+    FakeDescriptorHeap(
+        ID3D12Device* device,
+        const D3D12_DESCRIPTOR_HEAP_DESC& desc,
+        SIZE_T start)
+        : device_(device),
+          desc_(desc),
+          start_(start)
+    {
+    }
+
+    D3D12_DESCRIPTOR_HEAP_DESC STDMETHODCALLTYPE GetDesc() final
+    {
+        return desc_;
+    }
+
+    D3D12_CPU_DESCRIPTOR_HANDLE STDMETHODCALLTYPE
+    GetCPUDescriptorHandleForHeapStart() final
+    {
+        return D3D12_CPU_DESCRIPTOR_HANDLE{start_};
+    }
+
+    D3D12_GPU_DESCRIPTOR_HANDLE STDMETHODCALLTYPE
+    GetGPUDescriptorHandleForHeapStart() final
+    {
+        return D3D12_GPU_DESCRIPTOR_HANDLE{start_};
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return device_->QueryInterface(riid, device);
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, const IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(LPCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    Microsoft::WRL::ComPtr<ID3D12Device> device_;
+    D3D12_DESCRIPTOR_HEAP_DESC desc_;
+    SIZE_T start_;
+};
+
+// A command allocator whose command lists don't use any memory.
+class FakeCommandAllocator : public WRL::Base<ID3D12CommandAllocator>
+{
+  public:
+    HRESULT STDMETHODCALLTYPE Reset() final { return S_OK; }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, const IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(LPCWSTR name) final { return E_NOTIMPL; }
+};
+
+// A command list that records the names of the commands the classes under test
+// use, in order, instead of executing anything. Resource barriers are recorded
+// as one name per barrier. The commands are cleared when the list is reset.
+class FakeCommandList : public WRL::Base<ID3D12GraphicsCommandList>
+{
+  public:
+    explicit FakeCommandList(D3D12_COMMAND_LIST_TYPE type) : type_(type) {}
+
+    static FakeCommandList* FromCommandList(ID3D12CommandList* command_list)
+    {
+        return static_cast<FakeCommandList*>(
+            static_cast<ID3D12GraphicsCommandList*>(command_list));
+    }
+
+    const std::vector<std::string>& GetCommands() const { return commands_; }
+
+    void Record(std::string command)
+    {
+        commands_.push_back(std::move(command));
+    }
+
+    D3D12_COMMAND_LIST_TYPE STDMETHODCALLTYPE GetType() final { return type_; }
+
+    HRESULT STDMETHODCALLTYPE Close() final
+    {
+        commands_.push_back("Close");
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE Reset(
+        ID3D12CommandAllocator* allocator,
+        ID3D12PipelineState* initial_state) final
+    {
+        commands_.clear();
+        return S_OK;
+    }
+
+    void STDMETHODCALLTYPE ClearState(ID3D12PipelineState* pipeline_state) final
+    {
+    }
+
+    void STDMETHODCALLTYPE DrawInstanced(
+        UINT vertex_count_per_instance,
+        UINT instance_count,
+        UINT start_vertex_location,
+        UINT start_instance_location) final
+    {
+    }
+
+    void STDMETHODCALLTYPE DrawIndexedInstanced(
+        UINT index_count_per_instance,
+        UINT instance_count,
+        UINT start_index_location,
+        INT base_vertex_location,
+        UINT start_instance_location) final
+    {
+    }
+
+    void STDMETHODCALLTYPE Dispatch(
+        UINT thread_group_count_x,
+        UINT thread_group_count_y,
+        UINT thread_group_count_z) final
+    {
+        commands_.push_back("Dispatch");
+    }
+
+    void STDMETHODCALLTYPE CopyBufferRegion(
+        ID3D12Resource* dst_buffer,
+        UINT64 dst_offset,
+        ID3D12Resource* src_buffer,
+        UINT64 src_offset,
+        UINT64 num_bytes) final
+    {
+        commands_.push_back("Copy");
+    }
+
+    void STDMETHODCALLTYPE CopyTextureRegion(
+        const D3D12_TEXTURE_COPY_LOCATION* dst,
+        UINT dst_x,
+        UINT dst_y,
+        UINT dst_z,
+        const D3D12_TEXTURE_COPY_LOCATION* src,
+        const D3D12_BOX* src_box) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    CopyResource(ID3D12Resource* dst_resource, ID3D12Resource* src_resource)
+        final
+    {
+    }
+
+    void STDMETHODCALLTYPE CopyTiles(
+        ID3D12Resource* tiled_resource,
+        const D3D12_TILED_RESOURCE_COORDINATE* tile_region_start_coordinate,
+        const D3D12_TILE_REGION_SIZE* tile_region_size,
+        ID3D12Resource* buffer,
+        UINT64 buffer_start_offset_in_bytes,
+        D3D12_TILE_COPY_FLAGS flags) final
+    {
+    }
+
+    void STDMETHODCALLTYPE ResolveSubresource(
+        ID3D12Resource* dst_resource,
+        UINT dst_subresource,
+        ID3D12Resource* src_resource,
+        UINT src_subresource,
+        DXGI_FORMAT format) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitive_topology) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    RSSetViewports(UINT num_viewports, const D3D12_VIEWPORT* viewports) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    RSSetScissorRects(UINT num_rects, const D3D12_RECT* rects) final
+    {
+    }
+
+    void STDMETHODCALLTYPE OMSetBlendFactor(const FLOAT blend_factor[4]) final
+    {
+    }
+
+    void STDMETHODCALLTYPE OMSetStencilRef(UINT stencil_ref) final {}
+
+    void STDMETHODCALLTYPE
+    SetPipelineState(ID3D12PipelineState* pipeline_state) final
+    {
+    }
+
+    void STDMETHODCALLTYPE ResourceBarrier(
+        UINT num_barriers,
+        const D3D12_RESOURCE_BARRIER* barriers) final
+    {
+        for (UINT i = 0; i < num_barriers; ++i)
+        {
+            switch (barriers[i].Type)
+            {
+            case D3D12_RESOURCE_BARRIER_TYPE_TRANSITION:
+                commands_.push_back("TransitionBarrier");
+                break;
+            case D3D12_RESOURCE_BARRIER_TYPE_ALIASING:
+                commands_.push_back("AliasingBarrier");
+                break;
+            case D3D12_RESOURCE_BARRIER_TYPE_UAV:
+                commands_.push_back("UavBarrier");
+                break;
+            }
+        }
+    }
+
+    void STDMETHODCALLTYPE
+    ExecuteBundle(ID3D12GraphicsCommandList* command_list) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetDescriptorHeaps(
+        UINT num_descriptor_heaps,
+        ID3D12DescriptorHeap* const* descriptor_heaps) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    SetComputeRootSignature(ID3D12RootSignature* root_signature) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    SetGraphicsRootSignature(ID3D12RootSignature* root_signature) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetComputeRootDescriptorTable(
+        UINT root_parameter_index,
+        D3D12_GPU_DESCRIPTOR_HANDLE base_descriptor) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetGraphicsRootDescriptorTable(
+        UINT root_parameter_index,
+        D3D12_GPU_DESCRIPTOR_HANDLE base_descriptor) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetComputeRoot32BitConstant(
+        UINT root_parameter_index,
+        UINT src_data,
+        UINT dest_offset_in_32bit_values) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetGraphicsRoot32BitConstant(
+        UINT root_parameter_index,
+        UINT src_data,
+        UINT dest_offset_in_32bit_values) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetComputeRoot32BitConstants(
+        UINT root_parameter_index,
+        UINT num_32bit_values_to_set,
+        const void* src_data,
+        UINT dest_offset_in_32bit_values) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetGraphicsRoot32BitConstants(
+        UINT root_parameter_index,
+        UINT num_32bit_values_to_set,
+        const void* src_data,
+        UINT dest_offset_in_32bit_values) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetComputeRootConstantBufferView(
+        UINT root_parameter_index,
+        D3D12_GPU_VIRTUAL_ADDRESS buffer_location) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetGraphicsRootConstantBufferView(
+        UINT root_parameter_index,
+        D3D12_GPU_VIRTUAL_ADDRESS buffer_location) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetComputeRootShaderResourceView(
+        UINT root_parameter_index,
+        D3D12_GPU_VIRTUAL_ADDRESS buffer_location) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetGraphicsRootShaderResourceView(
+        UINT root_parameter_index,
+        D3D12_GPU_VIRTUAL_ADDRESS buffer_location) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetComputeRootUnorderedAccessView(
+        UINT root_parameter_index,
+        D3D12_GPU_VIRTUAL_ADDRESS buffer_location) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetGraphicsRootUnorderedAccessView(
+        UINT root_parameter_index,
+        D3D12_GPU_VIRTUAL_ADDRESS buffer_location) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) final
+    {
+    }
+
+    void STDMETHODCALLTYPE IASetVertexBuffers(
+        UINT start_slot,
+        UINT num_views,
+        const D3D12_VERTEX_BUFFER_VIEW* views) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SOSetTargets(
+        UINT start_slot,
+        UINT num_views,
+        const D3D12_STREAM_OUTPUT_BUFFER_VIEW* views) final
+    {
+    }
+
+    void STDMETHODCALLTYPE OMSetRenderTargets(
+        UINT num_render_target_descriptors,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* render_target_descriptors,
+        BOOL rts_single_handle_to_descriptor_range,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* depth_stencil_descriptor) final
+    {
+    }
+
+    void STDMETHODCALLTYPE ClearDepthStencilView(
+        D3D12_CPU_DESCRIPTOR_HANDLE depth_stencil_view,
+        D3D12_CLEAR_FLAGS clear_flags,
+        FLOAT depth,
+        UINT8 stencil,
+        UINT num_rects,
+        const D3D12_RECT* rects) final
+    {
+    }
+
+    void STDMETHODCALLTYPE ClearRenderTargetView(
+        D3D12_CPU_DESCRIPTOR_HANDLE render_target_view,
+        const FLOAT color_rgba[4],
+        UINT num_rects,
+        const D3D12_RECT* rects) final
+    {
+    }
+
+    void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(
+        D3D12_GPU_DESCRIPTOR_HANDLE view_gpu_handle_in_current_heap,
+        D3D12_CPU_DESCRIPTOR_HANDLE view_cpu_handle,
+        ID3D12Resource* resource,
+        const UINT values[4],
+        UINT num_rects,
+        const D3D12_RECT* rects) final
+    {
+        commands_.push_back("ClearUav");
+    }
+
+    void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(
+        D3D12_GPU_DESCRIPTOR_HANDLE view_gpu_handle_in_current_heap,
+        D3D12_CPU_DESCRIPTOR_HANDLE view_cpu_handle,
+        ID3D12Resource* resource,
+        const FLOAT values[4],
+        UINT num_rects,
+        const D3D12_RECT* rects) final
+    {
+        commands_.push_back("ClearUav");
+    }
+
+    void STDMETHODCALLTYPE DiscardResource(
+        ID3D12Resource* resource,
+        const D3D12_DISCARD_REGION* region) final
+    {
+    }
+
+    void STDMETHODCALLTYPE BeginQuery(
+        ID3D12QueryHeap* query_heap,
+        D3D12_QUERY_TYPE type,
+        UINT index) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    EndQuery(ID3D12QueryHeap* query_heap, D3D12_QUERY_TYPE type, UINT index)
+        final
+    {
+    }
+
+    void STDMETHODCALLTYPE ResolveQueryData(
+        ID3D12QueryHeap* query_heap,
+        D3D12_QUERY_TYPE type,
+        UINT start_index,
+        UINT num_queries,
+        ID3D12Resource* destination_buffer,
+        UINT64 aligned_destination_buffer_offset) final
+    {
+    }
+
+    void STDMETHODCALLTYPE SetPredication(
+        ID3D12Resource* buffer,
+        UINT64 aligned_buffer_offset,
+        D3D12_PREDICATION_OP operation) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    SetMarker(UINT metadata, const void* data, UINT size) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    BeginEvent(UINT metadata, const void* data, UINT size) final
+    {
+    }
+
+    void STDMETHODCALLTYPE EndEvent() final {}
+
+    void STDMETHODCALLTYPE ExecuteIndirect(
+        ID3D12CommandSignature* command_signature,
+        UINT max_command_count,
+        ID3D12Resource* argument_buffer,
+        UINT64 argument_buffer_offset,
+        ID3D12Resource* count_buffer,
+        UINT64 count_buffer_offset) final
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, const IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(LPCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    D3D12_COMMAND_LIST_TYPE type_;
+    std::vector<std::string> commands_;
+};
+
+// A queue whose GPU only makes progress when the test tells it to: the fence
+// values signaled after each submission complete once the test calls
+// CompleteSubmittedWork. The queue keeps the commands of each submission, and
+// the fence values that submissions were made to wait for. Submissions may come
+// from another thread (e.g. an execution context's), so the queue is thread
+// safe.
+class FakeCommandQueue : public WRL::Base<ID3D12CommandQueue>
+{
+  public:
+    struct FenceWait
+    {
+        ID3D12Fence* fence;
+        UINT64 value;
+
+        // The number of submissions made before the wait
+        size_t submission_index;
+    };
+
+    FakeCommandQueue(ID3D12Device* device, D3D12_COMMAND_LIST_TYPE type)
+        : device_(device),
+          type_(type)
+    {
+    }
+
+    // Signals the fence values of the work submitted so far.
+    void CompleteSubmittedWork()
+    {
+        std::vector<std::pair<Microsoft::WRL::ComPtr<ID3D12Fence>, UINT64>>
+            signals;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            signals.swap(pending_signals_);
+        }
+
+        for (auto& signal : signals)
+        {
+            signal.first->Signal(signal.second);
+        }
+    }
+
+    // Waits until `count` submissions have been made in total, and returns
+    // false if that takes unreasonably long.
+    bool WaitForSubmissions(size_t count)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return submitted_.wait_for(
+            lock,
+            std::chrono::seconds(10),
+            [&] { return submissions_.size() >= count; });
+    }
+
+    // Waits until the fence has been signaled after `count` submissions in
+    // total, and returns false if that takes unreasonably long.
+    bool WaitForSignals(size_t count)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return submitted_.wait_for(
+            lock,
+            std::chrono::seconds(10),
+            [&] { return signal_count_ >= count; });
+    }
+
+    size_t GetSubmissionCount()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return submissions_.size();
+    }
+
+    // Returns the commands of the command lists of a submission.
+    std::vector<std::string> GetSubmission(size_t index)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return submissions_.at(index);
+    }
+
+    std::vector<FenceWait> GetWaits()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return waits_;
+    }
+
+    void STDMETHODCALLTYPE UpdateTileMappings(
+        ID3D12Resource* resource,
+        UINT num_resource_regions,
+        const D3D12_TILED_RESOURCE_COORDINATE* region_start_coordinates,
+        const D3D12_TILE_REGION_SIZE* resource_region_sizes,
+        ID3D12Heap* heap,
+        UINT num_ranges,
+        const D3D12_TILE_RANGE_FLAGS* range_flags,
+        const UINT* heap_range_start_offsets,
+        const UINT* range_tile_counts,
+        D3D12_TILE_MAPPING_FLAGS flags) final
+    {
+    }
+
+    void STDMETHODCALLTYPE CopyTileMappings(
+        ID3D12Resource* dst_resource,
+        const D3D12_TILED_RESOURCE_COORDINATE* dst_region_start_coordinate,
+        ID3D12Resource* src_resource,
+        const D3D12_TILED_RESOURCE_COORDINATE* src_region_start_coordinate,
+        const D3D12_TILE_REGION_SIZE* region_size,
+        D3D12_TILE_MAPPING_FLAGS flags) final
+    {
+    }
+
+    void STDMETHODCALLTYPE ExecuteCommandLists(
+        UINT num_command_lists,
+        ID3D12CommandList* const* command_lists) final
+    {
+        std::vector<std::string> commands;
+        for (UINT i = 0; i < num_command_lists; ++i)
+        {
+            const auto& list_commands =
+                FakeCommandList::FromCommandList(command_lists[i])
+                    ->GetCommands();
+            commands.insert(
+                commands.end(),
+                list_commands.begin(),
+                list_commands.end());
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        submissions_.push_back(std::move(commands));
+        submitted_.notify_all();
+    }
+
+    void STDMETHODCALLTYPE
+    SetMarker(UINT metadata, const void* data, UINT size) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    BeginEvent(UINT metadata, const void* data, UINT size) final
+    {
+    }
+
+    void STDMETHODCALLTYPE EndEvent() final {}
+
+    HRESULT STDMETHODCALLTYPE Signal(ID3D12Fence* fence, UINT64 value) final
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_signals_.emplace_back(fence, value);
+        ++signal_count_;
+        submitted_.notify_all();
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE Wait(ID3D12Fence* fence, UINT64 value) final
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        waits_.push_back({fence, value, submissions_.size()});
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetTimestampFrequency(UINT64* frequency) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetClockCalibration(UINT64* gpu_timestamp, UINT64* cpu_timestamp) final
+    {
+        return E_NOTIMPL;
+    }
+
+    D3D12_COMMAND_QUEUE_DESC STDMETHODCALLTYPE GetDesc() final
+    {
+        D3D12_COMMAND_QUEUE_DESC desc = {};
+        desc.Type = type_;
+        return desc;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return device_->QueryInterface(riid, device);
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, const IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(LPCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    Microsoft::WRL::ComPtr<ID3D12Device> device_;
+    D3D12_COMMAND_LIST_TYPE type_;
+
+    std::mutex mutex_;
+    std::condition_variable submitted_;
+    std::vector<std::vector<std::string>> submissions_;
+    std::vector<std::pair<Microsoft::WRL::ComPtr<ID3D12Fence>, UINT64>>
+        pending_signals_;
+    size_t signal_count_ = 0;
+    std::vector<FenceWait> waits_;
+};
+
+// A device that creates fences, heaps and buffers backed by host memory, along
+// with fake queues and recording command lists, which stands in for the D3D12
+// device of the classes that create their own objects. It doesn't support any
+// optional features, so heap allocations are placed rather than tiled. The
+// device is thread safe, like a D3D12 device.
+class FakeDevice : public WRL::Base<ID3D12Device>
+{
+  public:
+    static constexpr UINT kDescriptorHandleIncrement = 32;
+
+    uint64_t GetHeapCount() const { return heap_count_.load(); }
+    uint64_t GetResourceCount() const { return resource_count_.load(); }
+    uint64_t GetDescriptorHeapCount() const
+    {
+        return descriptor_heap_count_.load();
+    }
+
+    UINT STDMETHODCALLTYPE GetNodeCount() final { return 1; }
+
+    HRESULT STDMETHODCALLTYPE CreateCommandQueue(
+        const D3D12_COMMAND_QUEUE_DESC* desc,
+        REFIID riid,
+        void** command_queue) final
+    {
+        return Microsoft::WRL::Make<FakeCommandQueue>(this, desc->Type)
+            ->QueryInterface(riid, command_queue);
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateCommandAllocator(
+        D3D12_COMMAND_LIST_TYPE type,
+        REFIID riid,
+        void** command_allocator) final
+    {
+        return Microsoft::WRL::Make<FakeCommandAllocator>()->QueryInterface(
+            riid,
+            command_allocator);
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateGraphicsPipelineState(
+        const D3D12_GRAPHICS_PIPELINE_STATE_DESC* desc,
+        REFIID riid,
+        void** pipeline_state) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateComputePipelineState(
+        const D3D12_COMPUTE_PIPELINE_STATE_DESC* desc,
+        REFIID riid,
+        void** pipeline_state) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateCommandList(
+        UINT node_mask,
+        D3D12_COMMAND_LIST_TYPE type,
+        ID3D12CommandAllocator* command_allocator,
+        ID3D12PipelineState* initial_state,
+        REFIID riid,
+        void** command_list) final
+    {
+        return Microsoft::WRL::Make<FakeCommandList>(type)->QueryInterface(
+            riid,
+            command_list);
+    }
+
+    HRESULT STDMETHODCALLTYPE CheckFeatureSupport(
+        D3D12_FEATURE feature,
+        void* feature_support_data,
+        UINT feature_support_data_size) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateDescriptorHeap(
+        const D3D12_DESCRIPTOR_HEAP_DESC* desc,
+        REFIID riid,
+        void** heap) final
+    {
+        // Give every heap a distinct range of handles
+        SIZE_T start = next_descriptor_handle_.fetch_add(
+            static_cast<SIZE_T>(desc->NumDescriptors) *
+            kDescriptorHandleIncrement);
+        descriptor_heap_count_.fetch_add(1);
+        return Microsoft::WRL::Make<FakeDescriptorHeap>(this, *desc, start)
+            ->QueryInterface(riid, heap);
+    }
+
+    UINT STDMETHODCALLTYPE
+    GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE type) final
+    {
+        return kDescriptorHandleIncrement;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateRootSignature(
+        UINT node_mask,
+        const void* blob_with_root_signature,
+        SIZE_T blob_length_in_bytes,
+        REFIID riid,
+        void** root_signature) final
+    {
+        return E_NOTIMPL;
+    }
+
+    void STDMETHODCALLTYPE CreateConstantBufferView(
+        const D3D12_CONSTANT_BUFFER_VIEW_DESC* desc,
+        D3D12_CPU_DESCRIPTOR_HANDLE dest_descriptor) final
+    {
+    }
+
+    void STDMETHODCALLTYPE CreateShaderResourceView(
+        ID3D12Resource* resource,
+        const D3D12_SHADER_RESOURCE_VIEW_DESC* desc,
+        D3D12_CPU_DESCRIPTOR_HANDLE dest_descriptor) final
+    {
+    }
+
+    void STDMETHODCALLTYPE CreateUnorderedAccessView(
+        ID3D12Resource* resource,
+        ID3D12Resource* counter_resource,
+        const D3D12_UNORDERED_ACCESS_VIEW_DESC* desc,
+        D3D12_CPU_DESCRIPTOR_HANDLE dest_descriptor) final
+    {
+    }
+
+    void STDMETHODCALLTYPE CreateRenderTargetView(
+        ID3D12Resource* resource,
+        const D3D12_RENDER_TARGET_VIEW_DESC* desc,
+        D3D12_CPU_DESCRIPTOR_HANDLE dest_descriptor) final
+    {
+    }
+
+    void STDMETHODCALLTYPE CreateDepthStencilView(
+        ID3D12Resource* resource,
+        const D3D12_DEPTH_STENCIL_VIEW_DESC* desc,
+        D3D12_CPU_DESCRIPTOR_HANDLE dest_descriptor) final
+    {
+    }
+
+    void STDMETHODCALLTYPE CreateSampler(
+        const D3D12_SAMPLER_DESC* desc,
+        D3D12_CPU_DESCRIPTOR_HANDLE dest_descriptor) final
+    {
+    }
+
+    void STDMETHODCALLTYPE CopyDescriptors(
+        UINT num_dest_descriptor_ranges,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* dest_descriptor_range_starts,
+        const UINT* dest_descriptor_range_sizes,
+        UINT num_src_descriptor_ranges,
+        const D3D12_CPU_DESCRIPTOR_HANDLE* src_descriptor_range_starts,
+        const UINT* src_descriptor_range_sizes,
+        D3D12_DESCRIPTOR_HEAP_TYPE descriptor_heaps_type) final
+    {
+    }
+
+    void STDMETHODCALLTYPE CopyDescriptorsSimple(
+        UINT num_descriptors,
+        D3D12_CPU_DESCRIPTOR_HANDLE dest_descriptor_range_start,
+        D3D12_CPU_DESCRIPTOR_HANDLE src_descriptor_range_start,
+        D3D12_DESCRIPTOR_HEAP_TYPE descriptor_heaps_type) final
+    {
+    }
+
+    D3D12_RESOURCE_ALLOCATION_INFO STDMETHODCALLTYPE GetResourceAllocationInfo(
+        UINT visible_mask,
+        UINT num_resource_descs,
+        const D3D12_RESOURCE_DESC* resource_descs) final
+    {
+        return {};
+    }
+
+    D3D12_HEAP_PROPERTIES STDMETHODCALLTYPE
+    GetCustomHeapProperties(UINT node_mask, D3D12_HEAP_TYPE heap_type) final
+    {
+        return {};
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateCommittedResource(
+        const D3D12_HEAP_PROPERTIES* heap_properties,
+        D3D12_HEAP_FLAGS heap_flags,
+        const D3D12_RESOURCE_DESC* desc,
+        D3D12_RESOURCE_STATES initial_resource_state,
+        const D3D12_CLEAR_VALUE* optimized_clear_value,
+        REFIID riid,
+        void** resource) final
+    {
+        return CreateBuffer(*desc, riid, resource);
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    CreateHeap(const D3D12_HEAP_DESC* desc, REFIID riid, void** heap) final
+    {
+        heap_count_.fetch_add(1);
+        return Microsoft::WRL::Make<FakeHeap>(*desc)->QueryInterface(
+            riid,
+            heap);
+    }
+
+    HRESULT STDMETHODCALLTYPE CreatePlacedResource(
+        ID3D12Heap* heap,
+        UINT64 heap_offset,
+        const D3D12_RESOURCE_DESC* desc,
+        D3D12_RESOURCE_STATES initial_state,
+        const D3D12_CLEAR_VALUE* optimized_clear_value,
+        REFIID riid,
+        void** resource) final
+    {
+        return CreateBuffer(*desc, riid, resource);
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateReservedResource(
+        const D3D12_RESOURCE_DESC* desc,
+        D3D12_RESOURCE_STATES initial_state,
+        const D3D12_CLEAR_VALUE* optimized_clear_value,
+        REFIID riid,
+        void** resource) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateSharedHandle(
+        ID3D12DeviceChild* object,
+        const SECURITY_ATTRIBUTES* attributes,
+        DWORD access,
+        LPCWSTR name,
+        HANDLE* handle) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    OpenSharedHandle(HANDLE nt_handle, REFIID riid, void** obj) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    OpenSharedHandleByName(LPCWSTR name, DWORD access, HANDLE* nt_handle) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    MakeResident(UINT num_objects, ID3D12Pageable* const* objects) final
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    Evict(UINT num_objects, ID3D12Pageable* const* objects) final
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateFence(
+        UINT64 initial_value,
+        D3D12_FENCE_FLAGS flags,
+        REFIID riid,
+        void** fence) final
+    {
+        auto fake_fence = Microsoft::WRL::Make<FakeFence>();
+        fake_fence->Signal(initial_value);
+        return fake_fence->QueryInterface(riid, fence);
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() final { return S_OK; }
+
+    void STDMETHODCALLTYPE GetCopyableFootprints(
+        const D3D12_RESOURCE_DESC* resource_desc,
+        UINT first_subresource,
+        UINT num_subresources,
+        UINT64 base_offset,
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT* layouts,
+        UINT* num_rows,
+        UINT64* row_size_in_bytes,
+        UINT64* total_bytes) final
+    {
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateQueryHeap(
+        const D3D12_QUERY_HEAP_DESC* desc,
+        REFIID riid,
+        void** heap) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetStablePowerState(BOOL enable) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateCommandSignature(
+        const D3D12_COMMAND_SIGNATURE_DESC* desc,
+        ID3D12RootSignature* root_signature,
+        REFIID riid,
+        void** command_signature) final
+    {
+        return E_NOTIMPL;
+    }
+
+    void STDMETHODCALLTYPE GetResourceTiling(
+        ID3D12Resource* tiled_resource,
+        UINT* num_tiles_for_entire_resource,
+        D3D12_PACKED_MIP_INFO* packed_mip_desc,
+        D3D12_TILE_SHAPE* standard_tile_shape_for_non_packed_mips,
+        UINT* num_subresource_tilings,
+        UINT first_subresource_tiling_to_get,
+        D3D12_SUBRESOURCE_TILING* subresource_tilings_for_non_packed_mips) final
+    {
+    }
+
+    LUID STDMETHODCALLTYPE GetAdapterLuid() final { return {}; }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, const IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(LPCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    std::atomic<uint64_t> heap_count_ = {0};
+    std::atomic<uint64_t> resource_count_ = {0};
+    std::atomic<uint64_t> descriptor_heap_count_ = {0};
+    std::atomic<SIZE_T> next_descriptor_handle_ = {kDescriptorHandleIncrement};
+
+    HRESULT CreateBuffer(
+        const D3D12_RESOURCE_DESC& desc,
+        REFIID riid,
+        void** resource)
+    {
+        resource_count_.fetch_add(1);
+        return Microsoft::WRL::Make<FakeBuffer>(desc.Width)->QueryInterface(
+            riid,
+            resource);
+    }
+};
+
+// Measures the throughput of the heap allocator as the number of threads
+// allocating, looking up and freeing buffers grows. Each allocation is looked
+// up several times, as kernels look up every buffer they bind. Lookups don't
+// take the allocator lock, and freed allocations are reused from the pool, so
+// this mostly measures contention on the lock. The rates depend on the
+// machine, so they're reported as test properties instead of being checked.
+TEST(D3D12HeapAllocatorBenchmarks, OperationsPerSecondByThreadCount)
+{
+    constexpr uint64_t kAllocationSize = 64 * 1024;
+    constexpr int kAllocationsPerThread = 20000;
+    constexpr int kLookupsPerAllocation = 8;
+
+    auto device = Microsoft::WRL::Make<FakeDevice>();
+    tfdml::D3D12HeapAllocator allocator(
+        device.Get(),
+        nullptr,
+        CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    ASSERT_FALSE(allocator.TilingEnabled());
+
+    for (int thread_count : {1, 2, 4, 8})
+    {
+        std::atomic<uint64_t> failure_count = {0};
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back(
+                [&]()
+                {
+                    for (int i = 0; i < kAllocationsPerThread; ++i)
+                    {
+                        void* ptr = allocator.Alloc(0, kAllocationSize);
+                        if (!ptr)
+                        {
+                            failure_count.fetch_add(1);
+                            continue;
+                        }
+
+                        for (int j = 0; j < kLookupsPerAllocation; ++j)
+                        {
+                            tfdml::D3D12BufferRegion region =
+                                allocator.CreateBufferRegion(
+                                    ptr,
+                                    kAllocationSize);
+                            if (region.SizeInBytes() != kAllocationSize)
+                            {
+                                failure_count.fetch_add(1);
+                            }
+                        }
+
+                        allocator.Free(ptr, kAllocationSize);
+                    }
+                });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        double operations_per_second = thread_count * kAllocationsPerThread *
+                                       (kLookupsPerAllocation + 2) /
+                                       elapsed.count();
+        RecordProperty(
+            "operations_per_second_" + std::to_string(thread_count) +
+                "_threads",
+            static_cast<int>(operations_per_second));
+
+        EXPECT_EQ(failure_count.load(), 0u);
+    }
+
+    // Every allocation has the same size, so only the allocations made while
+    // every pooled allocation was in use create a heap.
+    EXPECT_GT(allocator.GetPoolHitCount(), 0u);
+    EXPECT_EQ(device->GetHeapCount(), allocator.GetPoolMissCount());
+}
+
+class DmlTemporaryHeapTests : public ::testing::Test
+{
+  protected:
+    // The size of the heap's first chunk
+    static constexpr uint64_t kChunkSize = 1024 * 1024;
+
+    // Reserves a buffer for work that completes at the given fence value, and
+    // returns the buffer's binding.
+    DML_BUFFER_BINDING Execute(uint64_t size_in_bytes, uint64_t fence_value)
+    {
+        DML_BUFFER_BINDING binding = {};
+        auto done_event = heap_.ExecuteWithTemporaryBuffer(
+            size_in_bytes,
+            [&](const DML_BUFFER_BINDING& temp_binding)
+            {
+                binding = temp_binding;
+                return tfdml::DmlGpuEvent{fence_value, fence_};
+            });
+
+        EXPECT_TRUE(done_event.ok());
+        EXPECT_EQ(binding.SizeInBytes, size_in_bytes);
+        return binding;
+    }
+
+    Microsoft::WRL::ComPtr<FakeDevice> device_ =
+        Microsoft::WRL::Make<FakeDevice>();
+    Microsoft::WRL::ComPtr<FakeFence> fence_ =
+        Microsoft::WRL::Make<FakeFence>();
+    tfdml::DmlTemporaryHeap heap_{device_.Get()};
+};
+
+TEST_F(DmlTemporaryHeapTests, ReusesBuffersOnceTheirWorkCompletes)
+{
+    DML_BUFFER_BINDING first = Execute(kChunkSize, 1);
+    EXPECT_EQ(first.Offset, 0u);
+    EXPECT_EQ(heap_.Capacity(), kChunkSize);
+
+    // The GPU is still using the first buffer, so the heap has to grow
+    DML_BUFFER_BINDING second = Execute(kChunkSize, 2);
+    EXPECT_NE(second.Buffer, first.Buffer);
+    EXPECT_EQ(heap_.Capacity(), 2 * kChunkSize);
+
+    // Once the work completes, the buffers are reused instead
+    fence_->Signal(2);
+    DML_BUFFER_BINDING third = Execute(kChunkSize, 3);
+    EXPECT_EQ(third.Buffer, first.Buffer);
+    EXPECT_EQ(third.Offset, 0u);
+    EXPECT_EQ(heap_.Capacity(), 2 * kChunkSize);
+    EXPECT_EQ(device_->GetResourceCount(), 2u);
+}
+
+TEST_F(DmlTemporaryHeapTests, ReportsPeakUsage)
+{
+    Execute(1000, 1);
+    Execute(2000, 2);
+    Execute(3000, 3);
+    EXPECT_EQ(heap_.PeakUsage(), 6000u);
+
+    // Reclaimed buffers no longer count towards the usage, but the peak is
+    // retained
+    fence_->Signal(3);
+    Execute(500, 4);
+    EXPECT_EQ(heap_.PeakUsage(), 6000u);
+
+    fence_->Signal(4);
+    Execute(5000, 5);
+    Execute(4000, 6);
+    EXPECT_EQ(heap_.PeakUsage(), 9000u);
+}
+
+TEST_F(DmlTemporaryHeapTests, ExecutesWithoutHoldingTheLock)
+{
+    // Work may be queued by another thread while this one is queuing its own,
+    // which would deadlock if the heap's lock was held. The inner work is
+    // queued first, even though its buffer was reserved last.
+    DML_BUFFER_BINDING outer = {};
+    DML_BUFFER_BINDING inner = {};
+    auto done_event = heap_.ExecuteWithTemporaryBuffer(
+        1024,
+        [&](const DML_BUFFER_BINDING& binding)
+        {
+            outer = binding;
+            inner = Execute(1024, 1);
+            return tfdml::DmlGpuEvent{2, fence_};
+        });
+    ASSERT_TRUE(done_event.ok());
+    EXPECT_EQ(outer.Buffer, inner.Buffer);
+    EXPECT_NE(outer.Offset, inner.Offset);
+
+    // The inner buffer follows the outer one in the ring, so it's only
+    // reclaimed along with the outer buffer
+    fence_->Signal(1);
+    EXPECT_NE(Execute(1024, 3).Offset, 0u);
+
+    fence_->Signal(3);
+    EXPECT_EQ(Execute(1024, 4).Offset, 0u);
+}
+
+// Compares the CPU cost of allocating and releasing the descriptors of a
+// dispatch from the descriptor ring, against allocating them from
+// DmlDescriptorAllocator and releasing them along with the last reference to
+// the allocation, as kernels used to do. The GPU is emulated by signaling the
+// fence every few dispatches. The timings depend on the machine, so they're
+// reported as test properties instead of being checked.
+TEST(DmlDescriptorRingBenchmarks, DispatchCostByAllocator)
+{
+    constexpr int kDispatchCount = 100000;
+    constexpr int kDispatchesPerFenceSignal = 64;
+    constexpr uint32_t kDescriptorsPerDispatch = 8;
+
+    auto device = Microsoft::WRL::Make<FakeDevice>();
+    auto fence = Microsoft::WRL::Make<FakeFence>();
+
+    tfdml::D3D12DescriptorHeapAllocator heap_allocator(
+        device.Get(),
+        D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+        D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
+        0);
+    tfdml::DmlDescriptorAllocator descriptor_allocator(
+        &heap_allocator,
+        "benchmark");
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kDispatchCount; ++i)
+    {
+        auto allocation = std::make_shared<tfdml::DescriptorAllocation>(
+            descriptor_allocator.Alloc(kDescriptorsPerDispatch));
+        ASSERT_TRUE(*allocation);
+        ASSERT_NE(allocation->GetDescriptorHandles().heap, nullptr);
+    }
+    std::chrono::duration<double, std::nano> allocator_elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    tfdml::DmlDescriptorRing ring(device.Get(), fence.Get());
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kDispatchCount; ++i)
+    {
+        uint64_t fence_value = i / kDispatchesPerFenceSignal + 1;
+        if (i % kDispatchesPerFenceSignal == 0)
+        {
+            fence->Signal(fence_value - 1);
+        }
+
+        auto allocation = ring.TryAllocate(kDescriptorsPerDispatch);
+        ASSERT_TRUE(allocation);
+        ASSERT_NE(allocation->handles.heap, nullptr);
+        ring.Release(*allocation, tfdml::DmlGpuEvent{fence_value, fence});
+    }
+    std::chrono::duration<double, std::nano> ring_elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    RecordProperty(
+        "ns_per_dispatch_descriptor_allocator",
+        static_cast<int>(allocator_elapsed.count() / kDispatchCount));
+    RecordProperty(
+        "ns_per_dispatch_descriptor_ring",
+        static_cast<int>(ring_elapsed.count() / kDispatchCount));
+}
+
+// A binding table that only counts how many times a persistent resource was
+// bound to it.
+class FakeBindingTable : public WRL::Base<IDMLBindingTable>
+{
+  public:
+    explicit FakeBindingTable(std::atomic<uint64_t>* persistent_binding_count)
+        : persistent_binding_count_(persistent_binding_count)
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    BindInputs(UINT binding_count, const DML_BINDING_DESC* bindings) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    BindOutputs(UINT binding_count, const DML_BINDING_DESC* bindings) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    BindTemporaryResource(const DML_BINDING_DESC* binding) final
+    {
+    }
+
+    void STDMETHODCALLTYPE
+    BindPersistentResource(const DML_BINDING_DESC* binding) final
+    {
+        persistent_binding_count_->fetch_add(1);
+    }
+
+    HRESULT STDMETHODCALLTYPE Reset(const DML_BINDING_TABLE_DESC* desc) final
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(PCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    std::atomic<uint64_t>* persistent_binding_count_;
+};
+
+// A compiled operator that can't be executed, which only reports the
+// descriptors it requires.
+class FakeCompiledOperator : public WRL::Base<IDMLCompiledOperator>
+{
+  public:
+    explicit FakeCompiledOperator(uint32_t descriptor_count)
+        : descriptor_count_(descriptor_count)
+    {
+    }
+
+    DML_BINDING_PROPERTIES STDMETHODCALLTYPE GetBindingProperties() final
+    {
+        DML_BINDING_PROPERTIES props = {};
+        props.RequiredDescriptorCount = descriptor_count_;
+        return props;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(PCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    uint32_t descriptor_count_;
+};
+
+// A command recorder that records each dispatch into a FakeCommandList.
+class FakeCommandRecorder : public WRL::Base<IDMLCommandRecorder>
+{
+  public:
+    void STDMETHODCALLTYPE RecordDispatch(
+        ID3D12CommandList* command_list,
+        IDMLDispatchable* dispatchable,
+        IDMLBindingTable* bindings) final
+    {
+        FakeCommandList::FromCommandList(command_list)->Record("Dispatch");
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** device) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(PCWSTR name) final { return E_NOTIMPL; }
+};
+
+// A DirectML device that only creates command recorders and binding tables,
+// and counts the binding tables. Its parent is the given D3D12 device.
+class FakeDmlDevice : public WRL::Base<IDMLDevice>
+{
+  public:
+    explicit FakeDmlDevice(ID3D12Device* d3d12_device)
+        : d3d12_device_(d3d12_device)
+    {
+    }
+
+    uint64_t GetBindingTableCount() const
+    {
+        return binding_table_count_.load();
+    }
+
+    uint64_t GetPersistentBindingCount() const
+    {
+        return persistent_binding_count_.load();
+    }
+
+    HRESULT STDMETHODCALLTYPE CheckFeatureSupport(
+        DML_FEATURE feature,
+        UINT feature_query_data_size,
+        const void* feature_query_data,
+        UINT feature_support_data_size,
+        void* feature_support_data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateOperator(
+        const DML_OPERATOR_DESC* desc,
+        REFIID riid,
+        void** op) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE CompileOperator(
+        IDMLOperator* op,
+        DML_EXECUTION_FLAGS flags,
+        REFIID riid,
+        void** compiled_op) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateOperatorInitializer(
+        UINT operator_count,
+        IDMLCompiledOperator* const* operators,
+        REFIID riid,
+        void** initializer) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    CreateCommandRecorder(REFIID riid, void** command_recorder) final
+    {
+        return Microsoft::WRL::Make<FakeCommandRecorder>()->QueryInterface(
+            riid,
+            command_recorder);
+    }
+
+    HRESULT STDMETHODCALLTYPE CreateBindingTable(
+        const DML_BINDING_TABLE_DESC* desc,
+        REFIID riid,
+        void** binding_table) final
+    {
+        binding_table_count_.fetch_add(1);
+        return Microsoft::WRL::Make<FakeBindingTable>(
+                   &persistent_binding_count_)
+            ->QueryInterface(riid, binding_table);
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    Evict(UINT count, IDMLPageable* const* objects) final
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    MakeResident(UINT count, IDMLPageable* const* objects) final
+    {
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() final { return S_OK; }
+
+    HRESULT STDMETHODCALLTYPE GetParentDevice(REFIID riid, void** device) final
+    {
+        return d3d12_device_->QueryInterface(riid, device);
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    GetPrivateData(REFGUID guid, UINT* data_size, void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateData(REFGUID guid, UINT data_size, const void* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE
+    SetPrivateDataInterface(REFGUID guid, IUnknown* data) final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT STDMETHODCALLTYPE SetName(PCWSTR name) final { return E_NOTIMPL; }
+
+  private:
+    Microsoft::WRL::ComPtr<ID3D12Device> d3d12_device_;
+    std::atomic<uint64_t> binding_table_count_ = {0};
+    std::atomic<uint64_t> persistent_binding_count_ = {0};
+};
+
+class DmlBindingTablePoolTests : public ::testing::Test
+{
+  protected:
+    static constexpr uint32_t kDescriptorCount = 8;
+
+    Microsoft::WRL::ComPtr<FakeDevice> device_ =
+        Microsoft::WRL::Make<FakeDevice>();
+    Microsoft::WRL::ComPtr<FakeDmlDevice> dml_device_ =
+        Microsoft::WRL::Make<FakeDmlDevice>(device_.Get());
+    Microsoft::WRL::ComPtr<FakeCompiledOperator> op_ =
+        Microsoft::WRL::Make<FakeCompiledOperator>(kDescriptorCount);
+    Microsoft::WRL::ComPtr<FakeFence> fence_ =
+        Microsoft::WRL::Make<FakeFence>();
+
+    tfdml::D3D12DescriptorHeapAllocator heap_allocator_{
+        device_.Get(),
+        D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV,
+        D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE,
+        0};
+    tfdml::DmlDescriptorAllocator descriptor_allocator_{
+        &heap_allocator_,
+        "test"};
+
+    // Binding table slots only allocate their descriptors from the context
+    tfdml::DMLDeviceContext device_context_{
+        nullptr,
+        nullptr,
+        nullptr,
+        nullptr,
+        nullptr,
+        nullptr,
+        &descriptor_allocator_,
+        nullptr};
+};
+
+TEST_F(DmlBindingTablePoolTests, ReusesBindingTablesOnceTheGpuIsDone)
+{
+    tfdml::DmlBindingTablePool pool(dml_device_.Get(), op_.Get(), nullptr);
+    pool.AddSlot(&device_context_);
+    EXPECT_EQ(dml_device_->GetBindingTableCount(), 1u);
+
+    // The slot created up front is used by the first execution
+    auto* first = pool.TryAcquire(&device_context_);
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(dml_device_->GetBindingTableCount(), 1u);
+    pool.Release(first, tfdml::DmlGpuEvent{1, fence_});
+
+    // The GPU is still using the first slot
+    auto* second = pool.TryAcquire(&device_context_);
+    ASSERT_NE(second, nullptr);
+    EXPECT_NE(second, first);
+    EXPECT_EQ(dml_device_->GetBindingTableCount(), 2u);
+    pool.Release(second, tfdml::DmlGpuEvent{2, fence_});
+
+    fence_->Signal(1);
+    EXPECT_EQ(pool.TryAcquire(&device_context_), first);
+    EXPECT_EQ(dml_device_->GetBindingTableCount(), 2u);
+}
+
+TEST_F(DmlBindingTablePoolTests, CreatesAtMostMaxSlotsBindingTables)
+{
+    tfdml::DmlBindingTablePool pool(dml_device_.Get(), op_.Get(), nullptr);
+
+    std::vector<tfdml::DmlBindingTablePool::Slot*> slots;
+    for (size_t i = 0; i < tfdml::DmlBindingTablePool::kMaxSlots; ++i)
+    {
+        slots.push_back(pool.TryAcquire(&device_context_));
+        ASSERT_NE(slots.back(), nullptr);
+    }
+
+    // Further executions fall back to their own binding tables
+    EXPECT_EQ(pool.TryAcquire(&device_context_), nullptr);
+    EXPECT_EQ(
+        dml_device_->GetBindingTableCount(),
+        tfdml::DmlBindingTablePool::kMaxSlots);
+    EXPECT_EQ(pool.GetSlotCount(), tfdml::DmlBindingTablePool::kMaxSlots);
+
+    pool.AddSlot(&device_context_);
+    EXPECT_EQ(pool.GetSlotCount(), tfdml::DmlBindingTablePool::kMaxSlots);
+    EXPECT_EQ(
+        dml_device_->GetBindingTableCount(),
+        tfdml::DmlBindingTablePool::kMaxSlots);
+
+    pool.Release(slots[2], tfdml::DmlGpuEvent{1, fence_});
+    EXPECT_EQ(pool.TryAcquire(&device_context_), nullptr);
+
+    fence_->Signal(1);
+    EXPECT_EQ(pool.TryAcquire(&device_context_), slots[2]);
+}
+
+TEST_F(DmlBindingTablePoolTests, BindsThePersistentResourceOncePerSlot)
+{
+    auto persistent_resource = Microsoft::WRL::Make<FakeBuffer>(256);
+    DML_BUFFER_BINDING persistent_binding = {
+        persistent_resource.Get(),
+        0,
+        256};
+    tfdml::DmlBindingTablePool pool(
+        dml_device_.Get(),
+        op_.Get(),
+        &persistent_binding);
+
+    for (uint64_t fence_value = 1; fence_value <= 100; ++fence_value)
+    {
+        auto* slot = pool.TryAcquire(&device_context_);
+        ASSERT_NE(slot, nullptr);
+        pool.Release(slot, tfdml::DmlGpuEvent{fence_value, fence_});
+
+        // Let the GPU fall behind by a couple of executions
+        if (fence_value > 2)
+        {
+            fence_->Signal(fence_value - 2);
+        }
+    }
+
+    EXPECT_EQ(pool.GetSlotCount(), 3u);
+    EXPECT_EQ(dml_device_->GetBindingTableCount(), 3u);
+    EXPECT_EQ(dml_device_->GetPersistentBindingCount(), 3u);
+}
+
+TEST_F(DmlBindingTablePoolTests, ReportsTheDescriptorsOfAFullPool)
+{
+    tfdml::DmlBindingTablePool pool(dml_device_.Get(), op_.Get(), nullptr);
+    pool.AddSlot(&device_context_);
+
+    // The size doesn't depend on how many slots have been created so far,
+    // since the kernel manager only weighs a kernel once
+    EXPECT_EQ(
+        pool.GetMaxDescriptorSizeInBytes(),
+        tfdml::DmlBindingTablePool::kMaxSlots * kDescriptorCount *
+            FakeDevice::kDescriptorHandleIncrement);
+}
+
+class DmlCommandListTests : public ::testing::Test
+{
+  protected:
+    using Commands = std::vector<std::string>;
+
+    // Returns an open command list that records into a FakeCommandList.
+    std::unique_ptr<tfdml::DmlCommandList> CreateCommandList(
+        D3D12_COMMAND_LIST_TYPE type = D3D12_COMMAND_LIST_TYPE_DIRECT)
+    {
+        D3D12_COMMAND_QUEUE_DESC queue_desc = {};
+        queue_desc.Type = type;
+        Microsoft::WRL::ComPtr<ID3D12CommandQueue> queue;
+        EXPECT_EQ(
+            device_->CreateCommandQueue(&queue_desc, IID_PPV_ARGS(&queue)),
+            S_OK);
+
+        auto command_list = std::make_unique<tfdml::DmlCommandList>(
+            device_.Get(),
+            dml_device_.Get(),
+            std::make_shared<tfdml::DmlCommandQueue>(queue.Get()));
+        command_list->Open();
+        return command_list;
+    }
+
+    static Commands GetCommands(tfdml::DmlCommandList& command_list)
+    {
+        return FakeCommandList::FromCommandList(command_list.Get())
+            ->GetCommands();
+    }
+
+    void Execute(
+        tfdml::DmlCommandList& command_list,
+        absl::Span<const tfdml::DmlBufferAccess> accesses)
+    {
+        command_list.ExecuteOperator(op_.Get(), nullptr, nullptr, accesses, 0);
+    }
+
+    static tfdml::DmlBufferAccess Read(
+        ID3D12Resource* resource,
+        uint64_t offset,
+        uint64_t size_in_bytes)
+    {
+        return {resource, offset, size_in_bytes, false};
+    }
+
+    static tfdml::DmlBufferAccess Write(
+        ID3D12Resource* resource,
+        uint64_t offset,
+        uint64_t size_in_bytes)
+    {
+        return {resource, offset, size_in_bytes, true};
+    }
+
+    Microsoft::WRL::ComPtr<FakeDevice> device_ =
+        Microsoft::WRL::Make<FakeDevice>();
+    Microsoft::WRL::ComPtr<FakeDmlDevice> dml_device_ =
+        Microsoft::WRL::Make<FakeDmlDevice>(device_.Get());
+    Microsoft::WRL::ComPtr<FakeCompiledOperator> op_ =
+        Microsoft::WRL::Make<FakeCompiledOperator>(0);
+    Microsoft::WRL::ComPtr<FakeBuffer> a_ = Microsoft::WRL::Make<FakeBuffer>(0);
+    Microsoft::WRL::ComPtr<FakeBuffer> b_ = Microsoft::WRL::Make<FakeBuffer>(0);
+    Microsoft::WRL::ComPtr<FakeBuffer> c_ = Microsoft::WRL::Make<FakeBuffer>(0);
+};
+
+TEST_F(DmlCommandListTests, BarriersReadAfterWrite)
+{
+    auto command_list = CreateCommandList();
+    Execute(*command_list, {Write(a_.Get(), 0, 256)});
+    Execute(*command_list, {Read(a_.Get(), 128, 256)});
+
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        (Commands{"Dispatch", "UavBarrier", "AliasingBarrier", "Dispatch"}));
+}
+
+TEST_F(DmlCommandListTests, BarriersWriteAfterWrite)
+{
+    auto command_list = CreateCommandList();
+    Execute(*command_list, {Write(a_.Get(), 0, 256)});
+    Execute(*command_list, {Write(a_.Get(), 255, 1)});
+
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        (Commands{"Dispatch", "UavBarrier", "AliasingBarrier", "Dispatch"}));
+}
+
+TEST_F(DmlCommandListTests, BarriersWriteAfterRead)
+{
+    auto command_list = CreateCommandList();
+    Execute(*command_list, {Read(a_.Get(), 0, 256)});
+    Execute(*command_list, {Write(a_.Get(), 128, 256)});
+
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        (Commands{"Dispatch", "UavBarrier", "AliasingBarrier", "Dispatch"}));
+}
+
+TEST_F(DmlCommandListTests, DoesntBarrierIndependentAccesses)
+{
+    auto command_list = CreateCommandList();
+
+    // Reads of the same range
+    Execute(*command_list, {Read(a_.Get(), 0, 256)});
+    Execute(*command_list, {Read(a_.Get(), 0, 256)});
+
+    // Adjacent ranges of the same buffer, and the same range of another one
+    Execute(*command_list, {Write(a_.Get(), 256, 256)});
+    Execute(*command_list, {Write(a_.Get(), 512, 256), Read(b_.Get(), 0, 256)});
+    Execute(*command_list, {Write(c_.Get(), 0, 256)});
+
+    EXPECT_EQ(GetCommands(*command_list), Commands(5, "Dispatch"));
+}
+
+TEST_F(DmlCommandListTests, CoalescesTheBarriersOfACommand)
+{
+    auto command_list = CreateCommandList();
+    Execute(*command_list, {Write(a_.Get(), 0, 256)});
+    Execute(*command_list, {Write(b_.Get(), 0, 256)});
+
+    // Both of the reads depend on earlier writes, which a single barrier
+    // covers. Only the last command depends on the one before it.
+    Execute(*command_list, {Read(a_.Get(), 0, 256), Read(b_.Get(), 0, 256)});
+    Execute(*command_list, {Read(b_.Get(), 0, 256), Write(c_.Get(), 0, 256)});
+    Execute(*command_list, {Read(c_.Get(), 0, 256)});
+
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        (Commands{
+            "Dispatch",
+            "Dispatch",
+            "UavBarrier",
+            "AliasingBarrier",
+            "Dispatch",
+            "Dispatch",
+            "UavBarrier",
+            "AliasingBarrier",
+            "Dispatch"}));
+}
+
+TEST_F(DmlCommandListTests, BarriersAccessesThroughAliasedResources)
+{
+    // The copy writes the memory of `a_` through `b_`, which is placed at the
+    // same offset of the same heap. The accesses identify the memory by the
+    // resource in the UAV state, so reading `a_` afterwards is a dependency.
+    auto command_list = CreateCommandList();
+    tfdml::DmlBufferAccess copy_accesses[] = {
+        Read(c_.Get(), 0, 256),
+        Write(a_.Get(), 0, 256)};
+    command_list->CopyBufferRegion(
+        b_.Get(),
+        0,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        c_.Get(),
+        0,
+        D3D12_RESOURCE_STATE_COPY_SOURCE,
+        256,
+        copy_accesses,
+        0);
+    Execute(*command_list, {Read(a_.Get(), 0, 256)});
+
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        (Commands{"Copy", "UavBarrier", "AliasingBarrier", "Dispatch"}));
+}
+
+TEST_F(DmlCommandListTests, BarriersFillsLikeOtherWrites)
+{
+    auto command_list = CreateCommandList();
+    uint8_t value[4] = {};
+    command_list->FillBufferWithPattern(a_.Get(), 0, 256, value);
+    Execute(*command_list, {Read(a_.Get(), 0, 256)});
+
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        (Commands{"ClearUav", "UavBarrier", "AliasingBarrier", "Dispatch"}));
+}
+
+TEST_F(DmlCommandListTests, BarriersOnceTooManyRangesAreTracked)
+{
+    // The ranges are disjoint, but once 256 of them are tracked the next
+    // command barriers anyway
+    constexpr int kTrackedRangeLimit = 256;
+
+    auto command_list = CreateCommandList();
+    for (int i = 0; i < kTrackedRangeLimit; ++i)
+    {
+        Execute(*command_list, {Read(a_.Get(), i * 16, 16)});
+    }
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        Commands(kTrackedRangeLimit, "Dispatch"));
+
+    Execute(*command_list, {Read(a_.Get(), kTrackedRangeLimit * 16, 16)});
+    Commands expected(kTrackedRangeLimit, "Dispatch");
+    expected.insert(
+        expected.end(),
+        {"UavBarrier", "AliasingBarrier", "Dispatch"});
+    EXPECT_EQ(GetCommands(*command_list), expected);
+
+    // The barrier reset the tracking
+    Execute(*command_list, {Read(a_.Get(), 0, 16)});
+    expected.push_back("Dispatch");
+    EXPECT_EQ(GetCommands(*command_list), expected);
+}
+
+TEST_F(DmlCommandListTests, BarriersPendingWritesOnClose)
+{
+    auto command_list = CreateCommandList();
+    Execute(*command_list, {Read(b_.Get(), 0, 256)});
+    Execute(*command_list, {Write(a_.Get(), 0, 256)});
+    ASSERT_TRUE(command_list->Close().ok());
+
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        (Commands{
+            "Dispatch",
+            "Dispatch",
+            "UavBarrier",
+            "AliasingBarrier",
+            "Close"}));
+
+    // Nothing is tracked across command lists, and reads alone don't need a
+    // barrier before closing
+    command_list->Open();
+    Execute(*command_list, {Read(a_.Get(), 0, 256)});
+    ASSERT_TRUE(command_list->Close().ok());
+
+    EXPECT_EQ(GetCommands(*command_list), (Commands{"Dispatch", "Close"}));
+}
+
+TEST_F(DmlCommandListTests, UavBarrierIncludesAliasingAfterWrites)
+{
+    auto command_list = CreateCommandList();
+    Execute(*command_list, {Read(a_.Get(), 0, 256)});
+    command_list->UavBarrier();
+    Execute(*command_list, {Write(a_.Get(), 0, 256)});
+    command_list->UavBarrier();
+
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        (Commands{
+            "Dispatch",
+            "UavBarrier",
+            "Dispatch",
+            "UavBarrier",
+            "AliasingBarrier"}));
+}
+
+TEST_F(DmlCommandListTests, BarriersDependentCopies)
+{
+    // Copies on a copy queue may run concurrently too
+    auto command_list = CreateCommandList(D3D12_COMMAND_LIST_TYPE_COPY);
+    tfdml::DmlBufferAccess first_accesses[] = {
+        Read(b_.Get(), 0, 256),
+        Write(a_.Get(), 0, 256)};
+    tfdml::DmlBufferAccess second_accesses[] = {
+        Read(a_.Get(), 0, 256),
+        Write(c_.Get(), 0, 256)};
+    command_list->CopyBufferRegion(
+        a_.Get(),
+        0,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        b_.Get(),
+        0,
+        D3D12_RESOURCE_STATE_COPY_SOURCE,
+        256,
+        first_accesses,
+        0);
+    command_list->CopyBufferRegion(
+        c_.Get(),
+        0,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        a_.Get(),
+        0,
+        D3D12_RESOURCE_STATE_COPY_SOURCE,
+        256,
+        second_accesses,
+        0);
+
+    EXPECT_EQ(
+        GetCommands(*command_list),
+        (Commands{"Copy", "UavBarrier", "AliasingBarrier", "Copy"}));
+}
+
+// Sets an environment variable of the test process, or removes it if the value
+// is null.
+static void SetEnvVar(const char* name, const char* value)
+{
+#if _WIN32
+    _putenv_s(name, value ? value : "");
+#else
+    if (value)
+    {
+        setenv(name, value, 1);
+    }
+    else
+    {
+        unsetenv(name);
+    }
+#endif
+}
+
+class DmlExecutionContextTests : public ::testing::Test
+{
+  protected:
+    DmlExecutionContextTests()
+    {
+        compute_context_ = CreateExecutionContext(compute_queue_.Get());
+        copy_context_ = CreateExecutionContext(copy_queue_.Get());
+        compute_context_->SetPeer(copy_context_.get());
+        copy_context_->SetPeer(compute_context_.get());
+    }
+
+    // Returns a context whose batches are only flushed on request, so that the
+    // tests decide what goes into each submission.
+    std::unique_ptr<tfdml::DmlExecutionContext> CreateExecutionContext(
+        FakeCommandQueue* queue)
+    {
+        SetEnvVar("TF_DIRECTML_BATCH_FLUSH_SIZE", "1000000");
+        SetEnvVar("TF_DIRECTML_BATCH_FLUSH_TIME", "60000000");
+        auto context = std::make_unique<tfdml::DmlExecutionContext>(
+            device_.Get(),
+            dml_device_.Get(),
+            queue,
+            counters_);
+        SetEnvVar("TF_DIRECTML_BATCH_FLUSH_SIZE", nullptr);
+        SetEnvVar("TF_DIRECTML_BATCH_FLUSH_TIME", nullptr);
+        return context;
+    }
+
+    static tfdml::DmlGpuEvent Copy(
+        tfdml::DmlExecutionContext& context,
+        ID3D12Resource* dst,
+        ID3D12Resource* src)
+    {
+        return context.CopyBufferRegionRaw(
+            dst,
+            0,
+            D3D12_RESOURCE_STATE_COPY_DEST,
+            src,
+            0,
+            D3D12_RESOURCE_STATE_COPY_SOURCE,
+            256);
+    }
+
+    tfdml::DmlGpuEvent Execute(
+        tfdml::DmlExecutionContext& context,
+        absl::Span<const tfdml::DmlBufferAccess> accesses)
+    {
+        return context.ExecuteOperator(op_.Get(), nullptr, nullptr, accesses);
+    }
+
+    static tfdml::DmlBufferAccess Read(
+        ID3D12Resource* resource,
+        uint64_t offset,
+        uint64_t size_in_bytes)
+    {
+        return {resource, offset, size_in_bytes, false};
+    }
+
+    static tfdml::DmlBufferAccess Write(
+        ID3D12Resource* resource,
+        uint64_t offset,
+        uint64_t size_in_bytes)
+    {
+        return {resource, offset, size_in_bytes, true};
+    }
+
+    Microsoft::WRL::ComPtr<FakeDevice> device_ =
+        Microsoft::WRL::Make<FakeDevice>();
+    Microsoft::WRL::ComPtr<FakeDmlDevice> dml_device_ =
+        Microsoft::WRL::Make<FakeDmlDevice>(device_.Get());
+    Microsoft::WRL::ComPtr<FakeCompiledOperator> op_ =
+        Microsoft::WRL::Make<FakeCompiledOperator>(0);
+    Microsoft::WRL::ComPtr<FakeCommandQueue> compute_queue_ =
+        Microsoft::WRL::Make<FakeCommandQueue>(
+            device_.Get(),
+            D3D12_COMMAND_LIST_TYPE_DIRECT);
+    Microsoft::WRL::ComPtr<FakeCommandQueue> copy_queue_ =
+        Microsoft::WRL::Make<FakeCommandQueue>(
+            device_.Get(),
+            D3D12_COMMAND_LIST_TYPE_COPY);
+    Microsoft::WRL::ComPtr<FakeBuffer> a_ = Microsoft::WRL::Make<FakeBuffer>(0);
+    Microsoft::WRL::ComPtr<FakeBuffer> b_ = Microsoft::WRL::Make<FakeBuffer>(0);
+    Microsoft::WRL::ComPtr<FakeBuffer> c_ = Microsoft::WRL::Make<FakeBuffer>(0);
+    Microsoft::WRL::ComPtr<FakeBuffer> d_ = Microsoft::WRL::Make<FakeBuffer>(0);
+    std::shared_ptr<tfdml::DmlCounters> counters_ =
+        std::make_shared<tfdml::DmlCounters>();
+    std::unique_ptr<tfdml::DmlExecutionContext> compute_context_;
+    std::unique_ptr<tfdml::DmlExecutionContext> copy_context_;
+};
+
+TEST_F(DmlExecutionContextTests, WaitsForConflictingPeerWork)
+{
+    auto copy_event = Copy(*copy_context_, a_.Get(), b_.Get());
+    ASSERT_TRUE(copy_context_->Flush().ok());
+    ASSERT_TRUE(copy_queue_->WaitForSubmissions(1));
+
+    Execute(*compute_context_, {Read(a_.Get(), 128, 256)});
+    ASSERT_TRUE(compute_context_->Flush().ok());
+    ASSERT_TRUE(compute_queue_->WaitForSubmissions(1));
+
+    auto waits = compute_queue_->GetWaits();
+    ASSERT_EQ(waits.size(), 1u);
+    EXPECT_EQ(waits[0].fence, copy_event.fence.Get());
+    EXPECT_EQ(waits[0].value, copy_event.fence_value);
+    EXPECT_EQ(waits[0].submission_index, 0u);
+}
+
+TEST_F(DmlExecutionContextTests, WaitsForPeerReadsBeforeWriting)
+{
+    auto copy_event = Copy(*copy_context_, a_.Get(), b_.Get());
+    ASSERT_TRUE(copy_context_->Flush().ok());
+    ASSERT_TRUE(copy_queue_->WaitForSubmissions(1));
+
+    Execute(*compute_context_, {Write(b_.Get(), 0, 256)});
+    ASSERT_TRUE(compute_context_->Flush().ok());
+    ASSERT_TRUE(compute_queue_->WaitForSubmissions(1));
+
+    auto waits = compute_queue_->GetWaits();
+    ASSERT_EQ(waits.size(), 1u);
+    EXPECT_EQ(waits[0].fence, copy_event.fence.Get());
+    EXPECT_EQ(waits[0].value, copy_event.fence_value);
+}
+
+TEST_F(DmlExecutionContextTests, DoesntWaitForIndependentPeerWork)
+{
+    Copy(*copy_context_, a_.Get(), b_.Get());
+    ASSERT_TRUE(copy_context_->Flush().ok());
+    ASSERT_TRUE(copy_queue_->WaitForSubmissions(1));
+
+    // Both queues reading `b_` is fine, and so is accessing memory past the
+    // end of the copy
+    Execute(
+        *compute_context_,
+        {Read(b_.Get(), 0, 256), Write(a_.Get(), 256, 256)});
+    ASSERT_TRUE(compute_context_->Flush().ok());
+    ASSERT_TRUE(compute_queue_->WaitForSubmissions(1));
+
+    EXPECT_TRUE(compute_queue_->GetWaits().empty());
+}
+
+TEST_F(DmlExecutionContextTests, DoesntWaitForCompletedPeerWork)
+{
+    Copy(*copy_context_, a_.Get(), b_.Get());
+    ASSERT_TRUE(copy_context_->Flush().ok());
+    ASSERT_TRUE(copy_queue_->WaitForSubmissions(1));
+    copy_queue_->CompleteSubmittedWork();
+
+    Execute(*compute_context_, {Read(a_.Get(), 0, 256)});
+    ASSERT_TRUE(compute_context_->Flush().ok());
+    ASSERT_TRUE(compute_queue_->WaitForSubmissions(1));
+
+    EXPECT_TRUE(compute_queue_->GetWaits().empty());
+}
+
+TEST_F(DmlExecutionContextTests, FlushesConflictingPeerWork)
+{
+    // The copy is still batched when the operator needs its result, so the
+    // operator's dependency flushes it rather than waiting for a deadline
+    auto copy_event = Copy(*copy_context_, a_.Get(), b_.Get());
+    Execute(*compute_context_, {Read(a_.Get(), 0, 256)});
+    ASSERT_TRUE(copy_queue_->WaitForSubmissions(1));
+    EXPECT_EQ(
+        copy_queue_->GetSubmission(0),
+        (std::vector<std::string>{
+            "Copy",
+            "UavBarrier",
+            "AliasingBarrier",
+            "Close"}));
+
+    ASSERT_TRUE(compute_context_->Flush().ok());
+    ASSERT_TRUE(compute_queue_->WaitForSubmissions(1));
+
+    auto waits = compute_queue_->GetWaits();
+    ASSERT_EQ(waits.size(), 1u);
+    EXPECT_EQ(waits[0].fence, copy_event.fence.Get());
+    EXPECT_EQ(waits[0].value, copy_event.fence_value);
+}
+
+TEST_F(DmlExecutionContextTests, DoesntMakePeersWaitForEachOther)
+{
+    // The copy batch writes `c_`, then waits for the operator that writes
+    // `a_` so that it can read it
+    auto first_copy_event = Copy(*copy_context_, c_.Get(), b_.Get());
+    auto compute_event = Execute(*compute_context_, {Write(a_.Get(), 0, 256)});
+    Copy(*copy_context_, d_.Get(), a_.Get());
+
+    // The compute batch with the operator can't also wait for the copy batch,
+    // so an operator that reads `c_` goes into the next compute batch
+    Execute(*compute_context_, {Read(c_.Get(), 0, 256)});
+    ASSERT_TRUE(compute_context_->Flush().ok());
+    ASSERT_TRUE(compute_queue_->WaitForSubmissions(2));
+    ASSERT_TRUE(copy_queue_->WaitForSubmissions(1));
+
+    auto copy_waits = copy_queue_->GetWaits();
+    ASSERT_EQ(copy_waits.size(), 1u);
+    EXPECT_EQ(copy_waits[0].fence, compute_event.fence.Get());
+    EXPECT_EQ(copy_waits[0].value, compute_event.fence_value);
+    EXPECT_EQ(copy_waits[0].submission_index, 0u);
+
+    auto compute_waits = compute_queue_->GetWaits();
+    ASSERT_EQ(compute_waits.size(), 1u);
+    EXPECT_EQ(compute_waits[0].fence, first_copy_event.fence.Get());
+    EXPECT_EQ(compute_waits[0].value, first_copy_event.fence_value);
+    EXPECT_EQ(compute_waits[0].submission_index, 1u);
+}
+
+TEST_F(DmlExecutionContextTests, WaitsForTheQueueDependency)
+{
+    Microsoft::WRL::ComPtr<ID3D12Fence> fence =
+        Microsoft::WRL::Make<FakeFence>();
+    compute_context_->SetQueueDependency(
+        [fence] { return tfdml::DmlGpuEvent{1, fence}; });
+
+    Execute(*compute_context_, {Read(a_.Get(), 0, 256)});
+    ASSERT_TRUE(compute_context_->Flush().ok());
+    ASSERT_TRUE(compute_queue_->WaitForSubmissions(1));
+
+    auto waits = compute_queue_->GetWaits();
+    ASSERT_EQ(waits.size(), 1u);
+    EXPECT_EQ(waits[0].fence, fence.Get());
+    EXPECT_EQ(waits[0].value, 1u);
+    EXPECT_EQ(waits[0].submission_index, 0u);
+
+    // Batches don't wait once the dependency is signaled
+    fence->Signal(1);
+    Execute(*compute_context_, {Read(a_.Get(), 0, 256)});
+    ASSERT_TRUE(compute_context_->Flush().ok());
+    ASSERT_TRUE(compute_queue_->WaitForSubmissions(2));
+
+    EXPECT_EQ(compute_queue_->GetWaits().size(), 1u);
+}
+
+TEST_F(DmlExecutionContextTests, FlushUntilLeavesLaterCommandsPending)
+{
+    auto first_event = Copy(*copy_context_, a_.Get(), b_.Get());
+    ASSERT_TRUE(copy_context_->FlushUntil(first_event).ok());
+    ASSERT_TRUE(copy_queue_->WaitForSubmissions(1));
+
+    // The first event's batch has already been flushed, so asking for it again
+    // doesn't flush the copy recorded afterwards, and neither do events of
+    // other contexts
+    auto second_event = Copy(*copy_context_, c_.Get(), d_.Get());
+    auto compute_event = Execute(*compute_context_, {});
+    ASSERT_TRUE(copy_context_->FlushUntil(first_event).ok());
+    ASSERT_TRUE(copy_context_->FlushUntil(compute_event).ok());
+
+    // Give the execution thread a chance to flush by mistake
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(copy_queue_->GetSubmissionCount(), 1u);
+
+    copy_queue_->CompleteSubmittedWork();
+    EXPECT_TRUE(first_event.IsSignaled());
+    EXPECT_FALSE(second_event.IsSignaled());
+
+    ASSERT_TRUE(copy_context_->FlushUntil(second_event).ok());
+    ASSERT_TRUE(copy_queue_->WaitForSubmissions(2));
+    EXPECT_EQ(
+        copy_queue_->GetSubmission(1),
+        (std::vector<std::string>{
+            "Copy",
+            "UavBarrier",
+            "AliasingBarrier",
+            "Close"}));
+}
+
+TEST(DmlFlushPolicyTests, HalvesTheTargetsOnceTheGpuCatchesUp)
+{
+    tfdml::DmlFlushPolicy policy;
+    policy.Update(0);
+    EXPECT_EQ(policy.batch_flush_size, 50u);
+    EXPECT_EQ(policy.batch_flush_time, std::chrono::microseconds(500));
+
+    // Down to a floor
+    for (int i = 0; i < 10; ++i)
+    {
+        policy.Update(0);
+    }
+    EXPECT_EQ(policy.batch_flush_size, 10u);
+    EXPECT_EQ(policy.batch_flush_time, std::chrono::microseconds(100));
+}
+
+TEST(DmlFlushPolicyTests, DoublesTheTargetsWhileTheGpuFallsBehind)
+{
+    tfdml::DmlFlushPolicy policy;
+    policy.Update(3);
+    EXPECT_EQ(policy.batch_flush_size, 200u);
+    EXPECT_EQ(policy.batch_flush_time, std::chrono::microseconds(2000));
+
+    // Up to a ceiling
+    for (int i = 0; i < 10; ++i)
+    {
+        policy.Update(3);
+    }
+    EXPECT_EQ(policy.batch_flush_size, 1000u);
+    EXPECT_EQ(policy.batch_flush_time, std::chrono::microseconds(10000));
+}
+
+TEST(DmlFlushPolicyTests, KeepsTheTargetsWhileTheGpuKeepsUp)
+{
+    tfdml::DmlFlushPolicy policy;
+    policy.Update(1);
+    policy.Update(2);
+    EXPECT_EQ(policy.batch_flush_size, 100u);
+    EXPECT_EQ(policy.batch_flush_time, std::chrono::microseconds(1000));
+}
+
+TEST(DmlFlushPolicyTests, KeepsFixedTargets)
+{
+    tfdml::DmlFlushPolicy policy;
+    policy.batch_flush_size = 64;
+    policy.adaptive_batch_flush_size = false;
+    policy.Update(0);
+    EXPECT_EQ(policy.batch_flush_size, 64u);
+    EXPECT_EQ(policy.batch_flush_time, std::chrono::microseconds(500));
+
+    policy.batch_flush_time = std::chrono::microseconds(300);
+    policy.adaptive_batch_flush_time = false;
+    policy.Update(3);
+    EXPECT_EQ(policy.batch_flush_size, 64u);
+    EXPECT_EQ(policy.batch_flush_time, std::chrono::microseconds(300));
+}
+
+TEST_F(DmlExecutionContextTests, QueuingCommandsDoesntAllocate)
+{
+    // Without a peer, nothing but the batch's own memory is used to queue a
+    // command, and that memory is reused once the batch has been executed
+    auto queue = Microsoft::WRL::Make<FakeCommandQueue>(
+        device_.Get(),
+        D3D12_COMMAND_LIST_TYPE_DIRECT);
+    auto context = CreateExecutionContext(queue.Get());
+
+    constexpr int kCommandCount = 32;
+    tfdml::DmlBufferAccess accesses[] = {
+        Read(a_.Get(), 0, 256),
+        Write(b_.Get(), 0, 256)};
+    const uint8_t pattern[4] = {};
+
+    auto queue_commands = [&]
+    {
+        for (int i = 0; i < kCommandCount; ++i)
+        {
+            Execute(*context, accesses);
+            context->FillBufferWithPatternRaw(c_.Get(), 0, 256, pattern);
+            Copy(*context, d_.Get(), c_.Get());
+            context->UavBarrier();
+        }
+    };
+
+    // Both of the batches have to grow first. Waiting for the fence signal
+    // after each submission lets the execution thread go idle, since it
+    // allocates while recording.
+    for (size_t i = 1; i <= 2; ++i)
+    {
+        queue_commands();
+        ASSERT_TRUE(context->Flush().ok());
+        ASSERT_TRUE(queue->WaitForSignals(i));
+    }
+
+    uint64_t allocation_count = g_allocation_count.load();
+    queue_commands();
+    EXPECT_EQ(g_allocation_count.load() - allocation_count, 0u);
+}
+
+// Measures how many commands per second can be queued as the number of
+// threads queuing them grows, while the execution thread flushes them with the
+// default flush policy. The rates depend on the machine, so they're reported
+// as test properties instead of being checked.
+TEST_F(DmlExecutionContextTests, QueuedCommandsPerSecondByThreadCount)
+{
+    constexpr int kCommandsPerThread = 20000;
+
+    auto queue = Microsoft::WRL::Make<FakeCommandQueue>(
+        device_.Get(),
+        D3D12_COMMAND_LIST_TYPE_DIRECT);
+    auto context = std::make_unique<tfdml::DmlExecutionContext>(
+        device_.Get(),
+        dml_device_.Get(),
+        queue.Get(),
+        counters_);
+
+    uint64_t expected_command_count = 0;
+    for (int thread_count : {1, 2, 4, 8})
+    {
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < thread_count; ++t)
+        {
+            threads.emplace_back(
+                [&, t]()
+                {
+                    tfdml::DmlBufferAccess access =
+                        Read(a_.Get(), t * 256, 256);
+                    for (int i = 0; i < kCommandsPerThread; ++i)
+                    {
+                        Execute(*context, {access});
+                    }
+                });
+        }
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        double commands_per_second =
+            thread_count * kCommandsPerThread / elapsed.count();
+        RecordProperty(
+            "commands_per_second_" + std::to_string(thread_count) +
+                "_threads",
+            static_cast<int>(commands_per_second));
+
+        expected_command_count += thread_count * kCommandsPerThread;
+    }
+
+    // Every command made it into a batch
+    ASSERT_TRUE(context->Flush().ok());
+    auto flushed_count = [&]
+    { return counters_->GetValue(tfdml::DmlCounter::CommandsFlushed); };
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (flushed_count() < expected_command_count &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(flushed_count(), expected_command_count);
+}
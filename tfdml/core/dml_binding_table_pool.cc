@@ -0,0 +1,147 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "dml_binding_table_pool.h"
+
+#include "absl/memory/memory.h"
+#include "dml_device_context.h"
+
+namespace tfdml
+{
+
+DmlBindingTablePool::DmlBindingTablePool(
+    IDMLDevice* dml_device,
+    IDMLDispatchable* dispatchable,
+    const DML_BUFFER_BINDING* persistent_resource_binding)
+    : dml_device_(dml_device),
+      dispatchable_(dispatchable),
+      size_in_descriptors_(
+          dispatchable->GetBindingProperties().RequiredDescriptorCount)
+{
+    if (persistent_resource_binding)
+    {
+        persistent_resource_binding_ = *persistent_resource_binding;
+    }
+
+    Microsoft::WRL::ComPtr<ID3D12Device> d3d12_device;
+    DML_CHECK_SUCCEEDED(
+        dml_device->GetParentDevice(IID_PPV_ARGS(&d3d12_device)));
+    descriptor_size_in_bytes_ = d3d12_device->GetDescriptorHandleIncrementSize(
+        D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+}
+
+void DmlBindingTablePool::AddSlot(DMLDeviceContext* device_context)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (slots_.size() == kMaxSlots)
+    {
+        return;
+    }
+
+    auto slot = CreateSlot(device_context);
+    if (slot)
+    {
+        slots_.push_back(std::move(slot));
+    }
+}
+
+DmlBindingTablePool::Slot* DmlBindingTablePool::TryAcquire(
+    DMLDeviceContext* device_context)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (auto& slot : slots_)
+    {
+        if (!slot->in_use && (!slot->last_use || slot->last_use->IsSignaled()))
+        {
+            slot->in_use = true;
+            return slot.get();
+        }
+    }
+
+    if (slots_.size() == kMaxSlots)
+    {
+        return nullptr;
+    }
+
+    auto slot = CreateSlot(device_context);
+    if (!slot)
+    {
+        return nullptr;
+    }
+
+    slot->in_use = true;
+    slots_.push_back(std::move(slot));
+    return slots_.back().get();
+}
+
+void DmlBindingTablePool::Release(Slot* slot, const DmlGpuEvent& gpu_event)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    assert(slot->in_use);
+    slot->in_use = false;
+    slot->last_use = gpu_event;
+}
+
+uint64_t DmlBindingTablePool::GetMaxDescriptorSizeInBytes() const
+{
+    return static_cast<uint64_t>(kMaxSlots) * size_in_descriptors_ *
+           descriptor_size_in_bytes_;
+}
+
+size_t DmlBindingTablePool::GetSlotCount() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return slots_.size();
+}
+
+std::unique_ptr<DmlBindingTablePool::Slot> DmlBindingTablePool::CreateSlot(
+    DMLDeviceContext* device_context) const
+{
+    auto slot = absl::make_unique<Slot>();
+    slot->descriptor_range =
+        device_context->AllocateDescriptors(size_in_descriptors_);
+    if (!slot->descriptor_range)
+    {
+        return nullptr;
+    }
+
+    D3D12DescriptorHandles descriptor_handles =
+        slot->descriptor_range.GetDescriptorHandles();
+
+    DML_BINDING_TABLE_DESC bind_table_desc = {};
+    bind_table_desc.Dispatchable = dispatchable_.Get();
+    bind_table_desc.CPUDescriptorHandle = descriptor_handles.cpu;
+    bind_table_desc.GPUDescriptorHandle = descriptor_handles.gpu;
+    bind_table_desc.SizeInDescriptors = size_in_descriptors_;
+
+    DML_CHECK_SUCCEEDED(dml_device_->CreateBindingTable(
+        &bind_table_desc,
+        IID_PPV_ARGS(&slot->binding_table)));
+
+    // The persistent resource never changes for the lifetime of the pool
+    DML_BINDING_DESC persistent_binding_desc = {DML_BINDING_TYPE_NONE, nullptr};
+    if (persistent_resource_binding_)
+    {
+        persistent_binding_desc = {
+            DML_BINDING_TYPE_BUFFER,
+            &*persistent_resource_binding_};
+    }
+    slot->binding_table->BindPersistentResource(&persistent_binding_desc);
+
+    return slot;
+}
+
+} // namespace tfdml
@@ -0,0 +1,96 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/types/optional.h"
+#include "dml_common.h"
+#include "dml_descriptor_bfc_allocator.h"
+#include "dml_gpu_event.h"
+
+namespace tfdml
+{
+
+class DMLDeviceContext;
+
+// The binding tables of a dispatchable, along with the descriptors they write
+// to, which are reused by executions of the dispatchable once the GPU is done
+// with them. The persistent resource is bound when a binding table is created,
+// so executions only need to rebind their temporary resource, inputs, and
+// outputs. The binding tables are only released along with the pool. This
+// class is thread-safe.
+class DmlBindingTablePool
+{
+  public:
+    struct Slot
+    {
+        Microsoft::WRL::ComPtr<IDMLBindingTable> binding_table;
+        DescriptorAllocation descriptor_range;
+
+        // Whether an execution is currently being queued with this slot.
+        bool in_use = false;
+
+        // The completion event of the last execution that used this slot, or
+        // nullopt if the slot hasn't been used yet.
+        absl::optional<DmlGpuEvent> last_use;
+    };
+
+    // The number of executions that can be in flight on the GPU before
+    // additional executions fall back to a new binding table.
+    static constexpr size_t kMaxSlots = 4;
+
+    // `persistent_resource_binding` may be null if the dispatchable doesn't
+    // have a persistent resource.
+    DmlBindingTablePool(
+        IDMLDevice* dml_device,
+        IDMLDispatchable* dispatchable,
+        const DML_BUFFER_BINDING* persistent_resource_binding);
+
+    // Creates a slot up front, so that the first execution doesn't have to.
+    // Does nothing if the pool is full.
+    void AddSlot(DMLDeviceContext* device_context);
+
+    // Returns a slot which isn't in use by the GPU, creating one if there's
+    // room in the pool, or nullptr if all the slots are busy. The slot must be
+    // given back to Release.
+    Slot* TryAcquire(DMLDeviceContext* device_context);
+
+    void Release(Slot* slot, const DmlGpuEvent& gpu_event);
+
+    // Returns the size, in bytes, of the descriptors held by the pool once it
+    // has created all of its slots.
+    uint64_t GetMaxDescriptorSizeInBytes() const;
+
+    size_t GetSlotCount() const;
+
+  private:
+    // Returns nullptr if the descriptors couldn't be allocated.
+    std::unique_ptr<Slot> CreateSlot(DMLDeviceContext* device_context) const;
+
+    Microsoft::WRL::ComPtr<IDMLDevice> dml_device_;
+    Microsoft::WRL::ComPtr<IDMLDispatchable> dispatchable_;
+    absl::optional<DML_BUFFER_BINDING> persistent_resource_binding_;
+    uint32_t size_in_descriptors_;
+    uint32_t descriptor_size_in_bytes_;
+
+    mutable std::mutex mutex_;
+    absl::InlinedVector<std::unique_ptr<Slot>, kMaxSlots> slots_;
+};
+
+} // namespace tfdml
@@ -13,6 +13,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include "absl/memory/memory.h"
 #include "dml_bfc_allocator.h"
 #include "dml_buffer.h"
 #include "dml_execution_context.h"
@@ -22,6 +23,11 @@ limitations under the License.
 namespace tfdml
 {
 
+// Once this many ranges are tracked since the last barrier, the next command
+// inserts a barrier regardless, which bounds the cost of looking for
+// conflicts.
+static constexpr size_t max_tracked_ranges = 256;
+
 DmlCommandList::DmlCommandList(
     ID3D12Device* d3d_device,
     IDMLDevice* dml_device,
@@ -37,6 +43,11 @@ DmlCommandList::DmlCommandList(
 {
     DML_CHECK_SUCCEEDED(
         dml_device->CreateCommandRecorder(IID_PPV_ARGS(&recorder_)));
+
+    if (DmlGpuTimeline::IsSupported(d3d_device, queue_->GetType()))
+    {
+        gpu_timeline_ = absl::make_unique<DmlGpuTimeline>(d3d_device, queue_);
+    }
 }
 
 void DmlCommandList::CopyBufferRegion(
@@ -46,11 +57,15 @@ void DmlCommandList::CopyBufferRegion(
     ID3D12Resource* src_buffer,
     uint64_t src_offset,
     D3D12_RESOURCE_STATES src_state,
-    uint64_t byte_count)
+    uint64_t byte_count,
+    absl::Span<const DmlBufferAccess> accesses,
+    uint64_t correlation_id)
 {
     DmlTracing::Instance().LogExecutionContextCopyBufferRegion();
 
-    absl::InlinedVector<D3D12_RESOURCE_BARRIER, 3> barriers;
+    BarrierForAccesses(accesses);
+
+    absl::InlinedVector<D3D12_RESOURCE_BARRIER, 2> barriers;
 
     if (!(dst_state & D3D12_RESOURCE_STATE_COPY_DEST))
     {
@@ -72,6 +87,8 @@ void DmlCommandList::CopyBufferRegion(
         d3d_command_list_->ResourceBarrier(barriers.size(), barriers.data());
     }
 
+    auto start_query_index = BeginTimedCommand(correlation_id);
+
     d3d_command_list_->CopyBufferRegion(
         dst_buffer,
         dst_offset,
@@ -79,19 +96,22 @@ void DmlCommandList::CopyBufferRegion(
         src_offset,
         byte_count);
 
-    // Reset barrier state
-    for (auto& barrier : barriers)
-    {
-        std::swap(
-            barrier.Transition.StateBefore,
-            barrier.Transition.StateAfter);
-    }
+    EndTimedCommand(start_query_index);
 
-    // Since this copy may write to GPU memory, we also need to perform an
-    // aliasing barrier
-    barriers.push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, nullptr));
+    // Reset barrier state. Since the copy may write through a resource that
+    // aliases the memory of other resources, later commands that access the
+    // written range get an aliasing barrier from BarrierForAccesses.
+    if (!barriers.empty())
+    {
+        for (auto& barrier : barriers)
+        {
+            std::swap(
+                barrier.Transition.StateBefore,
+                barrier.Transition.StateAfter);
+        }
 
-    d3d_command_list_->ResourceBarrier(barriers.size(), barriers.data());
+        d3d_command_list_->ResourceBarrier(barriers.size(), barriers.data());
+    }
 }
 
 void DmlCommandList::FillBufferWithPattern(
@@ -136,6 +156,9 @@ void DmlCommandList::FillBufferWithPattern(
     assert(dst_offset % sizeof(uint32_t) == 0);
     assert(dst_size_in_bytes % sizeof(uint32_t) == 0);
 
+    DmlBufferAccess access = {dst, dst_offset, dst_size_in_bytes, true};
+    BarrierForAccesses({access});
+
     // Create a RAW buffer UAV over the resource.
     D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
     uav_desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
@@ -176,12 +199,6 @@ void DmlCommandList::FillBufferWithPattern(
         fillPattern.integers,
         0,
         nullptr);
-
-    // Barrier all outputs.
-    D3D12_RESOURCE_BARRIER barriers[] = {
-        CD3DX12_RESOURCE_BARRIER::UAV(nullptr),
-        CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, nullptr)};
-    d3d_command_list_->ResourceBarrier(ABSL_ARRAYSIZE(barriers), barriers);
 }
 
 void DmlCommandList::InitializeOperator(
@@ -202,29 +219,26 @@ void DmlCommandList::InitializeOperator(
     if ((binding_props.PersistentResourceSize > 0) ||
         (binding_props.TemporaryResourceSize > 0))
     {
-        D3D12_RESOURCE_BARRIER barriers[] = {
-            CD3DX12_RESOURCE_BARRIER::UAV(nullptr),
-            CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, nullptr)};
-        d3d_command_list_->ResourceBarrier(ABSL_ARRAYSIZE(barriers), barriers);
+        BarrierAll();
     }
 }
 
 void DmlCommandList::ExecuteOperator(
     IDMLCompiledOperator* op,
     IDMLBindingTable* binding_table,
-    ID3D12DescriptorHeap* descriptor_heap)
+    ID3D12DescriptorHeap* descriptor_heap,
+    absl::Span<const DmlBufferAccess> accesses,
+    uint64_t correlation_id)
 {
     DmlTracing::Instance().LogExecuteOperatorStart(op, d3d_command_list_.Get());
 
+    BarrierForAccesses(accesses);
+
     // Record the execution work.
     SetDescriptorHeap(descriptor_heap);
+    auto start_query_index = BeginTimedCommand(correlation_id);
     recorder_->RecordDispatch(d3d_command_list_.Get(), op, binding_table);
-
-    // Barrier all outputs.
-    D3D12_RESOURCE_BARRIER barriers[] = {
-        CD3DX12_RESOURCE_BARRIER::UAV(nullptr),
-        CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, nullptr)};
-    d3d_command_list_->ResourceBarrier(ABSL_ARRAYSIZE(barriers), barriers);
+    EndTimedCommand(start_query_index);
 
     DmlTracing::Instance().LogExecuteOperatorEnd(d3d_command_list_.Get());
 }
@@ -239,8 +253,136 @@ void DmlCommandList::ResourceBarrier(
 
 void DmlCommandList::UavBarrier()
 {
+    // Writes through aliased resources also need an aliasing barrier, which
+    // BarrierAll includes.
+    if (!unbarriered_writes_.empty())
+    {
+        BarrierAll();
+        return;
+    }
+
     D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
     d3d_command_list_->ResourceBarrier(1, &barrier);
+    unbarriered_reads_.clear();
+}
+
+void DmlCommandList::WriteTimestamp(
+    ID3D12QueryHeap* query_heap,
+    uint32_t query_index,
+    ID3D12Resource* dst_buffer,
+    uint64_t dst_offset)
+{
+    d3d_command_list_->EndQuery(
+        query_heap,
+        D3D12_QUERY_TYPE_TIMESTAMP,
+        query_index);
+
+    d3d_command_list_->ResolveQueryData(
+        query_heap,
+        D3D12_QUERY_TYPE_TIMESTAMP,
+        query_index,
+        1,
+        dst_buffer,
+        dst_offset);
+}
+
+absl::optional<uint32_t> DmlCommandList::BeginTimedCommand(
+    uint64_t correlation_id)
+{
+    if (!gpu_timeline_ || correlation_id == 0)
+    {
+        return absl::nullopt;
+    }
+
+    return gpu_timeline_->BeginCommand(
+        d3d_command_list_.Get(),
+        correlation_id);
+}
+
+void DmlCommandList::EndTimedCommand(
+    const absl::optional<uint32_t>& start_query_index)
+{
+    if (start_query_index)
+    {
+        gpu_timeline_->EndCommand(d3d_command_list_.Get(), *start_query_index);
+    }
+}
+
+bool DmlCommandList::Overlaps(
+    const DmlBufferAccess& access,
+    absl::Span<const TrackedRange> ranges)
+{
+    uint64_t end = access.offset + access.size_in_bytes;
+    for (const auto& range : ranges)
+    {
+        if (range.resource == access.resource && range.begin < end &&
+            access.offset < range.end)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DmlCommandList::BarrierForAccesses(
+    absl::Span<const DmlBufferAccess> accesses)
+{
+    bool needs_barrier = unbarriered_reads_.size() +
+                             unbarriered_writes_.size() + accesses.size() >
+                         max_tracked_ranges;
+
+    for (const auto& access : accesses)
+    {
+        if (needs_barrier)
+        {
+            break;
+        }
+
+        // Read-after-write and write-after-write
+        needs_barrier = Overlaps(access, unbarriered_writes_);
+
+        // Write-after-read
+        if (access.is_write && !needs_barrier)
+        {
+            needs_barrier = Overlaps(access, unbarriered_reads_);
+        }
+    }
+
+    if (needs_barrier)
+    {
+        BarrierAll();
+    }
+
+    for (const auto& access : accesses)
+    {
+        TrackedRange range = {
+            access.resource,
+            access.offset,
+            access.offset + access.size_in_bytes};
+
+        if (access.is_write)
+        {
+            unbarriered_writes_.push_back(range);
+        }
+        else
+        {
+            unbarriered_reads_.push_back(range);
+        }
+    }
+}
+
+void DmlCommandList::BarrierAll()
+{
+    // Copy command lists need these too: copies in the same list may otherwise
+    // run concurrently.
+    D3D12_RESOURCE_BARRIER barriers[] = {
+        CD3DX12_RESOURCE_BARRIER::UAV(nullptr),
+        CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, nullptr)};
+    d3d_command_list_->ResourceBarrier(ABSL_ARRAYSIZE(barriers), barriers);
+
+    unbarriered_reads_.clear();
+    unbarriered_writes_.clear();
 }
 
 void DmlCommandList::SetDescriptorHeap(ID3D12DescriptorHeap* descriptor_heap)
@@ -282,6 +424,21 @@ void DmlCommandList::Open()
 
 Status DmlCommandList::Close()
 {
+    // Work in later command lists may depend on the writes in this one, so
+    // they're barriered before closing.
+    if (!unbarriered_writes_.empty())
+    {
+        BarrierAll();
+    }
+    unbarriered_reads_.clear();
+
+    if (gpu_timeline_)
+    {
+        gpu_timeline_->EndCommandList(
+            d3d_command_list_.Get(),
+            queue_->GetNextCompletionEvent());
+    }
+
     HRESULT hr = d3d_command_list_->Close();
     if (dml_util::HrIsOutOfMemory(hr))
     {
@@ -18,6 +18,7 @@ limitations under the License.
 #include "dml_command_allocator_ring.h"
 #include "dml_common.h"
 #include "dml_descriptor_pool.h"
+#include "dml_gpu_timeline.h"
 #include "tfdml/runtime_adapter/status.h"
 
 namespace tfdml
@@ -25,8 +26,26 @@ namespace tfdml
 class DmlAllocator;
 class DmlCommandQueue;
 
+// A byte range of a buffer that a recorded command reads or writes. The
+// resource identifies the memory being accessed: for buffers with several
+// resources aliasing the same memory (e.g. a D3D12BufferRegion), this is the
+// resource in the UAV state, regardless of which resource the command uses.
+struct DmlBufferAccess
+{
+    ID3D12Resource* resource;
+    uint64_t offset;
+    uint64_t size_in_bytes;
+    bool is_write;
+};
+
 // Helper that manages and wraps an ID3D12GraphicsCommandList and its backing
-// command allocator. This class is NOT thread safe.
+// command allocator. Rather than inserting a barrier after every command, the
+// command list tracks the buffer ranges read and written since the last
+// barrier, and only inserts one before a command that depends on, or
+// overwrites, the result of an earlier command. Commands recorded with a
+// nonzero correlation id (that of the profiler's CPU event for the command) are
+// timed on the GPU when the queue supports it; see DmlGpuTimeline. This class
+// is NOT thread safe.
 class DmlCommandList
 {
   public:
@@ -39,7 +58,8 @@ class DmlCommandList
     // Records a CopyBufferRegion (see
     // ID3D12GraphicsCommandList::CopyBufferRegion) for execution. Transition
     // barriers are automatically inserted to transition the source and
-    // destination resources to COPY_SOURCE and COPY_DEST if necessary.
+    // destination resources to COPY_SOURCE and COPY_DEST if necessary. The
+    // accesses describe the memory read and written by the copy.
     void CopyBufferRegion(
         ID3D12Resource* dst_buffer,
         uint64_t dst_offset,
@@ -47,7 +67,9 @@ class DmlCommandList
         ID3D12Resource* src_buffer,
         uint64_t src_offset,
         D3D12_RESOURCE_STATES src_state,
-        uint64_t byte_count);
+        uint64_t byte_count,
+        absl::Span<const DmlBufferAccess> accesses,
+        uint64_t correlation_id);
 
     // Records a ClearUAV with the specified value into the command list.
     void FillBufferWithPattern(
@@ -65,11 +87,14 @@ class DmlCommandList
         ID3D12DescriptorHeap* descriptor_heap);
 
     // Records DML operator execution into the command list. It's safe to
-    // release the binding table immediately after this is called.
+    // release the binding table immediately after this is called. The accesses
+    // must cover every buffer bound to the operator.
     void ExecuteOperator(
         IDMLCompiledOperator* op,
         IDMLBindingTable* binding_table,
-        ID3D12DescriptorHeap* descriptor_heap);
+        ID3D12DescriptorHeap* descriptor_heap,
+        absl::Span<const DmlBufferAccess> accesses,
+        uint64_t correlation_id);
 
     // Records a resoruce barrier into the command list.
     void ResourceBarrier(absl::Span<const D3D12_RESOURCE_BARRIER> barriers);
@@ -77,6 +102,15 @@ class DmlCommandList
     // Records a UAV barrier on all resources into the command list.
     void UavBarrier();
 
+    // Records a GPU timestamp into a query of the heap, and resolves it into
+    // the dst buffer, which must be in the COPY_DEST state. The timestamp is
+    // taken once all of the earlier work on the queue has completed.
+    void WriteTimestamp(
+        ID3D12QueryHeap* query_heap,
+        uint32_t query_index,
+        ID3D12Resource* dst_buffer,
+        uint64_t dst_offset);
+
     // Opens the command list for recording, which is required before any of the
     // above methods can be called.
     void Open();
@@ -89,6 +123,10 @@ class DmlCommandList
     // Returns a pointer to the underlying D3D command list.
     ID3D12CommandList* Get() { return d3d_command_list_.Get(); }
 
+    // Returns the timeline of the commands' GPU execution, or null if the
+    // queue doesn't support timestamps.
+    DmlGpuTimeline* GetGpuTimeline() const { return gpu_timeline_.get(); }
+
   private:
     Microsoft::WRL::ComPtr<ID3D12Device> d3d_device_;
     Microsoft::WRL::ComPtr<IDMLDevice> dml_device_;
@@ -105,7 +143,37 @@ class DmlCommandList
 
     DmlCommandAllocatorRing<2> command_allocator_ring_;
 
+    std::unique_ptr<DmlGpuTimeline> gpu_timeline_;
+
+    // A range of memory accessed by a command since the last barrier.
+    struct TrackedRange
+    {
+        ID3D12Resource* resource;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    absl::InlinedVector<TrackedRange, 16> unbarriered_reads_;
+    absl::InlinedVector<TrackedRange, 16> unbarriered_writes_;
+
     void SetDescriptorHeap(ID3D12DescriptorHeap* descriptor_heap);
+
+    // Writes the start timestamp of a command if it's timed, returning the
+    // query to pass to EndTimedCommand.
+    absl::optional<uint32_t> BeginTimedCommand(uint64_t correlation_id);
+    void EndTimedCommand(const absl::optional<uint32_t>& start_query_index);
+
+    static bool Overlaps(
+        const DmlBufferAccess& access,
+        absl::Span<const TrackedRange> ranges);
+
+    // Inserts a barrier if any of the accesses conflicts with an access made
+    // since the last barrier, then starts tracking the accesses.
+    void BarrierForAccesses(absl::Span<const DmlBufferAccess> accesses);
+
+    // Inserts a UAV and aliasing barrier on all resources, after which no
+    // earlier access can conflict with a later one.
+    void BarrierAll();
 };
 
 } // namespace tfdml
\ No newline at end of file
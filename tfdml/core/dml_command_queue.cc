@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "dml_command_queue.h"
 
+#include "dml_tracing.h"
+
 namespace tfdml
 {
 
@@ -38,6 +40,28 @@ void DmlCommandQueue::ExecuteCommandLists(
 
     ++last_fence_value_;
     DML_CHECK_SUCCEEDED(queue_->Signal(fence_.Get(), last_fence_value_));
+    DmlTracing::Instance().LogFenceSignal(type_, last_fence_value_);
+}
+
+uint64_t DmlCommandQueue::GetTimestampFrequency() const
+{
+    uint64_t frequency = 0;
+    DML_CHECK_SUCCEEDED(queue_->GetTimestampFrequency(&frequency));
+    return frequency;
+}
+
+void DmlCommandQueue::GetClockCalibration(
+    uint64_t* gpu_timestamp,
+    uint64_t* cpu_timestamp) const
+{
+    DML_CHECK_SUCCEEDED(
+        queue_->GetClockCalibration(gpu_timestamp, cpu_timestamp));
+}
+
+void DmlCommandQueue::Wait(const DmlGpuEvent& gpu_event)
+{
+    DML_CHECK_SUCCEEDED(
+        queue_->Wait(gpu_event.fence.Get(), gpu_event.fence_value));
 }
 
 DmlGpuEvent DmlCommandQueue::GetCurrentCompletionEvent()
@@ -35,8 +35,22 @@ class DmlCommandQueue
     Microsoft::WRL::ComPtr<ID3D12Fence> GetFence() const { return fence_; }
     uint64_t GetLastFenceValue() const { return last_fence_value_; }
 
+    // Returns the rate, in ticks per second, of the GPU timestamps recorded on
+    // the queue.
+    uint64_t GetTimestampFrequency() const;
+
+    // Samples the GPU timestamp counter of the queue and the CPU's performance
+    // counter at the same moment.
+    void GetClockCalibration(
+        uint64_t* gpu_timestamp,
+        uint64_t* cpu_timestamp) const;
+
     void ExecuteCommandLists(absl::Span<ID3D12CommandList*> command_lists);
 
+    // Makes work submitted to the queue after this call wait on the GPU until
+    // the event, which usually belongs to another queue, is signaled.
+    void Wait(const DmlGpuEvent& gpu_event);
+
     // Returns an event that will become signaled when everything submitted to
     // the queue thus far has completed execution on the GPU.
     DmlGpuEvent GetCurrentCompletionEvent();
@@ -0,0 +1,97 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "dml_compile_pool.h"
+
+#include <cassert>
+
+namespace tfdml
+{
+
+DmlCompilePool::DmlCompilePool(uint32_t thread_count)
+{
+    assert(thread_count > 0);
+
+    shared_state_ = std::make_shared<SharedState>();
+
+    threads_.reserve(thread_count);
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        threads_.emplace_back(ThreadProc, shared_state_);
+    }
+}
+
+DmlCompilePool::~DmlCompilePool()
+{
+    // Request exit of the background threads once they've run the tasks which
+    // are still queued
+    std::unique_lock<std::mutex> lock(shared_state_->mutex);
+    shared_state_->exit_requested = true;
+    shared_state_->task_queued.notify_all();
+    lock.unlock();
+
+    // Like the execution context and event queue threads, these are detached
+    // rather than joined so that the destructor never blocks.
+    for (auto& thread : threads_)
+    {
+        thread.detach();
+    }
+}
+
+void DmlCompilePool::Run(const std::function<void()>& task)
+{
+    Task queued_task = {&task};
+
+    std::unique_lock<std::mutex> lock(shared_state_->mutex);
+    shared_state_->queued_tasks.push_back(&queued_task);
+    shared_state_->task_queued.notify_one();
+
+    shared_state_->task_completed.wait(
+        lock,
+        [&queued_task] { return queued_task.completed; });
+}
+
+/*static*/ void DmlCompilePool::ThreadProc(std::shared_ptr<SharedState> state)
+{
+    std::unique_lock<std::mutex> lock(state->mutex);
+
+    while (true)
+    {
+        if (state->queued_tasks.empty())
+        {
+            if (state->exit_requested)
+            {
+                break;
+            }
+
+            state->task_queued.wait(lock);
+            continue;
+        }
+
+        Task* task = state->queued_tasks.front();
+        state->queued_tasks.pop_front();
+
+        // The task runs without holding the lock, so that the other threads
+        // can pick up tasks in the meantime
+        lock.unlock();
+        (*task->function)();
+        lock.lock();
+
+        task->completed = true;
+        state->task_completed.notify_all();
+    }
+}
+
+} // namespace tfdml
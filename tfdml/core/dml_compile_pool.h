@@ -0,0 +1,77 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tfdml
+{
+
+// A fixed set of threads which DirectML operators are compiled on. Kernels are
+// still constructed on the TF executor threads, since construction needs the
+// live OpKernelContext, but their operator compilations are handed to the pool
+// when the TF_DIRECTML_KERNEL_COMPILE_THREADS environment variable enables it.
+// This decouples how many compilations run at once from how many executor
+// threads miss the kernel cache at the same time. This class is thread-safe.
+class DmlCompilePool
+{
+  public:
+    // `thread_count` must be at least 1.
+    explicit DmlCompilePool(uint32_t thread_count);
+    ~DmlCompilePool();
+
+    // Runs the task on one of the pool's threads and blocks until it has
+    // finished. Tasks submitted concurrently run concurrently, up to the
+    // number of threads in the pool; the others wait in submission order.
+    void Run(const std::function<void()>& task);
+
+    uint32_t GetThreadCount() const
+    {
+        return static_cast<uint32_t>(threads_.size());
+    }
+
+  private:
+    // A task waiting for or running on a pool thread. Tasks live on the stack
+    // of the thread that called Run, which blocks until they're completed.
+    struct Task
+    {
+        const std::function<void()>* function;
+        bool completed = false;
+    };
+
+    // State shared with the background threads. Protected by `mutex`.
+    struct SharedState
+    {
+        std::mutex mutex;
+        std::condition_variable task_queued;
+        std::condition_variable task_completed;
+        std::deque<Task*> queued_tasks;
+        bool exit_requested = false;
+    };
+
+    static void ThreadProc(std::shared_ptr<SharedState> state);
+
+    std::shared_ptr<SharedState> shared_state_;
+    std::vector<std::thread> threads_;
+};
+
+} // namespace tfdml
@@ -0,0 +1,87 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#include "dml_counters.h"
+
+namespace tfdml
+{
+
+struct CounterInfo
+{
+    const char* name;
+    bool is_gauge;
+};
+
+// Indexed by DmlCounter
+static constexpr CounterInfo counter_infos[] = {
+    {"batches_flushed", false},
+    {"commands_flushed", false},
+    {"flushes_for_size", false},
+    {"flushes_for_time", false},
+    {"flushes_requested", false},
+    {"execution_thread_wait_ns", false},
+    {"kernel_cache_hits", false},
+    {"kernel_cache_misses", false},
+    {"kernel_creations", false},
+    {"kernel_creation_time_ns", false},
+    {"event_queue_depth", true},
+    {"event_queue_max_depth", true},
+    {"uploads", false},
+    {"upload_bytes", false},
+    {"uploads_from_staging_pool", false},
+    {"readbacks", false},
+    {"readback_bytes", false},
+    {"readbacks_to_staging_pool", false},
+};
+
+static_assert(
+    sizeof(counter_infos) / sizeof(counter_infos[0]) ==
+        DmlCounters::kCounterCount,
+    "Every counter needs a name");
+
+void DmlCounters::UpdateMax(DmlCounter counter, uint64_t value)
+{
+    auto& max_value = Get(counter);
+    uint64_t current = max_value.load(std::memory_order_relaxed);
+    while (current < value && !max_value.compare_exchange_weak(
+                                  current,
+                                  value,
+                                  std::memory_order_relaxed))
+    {
+    }
+}
+
+DmlCounters::Values DmlCounters::GetValues() const
+{
+    Values values;
+    for (size_t i = 0; i < kCounterCount; ++i)
+    {
+        values[i] = counters_[i].value.load(std::memory_order_relaxed);
+    }
+    return values;
+}
+
+/*static*/ const char* DmlCounters::GetName(DmlCounter counter)
+{
+    return counter_infos[static_cast<size_t>(counter)].name;
+}
+
+/*static*/ bool DmlCounters::IsGauge(DmlCounter counter)
+{
+    return counter_infos[static_cast<size_t>(counter)].is_gauge;
+}
+
+} // namespace tfdml
@@ -0,0 +1,124 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include "dml_common.h"
+
+namespace tfdml
+{
+
+// Counters of a device's dispatch pipeline, which are used to tune the batch
+// flush settings. Most counters are running totals; gauges hold a current or
+// peak value instead (see DmlCounters::IsGauge).
+enum class DmlCounter : uint32_t
+{
+    // DmlExecutionContext
+    BatchesFlushed,
+    CommandsFlushed,
+    FlushesForSize,
+    FlushesForTime,
+    FlushesRequested,
+    ExecutionThreadWaitNs,
+
+    // DmlKernelManager
+    KernelCacheHits,
+    KernelCacheMisses,
+    KernelCreations,
+    KernelCreationTimeNs,
+
+    // DmlEventQueue
+    EventQueueDepth,
+    EventQueueMaxDepth,
+
+    // DmlUploadHeap
+    Uploads,
+    UploadBytes,
+    UploadsFromStagingPool,
+
+    // DmlReadbackHeap
+    Readbacks,
+    ReadbackBytes,
+    ReadbacksToStagingPool,
+
+    Count,
+};
+
+// A registry of the counters of a device, which are updated with relaxed
+// atomic operations and never take a lock. This class is thread-safe.
+class DmlCounters
+{
+  public:
+    static constexpr size_t kCounterCount =
+        static_cast<size_t>(DmlCounter::Count);
+
+    using Values = std::array<uint64_t, kCounterCount>;
+
+    void Add(DmlCounter counter, uint64_t value)
+    {
+        Get(counter).fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void Increment(DmlCounter counter) { Add(counter, 1); }
+
+    void Subtract(DmlCounter counter, uint64_t value)
+    {
+        Get(counter).fetch_sub(value, std::memory_order_relaxed);
+    }
+
+    // Raises a gauge to the value if it's higher than the current one.
+    void UpdateMax(DmlCounter counter, uint64_t value);
+
+    uint64_t GetValue(DmlCounter counter) const
+    {
+        return Get(counter).load(std::memory_order_relaxed);
+    }
+
+    Values GetValues() const;
+
+    // Returns the name under which the counter is exported, e.g.
+    // "batches_flushed".
+    static const char* GetName(DmlCounter counter);
+
+    // Gauges hold a current or peak value, rather than a running total, so
+    // they aren't meaningful as a difference between two points in time.
+    static bool IsGauge(DmlCounter counter);
+
+  private:
+    // Each counter has its own cache line, so that counters which are updated
+    // by different threads don't contend.
+    struct Counter
+    {
+        std::atomic<uint64_t> value = {0};
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::atomic<uint64_t>& Get(DmlCounter counter)
+    {
+        return counters_[static_cast<size_t>(counter)].value;
+    }
+
+    const std::atomic<uint64_t>& Get(DmlCounter counter) const
+    {
+        return counters_[static_cast<size_t>(counter)].value;
+    }
+
+    std::array<Counter, kCounterCount> counters_;
+};
+
+} // namespace tfdml
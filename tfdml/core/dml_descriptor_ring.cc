@@ -0,0 +1,145 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#include "dml_descriptor_ring.h"
+
+namespace tfdml
+{
+
+DmlDescriptorRing::DmlDescriptorRing(
+    ID3D12Device* device,
+    ID3D12Fence* fence,
+    uint32_t capacity_in_descriptors)
+    : fence_(fence),
+      capacity_(capacity_in_descriptors),
+      handle_increment_(device->GetDescriptorHandleIncrementSize(
+          D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV))
+{
+    D3D12_DESCRIPTOR_HEAP_DESC desc = {};
+    desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    desc.NumDescriptors = capacity_;
+    desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+
+    DML_CHECK_SUCCEEDED(
+        device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&heap_)));
+
+    cpu_start_ = heap_->GetCPUDescriptorHandleForHeapStart();
+    gpu_start_ = heap_->GetGPUDescriptorHandleForHeapStart();
+}
+
+absl::optional<DmlDescriptorRing::Allocation> DmlDescriptorRing::TryAllocate(
+    uint32_t num_descriptors)
+{
+    assert(num_descriptors != 0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    Reclaim();
+
+    // Ranges must be contiguous, so if the range doesn't fit between the head
+    // and the end of the heap, it wraps around to the beginning; the skipped
+    // descriptors are reclaimed along with the range.
+    absl::optional<uint32_t> begin;
+    if (entries_.empty())
+    {
+        head_ = 0;
+        tail_ = 0;
+
+        if (num_descriptors <= capacity_)
+        {
+            begin = 0;
+        }
+    }
+    else if (head_ > tail_)
+    {
+        // Free space at the end and beginning of the heap:
+        //   |------XXXXYYYZZ------|
+        //          ^tail    ^head
+        if (head_ + num_descriptors <= capacity_)
+        {
+            begin = head_;
+        }
+        else if (num_descriptors <= tail_)
+        {
+            begin = 0;
+        }
+    }
+    else if (head_ < tail_)
+    {
+        // Free space in the middle of the heap:
+        //   |YYYZZ---------XXXX-|
+        //         ^head    ^tail
+        if (head_ + num_descriptors <= tail_)
+        {
+            begin = head_;
+        }
+    }
+
+    if (!begin)
+    {
+        return absl::nullopt;
+    }
+
+    head_ = *begin + num_descriptors;
+
+    Entry entry = {};
+    entry.end = head_;
+    entry.released = false;
+    entries_.push_back(entry);
+
+    Allocation allocation = {};
+    allocation.handles.heap = heap_.Get();
+    allocation.handles.cpu = CD3DX12_CPU_DESCRIPTOR_HANDLE(
+        cpu_start_,
+        *begin,
+        handle_increment_);
+    allocation.handles.gpu = CD3DX12_GPU_DESCRIPTOR_HANDLE(
+        gpu_start_,
+        *begin,
+        handle_increment_);
+    allocation.id = first_entry_id_ + entries_.size() - 1;
+    return allocation;
+}
+
+void DmlDescriptorRing::Release(
+    const Allocation& allocation,
+    const DmlGpuEvent& gpu_event)
+{
+    assert(gpu_event.fence.Get() == fence_.Get());
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    assert(allocation.id >= first_entry_id_);
+    Entry& entry = entries_[allocation.id - first_entry_id_];
+    entry.fence_value = gpu_event.fence_value;
+    entry.released = true;
+}
+
+void DmlDescriptorRing::Reclaim()
+{
+    // Ranges are reclaimed in allocation order, so a range that is released
+    // after a later one holds that one back. This only delays its reuse.
+    uint64_t completed_fence_value = fence_->GetCompletedValue();
+    while (!entries_.empty() && entries_.front().released &&
+           entries_.front().fence_value <= completed_fence_value)
+    {
+        tail_ = entries_.front().end;
+        entries_.pop_front();
+        ++first_entry_id_;
+    }
+}
+
+} // namespace tfdml
@@ -0,0 +1,101 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#pragma once
+
+#include <deque>
+
+#include "dml_common.h"
+#include "dml_descriptor_heap_allocator.h"
+#include "dml_gpu_event.h"
+
+namespace tfdml
+{
+
+// A shader-visible CBV/SRV/UAV descriptor heap used as a ring buffer, for
+// descriptors that are only needed until the GPU work they're bound to
+// completes (e.g. the descriptors of a single operator dispatch). Allocating is
+// a pointer bump, and reclaiming a range is a single comparison of its fence
+// value against the completed value of the fence. Descriptors that live longer
+// than a dispatch should come from DmlDescriptorAllocator instead. This class
+// is thread-safe.
+class DmlDescriptorRing
+{
+  public:
+    // The capacity of the ring, which matches the block size of
+    // DmlDescriptorAllocator.
+    static constexpr uint32_t kDefaultCapacityInDescriptors = 65536;
+
+    struct Allocation
+    {
+        D3D12DescriptorHandles handles;
+        uint64_t id;
+    };
+
+    // `fence` is the fence signaled by the execution context, which the GPU
+    // events supplied to Release must belong to.
+    DmlDescriptorRing(
+        ID3D12Device* device,
+        ID3D12Fence* fence,
+        uint32_t capacity_in_descriptors = kDefaultCapacityInDescriptors);
+
+    // Reserves a contiguous range of descriptors, or returns nullopt if the
+    // ring doesn't currently have enough free space. The range must be
+    // released once the work using it has been queued.
+    absl::optional<Allocation> TryAllocate(uint32_t num_descriptors);
+
+    // Makes the descriptors available for reuse once the GPU event becomes
+    // signaled.
+    void Release(const Allocation& allocation, const DmlGpuEvent& gpu_event);
+
+  private:
+    // A range of descriptors in the ring, in allocation order.
+    struct Entry
+    {
+        // The end of the range, which is where the tail moves to once the
+        // range is reclaimed.
+        uint32_t end;
+
+        // Only valid once the range has been released.
+        uint64_t fence_value;
+        bool released;
+    };
+
+    // Frees the ranges at the tail of the ring which have been released and
+    // whose fence value has completed. The mutex must already be held.
+    void Reclaim();
+
+    std::mutex mutex_;
+    Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> heap_;
+    Microsoft::WRL::ComPtr<ID3D12Fence> fence_;
+    const uint32_t capacity_;
+    const uint32_t handle_increment_;
+    D3D12_CPU_DESCRIPTOR_HANDLE cpu_start_;
+    D3D12_GPU_DESCRIPTOR_HANDLE gpu_start_;
+
+    // Descriptors are allocated at the head and reclaimed from the tail. When
+    // head == tail, the ring is either empty or full depending on whether
+    // there are any entries.
+    uint32_t head_ = 0;
+    uint32_t tail_ = 0;
+
+    std::deque<Entry> entries_;
+
+    // The ID of entries_.front()
+    uint64_t first_entry_id_ = 0;
+};
+
+} // namespace tfdml
@@ -23,6 +23,8 @@ limitations under the License.
 #include "dml_event_queue.h"
 #include "dml_kernel_manager.h"
 #include "dml_readback_heap.h"
+#include "dml_stream_event.h"
+#include "dml_temporary_heap.h"
 #include "dml_tracing.h"
 #include "dml_upload_heap.h"
 #include "tfdml/core/dml_util.h"
@@ -41,8 +43,10 @@ DmlDevice::DmlDevice(const DmlDeviceState* state, uint32_t device_ordinal)
         state_->event_queue.get(),
         state_->upload_heap.get(),
         state_->readback_heap.get(),
+        state_->temporary_heap.get(),
         state_->dml_allocator.get(),
-        state_->descriptor_allocator.get());
+        state_->descriptor_allocator.get(),
+        state_->descriptor_ring.get());
 }
 
 Status DmlDevice::Sync()
@@ -53,7 +57,16 @@ Status DmlDevice::Sync()
 
     auto status_or_event = state_->execution_context->Flush();
     TF_RETURN_IF_ERROR(status_or_event.status());
-    status_or_event.ConsumeValueOrDie().WaitForSignal();
+    DmlGpuEvent compute_event = status_or_event.ConsumeValueOrDie();
+
+    if (state_->copy_execution_context)
+    {
+        auto status_or_copy_event = state_->copy_execution_context->Flush();
+        TF_RETURN_IF_ERROR(status_or_copy_event.status());
+        status_or_copy_event.ConsumeValueOrDie().WaitForSignal();
+    }
+
+    compute_event.WaitForSignal();
     auto end_time = std::chrono::high_resolution_clock::now();
 
     std::chrono::duration<double> wait_seconds = end_time - start_time;
@@ -67,6 +80,36 @@ Status DmlDevice::Sync()
     return Status::OK();
 }
 
+void DmlDevice::RecordEvent(DmlStreamEvent* event) const
+{
+    absl::InlinedVector<DmlGpuEvent, 2> gpu_events = {
+        state_->execution_context->GetCurrentCompletionEvent()};
+
+    if (state_->copy_execution_context)
+    {
+        gpu_events.push_back(
+            state_->copy_execution_context->GetCurrentCompletionEvent());
+    }
+
+    event->Record(gpu_events, this);
+}
+
+Status DmlDevice::FlushEvent(const DmlStreamEvent& event) const
+{
+    for (const DmlGpuEvent& gpu_event : event.GetGpuEvents())
+    {
+        TF_RETURN_IF_ERROR(state_->execution_context->FlushUntil(gpu_event));
+
+        if (state_->copy_execution_context)
+        {
+            TF_RETURN_IF_ERROR(
+                state_->copy_execution_context->FlushUntil(gpu_event));
+        }
+    }
+
+    return Status::OK();
+}
+
 Status DmlDevice::CopyCPUTensorToDevice(
     const Tensor* cpu_tensor,
     Tensor* device_tensor)
@@ -147,6 +190,16 @@ DmlEventQueue* DmlDevice::GetEventQueue() const
     return state_->event_queue.get();
 }
 
+DmlHostStagingPool* DmlDevice::GetHostStagingPool() const
+{
+    return state_->host_staging_pool.get();
+}
+
+DmlCompilePool* DmlDevice::GetCompilePool() const
+{
+    return state_->compile_pool.get();
+}
+
 DMLDeviceContext* DmlDevice::GetDeviceContext() const
 {
     return device_context_.get();
@@ -26,13 +26,16 @@ namespace tfdml
 class Tensor;
 class DmlAdapter;
 class DmlAllocator;
+class DmlCompilePool;
 class DmlDescriptorAllocator;
 class DmlKernelManager;
 class DmlExecutionContext;
 class DmlUploadHeap;
 class DmlReadbackHeap;
 class DmlEventQueue;
+class DmlHostStagingPool;
 class DMLDeviceContext;
+class DmlStreamEvent;
 struct DmlDeviceState;
 
 class DmlDevice : public Device
@@ -49,8 +52,17 @@ class DmlDevice : public Device
     DmlUploadHeap* GetUploadHeap() const;
     DmlReadbackHeap* GetReadbackHeap() const;
     DmlEventQueue* GetEventQueue() const;
+    DmlHostStagingPool* GetHostStagingPool() const;
+    DmlCompilePool* GetCompilePool() const;
     DMLDeviceContext* GetDeviceContext() const;
     Status Sync();
+
+    // Records the work queued on the device so far into the event.
+    void RecordEvent(DmlStreamEvent* event) const;
+
+    // Requests a flush of the work recorded into the event, without waiting
+    // for it to complete.
+    Status FlushEvent(const DmlStreamEvent& event) const;
     inline uint32_t GetDeviceOrdinal() const { return device_ordinal_; }
 
     absl::optional<uint32_t> TryLogKernelComputeStart(
@@ -242,6 +242,19 @@ const DmlDeviceState* DmlDeviceCache::GetOrCreateDeviceState(
     return device_states_[adapter_index].get();
 }
 
+const DmlDeviceState* DmlDeviceCache::TryGetDeviceState(
+    uint32_t adapter_index) const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (adapter_index >= device_states_.size())
+    {
+        return nullptr;
+    }
+
+    return device_states_[adapter_index].get();
+}
+
 const DmlAdapter& DmlDeviceCache::GetAdapter(uint32_t adapter_index) const
 {
     return adapters_[adapter_index];
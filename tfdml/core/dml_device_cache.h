@@ -41,6 +41,10 @@ class DmlDeviceCache
     // are ignored. This is unusual, but matches the behavior of the CUDA
     // device.
     const DmlDeviceState* GetOrCreateDeviceState(uint32_t adapter_index);
+
+    // Returns the state of the device on the adapter, or null if the adapter
+    // doesn't exist or its device hasn't been created yet.
+    const DmlDeviceState* TryGetDeviceState(uint32_t adapter_index) const;
     const DmlAdapter& GetAdapter(uint32_t adapter_index) const;
 
   private:
@@ -16,6 +16,7 @@ limitations under the License.
 #include "dml_device_context.h"
 
 #include "dml_bfc_allocator.h"
+#include "dml_kernel_manager.h"
 #include "dml_util.h"
 #include "tensorflow/c/experimental/stream_executor/stream_executor.h"
 #include "tensorflow/c/kernels.h"
@@ -55,10 +56,10 @@ Status DMLDeviceContext::CopyCPUTensorToDevice(
         upload_heap_->BeginUploadToGpu(dst, byte_span);
 
     // Immediately signal completion even though we haven't actually kicked off
-    // the GPU, or waited for it to complete. This is because from the
-    // framework's point of view, there's no way for it to observe this state
-    // (except when copying a tensor back to CPU, at which point we correctly
-    // flush and queue a callback)
+    // the GPU, or waited for it to complete. The upload heap has its own copy
+    // of the CPU data, so from the framework's point of view, there's no way
+    // for it to observe this state (except when copying a tensor back to CPU,
+    // at which point we correctly flush and queue a callback)
     return status_or_event.status();
 }
 
@@ -125,9 +126,7 @@ Status DMLDeviceContext::CopyDeviceTensorToCPU(
         return status_or_event.status();
     }
 
-    TF_RETURN_IF_ERROR(device->Sync());
-    status_or_event.ConsumeValueOrDie().WaitForSignal();
-    return Status::OK();
+    return WaitForReadback(device, status_or_event.ConsumeValueOrDie());
 }
 
 Status DMLDeviceContext::CopyDeviceTensorsToCPU(
@@ -178,8 +177,7 @@ Status DMLDeviceContext::CopyDeviceTensorsToCPU(
     // actually copy anything
     if (copy_event.fence)
     {
-        TF_RETURN_IF_ERROR(device->Sync());
-        copy_event.WaitForSignal();
+        TF_RETURN_IF_ERROR(WaitForReadback(device, copy_event));
     }
 
     return Status::OK();
@@ -189,7 +187,8 @@ Status DMLDeviceContext::CopyCPUMemoryToDevice(
     DmlDevice* device,
     const void* cpu_memory,
     SP_DeviceMemoryBase* device_memory,
-    uint64_t size_in_bytes) const
+    uint64_t size_in_bytes,
+    bool stream_ordered) const
 {
     if (size_in_bytes == 0)
     {
@@ -210,14 +209,20 @@ Status DMLDeviceContext::CopyCPUMemoryToDevice(
         static_cast<const uint8_t*>(cpu_memory),
         size_in_bytes);
 
+    // Stream-ordered copies keep the CPU memory alive and unchanged until the
+    // stream completes them, so memory from the host staging pool can be read
+    // by the GPU directly. Otherwise the upload heap makes its own copy.
     StatusOr<DmlGpuEvent> status_or_event =
-        upload_heap_->BeginUploadToGpu(dst, byte_span);
+        stream_ordered
+            ? upload_heap_->BeginStreamOrderedUploadToGpu(dst, byte_span)
+            : upload_heap_->BeginUploadToGpu(dst, byte_span);
 
     // Immediately signal completion even though we haven't actually kicked off
-    // the GPU, or waited for it to complete. This is because from the
-    // framework's point of view, there's no way for it to observe this state
-    // (except when copying a tensor back to CPU, at which point we correctly
-    // flush and queue a callback)
+    // the GPU, or waited for it to complete. Either the upload heap has its own
+    // copy of the CPU data, or the caller keeps it alive until the stream
+    // completes, so from the framework's point of view there's no way for it to
+    // observe this state (except when copying a tensor back to CPU, at which
+    // point we correctly flush and queue a callback)
     return status_or_event.status();
 }
 
@@ -253,6 +258,18 @@ StatusOr<DmlGpuEvent> DMLDeviceContext::CopyDeviceMemoryToCPU(
     return status_or_event;
 }
 
+Status DMLDeviceContext::WaitForReadback(
+    DmlDevice* device,
+    const DmlGpuEvent& readback_event)
+{
+    TF_RETURN_IF_ERROR(readback_heap_->FlushReadback(readback_event));
+    readback_event.WaitForSignal();
+
+    // Take the opportunity to free some memory if needed
+    device->GetKernelManager()->ReleaseCompletedReferences();
+    return Status::OK();
+}
+
 void DMLDeviceContext::CopyMemoryInSameDevice(
     DmlDevice* device,
     const SP_DeviceMemoryBase* input_memory,
@@ -327,6 +344,33 @@ DmlGpuEvent DMLDeviceContext::BindAndExecuteOperator(
     _In_opt_ const DML_BUFFER_BINDING* persistent_resource_binding,
     absl::Span<const absl::optional<DML_BUFFER_BINDING>> input_bindings,
     absl::Span<const absl::optional<DML_BUFFER_BINDING>> output_bindings)
+{
+    // Bind the persistent resource
+    DML_BINDING_DESC persistent_binding_desc = {DML_BINDING_TYPE_NONE, nullptr};
+    if (persistent_resource_binding)
+    {
+        persistent_binding_desc = {
+            DML_BINDING_TYPE_BUFFER,
+            persistent_resource_binding};
+    }
+    binding_table->BindPersistentResource(&persistent_binding_desc);
+
+    return RebindAndExecuteOperator(
+        op,
+        std::move(binding_table),
+        heap_for_binding_table,
+        temporary_resource_binding,
+        input_bindings,
+        output_bindings);
+}
+
+DmlGpuEvent DMLDeviceContext::RebindAndExecuteOperator(
+    IDMLCompiledOperator* op,
+    Microsoft::WRL::ComPtr<IDMLBindingTable>&& binding_table,
+    ID3D12DescriptorHeap* heap_for_binding_table,
+    _In_opt_ const DML_BUFFER_BINDING* temporary_resource_binding,
+    absl::Span<const absl::optional<DML_BUFFER_BINDING>> input_bindings,
+    absl::Span<const absl::optional<DML_BUFFER_BINDING>> output_bindings)
 {
     // Bind the temporary resource
     DML_BINDING_DESC temporary_binding_desc = {DML_BINDING_TYPE_NONE, nullptr};
@@ -338,15 +382,21 @@ DmlGpuEvent DMLDeviceContext::BindAndExecuteOperator(
     }
     binding_table->BindTemporaryResource(&temporary_binding_desc);
 
-    // Bind the persistent resource
-    DML_BINDING_DESC persistent_binding_desc = {DML_BINDING_TYPE_NONE, nullptr};
-    if (persistent_resource_binding)
+    // The execution context only inserts a barrier before the operator when
+    // it accesses memory that earlier commands are still using. The
+    // persistent resource isn't included, since only initialization writes to
+    // it and that's always followed by a barrier.
+    absl::InlinedVector<DmlBufferAccess, 12> accesses;
+    auto add_access = [&](const DML_BUFFER_BINDING& binding, bool is_write)
     {
-        persistent_binding_desc = {
-            DML_BINDING_TYPE_BUFFER,
-            persistent_resource_binding};
+        accesses.push_back(
+            {binding.Buffer, binding.Offset, binding.SizeInBytes, is_write});
+    };
+
+    if (temporary_resource_binding)
+    {
+        add_access(*temporary_resource_binding, true);
     }
-    binding_table->BindPersistentResource(&persistent_binding_desc);
 
     // Set up the input bindings
     absl::InlinedVector<DML_BINDING_DESC, 8> input_binding_descs;
@@ -356,6 +406,7 @@ DmlGpuEvent DMLDeviceContext::BindAndExecuteOperator(
         if (binding)
         {
             desc = {DML_BINDING_TYPE_BUFFER, &binding.value()};
+            add_access(*binding, false);
         }
 
         input_binding_descs.push_back(desc);
@@ -372,6 +423,7 @@ DmlGpuEvent DMLDeviceContext::BindAndExecuteOperator(
         if (binding)
         {
             desc = {DML_BINDING_TYPE_BUFFER, &binding.value()};
+            add_access(*binding, true);
         }
 
         output_binding_descs.push_back(desc);
@@ -383,7 +435,15 @@ DmlGpuEvent DMLDeviceContext::BindAndExecuteOperator(
     return execution_context_->ExecuteOperator(
         op,
         std::move(binding_table),
-        heap_for_binding_table);
+        heap_for_binding_table,
+        accesses);
+}
+
+StatusOr<DmlGpuEvent> DMLDeviceContext::ExecuteWithTemporaryBuffer(
+    uint64_t size_in_bytes,
+    DmlTemporaryHeap::ExecuteFn execute) const
+{
+    return temporary_heap_->ExecuteWithTemporaryBuffer(size_in_bytes, execute);
 }
 
 DmlGpuEvent DMLDeviceContext::InsertUavBarrier() const
@@ -477,6 +537,19 @@ DescriptorAllocation DMLDeviceContext::AllocateDescriptors(
     return descriptor_allocator_->Alloc(size_in_descriptors);
 }
 
+absl::optional<DmlDescriptorRing::Allocation> DMLDeviceContext::
+    TryAllocateTransientDescriptors(uint32_t size_in_descriptors) const
+{
+    return descriptor_ring_->TryAllocate(size_in_descriptors);
+}
+
+void DMLDeviceContext::ReleaseTransientDescriptors(
+    const DmlDescriptorRing::Allocation& allocation,
+    const DmlGpuEvent& gpu_event) const
+{
+    descriptor_ring_->Release(allocation, gpu_event);
+}
+
 DmlGpuEvent DMLDeviceContext::CopyBufferToBuffer(
     const D3D12BufferRegion& dst,
     const D3D12BufferRegion& src) const
@@ -18,9 +18,11 @@ limitations under the License.
 #include "dml_buffer.h"
 #include "dml_buffer_region.h"
 #include "dml_descriptor_bfc_allocator.h"
+#include "dml_descriptor_ring.h"
 #include "dml_event_queue.h"
 #include "dml_execution_context.h"
 #include "dml_readback_heap.h"
+#include "dml_temporary_heap.h"
 #include "dml_upload_heap.h"
 #include "tfdml/runtime_adapter/tensor.h"
 
@@ -41,8 +43,10 @@ class DMLDeviceContext
     DmlEventQueue* event_queue_;
     DmlUploadHeap* upload_heap_;
     DmlReadbackHeap* readback_heap_;
+    DmlTemporaryHeap* temporary_heap_;
     DmlAllocator* allocator_;
     DmlDescriptorAllocator* descriptor_allocator_;
+    DmlDescriptorRing* descriptor_ring_;
 
   public:
     DMLDeviceContext(
@@ -50,14 +54,18 @@ class DMLDeviceContext
         DmlEventQueue* event_queue,
         DmlUploadHeap* upload_heap,
         DmlReadbackHeap* readback_heap,
+        DmlTemporaryHeap* temporary_heap,
         DmlAllocator* allocator,
-        DmlDescriptorAllocator* descriptor_allocator)
+        DmlDescriptorAllocator* descriptor_allocator,
+        DmlDescriptorRing* descriptor_ring)
         : execution_context_(execution_context),
           event_queue_(event_queue),
           upload_heap_(upload_heap),
           readback_heap_(readback_heap),
+          temporary_heap_(temporary_heap),
           allocator_(allocator),
-          descriptor_allocator_(descriptor_allocator)
+          descriptor_allocator_(descriptor_allocator),
+          descriptor_ring_(descriptor_ring)
     {
     }
 
@@ -81,11 +89,17 @@ class DMLDeviceContext
         absl::Span<const Tensor> device_tensors,
         absl::Span<Tensor> cpu_tensors);
 
+    // Begins copying CPU memory to the device without waiting for the copy to
+    // complete. The CPU memory can be released or modified as soon as this
+    // returns, unless the copy is `stream_ordered`: the CPU memory must then
+    // stay unchanged until the stream has completed the copy, which lets memory
+    // from the host staging pool be copied by the GPU directly.
     Status CopyCPUMemoryToDevice(
         DmlDevice* device,
         const void* cpu_memory,
         SP_DeviceMemoryBase* device_memory,
-        uint64_t size_in_bytes) const;
+        uint64_t size_in_bytes,
+        bool stream_ordered) const;
 
     StatusOr<DmlGpuEvent> CopyDeviceMemoryToCPU(
         DmlDevice* device,
@@ -93,6 +107,13 @@ class DMLDeviceContext
         void* cpu_memory,
         uint64_t size_in_bytes);
 
+    // Blocks until a readback returned by CopyDeviceMemoryToCPU completes. Only
+    // the work that the readback depends on is flushed and waited for; work
+    // recorded after it keeps running.
+    Status WaitForReadback(
+        DmlDevice* device,
+        const DmlGpuEvent& readback_event);
+
     void CopyMemoryInSameDevice(
         DmlDevice* device,
         const SP_DeviceMemoryBase* input_memory,
@@ -121,6 +142,24 @@ class DMLDeviceContext
         absl::Span<const absl::optional<DML_BUFFER_BINDING>> input_bindings,
         absl::Span<const absl::optional<DML_BUFFER_BINDING>> output_bindings);
 
+    // Same as BindAndExecuteOperator, but for a binding table that's reused
+    // across executions and already has the operator's persistent resource
+    // bound. Only the temporary resource, inputs, and outputs are rebound.
+    DmlGpuEvent RebindAndExecuteOperator(
+        IDMLCompiledOperator* op,
+        Microsoft::WRL::ComPtr<IDMLBindingTable>&& binding_table,
+        ID3D12DescriptorHeap* heap_for_binding_table,
+        _In_opt_ const DML_BUFFER_BINDING* temporary_resource_binding,
+        absl::Span<const absl::optional<DML_BUFFER_BINDING>> input_bindings,
+        absl::Span<const absl::optional<DML_BUFFER_BINDING>> output_bindings);
+
+    // Reserves a temporary buffer which is only valid for the work queued by
+    // `execute`, and is recycled once that work completes on the GPU. See
+    // DmlTemporaryHeap::ExecuteWithTemporaryBuffer.
+    StatusOr<DmlGpuEvent> ExecuteWithTemporaryBuffer(
+        uint64_t size_in_bytes,
+        DmlTemporaryHeap::ExecuteFn execute) const;
+
     DmlGpuEvent InsertUavBarrier() const;
 
     DmlGpuEvent GetCurrentCompletionEvent() const;
@@ -154,6 +193,18 @@ class DMLDeviceContext
     // back to the pool.
     DescriptorAllocation AllocateDescriptors(size_t size_in_descriptors) const;
 
+    // Allocates a range of descriptors that only needs to live until the work
+    // it's bound to completes, or returns nullopt if the descriptor ring is
+    // full. The range must be released with ReleaseTransientDescriptors once
+    // that work has been queued.
+    absl::optional<DmlDescriptorRing::Allocation>
+    TryAllocateTransientDescriptors(uint32_t size_in_descriptors) const;
+
+    // Returns the descriptors to the ring once gpu_event is signaled.
+    void ReleaseTransientDescriptors(
+        const DmlDescriptorRing::Allocation& allocation,
+        const DmlGpuEvent& gpu_event) const;
+
     // Copies src to dst (dst needs to be at least as big as src).
     DmlGpuEvent CopyBufferToBuffer(
         const D3D12BufferRegion& dst,
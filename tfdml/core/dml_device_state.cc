@@ -17,11 +17,16 @@ limitations under the License.
 
 #include "dml_adapter_impl.h"
 #include "dml_bfc_allocator.h"
+#include "dml_compile_pool.h"
+#include "dml_counters.h"
 #include "dml_descriptor_bfc_allocator.h"
+#include "dml_descriptor_ring.h"
 #include "dml_device_context.h"
 #include "dml_event_queue.h"
+#include "dml_host_staging_pool.h"
 #include "dml_kernel_manager.h"
 #include "dml_readback_heap.h"
+#include "dml_temporary_heap.h"
 #include "dml_upload_heap.h"
 #include "dml_util.h"
 #include "tfdml/core/dml_dso_loader.h"
@@ -147,24 +152,132 @@ namespace tfdml
         descriptor_heap_allocator.get(),
         "DmlDescriptorAllocator");
 
+    auto counters = std::make_shared<DmlCounters>();
+
     auto execution_context = absl::make_unique<DmlExecutionContext>(
         d3d_device.Get(),
         dml_device.Get(),
-        command_queue.Get());
+        command_queue.Get(),
+        counters);
 
     auto event_queue = absl::make_unique<DmlEventQueue>(
+        execution_context->GetCurrentCompletionEvent().fence.Get(),
+        counters);
+
+    auto descriptor_ring = absl::make_unique<DmlDescriptorRing>(
+        d3d_device.Get(),
         execution_context->GetCurrentCompletionEvent().fence.Get());
 
+    // Transfers on a dedicated copy queue overlap with compute work, but need
+    // the two queues to wait for each other's conflicting work, so they're
+    // opt-in until that has seen more use on real hardware.
+    bool use_copy_queue;
+    s = ReadBoolFromEnvVar(
+        "TF_DIRECTML_USE_COPY_QUEUE",
+        false,
+        &use_copy_queue);
+
+    ComPtr<ID3D12CommandQueue> copy_command_queue;
+    std::unique_ptr<DmlExecutionContext> copy_execution_context;
+    std::unique_ptr<DmlEventQueue> copy_event_queue;
+
+    if (use_copy_queue)
+    {
+        D3D12_COMMAND_QUEUE_DESC copy_command_queue_desc = command_queue_desc;
+        copy_command_queue_desc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+
+        DML_CHECK_SUCCEEDED(d3d_device->CreateCommandQueue(
+            &copy_command_queue_desc,
+            IID_PPV_ARGS(&copy_command_queue)));
+
+        copy_execution_context = absl::make_unique<DmlExecutionContext>(
+            d3d_device.Get(),
+            dml_device.Get(),
+            copy_command_queue.Get(),
+            counters);
+
+        copy_event_queue = absl::make_unique<DmlEventQueue>(
+            copy_execution_context->GetCurrentCompletionEvent().fence.Get(),
+            counters);
+
+        // Each context waits for the other's work on any buffer range that it
+        // touches. Tile mappings for new allocations are done on the compute
+        // queue, so the copy queue also waits for them before using memory.
+        execution_context->SetPeer(copy_execution_context.get());
+        copy_execution_context->SetPeer(execution_context.get());
+        copy_execution_context->SetQueueDependency(
+            [allocator = heap_allocator.get()]
+            { return allocator->GetTileMappingCompletionEvent(); });
+    }
+
+    DmlExecutionContext* transfer_execution_context =
+        copy_execution_context ? copy_execution_context.get()
+                               : execution_context.get();
+
+    DmlEventQueue* transfer_event_queue =
+        copy_event_queue ? copy_event_queue.get() : event_queue.get();
+
+    bool use_host_staging_pool;
+    s = ReadBoolFromEnvVar(
+        "TF_DIRECTML_USE_HOST_STAGING_POOL",
+        true,
+        &use_host_staging_pool);
+
+    std::unique_ptr<DmlHostStagingPool> host_staging_pool;
+    if (use_host_staging_pool)
+    {
+        // Free staging blocks beyond this limit are released rather than kept
+        // around for reuse
+        int64_t retention_limit_in_mb = 0;
+        s = ReadInt64FromEnvVar(
+            "TF_DIRECTML_HOST_STAGING_RETENTION_MB",
+            256,
+            &retention_limit_in_mb);
+
+        uint64_t retention_limit_in_bytes =
+            retention_limit_in_mb > 0
+                ? static_cast<uint64_t>(retention_limit_in_mb) << 20
+                : 0;
+
+        host_staging_pool = absl::make_unique<DmlHostStagingPool>(
+            d3d_device.Get(),
+            retention_limit_in_bytes);
+    }
+
     auto upload_heap = absl::make_unique<DmlUploadHeap>(
         d3d_device.Get(),
-        execution_context.get());
+        transfer_execution_context,
+        host_staging_pool.get(),
+        counters.get());
 
     auto readback_heap = absl::make_unique<DmlReadbackHeap>(
         d3d_device.Get(),
-        execution_context.get(),
-        event_queue.get());
-
-    auto kernel_manager = absl::make_unique<DmlKernelManager>();
+        transfer_execution_context,
+        transfer_event_queue,
+        host_staging_pool.get(),
+        counters.get());
+
+    auto temporary_heap =
+        absl::make_unique<DmlTemporaryHeap>(d3d_device.Get());
+
+    auto kernel_manager = absl::make_unique<DmlKernelManager>(
+        execution_context->GetCurrentCompletionEvent().fence.Get(),
+        counters.get());
+
+    // Operator compilations run on the executor threads that miss the kernel
+    // cache unless a compile pool is requested
+    int64_t compile_thread_count = 0;
+    s = ReadInt64FromEnvVar(
+        "TF_DIRECTML_KERNEL_COMPILE_THREADS",
+        0,
+        &compile_thread_count);
+
+    std::unique_ptr<DmlCompilePool> compile_pool;
+    if (compile_thread_count > 0)
+    {
+        compile_pool = absl::make_unique<DmlCompilePool>(
+            static_cast<uint32_t>(compile_thread_count));
+    }
 
     // Construct the final state object
     auto state = absl::make_unique<DmlDeviceState>();
@@ -173,15 +286,23 @@ namespace tfdml
     state->command_queue = std::move(command_queue);
     state->sharing_contract = std::move(sharing_contract);
     state->dml_device = std::move(dml_device);
+    state->counters = std::move(counters);
     state->execution_context = std::move(execution_context);
     state->event_queue = std::move(event_queue);
+    state->copy_command_queue = std::move(copy_command_queue);
+    state->copy_execution_context = std::move(copy_execution_context);
+    state->copy_event_queue = std::move(copy_event_queue);
     state->heap_allocator = std::move(heap_allocator);
     state->dml_allocator = std::move(dml_allocator);
     state->descriptor_heap_allocator = std::move(descriptor_heap_allocator);
     state->descriptor_allocator = std::move(descriptor_allocator);
+    state->descriptor_ring = std::move(descriptor_ring);
+    state->host_staging_pool = std::move(host_staging_pool);
     state->upload_heap = std::move(upload_heap);
     state->readback_heap = std::move(readback_heap);
+    state->temporary_heap = std::move(temporary_heap);
     state->kernel_manager = std::move(kernel_manager);
+    state->compile_pool = std::move(compile_pool);
     return state;
 }
 
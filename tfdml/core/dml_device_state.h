@@ -23,14 +23,19 @@ namespace tfdml
 {
 
 class DmlAdapter;
+class DmlCompilePool;
+class DmlCounters;
 class DmlExecutionContext;
 class DmlEventQueue;
 class D3D12HeapAllocator;
 class DmlAllocator;
 class D3D12DescriptorHeapAllocator;
 class DmlDescriptorAllocator;
+class DmlDescriptorRing;
+class DmlHostStagingPool;
 class DmlUploadHeap;
 class DmlReadbackHeap;
+class DmlTemporaryHeap;
 class DmlKernelManager;
 class GPUOptions;
 
@@ -54,15 +59,31 @@ struct DmlDeviceState
     Microsoft::WRL::ComPtr<ID3D12CommandQueue> command_queue;
     Microsoft::WRL::ComPtr<ID3D12SharingContract> sharing_contract;
     Microsoft::WRL::ComPtr<IDMLDevice> dml_device;
+
+    // Dispatch pipeline counters. They're shared with the background threads of
+    // the execution contexts and event queues, which may outlive the state.
+    std::shared_ptr<DmlCounters> counters;
+
     std::unique_ptr<DmlExecutionContext> execution_context;
     std::unique_ptr<DmlEventQueue> event_queue;
+
+    // Uploads and readbacks run on a dedicated copy queue, so they can overlap
+    // with compute work. These are null if the copy queue is disabled.
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> copy_command_queue;
+    std::unique_ptr<DmlExecutionContext> copy_execution_context;
+    std::unique_ptr<DmlEventQueue> copy_event_queue;
+
     std::unique_ptr<D3D12HeapAllocator> heap_allocator;
     std::unique_ptr<DmlAllocator> dml_allocator;
     std::unique_ptr<D3D12DescriptorHeapAllocator> descriptor_heap_allocator;
     std::unique_ptr<DmlDescriptorAllocator> descriptor_allocator;
+    std::unique_ptr<DmlDescriptorRing> descriptor_ring;
+    std::unique_ptr<DmlHostStagingPool> host_staging_pool; // May be null
     std::unique_ptr<DmlUploadHeap> upload_heap;
     std::unique_ptr<DmlReadbackHeap> readback_heap;
+    std::unique_ptr<DmlTemporaryHeap> temporary_heap;
     std::unique_ptr<DmlKernelManager> kernel_manager;
+    std::unique_ptr<DmlCompilePool> compile_pool; // May be null
 };
 
 } // namespace tfdml
\ No newline at end of file
@@ -20,10 +20,13 @@ limitations under the License.
 namespace tfdml
 {
 
-DmlEventQueue::DmlEventQueue(ID3D12Fence* fence)
+DmlEventQueue::DmlEventQueue(
+    ID3D12Fence* fence,
+    std::shared_ptr<DmlCounters> counters)
 {
     shared_state_ = std::make_shared<SharedState>();
     shared_state_->fence = fence;
+    shared_state_->counters = std::move(counters);
 
     // Launch the thread, supplying it with a pointer to the shared state
     thread_ = std::thread(ThreadProc, shared_state_);
@@ -68,6 +71,11 @@ void DmlEventQueue::Enqueue(DmlGpuEvent gpu_event, DoneCallback done_callback)
             gpu_event.fence_value,
             Event{std::move(done_callback)});
         state->new_event_enqueued.notify_all();
+
+        state->counters->Increment(DmlCounter::EventQueueDepth);
+        state->counters->UpdateMax(
+            DmlCounter::EventQueueMaxDepth,
+            state->counters->GetValue(DmlCounter::EventQueueDepth));
     }
     else
     {
@@ -144,6 +152,9 @@ void DmlEventQueue::Enqueue(DmlGpuEvent gpu_event, DoneCallback done_callback)
             events_to_process.push_back(std::move(it->second));
         }
         state->events_by_fence_value.erase(begin, end);
+        state->counters->Subtract(
+            DmlCounter::EventQueueDepth,
+            events_to_process.size());
 
         // Process the events by invoking their done callback
         for (const auto& event : events_to_process)
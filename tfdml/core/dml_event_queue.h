@@ -18,9 +18,11 @@ limitations under the License.
 #include <condition_variable>
 #include <functional>
 #include <map>
+#include <memory>
 #include <thread>
 
 #include "dml_common.h"
+#include "dml_counters.h"
 #include "dml_gpu_event.h"
 
 namespace tfdml
@@ -29,13 +31,14 @@ namespace tfdml
 // Allows for queueing CPU work in response to a signaled GPU event. Each
 // instance of this queue can only be used with a single fence, and the fence's
 // signaled values are assumed to only ever increase in a monotonic fashion.
-// This class is thread-safe.
+// The number of queued callbacks is tracked in the device's counters. This
+// class is thread-safe.
 class DmlEventQueue
 {
   public:
     using DoneCallback = std::function<void()>;
 
-    explicit DmlEventQueue(ID3D12Fence* fence);
+    DmlEventQueue(ID3D12Fence* fence, std::shared_ptr<DmlCounters> counters);
     ~DmlEventQueue();
 
     // Enqueues an arbitrary callback to fire once the given GPU event becomes
@@ -67,6 +70,10 @@ class DmlEventQueue
         uint64_t current_awaited_fence_value = 0;
 
         bool exit_requested = false;
+
+        // Shared with the device, because the detached thread may still update
+        // the counters after the device has been destroyed.
+        std::shared_ptr<DmlCounters> counters;
     };
 
     static void ThreadProc(std::shared_ptr<SharedState> state);
@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "dml_execution_context.h"
 
+#include "absl/memory/memory.h"
 #include "dml_bfc_allocator.h"
 #include "dml_buffer.h"
 #include "dml_tracing.h"
@@ -33,10 +34,15 @@ static SetThreadDescriptionFn g_setThreadDescription = nullptr;
 namespace tfdml
 {
 
+// The minimum size of the blocks allocated by a batch's command arena
+static constexpr size_t command_arena_block_size = 4096;
+
 DmlExecutionContext::DmlExecutionContext(
     ID3D12Device* d3d_device,
     IDMLDevice* dml_device,
-    ID3D12CommandQueue* queue)
+    ID3D12CommandQueue* queue,
+    std::shared_ptr<DmlCounters> counters)
+    : last_tracked_fence_value_(0)
 {
 #if _WIN32
     auto kernel32_handle_or = DmlCachedDsoLoader::GetKernel32DsoHandle();
@@ -53,11 +59,13 @@ DmlExecutionContext::DmlExecutionContext(
     dml_command_queue_ = std::make_shared<DmlCommandQueue>(queue);
 
     batch_state_ = std::make_shared<BatchState>();
+    batch_state_->counters = std::move(counters);
     batch_state_->next_flush_event =
         dml_command_queue_->GetCurrentCompletionEvent();
     ++batch_state_->next_flush_event.fence_value;
 
-    uint32_t batch_flush_size = default_batch_flush_size;
+    // Explicitly configured flush targets are used as-is instead of adapting
+    DmlFlushPolicy& flush_policy = batch_state_->flush_policy;
     {
         int64_t batch_flush_size_int64 = 0;
         Status s = ReadInt64FromEnvVar(
@@ -66,11 +74,12 @@ DmlExecutionContext::DmlExecutionContext(
             &batch_flush_size_int64);
         if (s.ok() && batch_flush_size_int64 != 0)
         {
-            batch_flush_size = static_cast<uint32_t>(batch_flush_size_int64);
+            flush_policy.batch_flush_size =
+                static_cast<uint32_t>(batch_flush_size_int64);
+            flush_policy.adaptive_batch_flush_size = false;
         }
     }
 
-    uint32_t batch_flush_time_us = default_batch_flush_time_us;
     {
         int64_t batch_flush_time_us_int64 = 0;
         Status s = ReadInt64FromEnvVar(
@@ -79,8 +88,9 @@ DmlExecutionContext::DmlExecutionContext(
             &batch_flush_time_us_int64);
         if (s.ok() && batch_flush_time_us_int64 != 0)
         {
-            batch_flush_time_us =
-                static_cast<uint32_t>(batch_flush_time_us_int64);
+            flush_policy.batch_flush_time =
+                std::chrono::microseconds(batch_flush_time_us_int64);
+            flush_policy.adaptive_batch_flush_time = false;
         }
     }
 
@@ -93,9 +103,7 @@ DmlExecutionContext::DmlExecutionContext(
         ExecutionThreadProc,
         batch_state_,
         dml_command_list_,
-        dml_command_queue_,
-        batch_flush_size,
-        batch_flush_time_us);
+        dml_command_queue_);
 }
 
 DmlExecutionContext::~DmlExecutionContext()
@@ -104,6 +112,7 @@ DmlExecutionContext::~DmlExecutionContext()
     std::unique_lock<std::mutex> lock(batch_state_->mutex);
     batch_state_->exit_requested = true;
     batch_state_->command_added.notify_all(); // wake the thread
+    batch_state_->batch_flushed.notify_all();
     lock.unlock();
 
     // detach() rather than join(), because we don't want (or need) to wait for
@@ -121,22 +130,51 @@ DmlGpuEvent DmlExecutionContext::CopyBufferRegionRaw(
     D3D12_RESOURCE_STATES src_state,
     uint64_t byte_count)
 {
-    std::unique_lock<std::mutex> lock(batch_state_->mutex);
+    return AddCopyBufferRegion(
+        dst_buffer,
+        dst_offset,
+        dst_state,
+        dst_buffer,
+        src_buffer,
+        src_offset,
+        src_state,
+        src_buffer,
+        byte_count);
+}
 
-    batch_state_->WriteBatch().emplace_back(
-        [=](DmlCommandList& command_list)
-        {
-            command_list.CopyBufferRegion(
-                dst_buffer,
-                dst_offset,
-                dst_state,
-                src_buffer,
-                src_offset,
-                src_state,
-                byte_count);
-        });
+DmlGpuEvent DmlExecutionContext::AddCopyBufferRegion(
+    ID3D12Resource* dst_buffer,
+    uint64_t dst_offset,
+    D3D12_RESOURCE_STATES dst_state,
+    ID3D12Resource* dst_memory,
+    ID3D12Resource* src_buffer,
+    uint64_t src_offset,
+    D3D12_RESOURCE_STATES src_state,
+    ID3D12Resource* src_memory,
+    uint64_t byte_count)
+{
+    DmlBufferAccess accesses[] = {
+        {src_memory, src_offset, byte_count, false},
+        {dst_memory, dst_offset, byte_count, true}};
+    auto peer_dependency = GetPeerDependency(accesses);
 
-    batch_state_->command_added.notify_all();
+    std::unique_lock<std::mutex> lock(batch_state_->mutex);
+
+    auto& args = PrepareWriteBatch(lock, accesses, peer_dependency)
+                     .AddCommand(CommandType::CopyBufferRegion)
+                     .copy_buffer_region;
+    args.dst_buffer = dst_buffer;
+    args.dst_offset = dst_offset;
+    args.dst_state = dst_state;
+    args.src_buffer = src_buffer;
+    args.src_offset = src_offset;
+    args.src_state = src_state;
+    args.byte_count = byte_count;
+    args.dst_memory = dst_memory;
+    args.src_memory = src_memory;
+    args.correlation_id = DmlTracing::Instance().GetCurrentCorrelationId();
+
+    OnCommandAdded();
 
     return batch_state_->next_flush_event;
 }
@@ -147,36 +185,91 @@ DmlGpuEvent DmlExecutionContext::CopyBufferRegion(
 {
     CHECK(src.SizeInBytes() <= dst.SizeInBytes());
 
-    return CopyBufferRegionRaw(
+    // The copy resources alias the memory of the resource in the UAV state, if
+    // the region has one, which is what the operators that read and write the
+    // region are bound to.
+    ID3D12Resource* dst_memory = dst.ResourceInUavState()
+                                     ? dst.ResourceInUavState()
+                                     : dst.ResourceInCopyDstState();
+    ID3D12Resource* src_memory = src.ResourceInUavState()
+                                     ? src.ResourceInUavState()
+                                     : src.ResourceInCopySrcState();
+
+    return AddCopyBufferRegion(
         dst.ResourceInCopyDstState(),
         dst.Offset(),
         D3D12_RESOURCE_STATE_COPY_DEST,
+        dst_memory,
         src.ResourceInCopySrcState(),
         src.Offset(),
         D3D12_RESOURCE_STATE_COPY_SOURCE,
+        src_memory,
         src.SizeInBytes());
 }
 
+DmlGpuEvent DmlExecutionContext::CopyToStagingBuffer(
+    ID3D12Resource* staging_buffer,
+    uint64_t staging_offset,
+    const D3D12BufferRegion& src)
+{
+    ID3D12Resource* src_memory = src.ResourceInUavState()
+                                     ? src.ResourceInUavState()
+                                     : src.ResourceInCopySrcState();
+
+    return AddCopyBufferRegion(
+        staging_buffer,
+        staging_offset,
+        D3D12_RESOURCE_STATE_COMMON,
+        staging_buffer,
+        src.ResourceInCopySrcState(),
+        src.Offset(),
+        D3D12_RESOURCE_STATE_COPY_SOURCE,
+        src_memory,
+        src.SizeInBytes());
+}
+
+DmlGpuEvent DmlExecutionContext::CopyFromStagingBuffer(
+    const D3D12BufferRegion& dst,
+    ID3D12Resource* staging_buffer,
+    uint64_t staging_offset)
+{
+    ID3D12Resource* dst_memory = dst.ResourceInUavState()
+                                     ? dst.ResourceInUavState()
+                                     : dst.ResourceInCopyDstState();
+
+    return AddCopyBufferRegion(
+        dst.ResourceInCopyDstState(),
+        dst.Offset(),
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        dst_memory,
+        staging_buffer,
+        staging_offset,
+        D3D12_RESOURCE_STATE_COMMON,
+        staging_buffer,
+        dst.SizeInBytes());
+}
+
 DmlGpuEvent DmlExecutionContext::FillBufferWithPatternRaw(
     ID3D12Resource* dst,
     uint64_t dst_offset,
     uint64_t dst_size_in_bytes,
     absl::Span<const uint8_t> value)
 {
+    DmlBufferAccess access = {dst, dst_offset, dst_size_in_bytes, true};
+    auto peer_dependency = GetPeerDependency({access});
+
     std::unique_lock<std::mutex> lock(batch_state_->mutex);
 
-    absl::InlinedVector<uint8_t, 16> value_copy(value.begin(), value.end());
-    batch_state_->WriteBatch().emplace_back(
-        [=, value = std::move(value_copy)](DmlCommandList& command_list)
-        {
-            command_list.FillBufferWithPattern(
-                dst,
-                dst_offset,
-                dst_size_in_bytes,
-                value);
-        });
+    Batch& batch = PrepareWriteBatch(lock, {access}, peer_dependency);
+    auto& args = batch.AddCommand(CommandType::FillBufferWithPattern)
+                     .fill_buffer_with_pattern;
+    args.dst = dst;
+    args.dst_offset = dst_offset;
+    args.dst_size_in_bytes = dst_size_in_bytes;
+    args.value = batch.Arena().Copy(value);
+    args.value_size = value.size();
 
-    batch_state_->command_added.notify_all();
+    OnCommandAdded();
 
     return batch_state_->next_flush_event;
 }
@@ -188,17 +281,14 @@ DmlGpuEvent DmlExecutionContext::InitializeOperator(
 {
     std::unique_lock<std::mutex> lock(batch_state_->mutex);
 
-    batch_state_->WriteBatch().emplace_back(
-        [=,
-         binding_table = std::move(binding_table)](DmlCommandList& command_list)
-        {
-            command_list.InitializeOperator(
-                initializer,
-                binding_table.Get(),
-                descriptor_heap);
-        });
+    auto& args = batch_state_->WriteBatch()
+                     .AddCommand(CommandType::InitializeOperator)
+                     .initialize_operator;
+    args.initializer = initializer;
+    args.binding_table = binding_table.Detach();
+    args.descriptor_heap = descriptor_heap;
 
-    batch_state_->command_added.notify_all();
+    OnCommandAdded();
 
     return batch_state_->next_flush_event;
 }
@@ -206,20 +296,24 @@ DmlGpuEvent DmlExecutionContext::InitializeOperator(
 DmlGpuEvent DmlExecutionContext::ExecuteOperator(
     IDMLCompiledOperator* op,
     Microsoft::WRL::ComPtr<IDMLBindingTable>&& binding_table,
-    ID3D12DescriptorHeap* descriptor_heap)
+    ID3D12DescriptorHeap* descriptor_heap,
+    absl::Span<const DmlBufferAccess> accesses)
 {
+    auto peer_dependency = GetPeerDependency(accesses);
+
     std::unique_lock<std::mutex> lock(batch_state_->mutex);
 
-    batch_state_->WriteBatch().emplace_back(
-        [=, binding_table = std::move(binding_table)](
-            DmlCommandList& command_list) {
-            command_list.ExecuteOperator(
-                op,
-                binding_table.Get(),
-                descriptor_heap);
-        });
+    Batch& batch = PrepareWriteBatch(lock, accesses, peer_dependency);
+    auto& args =
+        batch.AddCommand(CommandType::ExecuteOperator).execute_operator;
+    args.op = op;
+    args.binding_table = binding_table.Detach();
+    args.descriptor_heap = descriptor_heap;
+    args.accesses = batch.Arena().Copy(accesses);
+    args.access_count = accesses.size();
+    args.correlation_id = DmlTracing::Instance().GetCurrentCorrelationId();
 
-    batch_state_->command_added.notify_all();
+    OnCommandAdded();
 
     return batch_state_->next_flush_event;
 }
@@ -230,16 +324,14 @@ DmlGpuEvent DmlExecutionContext::ResourceBarrier(
     std::unique_lock<std::mutex> lock(batch_state_->mutex);
 
     // The caller may not keep the barriers referenced by the span alive for
-    // longer than this function call, so make a copy and transfer ownership to
-    // the lambda.
-    absl::InlinedVector<D3D12_RESOURCE_BARRIER, 4> barriers_copy(
-        barriers.begin(),
-        barriers.end());
-    batch_state_->WriteBatch().emplace_back(
-        [=, barriers = std::move(barriers_copy)](DmlCommandList& command_list)
-        { command_list.ResourceBarrier(barriers); });
+    // longer than this function call, so make a copy in the batch's arena.
+    Batch& batch = batch_state_->WriteBatch();
+    auto& args =
+        batch.AddCommand(CommandType::ResourceBarrier).resource_barrier;
+    args.barriers = batch.Arena().Copy(barriers);
+    args.barrier_count = barriers.size();
 
-    batch_state_->command_added.notify_all();
+    OnCommandAdded();
 
     return batch_state_->next_flush_event;
 }
@@ -248,10 +340,30 @@ DmlGpuEvent DmlExecutionContext::UavBarrier()
 {
     std::unique_lock<std::mutex> lock(batch_state_->mutex);
 
-    batch_state_->WriteBatch().emplace_back([=](DmlCommandList& command_list)
-                                            { command_list.UavBarrier(); });
+    batch_state_->WriteBatch().AddCommand(CommandType::UavBarrier);
 
-    batch_state_->command_added.notify_all();
+    OnCommandAdded();
+
+    return batch_state_->next_flush_event;
+}
+
+DmlGpuEvent DmlExecutionContext::WriteTimestamp(
+    ID3D12QueryHeap* query_heap,
+    uint32_t query_index,
+    ID3D12Resource* dst_buffer,
+    uint64_t dst_offset)
+{
+    std::unique_lock<std::mutex> lock(batch_state_->mutex);
+
+    auto& args = batch_state_->WriteBatch()
+                     .AddCommand(CommandType::WriteTimestamp)
+                     .write_timestamp;
+    args.query_heap = query_heap;
+    args.query_index = query_index;
+    args.dst_buffer = dst_buffer;
+    args.dst_offset = dst_offset;
+
+    OnCommandAdded();
 
     return batch_state_->next_flush_event;
 }
@@ -270,6 +382,20 @@ StatusOr<DmlGpuEvent> DmlExecutionContext::Flush()
     return event;
 }
 
+Status DmlExecutionContext::FlushUntil(const DmlGpuEvent& gpu_event)
+{
+    std::unique_lock<std::mutex> lock(batch_state_->mutex);
+    if (gpu_event.fence == batch_state_->next_flush_event.fence &&
+        gpu_event.fence_value >= batch_state_->next_flush_event.fence_value &&
+        !batch_state_->WriteBatch().empty())
+    {
+        batch_state_->flush_requested = true;
+        batch_state_->command_added.notify_all();
+    }
+
+    return batch_state_->status;
+}
+
 Status DmlExecutionContext::GetCommandRecorderStatus() const
 {
     std::unique_lock<std::mutex> lock(batch_state_->mutex);
@@ -287,6 +413,308 @@ DmlGpuEvent DmlExecutionContext::GetCurrentCompletionEvent()
     return event;
 }
 
+void* DmlExecutionContext::CommandArena::Allocate(
+    size_t size,
+    size_t alignment)
+{
+    // Move on to the next block (reusing the blocks from previous batches)
+    // until one has enough room, and only allocate a new block if none does.
+    while (current_block_ < blocks_.size())
+    {
+        Block& block = blocks_[current_block_];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+        size_t offset =
+            ((base + current_offset_ + alignment - 1) & ~(alignment - 1)) -
+            base;
+
+        if (offset + size <= block.size)
+        {
+            current_offset_ = offset + size;
+            return block.data.get() + offset;
+        }
+
+        ++current_block_;
+        current_offset_ = 0;
+    }
+
+    Block block = {};
+    block.size = std::max(command_arena_block_size, size + alignment);
+    block.data = absl::make_unique<uint8_t[]>(block.size);
+    blocks_.push_back(std::move(block));
+
+    return Allocate(size, alignment);
+}
+
+void DmlExecutionContext::CommandArena::Reset()
+{
+    current_block_ = 0;
+    current_offset_ = 0;
+}
+
+void DmlExecutionContext::Batch::Record(DmlCommandList& command_list) const
+{
+    for (const Command& command : commands_)
+    {
+        switch (command.type)
+        {
+        case CommandType::CopyBufferRegion: {
+            const auto& args = command.copy_buffer_region;
+            DmlBufferAccess accesses[] = {
+                {args.src_memory, args.src_offset, args.byte_count, false},
+                {args.dst_memory, args.dst_offset, args.byte_count, true}};
+            command_list.CopyBufferRegion(
+                args.dst_buffer,
+                args.dst_offset,
+                args.dst_state,
+                args.src_buffer,
+                args.src_offset,
+                args.src_state,
+                args.byte_count,
+                accesses,
+                args.correlation_id);
+            break;
+        }
+
+        case CommandType::FillBufferWithPattern: {
+            const auto& args = command.fill_buffer_with_pattern;
+            command_list.FillBufferWithPattern(
+                args.dst,
+                args.dst_offset,
+                args.dst_size_in_bytes,
+                absl::MakeConstSpan(args.value, args.value_size));
+            break;
+        }
+
+        case CommandType::InitializeOperator: {
+            const auto& args = command.initialize_operator;
+            command_list.InitializeOperator(
+                args.initializer,
+                args.binding_table,
+                args.descriptor_heap);
+            break;
+        }
+
+        case CommandType::ExecuteOperator: {
+            const auto& args = command.execute_operator;
+            command_list.ExecuteOperator(
+                args.op,
+                args.binding_table,
+                args.descriptor_heap,
+                absl::MakeConstSpan(args.accesses, args.access_count),
+                args.correlation_id);
+            break;
+        }
+
+        case CommandType::ResourceBarrier: {
+            const auto& args = command.resource_barrier;
+            command_list.ResourceBarrier(
+                absl::MakeConstSpan(args.barriers, args.barrier_count));
+            break;
+        }
+
+        case CommandType::UavBarrier: {
+            command_list.UavBarrier();
+            break;
+        }
+
+        case CommandType::WriteTimestamp: {
+            const auto& args = command.write_timestamp;
+            command_list.WriteTimestamp(
+                args.query_heap,
+                args.query_index,
+                args.dst_buffer,
+                args.dst_offset);
+            break;
+        }
+        }
+    }
+}
+
+void DmlExecutionContext::Batch::Reset()
+{
+    for (const Command& command : commands_)
+    {
+        IDMLBindingTable* binding_table = nullptr;
+        if (command.type == CommandType::InitializeOperator)
+        {
+            binding_table = command.initialize_operator.binding_table;
+        }
+        else if (command.type == CommandType::ExecuteOperator)
+        {
+            binding_table = command.execute_operator.binding_table;
+        }
+
+        if (binding_table)
+        {
+            binding_table->Release();
+        }
+    }
+
+    commands_.clear();
+    arena_.Reset();
+    accesses_.clear();
+    waits_.clear();
+}
+
+void DmlExecutionContext::SetPeer(DmlExecutionContext* peer)
+{
+    std::unique_lock<std::mutex> lock(batch_state_->mutex);
+    peer_ = peer;
+    batch_state_->track_accesses = true;
+}
+
+void DmlExecutionContext::SetQueueDependency(
+    std::function<DmlGpuEvent()> queue_dependency)
+{
+    std::unique_lock<std::mutex> lock(batch_state_->mutex);
+    batch_state_->queue_dependency = std::move(queue_dependency);
+}
+
+void DmlExecutionContext::CalibrateGpuTimeline()
+{
+    if (auto* gpu_timeline = dml_command_list_->GetGpuTimeline())
+    {
+        gpu_timeline->Calibrate();
+    }
+}
+
+std::vector<DmlGpuTimeline::Event> DmlExecutionContext::TakeGpuTimelineEvents()
+{
+    auto* gpu_timeline = dml_command_list_->GetGpuTimeline();
+    if (!gpu_timeline)
+    {
+        return {};
+    }
+
+    auto flush_event_or = Flush();
+    if (flush_event_or.ok())
+    {
+        flush_event_or.ValueOrDie().WaitForSignal();
+    }
+
+    return gpu_timeline->TakeCompletedEvents();
+}
+
+static bool Conflicts(
+    absl::Span<const DmlBufferAccess> lhs,
+    absl::Span<const DmlBufferAccess> rhs)
+{
+    for (const auto& a : lhs)
+    {
+        for (const auto& b : rhs)
+        {
+            if (a.resource == b.resource && (a.is_write || b.is_write) &&
+                a.offset < b.offset + b.size_in_bytes &&
+                b.offset < a.offset + a.size_in_bytes)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+absl::optional<DmlGpuEvent> DmlExecutionContext::FindConflictingWork(
+    absl::Span<const DmlBufferAccess> accesses)
+{
+    // Most of the time all of the tracked work has completed, which doesn't
+    // need the lock to find out.
+    uint64_t last_tracked_fence_value = last_tracked_fence_value_.load();
+    uint64_t completed_fence_value =
+        dml_command_queue_->GetFence()->GetCompletedValue();
+    if (accesses.empty() || last_tracked_fence_value <= completed_fence_value)
+    {
+        return absl::nullopt;
+    }
+
+    std::unique_lock<std::mutex> lock(batch_state_->mutex);
+
+    auto& in_flight_accesses = batch_state_->in_flight_accesses;
+    while (!in_flight_accesses.empty() &&
+           in_flight_accesses.front().fence_value <= completed_fence_value)
+    {
+        in_flight_accesses.pop_front();
+    }
+
+    // The most recent work is checked first, since its event is signaled last
+    if (Conflicts(batch_state_->WriteBatch().Accesses(), accesses))
+    {
+        batch_state_->write_batch_has_dependents = true;
+        batch_state_->flush_requested = true;
+        batch_state_->command_added.notify_all();
+        return batch_state_->next_flush_event;
+    }
+
+    for (auto it = in_flight_accesses.rbegin(); it != in_flight_accesses.rend();
+         ++it)
+    {
+        if (Conflicts(it->accesses, accesses))
+        {
+            DmlGpuEvent gpu_event = batch_state_->next_flush_event;
+            gpu_event.fence_value = it->fence_value;
+            return gpu_event;
+        }
+    }
+
+    return absl::nullopt;
+}
+
+DmlExecutionContext::Batch& DmlExecutionContext::PrepareWriteBatch(
+    std::unique_lock<std::mutex>& lock,
+    absl::Span<const DmlBufferAccess> accesses,
+    const absl::optional<DmlGpuEvent>& peer_dependency)
+{
+    if (peer_dependency && batch_state_->write_batch_has_dependents)
+    {
+        // The peer waits for the write batch, so the batch can't also wait for
+        // the peer. Flush it and add the command to the next one instead.
+        uint64_t fence_value = batch_state_->next_flush_event.fence_value;
+        batch_state_->flush_requested = true;
+        batch_state_->command_added.notify_all();
+        batch_state_->batch_flushed.wait(
+            lock,
+            [&]
+            {
+                return batch_state_->next_flush_event.fence_value !=
+                           fence_value ||
+                       batch_state_->exit_requested ||
+                       !batch_state_->status.ok();
+            });
+    }
+
+    Batch& batch = batch_state_->WriteBatch();
+
+    if (peer_dependency)
+    {
+        batch.AddWait(*peer_dependency);
+    }
+
+    if (batch_state_->track_accesses && !accesses.empty())
+    {
+        batch.AddAccesses(accesses);
+        last_tracked_fence_value_.store(
+            batch_state_->next_flush_event.fence_value);
+    }
+
+    return batch;
+}
+
+void DmlExecutionContext::Batch::AddWait(const DmlGpuEvent& gpu_event)
+{
+    // Waiting for a fence value also waits for all of the lower ones
+    for (auto& wait : waits_)
+    {
+        if (wait.fence.Get() == gpu_event.fence.Get())
+        {
+            wait.fence_value = std::max(wait.fence_value, gpu_event.fence_value);
+            return;
+        }
+    }
+
+    waits_.push_back(gpu_event);
+}
+
 D3D12_COMMAND_LIST_TYPE DmlExecutionContext::GetCommandListTypeForQueue() const
 {
     // No need to acquire the lock since the queue type is immutable once the
@@ -294,12 +722,40 @@ D3D12_COMMAND_LIST_TYPE DmlExecutionContext::GetCommandListTypeForQueue() const
     return dml_command_queue_->GetType();
 }
 
+uint64_t DmlExecutionContext::GetTimestampFrequency() const
+{
+    // The frequency of a queue is fixed, so the lock isn't needed either
+    return dml_command_queue_->GetTimestampFrequency();
+}
+
+void DmlExecutionContext::OnCommandAdded()
+{
+    // The execution thread waits indefinitely while the write batch is empty,
+    // and otherwise only until the flush deadline; it just needs to be woken
+    // up early if the batch has become large enough to flush.
+    size_t batch_size = batch_state_->WriteBatch().size();
+    if (batch_size == 1 ||
+        batch_size >= batch_state_->flush_policy.batch_flush_size)
+    {
+        batch_state_->command_added.notify_all();
+    }
+}
+
+// Adds the time since `wait_start` to the time the execution thread waited
+// for commands.
+static void AddWaitTime(
+    DmlCounters* counters,
+    std::chrono::steady_clock::time_point wait_start)
+{
+    auto wait_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - wait_start);
+    counters->Add(DmlCounter::ExecutionThreadWaitNs, wait_time.count());
+}
+
 /*static*/ void DmlExecutionContext::ExecutionThreadProc(
     std::shared_ptr<BatchState> state,
     std::shared_ptr<DmlCommandList> command_list,
-    std::shared_ptr<DmlCommandQueue> command_queue,
-    uint32_t batch_flush_size,
-    uint32_t batch_flush_time_us)
+    std::shared_ptr<DmlCommandQueue> command_queue)
 {
 #if _WIN32
     if (g_setThreadDescription)
@@ -312,10 +768,6 @@ D3D12_COMMAND_LIST_TYPE DmlExecutionContext::GetCommandListTypeForQueue() const
 
     while (true)
     {
-        std::chrono::duration<double> elapsed =
-            std::chrono::steady_clock::now() - last_flush_time;
-        auto elapsed_us = elapsed.count() * 1e6;
-
         std::unique_lock<std::mutex> lock(state->mutex);
         if (state->exit_requested)
         {
@@ -327,7 +779,9 @@ D3D12_COMMAND_LIST_TYPE DmlExecutionContext::GetCommandListTypeForQueue() const
         if (batch.empty())
         {
             // Wait for new work to be batched.
+            auto wait_start = std::chrono::steady_clock::now();
             state->command_added.wait(lock);
+            AddWaitTime(state->counters.get(), wait_start);
 
             // Return to the top in case of spurious wakeup.
             continue;
@@ -338,44 +792,100 @@ D3D12_COMMAND_LIST_TYPE DmlExecutionContext::GetCommandListTypeForQueue() const
         // has reached a certain size, or enough time has elapsed since the last
         // flush. The goal here is to balance feeding the GPU work while the CPU
         // is processing more commands and avoiding many small packets.
-        bool flush = false;
-        if (state->flush_requested || batch.size() >= batch_flush_size ||
-            elapsed_us >= batch_flush_time_us)
+        auto flush_deadline =
+            last_flush_time + state->flush_policy.batch_flush_time;
+
+        if (!state->flush_requested &&
+            batch.size() < state->flush_policy.batch_flush_size &&
+            std::chrono::steady_clock::now() < flush_deadline)
+        {
+            // Sleep until the deadline, unless a flush is triggered sooner.
+            auto wait_start = std::chrono::steady_clock::now();
+            state->command_added.wait_until(lock, flush_deadline);
+            AddWaitTime(state->counters.get(), wait_start);
+            continue;
+        }
+
+        DmlCounters* counters = state->counters.get();
+        if (state->flush_requested)
+        {
+            counters->Increment(DmlCounter::FlushesRequested);
+        }
+        else if (batch.size() >= state->flush_policy.batch_flush_size)
         {
-            state->write_batch_index = (state->write_batch_index + 1) % 2;
-            flush = true;
-            ++state->next_flush_event.fence_value;
+            counters->Increment(DmlCounter::FlushesForSize);
         }
+        else
+        {
+            counters->Increment(DmlCounter::FlushesForTime);
+        }
+        counters->Increment(DmlCounter::BatchesFlushed);
+        counters->Add(DmlCounter::CommandsFlushed, batch.size());
+
+        if (state->track_accesses)
+        {
+            state->in_flight_accesses.push_back(
+                {state->next_flush_event.fence_value, batch.TakeAccesses()});
+        }
+
+        absl::optional<DmlGpuEvent> queue_dependency;
+        if (state->queue_dependency)
+        {
+            queue_dependency = state->queue_dependency();
+        }
+
+        uint64_t fence_value = state->next_flush_event.fence_value;
+        state->write_batch_index = (state->write_batch_index + 1) % 2;
+        ++state->next_flush_event.fence_value;
         state->flush_requested = false;
+        state->write_batch_has_dependents = false;
+        state->batch_flushed.notify_all();
 
         // Unlock to allow kernels to resume writing to the new write batch.
         lock.unlock();
 
-        if (flush)
+        DmlTracing::Instance().LogExecutionContextFlush(
+            batch.size(),
+            fence_value);
+        // Record the commands into the command list.
+        command_list->Open();
+        batch.Record(*command_list);
+        auto status = command_list->Close();
+
+        if (!status.ok())
         {
-            DmlTracing::Instance().LogExecutionContextFlush();
-            // Record the commands into the command list.
-            command_list->Open();
-            for (auto& command : batch)
-            {
-                command(*command_list);
-            }
-            auto status = command_list->Close();
+            lock.lock();
+            state->status = status;
+            state->batch_flushed.notify_all();
+            lock.unlock();
+            break;
+        }
 
-            if (!status.ok())
+        // The number of earlier submissions the GPU is still working on
+        uint64_t fence_lag = command_queue->GetLastFenceValue() -
+                             command_queue->GetFence()->GetCompletedValue();
+
+        // Wait for the work on other queues that the batch depends on
+        for (const DmlGpuEvent& wait : batch.Waits())
+        {
+            if (!wait.IsSignaled())
             {
-                lock.lock();
-                state->status = status;
-                lock.unlock();
-                break;
+                command_queue->Wait(wait);
             }
+        }
+        if (queue_dependency && !queue_dependency->IsSignaled())
+        {
+            command_queue->Wait(*queue_dependency);
+        }
 
-            ID3D12CommandList* command_lists[] = {command_list->Get()};
-            command_queue->ExecuteCommandLists(command_lists);
+        ID3D12CommandList* command_lists[] = {command_list->Get()};
+        command_queue->ExecuteCommandLists(command_lists);
 
-            batch.clear();
-            last_flush_time = std::chrono::steady_clock::now();
-        }
+        batch.Reset();
+        last_flush_time = std::chrono::steady_clock::now();
+
+        lock.lock();
+        state->flush_policy.Update(fence_lag);
     }
 }
 
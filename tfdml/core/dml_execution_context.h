@@ -15,8 +15,13 @@ limitations under the License.
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
+#include <memory>
 #include <thread>
 #include <vector>
 
@@ -25,7 +30,9 @@ limitations under the License.
 #include "dml_command_list.h"
 #include "dml_command_queue.h"
 #include "dml_common.h"
+#include "dml_counters.h"
 #include "dml_descriptor_pool.h"
+#include "dml_flush_policy.h"
 #include "tfdml/runtime_adapter/statusor.h"
 
 namespace tfdml
@@ -40,19 +47,21 @@ class DmlCommandQueue;
 // keep GPU resource arguments (buffers, heaps, DML ops, etc.) alive until they
 // have finished executing on the GPU; the returned GPU event, when signaled,
 // indicates when the submitted work has finished and the associated objects are
-// safe to release.
+// safe to release. Flushes are tallied in the device's counters.
 class DmlExecutionContext
 {
   public:
     DmlExecutionContext(
         ID3D12Device* d3d12_device,
         IDMLDevice* dml_device,
-        ID3D12CommandQueue* queue);
+        ID3D12CommandQueue* queue,
+        std::shared_ptr<DmlCounters> counters);
 
     ~DmlExecutionContext();
 
     // NOTE: the caller is responsible for keeping the dst_buffer/src_buffer
-    // resources alive until the returned GPU event has completed.
+    // resources alive until the returned GPU event has completed. The
+    // resources must not alias the memory of other resources.
     DmlGpuEvent CopyBufferRegionRaw(
         ID3D12Resource* dst_buffer,
         uint64_t dst_offset,
@@ -66,10 +75,25 @@ class DmlExecutionContext
         const D3D12BufferRegion& dst,
         const D3D12BufferRegion& src);
 
+    // Copies between a buffer region and a host staging buffer (see
+    // DmlHostStagingPool), which is always in the COMMON state. The caller is
+    // responsible for keeping the staging buffer alive until the returned GPU
+    // event has completed.
+    DmlGpuEvent CopyToStagingBuffer(
+        ID3D12Resource* staging_buffer,
+        uint64_t staging_offset,
+        const D3D12BufferRegion& src);
+
+    DmlGpuEvent CopyFromStagingBuffer(
+        const D3D12BufferRegion& dst,
+        ID3D12Resource* staging_buffer,
+        uint64_t staging_offset);
+
     // NOTE: the caller is responsible for keeping the dst resource alive until
     // the returned GPU event has completed. A copy of the value span will be
     // made, so the pointed-to value is safe to release immediately after
-    // calling this method.
+    // calling this method. If dst aliases the memory of other resources, it
+    // must be the resource in the UAV state.
     DmlGpuEvent FillBufferWithPatternRaw(
         ID3D12Resource* dst,
         uint64_t dst_offset,
@@ -97,11 +121,14 @@ class DmlExecutionContext
 
     // NOTE: the caller is responsible for keeping the op and descriptor_heap
     // alive until the returned GPU event has completed. This class takes
-    // ownership of the binding table.
+    // ownership of the binding table. The accesses describe every buffer bound
+    // to the operator, and are used to decide whether the execution must wait
+    // on earlier commands; a copy of the span will be made.
     DmlGpuEvent ExecuteOperator(
         IDMLCompiledOperator* op,
         Microsoft::WRL::ComPtr<IDMLBindingTable>&& binding_table,
-        ID3D12DescriptorHeap* descriptor_heap);
+        ID3D12DescriptorHeap* descriptor_heap,
+        absl::Span<const DmlBufferAccess> accesses);
 
     // NOTE: A copy of the barriers span will be made, so the pointed-to value
     // is safe to release immediately after calling this method.
@@ -112,23 +139,245 @@ class DmlExecutionContext
     // span only includes a UAV barrier (elides an extra copy).
     DmlGpuEvent UavBarrier();
 
+    // Records a GPU timestamp into the query of the heap, and resolves it into
+    // the dst buffer once the returned event is signaled (see
+    // DmlCommandList::WriteTimestamp). The caller is responsible for keeping
+    // the query heap and dst buffer alive until then.
+    DmlGpuEvent WriteTimestamp(
+        ID3D12QueryHeap* query_heap,
+        uint32_t query_index,
+        ID3D12Resource* dst_buffer,
+        uint64_t dst_offset);
+
     // Indicates that any batched commands should be recorded and executed as
     // soon as possible, even if the batch is small. This is a no-op if nothing
     // is batched.
     StatusOr<DmlGpuEvent> Flush();
 
+    // Requests a flush of the batch that signals `gpu_event`, if that batch
+    // hasn't been flushed yet. Unlike Flush, this doesn't cut short a batch
+    // that only holds commands recorded after the event's batch. Events of
+    // other execution contexts are ignored.
+    Status FlushUntil(const DmlGpuEvent& gpu_event);
+
     Status GetCommandRecorderStatus() const;
 
     DmlGpuEvent GetCurrentCompletionEvent();
 
     D3D12_COMMAND_LIST_TYPE GetCommandListTypeForQueue() const;
 
+    // Returns the rate, in ticks per second, of the timestamps written by
+    // WriteTimestamp.
+    uint64_t GetTimestampFrequency() const;
+
+    // Orders the work of this context against the work of a peer context that
+    // executes on a different queue (e.g. a copy queue). A command that
+    // accesses memory which the peer's incomplete work writes, or that writes
+    // memory the peer's incomplete work reads, waits for that work on the GPU
+    // before executing. Both contexts must be peered with each other, and must
+    // outlive each other's use.
+    void SetPeer(DmlExecutionContext* peer);
+
+    // Sets a function returning an event that each batch waits for on the GPU
+    // before executing, e.g. the completion of tile mapping updates made on
+    // another queue.
+    void SetQueueDependency(std::function<DmlGpuEvent()> queue_dependency);
+
+    // Copies and operator executions recorded while a profiler event is active
+    // on the calling thread are timed on the GPU (see DmlGpuTimeline). This
+    // samples the GPU clock that their timestamps are converted from.
+    void CalibrateGpuTimeline();
+
+    // Flushes the recorded work, waits for it to complete, and returns the
+    // GPU timeline events that completed since the last call.
+    std::vector<DmlGpuTimeline::Event> TakeGpuTimelineEvents();
+
   private:
-    static constexpr uint32_t default_batch_flush_size = 100;
-    static constexpr uint32_t default_batch_flush_time_us = 1000;
+    enum class CommandType : uint8_t
+    {
+        CopyBufferRegion,
+        FillBufferWithPattern,
+        InitializeOperator,
+        ExecuteOperator,
+        ResourceBarrier,
+        UavBarrier,
+        WriteTimestamp,
+    };
+
+    struct CopyBufferRegionArgs
+    {
+        ID3D12Resource* dst_buffer;
+        uint64_t dst_offset;
+        D3D12_RESOURCE_STATES dst_state;
+        ID3D12Resource* src_buffer;
+        uint64_t src_offset;
+        D3D12_RESOURCE_STATES src_state;
+        uint64_t byte_count;
+
+        // The resources that identify the memory of the buffers when tracking
+        // accesses (see DmlBufferAccess).
+        ID3D12Resource* dst_memory;
+        ID3D12Resource* src_memory;
+
+        uint64_t correlation_id;
+    };
+
+    struct FillBufferWithPatternArgs
+    {
+        ID3D12Resource* dst;
+        uint64_t dst_offset;
+        uint64_t dst_size_in_bytes;
+        const uint8_t* value; // Allocated from the batch's arena
+        size_t value_size;
+    };
+
+    struct InitializeOperatorArgs
+    {
+        IDMLOperatorInitializer* initializer;
+        IDMLBindingTable* binding_table; // Owned by the batch
+        ID3D12DescriptorHeap* descriptor_heap;
+    };
+
+    struct ExecuteOperatorArgs
+    {
+        IDMLCompiledOperator* op;
+        IDMLBindingTable* binding_table; // Owned by the batch
+        ID3D12DescriptorHeap* descriptor_heap;
+        const DmlBufferAccess* accesses; // Allocated from the batch's arena
+        size_t access_count;
+        uint64_t correlation_id;
+    };
+
+    struct ResourceBarrierArgs
+    {
+        const D3D12_RESOURCE_BARRIER* barriers; // Allocated from the arena
+        size_t barrier_count;
+    };
+
+    struct WriteTimestampArgs
+    {
+        ID3D12QueryHeap* query_heap;
+        uint32_t query_index;
+        ID3D12Resource* dst_buffer;
+        uint64_t dst_offset;
+    };
+
+    // A batched command. Commands are plain records rather than closures so
+    // that queueing one never allocates: their variable-length arguments are
+    // copied into the batch's arena instead.
+    struct Command
+    {
+        CommandType type;
+        union
+        {
+            CopyBufferRegionArgs copy_buffer_region;
+            FillBufferWithPatternArgs fill_buffer_with_pattern;
+            InitializeOperatorArgs initialize_operator;
+            ExecuteOperatorArgs execute_operator;
+            ResourceBarrierArgs resource_barrier;
+            WriteTimestampArgs write_timestamp;
+        };
+    };
+
+    // A bump allocator for the variable-length arguments of a batch's
+    // commands. Reset() makes all of the memory available again without
+    // freeing it, so once the arena has grown to fit a batch, subsequent
+    // batches don't allocate at all.
+    class CommandArena
+    {
+      public:
+        void* Allocate(size_t size, size_t alignment);
+        void Reset();
+
+        template <typename T>
+        const T* Copy(absl::Span<const T> values)
+        {
+            static_assert(
+                std::is_trivially_copyable<T>::value,
+                "Arena values must be trivially copyable");
 
-    using Command = std::function<void(DmlCommandList&)>;
-    using Batch = absl::InlinedVector<Command, default_batch_flush_size>;
+            void* data = Allocate(values.size() * sizeof(T), alignof(T));
+            std::copy(values.begin(), values.end(), static_cast<T*>(data));
+            return static_cast<const T*>(data);
+        }
+
+      private:
+        struct Block
+        {
+            std::unique_ptr<uint8_t[]> data;
+            size_t size;
+        };
+
+        std::vector<Block> blocks_;
+        size_t current_block_ = 0;
+        size_t current_offset_ = 0;
+    };
+
+    class Batch
+    {
+      public:
+        Batch()
+        {
+            commands_.reserve(DmlFlushPolicy::default_batch_flush_size);
+        }
+        ~Batch() { Reset(); }
+
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+        Command& AddCommand(CommandType type)
+        {
+            commands_.emplace_back();
+            commands_.back().type = type;
+            return commands_.back();
+        }
+
+        CommandArena& Arena() { return arena_; }
+
+        // Records all of the commands in the batch into the command list.
+        void Record(DmlCommandList& command_list) const;
+
+        // Removes all commands from the batch and releases the binding tables
+        // it owns, while keeping its memory for reuse.
+        void Reset();
+
+        bool empty() const { return commands_.empty(); }
+        size_t size() const { return commands_.size(); }
+
+        // The memory accessed by the batch's commands, which is only tracked
+        // when the context has a peer.
+        void AddAccesses(absl::Span<const DmlBufferAccess> accesses)
+        {
+            accesses_.insert(accesses_.end(), accesses.begin(), accesses.end());
+        }
+        const std::vector<DmlBufferAccess>& Accesses() const
+        {
+            return accesses_;
+        }
+        std::vector<DmlBufferAccess> TakeAccesses()
+        {
+            return std::move(accesses_);
+        }
+
+        // Events on other queues that must be signaled before the batch
+        // executes.
+        void AddWait(const DmlGpuEvent& gpu_event);
+        absl::Span<const DmlGpuEvent> Waits() const { return waits_; }
+
+      private:
+        std::vector<Command> commands_;
+        CommandArena arena_;
+        std::vector<DmlBufferAccess> accesses_;
+        absl::InlinedVector<DmlGpuEvent, 2> waits_;
+    };
+
+    // The memory accessed by a batch that was submitted to the GPU, which is
+    // kept until the batch completes.
+    struct InFlightAccesses
+    {
+        uint64_t fence_value;
+        std::vector<DmlBufferAccess> accesses;
+    };
 
     // State related to the batching of commands, which may be accessed by
     // both external threads (e.g. DML kernels) and the internal execution
@@ -145,23 +394,85 @@ class DmlExecutionContext
         uint32_t write_batch_index = 0;
         Batch& WriteBatch() { return batches[write_batch_index]; }
 
+        DmlFlushPolicy flush_policy;
+
         bool exit_requested = false;
         bool flush_requested = false;
 
         Status status;
+
+        // Only set when the context has a peer.
+        bool track_accesses = false;
+        std::deque<InFlightAccesses> in_flight_accesses;
+
+        // Whether the peer has work waiting for the write batch, in which case
+        // commands that must wait for the peer go into a later batch: otherwise
+        // the queues would wait for each other.
+        bool write_batch_has_dependents = false;
+
+        // Notified whenever the write batch is swapped out to be executed
+        std::condition_variable batch_flushed;
+
+        std::function<DmlGpuEvent()> queue_dependency;
+
+        // Shared with the device, because the detached execution thread may
+        // still update the counters after the device has been destroyed.
+        std::shared_ptr<DmlCounters> counters;
     };
 
+    // Wakes up the execution thread if the command that was just added to the
+    // write batch requires it. The caller must hold the batch state's mutex.
+    void OnCommandAdded();
+
+    // Returns the event of this context's incomplete work that conflicts with
+    // the accesses, if there is any. If the work hasn't been flushed yet, a
+    // flush is requested. Called by the peer without holding its own lock.
+    absl::optional<DmlGpuEvent> FindConflictingWork(
+        absl::Span<const DmlBufferAccess> accesses);
+
+    // Returns the write batch for a command with the given accesses, after
+    // making it wait for any conflicting work of the peer. The caller must
+    // hold the batch state's mutex (through `lock`), and `peer_dependency`
+    // must have been obtained from the peer before taking it.
+    Batch& PrepareWriteBatch(
+        std::unique_lock<std::mutex>& lock,
+        absl::Span<const DmlBufferAccess> accesses,
+        const absl::optional<DmlGpuEvent>& peer_dependency);
+
+    absl::optional<DmlGpuEvent> GetPeerDependency(
+        absl::Span<const DmlBufferAccess> accesses)
+    {
+        return peer_ ? peer_->FindConflictingWork(accesses) : absl::nullopt;
+    }
+
+    // Same as CopyBufferRegionRaw, but with the resources that identify the
+    // memory of the buffers when they differ from the resources being copied.
+    DmlGpuEvent AddCopyBufferRegion(
+        ID3D12Resource* dst_buffer,
+        uint64_t dst_offset,
+        D3D12_RESOURCE_STATES dst_state,
+        ID3D12Resource* dst_memory,
+        ID3D12Resource* src_buffer,
+        uint64_t src_offset,
+        D3D12_RESOURCE_STATES src_state,
+        ID3D12Resource* src_memory,
+        uint64_t byte_count);
+
     std::shared_ptr<BatchState> batch_state_;
     std::shared_ptr<DmlCommandQueue> dml_command_queue_;
     std::shared_ptr<DmlCommandList> dml_command_list_;
     std::thread execution_thread_;
 
+    DmlExecutionContext* peer_ = nullptr;
+
+    // The fence value of the latest batch with tracked accesses, which lets
+    // the peer skip taking the lock when all of them have completed.
+    std::atomic<uint64_t> last_tracked_fence_value_;
+
     static void ExecutionThreadProc(
         std::shared_ptr<BatchState> batch_state,
         std::shared_ptr<DmlCommandList> command_list,
-        std::shared_ptr<DmlCommandQueue> command_queue,
-        uint32_t batch_flush_size,
-        uint32_t batch_flush_time_us);
+        std::shared_ptr<DmlCommandQueue> command_queue);
 };
 
 } // namespace tfdml
@@ -0,0 +1,66 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "dml_flush_policy.h"
+
+#include <algorithm>
+
+namespace tfdml
+{
+
+// Bounds of the adaptive flush targets
+static constexpr uint32_t min_batch_flush_size = 10;
+static constexpr uint32_t max_batch_flush_size = 1000;
+static constexpr std::chrono::microseconds min_batch_flush_time(100);
+static constexpr std::chrono::microseconds max_batch_flush_time(10000);
+
+// The number of incomplete submissions above which the GPU is considered to be
+// falling behind
+static constexpr uint64_t max_fence_lag = 2;
+
+void DmlFlushPolicy::Update(uint64_t fence_lag)
+{
+    if (fence_lag == 0)
+    {
+        // The GPU has already finished everything it was given
+        if (adaptive_batch_flush_size)
+        {
+            batch_flush_size =
+                std::max(batch_flush_size / 2, min_batch_flush_size);
+        }
+
+        if (adaptive_batch_flush_time)
+        {
+            batch_flush_time =
+                std::max(batch_flush_time / 2, min_batch_flush_time);
+        }
+    }
+    else if (fence_lag > max_fence_lag)
+    {
+        if (adaptive_batch_flush_size)
+        {
+            batch_flush_size =
+                std::min(batch_flush_size * 2, max_batch_flush_size);
+        }
+
+        if (adaptive_batch_flush_time)
+        {
+            batch_flush_time =
+                std::min(batch_flush_time * 2, max_batch_flush_time);
+        }
+    }
+}
+
+} // namespace tfdml
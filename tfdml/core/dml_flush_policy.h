@@ -0,0 +1,48 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace tfdml
+{
+
+// Decides when the batched commands of a DmlExecutionContext are flushed to the
+// GPU. A batch is flushed once it holds batch_flush_size commands or
+// batch_flush_time has elapsed since the previous flush. Unless they're fixed
+// by the TF_DIRECTML_BATCH_FLUSH_SIZE and TF_DIRECTML_BATCH_FLUSH_TIME
+// environment variables, both targets adapt to how far the GPU lags behind the
+// submitted work: when the GPU has caught up it's starved for work, so smaller
+// batches are flushed sooner; when it's falling behind, larger batches amortize
+// the cost of each submission.
+struct DmlFlushPolicy
+{
+    static constexpr uint32_t default_batch_flush_size = 100;
+    static constexpr uint32_t default_batch_flush_time_us = 1000;
+
+    uint32_t batch_flush_size = default_batch_flush_size;
+    std::chrono::microseconds batch_flush_time = std::chrono::microseconds(
+        static_cast<int64_t>(default_batch_flush_time_us));
+    bool adaptive_batch_flush_size = true;
+    bool adaptive_batch_flush_time = true;
+
+    // Adjusts the targets after a flush, given the number of submissions which
+    // haven't completed on the GPU yet.
+    void Update(uint64_t fence_lag);
+};
+
+} // namespace tfdml
@@ -0,0 +1,292 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#include "dml_gpu_timeline.h"
+
+#include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "dml_command_queue.h"
+
+namespace tfdml
+{
+
+DmlGpuTimeline::DmlGpuTimeline(
+    ID3D12Device* d3d_device,
+    std::shared_ptr<DmlCommandQueue> queue)
+    : d3d_device_(d3d_device),
+      queue_(std::move(queue)),
+      query_heap_type_(
+          queue_->GetType() == D3D12_COMMAND_LIST_TYPE_COPY
+              ? D3D12_QUERY_HEAP_TYPE_COPY_QUEUE_TIMESTAMP
+              : D3D12_QUERY_HEAP_TYPE_TIMESTAMP)
+{
+}
+
+/*static*/ bool DmlGpuTimeline::IsSupported(
+    ID3D12Device* d3d_device,
+    D3D12_COMMAND_LIST_TYPE command_list_type)
+{
+    if (command_list_type != D3D12_COMMAND_LIST_TYPE_COPY)
+    {
+        return true;
+    }
+
+    D3D12_FEATURE_DATA_D3D12_OPTIONS3 options3 = {};
+    if (FAILED(d3d_device->CheckFeatureSupport(
+            D3D12_FEATURE_D3D12_OPTIONS3,
+            &options3,
+            sizeof(options3))))
+    {
+        return false;
+    }
+
+    return options3.CopyQueueTimestampQueriesSupported;
+}
+
+absl::optional<uint32_t> DmlGpuTimeline::BeginCommand(
+    ID3D12GraphicsCommandList* command_list,
+    uint64_t correlation_id)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (!current_query_heap_)
+    {
+        current_query_heap_ = AcquireQueryHeap();
+        if (!current_query_heap_)
+        {
+            return absl::nullopt;
+        }
+    }
+
+    auto& query_pairs = current_query_heap_->query_pairs;
+    if ((query_pairs.size() + 1) * 2 > kQueriesPerHeap)
+    {
+        return absl::nullopt;
+    }
+
+    uint32_t start_query_index = static_cast<uint32_t>(query_pairs.size() * 2);
+    query_pairs.push_back(QueryPair{correlation_id, start_query_index});
+
+    command_list->EndQuery(
+        current_query_heap_->query_heap.Get(),
+        D3D12_QUERY_TYPE_TIMESTAMP,
+        start_query_index);
+
+    return start_query_index;
+}
+
+void DmlGpuTimeline::EndCommand(
+    ID3D12GraphicsCommandList* command_list,
+    uint32_t start_query_index)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    assert(current_query_heap_);
+
+    command_list->EndQuery(
+        current_query_heap_->query_heap.Get(),
+        D3D12_QUERY_TYPE_TIMESTAMP,
+        start_query_index + 1);
+}
+
+void DmlGpuTimeline::EndCommandList(
+    ID3D12GraphicsCommandList* command_list,
+    const DmlGpuEvent& completion_event)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (!current_query_heap_)
+    {
+        return;
+    }
+
+    command_list->ResolveQueryData(
+        current_query_heap_->query_heap.Get(),
+        D3D12_QUERY_TYPE_TIMESTAMP,
+        0,
+        static_cast<uint32_t>(current_query_heap_->query_pairs.size() * 2),
+        current_query_heap_->readback_buffer.Get(),
+        0);
+
+    current_query_heap_->completion_event = completion_event;
+    current_query_heap_ = nullptr;
+}
+
+void DmlGpuTimeline::Calibrate()
+{
+    ClockCalibration calibration = SampleClock();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    calibration_ = calibration;
+}
+
+std::vector<DmlGpuTimeline::Event> DmlGpuTimeline::TakeCompletedEvents()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    CollectCompletedHeaps();
+
+    std::vector<Event> events;
+    events.swap(completed_events_);
+    return events;
+}
+
+/*static*/ int64_t DmlGpuTimeline::ConvertToCpuTimestampNs(
+    uint64_t gpu_timestamp,
+    const ClockCalibration& calibration)
+{
+    // Timestamps may precede the calibration, so the difference is signed.
+    auto elapsed_ticks =
+        static_cast<int64_t>(gpu_timestamp - calibration.gpu_timestamp);
+    auto elapsed_ns = static_cast<double>(elapsed_ticks) * 1e9 /
+                      static_cast<double>(calibration.gpu_frequency);
+    return calibration.cpu_timestamp_ns + static_cast<int64_t>(elapsed_ns);
+}
+
+/*static*/ void DmlGpuTimeline::ResolveEvents(
+    absl::Span<const QueryPair> query_pairs,
+    absl::Span<const uint64_t> timestamps,
+    const ClockCalibration& calibration,
+    std::vector<Event>* events)
+{
+    for (const QueryPair& query_pair : query_pairs)
+    {
+        uint32_t end_query_index = query_pair.start_query_index + 1;
+        if (end_query_index >= timestamps.size())
+        {
+            continue;
+        }
+
+        // Queries that weren't written (e.g. the device was removed) resolve
+        // to zero, and shouldn't show up on the timeline.
+        uint64_t start_timestamp = timestamps[query_pair.start_query_index];
+        uint64_t end_timestamp = timestamps[end_query_index];
+        if (start_timestamp == 0 || end_timestamp < start_timestamp)
+        {
+            continue;
+        }
+
+        events->push_back(Event{
+            query_pair.correlation_id,
+            ConvertToCpuTimestampNs(start_timestamp, calibration),
+            ConvertToCpuTimestampNs(end_timestamp, calibration)});
+    }
+}
+
+DmlGpuTimeline::ClockCalibration DmlGpuTimeline::SampleClock() const
+{
+    ClockCalibration calibration = {};
+    uint64_t cpu_timestamp = 0;
+    queue_->GetClockCalibration(&calibration.gpu_timestamp, &cpu_timestamp);
+
+    // The CPU timestamp of the calibration is on the performance counter's
+    // clock, while the CPU events of the profiler are on the system clock, so
+    // the latter is sampled right after instead.
+    calibration.cpu_timestamp_ns = absl::GetCurrentTimeNanos();
+    calibration.gpu_frequency = queue_->GetTimestampFrequency();
+    return calibration;
+}
+
+DmlGpuTimeline::QueryHeap* DmlGpuTimeline::AcquireQueryHeap()
+{
+    // Timestamps are converted using the latest calibration, which is taken
+    // when the profiler starts, or else before the first timed command.
+    if (!calibration_)
+    {
+        calibration_ = SampleClock();
+    }
+
+    CollectCompletedHeaps();
+
+    for (size_t i = 0; i < query_heaps_.size(); ++i)
+    {
+        size_t index = (next_query_heap_ + i) % query_heaps_.size();
+        if (!query_heaps_[index]->completion_event)
+        {
+            next_query_heap_ = (index + 1) % query_heaps_.size();
+            return query_heaps_[index].get();
+        }
+    }
+
+    if (query_heaps_.size() == kMaxQueryHeaps)
+    {
+        return nullptr;
+    }
+
+    auto query_heap = absl::make_unique<QueryHeap>();
+
+    D3D12_QUERY_HEAP_DESC query_heap_desc = {};
+    query_heap_desc.Type = query_heap_type_;
+    query_heap_desc.Count = kQueriesPerHeap;
+
+    DML_CHECK_SUCCEEDED(d3d_device_->CreateQueryHeap(
+        &query_heap_desc,
+        IID_PPV_ARGS(&query_heap->query_heap)));
+
+    // Query data can only be resolved into buffers in the COPY_DEST state,
+    // which is also the only state allowed for readback heaps.
+    auto heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+    auto buffer_desc =
+        CD3DX12_RESOURCE_DESC::Buffer(kQueriesPerHeap * sizeof(uint64_t));
+
+    DML_CHECK_SUCCEEDED(d3d_device_->CreateCommittedResource(
+        &heap_properties,
+        D3D12_HEAP_FLAG_NONE,
+        &buffer_desc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&query_heap->readback_buffer)));
+
+    query_heap->query_pairs.reserve(kQueriesPerHeap / 2);
+
+    query_heaps_.push_back(std::move(query_heap));
+    next_query_heap_ = 0;
+    return query_heaps_.back().get();
+}
+
+void DmlGpuTimeline::CollectCompletedHeaps()
+{
+    for (auto& query_heap : query_heaps_)
+    {
+        if (!query_heap->completion_event ||
+            !query_heap->completion_event->IsSignaled())
+        {
+            continue;
+        }
+
+        auto query_count =
+            static_cast<uint32_t>(query_heap->query_pairs.size() * 2);
+
+        uint64_t* timestamps = nullptr;
+        D3D12_RANGE read_range = {0, query_count * sizeof(uint64_t)};
+        DML_CHECK_SUCCEEDED(query_heap->readback_buffer->Map(
+            0,
+            &read_range,
+            reinterpret_cast<void**>(&timestamps)));
+
+        ResolveEvents(
+            query_heap->query_pairs,
+            absl::MakeConstSpan(timestamps, query_count),
+            *calibration_,
+            &completed_events_);
+
+        D3D12_RANGE written_range = {0, 0};
+        query_heap->readback_buffer->Unmap(0, &written_range);
+
+        query_heap->query_pairs.clear();
+        query_heap->completion_event = absl::nullopt;
+    }
+}
+
+} // namespace tfdml
@@ -0,0 +1,154 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "dml_common.h"
+#include "dml_gpu_event.h"
+
+namespace tfdml
+{
+class DmlCommandQueue;
+
+// Records the GPU execution time of the commands of a command list, for the
+// device timeline of the TF profiler. Each bracketed command gets a pair of
+// timestamp queries, which are written into a ring of query heaps (one heap
+// per command list submission) and resolved when the command list is closed.
+// Once a submission completes on the GPU, its timestamps are converted to the
+// CPU clock and tagged with the correlation id of the CPU event that recorded
+// the command. Recording is done by the command list, while completed events
+// may be taken from any thread.
+class DmlGpuTimeline
+{
+  public:
+    // The GPU execution of a command, on the CPU clock.
+    struct Event
+    {
+        uint64_t correlation_id;
+        int64_t start_timestamp_ns;
+        int64_t end_timestamp_ns;
+    };
+
+    // A GPU timestamp and the CPU time at which it was sampled.
+    struct ClockCalibration
+    {
+        uint64_t gpu_timestamp;
+        int64_t cpu_timestamp_ns;
+        uint64_t gpu_frequency;
+    };
+
+    // A bracketed command, whose start and end timestamps are written into
+    // consecutive queries.
+    struct QueryPair
+    {
+        uint64_t correlation_id;
+        uint32_t start_query_index;
+    };
+
+    DmlGpuTimeline(
+        ID3D12Device* d3d_device,
+        std::shared_ptr<DmlCommandQueue> queue);
+
+    // Returns whether the timestamps of the command list type can be queried.
+    static bool IsSupported(
+        ID3D12Device* d3d_device,
+        D3D12_COMMAND_LIST_TYPE command_list_type);
+
+    // Writes the start timestamp of a command. Returns the index to pass to
+    // EndCommand, or nullopt if no query is available, in which case the
+    // command isn't timed.
+    absl::optional<uint32_t> BeginCommand(
+        ID3D12GraphicsCommandList* command_list,
+        uint64_t correlation_id);
+
+    void EndCommand(
+        ID3D12GraphicsCommandList* command_list,
+        uint32_t start_query_index);
+
+    // Resolves the timestamps written since the command list was opened. The
+    // completion event is the one signaled after the command list executes.
+    void EndCommandList(
+        ID3D12GraphicsCommandList* command_list,
+        const DmlGpuEvent& completion_event);
+
+    // Samples the GPU clock against the CPU clock. Timestamps that complete
+    // afterwards are converted using this calibration.
+    void Calibrate();
+
+    // Returns the events of the submissions which have completed on the GPU
+    // since the last call.
+    std::vector<Event> TakeCompletedEvents();
+
+    static int64_t ConvertToCpuTimestampNs(
+        uint64_t gpu_timestamp,
+        const ClockCalibration& calibration);
+
+    // Appends an event for each query pair, given the resolved timestamps of
+    // the queries. Pairs with invalid timestamps are skipped.
+    static void ResolveEvents(
+        absl::Span<const QueryPair> query_pairs,
+        absl::Span<const uint64_t> timestamps,
+        const ClockCalibration& calibration,
+        std::vector<Event>* events);
+
+  private:
+    // Bounds the GPU work that is timed per command list submission, and the
+    // number of submissions that are timed while they're in flight.
+    static constexpr uint32_t kQueriesPerHeap = 2048;
+    static constexpr size_t kMaxQueryHeaps = 8;
+
+    struct QueryHeap
+    {
+        Microsoft::WRL::ComPtr<ID3D12QueryHeap> query_heap;
+
+        // Holds the resolved timestamps of the queries in the same order.
+        Microsoft::WRL::ComPtr<ID3D12Resource> readback_buffer;
+
+        std::vector<QueryPair> query_pairs;
+
+        // Only set while the submission that uses the heap is in flight.
+        absl::optional<DmlGpuEvent> completion_event;
+    };
+
+    ClockCalibration SampleClock() const;
+
+    // Returns a heap that isn't used by an in-flight submission, or null if
+    // all of them are. The caller must hold the mutex.
+    QueryHeap* AcquireQueryHeap();
+
+    // Converts the timestamps of the heaps whose submissions have completed.
+    // The caller must hold the mutex.
+    void CollectCompletedHeaps();
+
+    Microsoft::WRL::ComPtr<ID3D12Device> d3d_device_;
+    std::shared_ptr<DmlCommandQueue> queue_;
+    D3D12_QUERY_HEAP_TYPE query_heap_type_;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<QueryHeap>> query_heaps_;
+    size_t next_query_heap_ = 0;
+    QueryHeap* current_query_heap_ = nullptr;
+    absl::optional<ClockCalibration> calibration_;
+    std::vector<Event> completed_events_;
+};
+
+} // namespace tfdml
@@ -0,0 +1,114 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#include "dml_gpu_timer.h"
+
+#include "dml_execution_context.h"
+
+namespace tfdml
+{
+
+DmlGpuTimer::DmlGpuTimer(
+    ID3D12Device* device,
+    DmlExecutionContext* execution_context)
+    : execution_context_(execution_context)
+{
+    D3D12_QUERY_HEAP_DESC query_heap_desc = {};
+    query_heap_desc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    query_heap_desc.Count = 2;
+
+    DML_CHECK_SUCCEEDED(
+        device->CreateQueryHeap(&query_heap_desc, IID_PPV_ARGS(&query_heap_)));
+
+    // Query data can only be resolved into buffers in the COPY_DEST state,
+    // which is also the only state allowed for readback heaps.
+    auto heap_properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+    auto buffer_desc =
+        CD3DX12_RESOURCE_DESC::Buffer(query_heap_desc.Count * sizeof(uint64_t));
+
+    DML_CHECK_SUCCEEDED(device->CreateCommittedResource(
+        &heap_properties,
+        D3D12_HEAP_FLAG_NONE,
+        &buffer_desc,
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(&readback_buffer_)));
+}
+
+void DmlGpuTimer::Start()
+{
+    (void)execution_context_->WriteTimestamp(
+        query_heap_.Get(),
+        kStartQueryIndex,
+        readback_buffer_.Get(),
+        kStartQueryIndex * sizeof(uint64_t));
+
+    started_ = true;
+    stop_event_ = absl::nullopt;
+}
+
+void DmlGpuTimer::Stop()
+{
+    if (!started_)
+    {
+        return;
+    }
+
+    // Both timestamps are resolved once the stop event is signaled, since the
+    // stop timestamp is written after the start timestamp on the same queue
+    stop_event_ = execution_context_->WriteTimestamp(
+        query_heap_.Get(),
+        kStopQueryIndex,
+        readback_buffer_.Get(),
+        kStopQueryIndex * sizeof(uint64_t));
+}
+
+uint64_t DmlGpuTimer::GetElapsedNanoseconds()
+{
+    if (!stop_event_)
+    {
+        return 0;
+    }
+
+    if (!execution_context_->FlushUntil(*stop_event_).ok())
+    {
+        return 0;
+    }
+
+    stop_event_->WaitForSignal();
+
+    uint64_t* timestamps = nullptr;
+    D3D12_RANGE read_range = {0, 2 * sizeof(uint64_t)};
+    DML_CHECK_SUCCEEDED(readback_buffer_->Map(
+        0,
+        &read_range,
+        reinterpret_cast<void**>(&timestamps)));
+    uint64_t start_ticks = timestamps[kStartQueryIndex];
+    uint64_t stop_ticks = timestamps[kStopQueryIndex];
+    D3D12_RANGE written_range = {0, 0};
+    readback_buffer_->Unmap(0, &written_range);
+
+    if (stop_ticks <= start_ticks)
+    {
+        return 0;
+    }
+
+    uint64_t frequency = execution_context_->GetTimestampFrequency();
+    return static_cast<uint64_t>(
+        static_cast<double>(stop_ticks - start_ticks) * 1e9 / frequency);
+}
+
+} // namespace tfdml
@@ -0,0 +1,56 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#pragma once
+
+#include "dml_common.h"
+#include "dml_gpu_event.h"
+
+namespace tfdml
+{
+
+class DmlExecutionContext;
+
+// Measures the GPU time between two points of the work recorded into an
+// execution context, using a pair of timestamp queries. Backs an SP_Timer.
+// This class is not thread-safe.
+class DmlGpuTimer
+{
+  public:
+    DmlGpuTimer(ID3D12Device* device, DmlExecutionContext* execution_context);
+
+    // Records the start and stop timestamps after all of the work recorded so
+    // far into the execution context.
+    void Start();
+    void Stop();
+
+    // Returns the GPU time between the start and stop timestamps, blocking
+    // until the stop timestamp has been written. Returns 0 if the timer hasn't
+    // been started and stopped.
+    uint64_t GetElapsedNanoseconds();
+
+  private:
+    static constexpr uint32_t kStartQueryIndex = 0;
+    static constexpr uint32_t kStopQueryIndex = 1;
+
+    DmlExecutionContext* execution_context_; // weak; owned by DmlDeviceState
+    Microsoft::WRL::ComPtr<ID3D12QueryHeap> query_heap_;
+    Microsoft::WRL::ComPtr<ID3D12Resource> readback_buffer_;
+    bool started_ = false;
+    absl::optional<DmlGpuEvent> stop_event_;
+};
+
+} // namespace tfdml
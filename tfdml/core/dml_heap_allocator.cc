@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "dml_heap_allocator.h"
 
+#include "absl/memory/memory.h"
 #include "dml_util.h"
 #include "tensorflow/c/logging.h"
 #include "tfdml/core/dml_tagged_pointer.h"
@@ -81,6 +82,37 @@ static uint64_t GetMaxHeapSizeInTiles()
     return D3D12HeapAllocator::kDefaultMaxHeapSizeInTiles;
 }
 
+static uint64_t GetMaxPoolSizeInBytes()
+{
+    int64_t override_value = -1;
+    Status s = ReadInt64FromEnvVar(
+        "TF_DIRECTML_HEAP_POOL_MAX_BYTES",
+        -1,
+        &override_value);
+    if (s.ok() && override_value >= 0)
+    {
+        return static_cast<uint64_t>(override_value);
+    }
+
+    return D3D12HeapAllocator::kDefaultMaxPoolSizeInBytes;
+}
+
+static std::chrono::milliseconds GetPoolRetentionTime()
+{
+    int64_t override_value = 0;
+    Status s = ReadInt64FromEnvVar(
+        "TF_DIRECTML_HEAP_POOL_RETENTION_MS",
+        0,
+        &override_value);
+    if (s.ok() && override_value > 0)
+    {
+        return std::chrono::milliseconds(override_value);
+    }
+
+    return std::chrono::milliseconds(
+        D3D12HeapAllocator::kDefaultPoolRetentionTimeMs);
+}
+
 D3D12HeapAllocator::D3D12HeapAllocator(
     ID3D12Device* device,
     ID3D12CommandQueue* queue,
@@ -95,10 +127,79 @@ D3D12HeapAllocator::D3D12HeapAllocator(
       resource_flags_(resource_flags),
       initial_state_(initial_state),
       tiling_enabled_(GetTilingEnabled(device)),
-      max_heap_size_in_tiles_(GetMaxHeapSizeInTiles())
+      max_heap_size_in_tiles_(GetMaxHeapSizeInTiles()),
+      max_pool_size_in_bytes_(GetMaxPoolSizeInBytes()),
+      pool_retention_time_(GetPoolRetentionTime()),
+      tile_mapping_fence_value_(0)
 {
     TF_VLog(1, "Tiling enabled = %d", tiling_enabled_);
     TF_VLog(1, "Max heap size in tiles = %llu", max_heap_size_in_tiles_);
+    TF_VLog(1, "Max heap pool size = %llu", max_pool_size_in_bytes_);
+
+    DML_CHECK_SUCCEEDED(device_->CreateFence(
+        0,
+        D3D12_FENCE_FLAG_NONE,
+        IID_PPV_ARGS(&tile_mapping_fence_)));
+
+    for (auto& segment : allocation_segments_)
+    {
+        segment.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+D3D12HeapAllocator::~D3D12HeapAllocator()
+{
+    for (auto& segment : allocation_segments_)
+    {
+        AllocationSegment* segment_ptr = segment.load();
+        if (!segment_ptr)
+        {
+            continue;
+        }
+
+        for (auto& slot : segment_ptr->slots)
+        {
+            delete slot.load();
+        }
+
+        delete segment_ptr;
+    }
+}
+
+std::atomic<D3D12HeapAllocator::Allocation*>& D3D12HeapAllocator::
+    GetAllocationSlot(uint32_t id)
+{
+    std::atomic<AllocationSegment*>& segment =
+        allocation_segments_[id >> kSegmentSizeLog2];
+
+    AllocationSegment* segment_ptr = segment.load(std::memory_order_relaxed);
+    if (!segment_ptr)
+    {
+        segment_ptr = new AllocationSegment();
+        for (auto& slot : segment_ptr->slots)
+        {
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+        segment.store(segment_ptr, std::memory_order_release);
+    }
+
+    return segment_ptr->slots[id & (kSegmentSize - 1)];
+}
+
+D3D12HeapAllocator::Allocation* D3D12HeapAllocator::FindAllocation(
+    uint32_t id) const
+{
+    AllocationSegment* segment =
+        allocation_segments_[id >> kSegmentSizeLog2].load(
+            std::memory_order_acquire);
+
+    if (!segment)
+    {
+        return nullptr;
+    }
+
+    return segment->slots[id & (kSegmentSize - 1)].load(
+        std::memory_order_acquire);
 }
 
 absl::optional<D3D12HeapAllocator::Allocation> D3D12HeapAllocator::
@@ -112,6 +213,7 @@ absl::optional<D3D12HeapAllocator::Allocation> D3D12HeapAllocator::
         1 + (size_in_bytes - 1) / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
     const uint64_t resource_size_in_bytes =
         resource_size_in_tiles * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+    allocation.size_in_bytes = resource_size_in_bytes;
     auto resource_desc =
         CD3DX12_RESOURCE_DESC::Buffer(resource_size_in_bytes, resource_flags_);
 
@@ -187,9 +289,11 @@ absl::optional<D3D12HeapAllocator::Allocation> D3D12HeapAllocator::
         constexpr UINT numHeapRanges = 1;
 
         // This is a brand new allocation/resource, so the tile mappings are
-        // guaranteed to be set (on the GPU timeline) by the time any code can
-        // reference the returned resource. We only execute operations on a
-        // single hardware queue so there is no need to wait or signal.
+        // guaranteed to be set (on the GPU timeline) by the time work on this
+        // queue can reference the returned resource. Work on other queues,
+        // such as the copy queue, isn't ordered against this queue, so the
+        // mappings are followed by a signal of the tile mapping fence, which
+        // that work waits for (see GetTileMappingCompletionEvent).
         //
         // All resources have identical tile mappings. The repeated call to
         // UpdateTileMappings on all resources instead of using CopyTileMappings
@@ -219,6 +323,15 @@ absl::optional<D3D12HeapAllocator::Allocation> D3D12HeapAllocator::
 
     assert(unmapped_resource_tiles == 0);
 
+    // Let work on other queues wait for the mappings.
+    {
+        std::unique_lock<std::mutex> lock(tile_mapping_mutex_);
+        uint64_t fence_value = tile_mapping_fence_value_.load() + 1;
+        DML_CHECK_SUCCEEDED(
+            queue_->Signal(tile_mapping_fence_.Get(), fence_value));
+        tile_mapping_fence_value_.store(fence_value);
+    }
+
     return allocation;
 }
 
@@ -226,6 +339,7 @@ absl::optional<D3D12HeapAllocator::Allocation> D3D12HeapAllocator::
     TryCreateUntiledAllocation(uint64_t size_in_bytes)
 {
     Allocation allocation = {};
+    allocation.size_in_bytes = size_in_bytes;
 
     // Create the allocation's sole heap. The allocation may be larger than the
     // requested size to ensure a whole number of tiles.
@@ -275,6 +389,109 @@ absl::optional<D3D12HeapAllocator::Allocation> D3D12HeapAllocator::
     return allocation;
 }
 
+DmlGpuEvent D3D12HeapAllocator::GetTileMappingCompletionEvent() const
+{
+    return DmlGpuEvent{tile_mapping_fence_value_.load(), tile_mapping_fence_};
+}
+
+uint64_t D3D12HeapAllocator::GetAllocationSize(uint64_t size_in_bytes) const
+{
+    if (!tiling_enabled_)
+    {
+        return size_in_bytes;
+    }
+
+    // Tiled allocations are rounded up to a whole number of tiles
+    return (1 + (size_in_bytes - 1) / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES) *
+           D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+}
+
+std::unique_ptr<D3D12HeapAllocator::Allocation> D3D12HeapAllocator::
+    TryTakePooledAllocation(uint64_t allocation_size)
+{
+    auto it = pooled_allocations_.find(allocation_size);
+    if (it == pooled_allocations_.end())
+    {
+        pool_miss_count_.fetch_add(1);
+        return nullptr;
+    }
+
+    // Reuse the most recently freed allocation, which is the most likely to
+    // still be resident
+    std::vector<PooledAllocation>& bucket = it->second;
+    std::unique_ptr<Allocation> allocation =
+        std::move(bucket.back().allocation);
+    bucket.pop_back();
+
+    if (bucket.empty())
+    {
+        pooled_allocations_.erase(it);
+    }
+
+    pool_hit_count_.fetch_add(1);
+    pool_retained_bytes_.fetch_sub(allocation->size_in_bytes);
+    return allocation;
+}
+
+void D3D12HeapAllocator::TrimPool(
+    std::chrono::steady_clock::time_point now,
+    uint64_t max_retained_bytes,
+    std::vector<std::unique_ptr<Allocation>>* allocations_to_free)
+{
+    auto release_oldest = [&](std::vector<PooledAllocation>& bucket)
+    {
+        pool_retained_bytes_.fetch_sub(
+            bucket.front().allocation->size_in_bytes);
+        allocations_to_free->push_back(std::move(bucket.front().allocation));
+        bucket.erase(bucket.begin());
+    };
+
+    // Release the allocations which haven't been reused in time
+    for (auto it = pooled_allocations_.begin();
+         it != pooled_allocations_.end();)
+    {
+        std::vector<PooledAllocation>& bucket = it->second;
+        while (!bucket.empty() &&
+               now - bucket.front().free_time >= pool_retention_time_)
+        {
+            release_oldest(bucket);
+        }
+
+        if (bucket.empty())
+        {
+            pooled_allocations_.erase(it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    // Then release the oldest allocations until the pool fits in the budget
+    while (pool_retained_bytes_.load() > max_retained_bytes)
+    {
+        auto oldest = pooled_allocations_.end();
+        for (auto it = pooled_allocations_.begin();
+             it != pooled_allocations_.end();
+             ++it)
+        {
+            if (oldest == pooled_allocations_.end() ||
+                it->second.front().free_time <
+                    oldest->second.front().free_time)
+            {
+                oldest = it;
+            }
+        }
+
+        release_oldest(oldest->second);
+
+        if (oldest->second.empty())
+        {
+            pooled_allocations_.erase(oldest);
+        }
+    }
+}
+
 void* D3D12HeapAllocator::Alloc(uint32_t device_id, uint64_t size_in_bytes)
 {
     if (size_in_bytes == 0)
@@ -282,11 +499,51 @@ void* D3D12HeapAllocator::Alloc(uint32_t device_id, uint64_t size_in_bytes)
         return nullptr;
     }
 
+    std::vector<std::unique_ptr<Allocation>> allocations_to_free;
+    std::unique_ptr<Allocation> allocation;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        allocation =
+            TryTakePooledAllocation(GetAllocationSize(size_in_bytes));
+        TrimPool(
+            std::chrono::steady_clock::now(),
+            max_pool_size_in_bytes_,
+            &allocations_to_free);
+    }
+    allocations_to_free.clear();
+
     // The D3D12 device is thread-safe so we don't need to hold the lock while
     // creating an allocation.
-    absl::optional<Allocation> allocation =
-        tiling_enabled_ ? TryCreateTiledAllocation(size_in_bytes)
-                        : TryCreateUntiledAllocation(size_in_bytes);
+    for (int attempt = 0; !allocation && attempt < 2; ++attempt)
+    {
+        if (attempt > 0)
+        {
+            // Out of memory: release the whole pool and try again.
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (pooled_allocations_.empty())
+                {
+                    break;
+                }
+
+                TrimPool(
+                    std::chrono::steady_clock::now(),
+                    0,
+                    &allocations_to_free);
+            }
+            allocations_to_free.clear();
+        }
+
+        absl::optional<Allocation> new_allocation =
+            tiling_enabled_ ? TryCreateTiledAllocation(size_in_bytes)
+                            : TryCreateUntiledAllocation(size_in_bytes);
+
+        if (new_allocation)
+        {
+            allocation = absl::make_unique<Allocation>(
+                std::move(*new_allocation));
+        }
+    }
 
     if (!allocation)
     {
@@ -309,7 +566,11 @@ void* D3D12HeapAllocator::Alloc(uint32_t device_id, uint64_t size_in_bytes)
         *id,
         strings::HumanReadableNumBytes(size_in_bytes).c_str());
 
-    allocations_by_id_.emplace(*id, std::move(*allocation));
+    // The allocation is published with release semantics, so that threads
+    // which receive the pointer from us also observe its resources.
+    GetAllocationSlot(*id).store(
+        allocation.release(),
+        std::memory_order_release);
 
     lock.unlock();
 
@@ -324,12 +585,18 @@ void D3D12HeapAllocator::Free(void* ptr, uint64_t size_in_bytes)
     TaggedPointer tagged_ptr = TaggedPointer::Unpack(ptr);
     CHECK(tagged_ptr.offset == 0);
 
+    std::vector<std::unique_ptr<Allocation>> allocations_to_free;
+
     // We need to access (mutable) state after this point, so we need to lock
     std::unique_lock<std::mutex> lock(mutex_);
 
-    auto it = allocations_by_id_.find(tagged_ptr.allocation_id);
+    std::atomic<Allocation*>& slot =
+        GetAllocationSlot(tagged_ptr.allocation_id);
+
+    std::unique_ptr<Allocation> allocation(
+        slot.exchange(nullptr, std::memory_order_relaxed));
 
-    CHECK(it != allocations_by_id_.end());
+    CHECK(allocation != nullptr);
 
     TF_VLog(
         3,
@@ -339,8 +606,32 @@ void D3D12HeapAllocator::Free(void* ptr, uint64_t size_in_bytes)
 
     ReleaseAllocationID(tagged_ptr.allocation_id);
 
-    // Frees the ID3D12Heap
-    allocations_by_id_.erase(it);
+    // Keep the allocation's heaps and resources for reuse, unless it can't fit
+    // in the pool at all.
+    auto now = std::chrono::steady_clock::now();
+    if (allocation->size_in_bytes <= max_pool_size_in_bytes_)
+    {
+        const uint64_t allocation_size = allocation->size_in_bytes;
+        pool_retained_bytes_.fetch_add(allocation_size);
+
+        PooledAllocation pooled_allocation = {};
+        pooled_allocation.free_time = now;
+        pooled_allocation.allocation = std::move(allocation);
+        pooled_allocations_[allocation_size].push_back(
+            std::move(pooled_allocation));
+    }
+    else
+    {
+        allocations_to_free.push_back(std::move(allocation));
+    }
+
+    TrimPool(now, max_pool_size_in_bytes_, &allocations_to_free);
+
+    lock.unlock();
+
+    // Frees the ID3D12Heaps. The caller guarantees that nothing is using the
+    // allocations anymore, so no other thread can be looking them up.
+    allocations_to_free.clear();
 }
 
 D3D12BufferRegion D3D12HeapAllocator::CreateBufferRegion(
@@ -351,14 +642,9 @@ D3D12BufferRegion D3D12HeapAllocator::CreateBufferRegion(
 
     TaggedPointer tagged_ptr = TaggedPointer::Unpack(ptr);
 
-    // We need to access (mutable) state after this point, so we need to lock
-    std::unique_lock<std::mutex> lock(mutex_);
-
     // Find the allocation corresponding to this pointer
-    auto it = allocations_by_id_.find(tagged_ptr.allocation_id);
-    CHECK(it != allocations_by_id_.end());
-
-    Allocation* allocation = &it->second;
+    Allocation* allocation = FindAllocation(tagged_ptr.allocation_id);
+    CHECK(allocation != nullptr);
 
     return D3D12BufferRegion(
         tagged_ptr.offset,
@@ -15,9 +15,16 @@ limitations under the License.
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
 #include "absl/container/flat_hash_map.h"
 #include "dml_buffer_region.h"
 #include "dml_common.h"
+#include "dml_gpu_event.h"
+#include "tfdml/core/dml_tagged_pointer.h"
 
 namespace tfdml
 {
@@ -62,6 +69,16 @@ class D3D12HeapAllocator
     static constexpr uint64_t kDefaultMaxAllocationSizeInBytes =
         (1ull << 32) - (1ull << 20);
 
+    // Freed allocations (their heaps and resources) are kept in a pool so that
+    // later allocations of the same size can reuse them instead of creating
+    // new heaps and resources. The pool retains at most this many bytes, and
+    // releases allocations which haven't been reused within the retention
+    // time. These can be overridden using the TF_DIRECTML_HEAP_POOL_MAX_BYTES
+    // and TF_DIRECTML_HEAP_POOL_RETENTION_MS environment variables; a budget
+    // of 0 disables the pool.
+    static constexpr uint64_t kDefaultMaxPoolSizeInBytes = 256ull << 20;
+    static constexpr int64_t kDefaultPoolRetentionTimeMs = 5000;
+
     D3D12HeapAllocator(
         ID3D12Device* device,
         ID3D12CommandQueue* queue,
@@ -70,13 +87,15 @@ class D3D12HeapAllocator
         D3D12_RESOURCE_FLAGS resource_flags,
         D3D12_RESOURCE_STATES initial_state);
 
+    ~D3D12HeapAllocator();
+
     // Creates a reserved or placed resource buffer over the given memory range.
     // The physical D3D12 resource may be larger than the requested size, so
     // callers must ensure to use the offset/size returned in the
     // D3D12BufferRegion else risk out of bounds access. Note that in practice
     // the ID3D12Resource is cached, so this call typically has a lower cost
     // than a call to ID3D12Device::CreatePlacedResource or
-    // CreateReservedResource.
+    // CreateReservedResource. This doesn't take any locks.
     D3D12BufferRegion CreateBufferRegion(
         const void* ptr,
         uint64_t size_in_bytes);
@@ -85,6 +104,20 @@ class D3D12HeapAllocator
     void Free(void* ptr, uint64_t size_in_bytes);
     bool TilingEnabled() const { return tiling_enabled_; };
 
+    // Returns an event which becomes signaled once the tile mappings of every
+    // allocation made so far have been updated. Mappings are updated on the
+    // queue this allocator was created with, so work on other queues must
+    // wait for this before accessing new allocations.
+    DmlGpuEvent GetTileMappingCompletionEvent() const;
+
+    // Statistics of the pool of freed allocations.
+    uint64_t GetPoolHitCount() const { return pool_hit_count_.load(); }
+    uint64_t GetPoolMissCount() const { return pool_miss_count_.load(); }
+    uint64_t GetPoolRetainedBytes() const
+    {
+        return pool_retained_bytes_.load();
+    }
+
   private:
     std::mutex mutex_;
 
@@ -96,6 +129,14 @@ class D3D12HeapAllocator
     const D3D12_RESOURCE_STATES initial_state_;
     bool tiling_enabled_;
     uint64_t max_heap_size_in_tiles_;
+    const uint64_t max_pool_size_in_bytes_;
+    const std::chrono::milliseconds pool_retention_time_;
+
+    // Signaled on the queue after each tiled allocation's mappings are
+    // updated.
+    std::mutex tile_mapping_mutex_;
+    Microsoft::WRL::ComPtr<ID3D12Fence> tile_mapping_fence_;
+    std::atomic<uint64_t> tile_mapping_fence_value_;
 
     // The largest allocation ID we've returned so far (or 0 if we've never done
     // so). Note that our allocation IDs start at 1 (not 0) to ensure that it
@@ -110,6 +151,10 @@ class D3D12HeapAllocator
 
     struct Allocation
     {
+        // The size of the allocation's resources, which may be larger than the
+        // size that was requested.
+        uint64_t size_in_bytes;
+
         Microsoft::WRL::ComPtr<ID3D12Heap> heap;
 
         // Heaps backing the memory for the allocation. If tiling is supported
@@ -130,7 +175,63 @@ class D3D12HeapAllocator
         Microsoft::WRL::ComPtr<ID3D12Resource> resource_copy_dst_state;
     };
 
-    absl::flat_hash_map<uint32_t, Allocation> allocations_by_id_;
+    // Allocations are indexed directly by their ID. Since freed IDs are reused,
+    // the ID space is dense, so this is a two-level table of fixed-size
+    // segments which are only created as the IDs grow. Slots are published
+    // atomically so that CreateBufferRegion can look allocations up without
+    // taking the lock; segments and slots are only written while holding
+    // mutex_.
+    static constexpr uint32_t kSegmentSizeLog2 = 10;
+    static constexpr uint32_t kSegmentSize = 1u << kSegmentSizeLog2;
+    static constexpr uint32_t kSegmentCount =
+        (1u << TaggedPointer::kAllocationIDBits) / kSegmentSize;
+
+    struct AllocationSegment
+    {
+        std::array<std::atomic<Allocation*>, kSegmentSize> slots;
+    };
+
+    std::array<std::atomic<AllocationSegment*>, kSegmentCount>
+        allocation_segments_;
+
+    // Returns the slot of the allocation ID, creating its segment if it
+    // doesn't exist yet. The mutex must already be held.
+    std::atomic<Allocation*>& GetAllocationSlot(uint32_t id);
+
+    // Returns the allocation with the given ID, or nullptr.
+    Allocation* FindAllocation(uint32_t id) const;
+
+    struct PooledAllocation
+    {
+        std::unique_ptr<Allocation> allocation;
+        std::chrono::steady_clock::time_point free_time;
+    };
+
+    // Freed allocations, bucketed by size. Each bucket is ordered by the time
+    // its allocations were freed, oldest first. Protected by mutex_.
+    absl::flat_hash_map<uint64_t, std::vector<PooledAllocation>>
+        pooled_allocations_;
+
+    std::atomic<uint64_t> pool_hit_count_ = {0};
+    std::atomic<uint64_t> pool_miss_count_ = {0};
+    std::atomic<uint64_t> pool_retained_bytes_ = {0};
+
+    // Returns the size of the resources of an allocation of the given size.
+    uint64_t GetAllocationSize(uint64_t size_in_bytes) const;
+
+    // Takes a pooled allocation of exactly the given (resource) size, or
+    // returns nullptr if there is none. The mutex must already be held.
+    std::unique_ptr<Allocation> TryTakePooledAllocation(
+        uint64_t allocation_size);
+
+    // Moves the pooled allocations that have exceeded the retention time, and
+    // then the oldest ones until the pool is within its budget, into
+    // `allocations_to_free`. The allocations should be destroyed once the
+    // mutex has been released. The mutex must already be held.
+    void TrimPool(
+        std::chrono::steady_clock::time_point now,
+        uint64_t max_retained_bytes,
+        std::vector<std::unique_ptr<Allocation>>* allocations_to_free);
 
     // Retrieves a free allocation ID, or nullopt if no more IDs are available.
     absl::optional<uint32_t> TryReserveAllocationID();
@@ -0,0 +1,279 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#include "dml_host_staging_pool.h"
+
+#include <algorithm>
+
+#include "absl/memory/memory.h"
+
+using Microsoft::WRL::ComPtr;
+
+namespace tfdml
+{
+
+DmlHostStagingPool::DmlHostStagingPool(
+    ID3D12Device* device,
+    uint64_t retention_limit_in_bytes)
+    : DmlHostStagingPool(
+          [device = ComPtr<ID3D12Device>(device)](
+              uint64_t size_in_bytes,
+              ComPtr<ID3D12Resource>* buffer)
+          {
+              // These are the properties of a readback heap: write-back memory
+              // that lives in system memory on discrete adapters. Unlike a
+              // readback heap, a custom heap lets the buffer be a copy source
+              // too, so a block serves uploads as well as readbacks.
+              D3D12_HEAP_PROPERTIES heap_properties =
+                  device->GetCustomHeapProperties(0, D3D12_HEAP_TYPE_READBACK);
+              auto buffer_desc = CD3DX12_RESOURCE_DESC::Buffer(size_in_bytes);
+
+              return device->CreateCommittedResource(
+                  &heap_properties,
+                  D3D12_HEAP_FLAG_NONE,
+                  &buffer_desc,
+                  D3D12_RESOURCE_STATE_COMMON,
+                  nullptr,
+                  IID_PPV_ARGS(buffer->ReleaseAndGetAddressOf()));
+          },
+          retention_limit_in_bytes)
+{
+}
+
+DmlHostStagingPool::DmlHostStagingPool(
+    CreateBufferFn create_buffer,
+    uint64_t retention_limit_in_bytes)
+    : create_buffer_(std::move(create_buffer)),
+      retention_limit_in_bytes_(retention_limit_in_bytes)
+{
+}
+
+DmlHostStagingPool::~DmlHostStagingPool()
+{
+    TF_VLog(
+        1,
+        "DmlHostStagingPool: %llu allocations (%llu reused, %llu failed), "
+        "peak usage %llu bytes",
+        stats_.allocation_count,
+        stats_.reuse_count,
+        stats_.failed_allocation_count,
+        stats_.peak_bytes_in_use);
+}
+
+bool DmlHostStagingPool::Block::IsIdle() const
+{
+    for (const DmlGpuEvent& gpu_use : gpu_uses)
+    {
+        if (!gpu_use.IsSignaled())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*static*/ uint32_t DmlHostStagingPool::GetSizeClass(uint64_t size_in_bytes)
+{
+    uint32_t size_class = 0;
+    uint64_t block_size_in_bytes = kMinBlockSizeInBytes;
+    while (block_size_in_bytes < size_in_bytes &&
+           size_class < kSizeClassCount)
+    {
+        block_size_in_bytes <<= 1;
+        ++size_class;
+    }
+
+    return size_class;
+}
+
+void* DmlHostStagingPool::Allocate(uint64_t size_in_bytes)
+{
+    uint32_t size_class = GetSizeClass(size_in_bytes);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (size_class >= kSizeClassCount)
+    {
+        ++stats_.failed_allocation_count;
+        return nullptr;
+    }
+
+    ReleaseIdleBlocks();
+
+    // Prefer the most recently freed block, whose memory is most likely to
+    // still be in the CPU caches. Blocks that the GPU is still copying to or
+    // from can't be handed out yet.
+    std::unique_ptr<Block> block;
+    auto& free_blocks = free_blocks_[size_class];
+    for (auto it = free_blocks.rbegin(); it != free_blocks.rend(); ++it)
+    {
+        if ((*it)->IsIdle())
+        {
+            block = std::move(*it);
+            free_blocks.erase(std::next(it).base());
+            stats_.bytes_retained -= block->size_in_bytes;
+            ++stats_.reuse_count;
+            break;
+        }
+    }
+
+    if (!block)
+    {
+        uint64_t block_size_in_bytes = kMinBlockSizeInBytes << size_class;
+
+        ComPtr<ID3D12Resource> buffer;
+        void* data = nullptr;
+        if (FAILED(create_buffer_(block_size_in_bytes, &buffer)) ||
+            FAILED(buffer->Map(0, nullptr, &data)))
+        {
+            ++stats_.failed_allocation_count;
+            return nullptr;
+        }
+
+        block = absl::make_unique<Block>();
+        block->buffer = std::move(buffer);
+        block->data = static_cast<uint8_t*>(data);
+        block->size_in_bytes = block_size_in_bytes;
+    }
+
+    stats_.bytes_in_use += block->size_in_bytes;
+    stats_.peak_bytes_in_use =
+        std::max(stats_.peak_bytes_in_use, stats_.bytes_in_use);
+    ++stats_.allocation_count;
+
+    uint8_t* data = block->data;
+    blocks_in_use_.emplace(reinterpret_cast<uintptr_t>(data), std::move(block));
+    return data;
+}
+
+bool DmlHostStagingPool::Free(void* ptr)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto it = blocks_in_use_.find(reinterpret_cast<uintptr_t>(ptr));
+    if (it == blocks_in_use_.end())
+    {
+        return false;
+    }
+
+    std::unique_ptr<Block> block = std::move(it->second);
+    blocks_in_use_.erase(it);
+    stats_.bytes_in_use -= block->size_in_bytes;
+
+    if (stats_.bytes_retained + block->size_in_bytes <=
+        retention_limit_in_bytes_)
+    {
+        stats_.bytes_retained += block->size_in_bytes;
+        free_blocks_[GetSizeClass(block->size_in_bytes)].push_back(
+            std::move(block));
+    }
+    else
+    {
+        blocks_to_release_.push_back(std::move(block));
+    }
+
+    ReleaseIdleBlocks();
+    return true;
+}
+
+DmlHostStagingPool::Block* DmlHostStagingPool::FindBlock(const void* ptr) const
+{
+    auto address = reinterpret_cast<uintptr_t>(ptr);
+
+    // Find the last block that starts at or before the address
+    auto it = blocks_in_use_.upper_bound(address);
+    if (it == blocks_in_use_.begin())
+    {
+        return nullptr;
+    }
+    --it;
+
+    Block* block = it->second.get();
+    if (address >= it->first + block->size_in_bytes)
+    {
+        return nullptr;
+    }
+
+    return block;
+}
+
+absl::optional<DmlHostStagingPool::StagingBuffer> DmlHostStagingPool::Find(
+    const void* ptr,
+    uint64_t size_in_bytes) const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    Block* block = FindBlock(ptr);
+    if (!block)
+    {
+        return absl::nullopt;
+    }
+
+    uint64_t offset = static_cast<const uint8_t*>(ptr) - block->data;
+    if (offset + size_in_bytes > block->size_in_bytes)
+    {
+        return absl::nullopt;
+    }
+
+    return StagingBuffer{block->buffer.Get(), offset};
+}
+
+void DmlHostStagingPool::AddGpuUse(
+    const void* ptr,
+    const DmlGpuEvent& gpu_event)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    Block* block = FindBlock(ptr);
+    if (!block)
+    {
+        return;
+    }
+
+    // Each queue signals its fence in order, so only the latest use on each
+    // of them matters
+    for (DmlGpuEvent& gpu_use : block->gpu_uses)
+    {
+        if (gpu_use.fence.Get() == gpu_event.fence.Get())
+        {
+            gpu_use.fence_value =
+                std::max(gpu_use.fence_value, gpu_event.fence_value);
+            return;
+        }
+    }
+
+    block->gpu_uses.push_back(gpu_event);
+}
+
+DmlHostStagingPool::Stats DmlHostStagingPool::GetStats() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void DmlHostStagingPool::ReleaseIdleBlocks()
+{
+    blocks_to_release_.erase(
+        std::remove_if(
+            blocks_to_release_.begin(),
+            blocks_to_release_.end(),
+            [](const std::unique_ptr<Block>& block)
+            { return block->IsIdle(); }),
+        blocks_to_release_.end());
+}
+
+} // namespace tfdml
@@ -0,0 +1,136 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "dml_common.h"
+#include "dml_gpu_event.h"
+
+namespace tfdml
+{
+
+// Hands out host memory that the GPU can copy to and from directly, so that
+// transfers between device memory and memory from the pool skip the upload
+// and readback heaps (and the extra memcpy through them). Each block is a
+// committed buffer in CPU-cached system memory that stays mapped for its whole
+// lifetime. Blocks are rounded up to power-of-two size classes and recycled
+// once the GPU is done with them, and up to a retention limit of free blocks is
+// kept around for reuse. This class is thread-safe.
+class DmlHostStagingPool
+{
+  public:
+    // Creates a buffer of the given size in the COMMON state, whose memory can
+    // be mapped for reading and writing.
+    using CreateBufferFn = std::function<HRESULT(
+        uint64_t size_in_bytes,
+        Microsoft::WRL::ComPtr<ID3D12Resource>* buffer)>;
+
+    static constexpr uint64_t kMinBlockSizeInBytes = 64 * 1024;
+    static constexpr uint32_t kSizeClassCount = 17; // Up to 4GB
+
+    struct Stats
+    {
+        uint64_t bytes_in_use = 0;
+        uint64_t peak_bytes_in_use = 0;
+        uint64_t bytes_retained = 0;
+        uint64_t allocation_count = 0;
+        uint64_t reuse_count = 0;
+        uint64_t failed_allocation_count = 0;
+    };
+
+    // A range of a block, which the GPU sees at `offset` in `buffer`. The
+    // buffer is always in the COMMON state.
+    struct StagingBuffer
+    {
+        ID3D12Resource* buffer;
+        uint64_t offset;
+    };
+
+    DmlHostStagingPool(ID3D12Device* device, uint64_t retention_limit_in_bytes);
+
+    DmlHostStagingPool(
+        CreateBufferFn create_buffer,
+        uint64_t retention_limit_in_bytes);
+
+    ~DmlHostStagingPool();
+
+    // Returns null if the size is too large or the buffer can't be created, in
+    // which case the caller should fall back to regular host memory.
+    void* Allocate(uint64_t size_in_bytes);
+
+    // Returns false if the memory wasn't allocated from this pool.
+    bool Free(void* ptr);
+
+    // Returns the buffer range backing the host memory, if all of it belongs
+    // to a single block of the pool.
+    absl::optional<StagingBuffer> Find(
+        const void* ptr,
+        uint64_t size_in_bytes) const;
+
+    // Prevents the block that contains `ptr` from being reused or released
+    // before the GPU event is signaled. Must be called for every GPU copy to
+    // or from the block.
+    void AddGpuUse(const void* ptr, const DmlGpuEvent& gpu_event);
+
+    Stats GetStats() const;
+
+  private:
+    struct Block
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+        uint8_t* data;
+        uint64_t size_in_bytes;
+
+        // The latest GPU use of the block on each queue
+        absl::InlinedVector<DmlGpuEvent, 2> gpu_uses;
+
+        ~Block() { buffer->Unmap(0, nullptr); }
+
+        bool IsIdle() const;
+    };
+
+    static uint32_t GetSizeClass(uint64_t size_in_bytes);
+
+    // Returns the block in use that contains `ptr`, if any. The caller must
+    // hold the lock.
+    Block* FindBlock(const void* ptr) const;
+
+    // Releases the blocks that can't be retained once the GPU is done with
+    // them. The caller must hold the lock.
+    void ReleaseIdleBlocks();
+
+    mutable std::mutex mutex_;
+    CreateBufferFn create_buffer_;
+    uint64_t retention_limit_in_bytes_;
+
+    // Keyed by the address of the blocks' memory
+    std::map<uintptr_t, std::unique_ptr<Block>> blocks_in_use_;
+
+    // The most recently freed blocks are at the back
+    std::vector<std::unique_ptr<Block>> free_blocks_[kSizeClassCount];
+
+    // Blocks over the retention limit, waiting for the GPU to finish with them
+    std::vector<std::unique_ptr<Block>> blocks_to_release_;
+
+    Stats stats_;
+};
+
+} // namespace tfdml
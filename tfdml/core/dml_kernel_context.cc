@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tfdml/core/dml_kernel_context.h"
 
+#include "tfdml/core/dml_compile_pool.h"
 #include "tfdml/core/dml_device.h"
 #include "tfdml/core/dml_event_queue.h"
 #include "tfdml/core/dml_execution_context.h"
@@ -69,6 +70,45 @@ std::shared_ptr<const InitializationHelper> DmlKernelConstruction::
     return init_helper_;
 }
 
+ComPtr<IDMLCompiledOperator> DmlKernelConstruction::CompileOperator(
+    const DML_OPERATOR_DESC& op_desc,
+    DML_EXECUTION_FLAGS execution_flags) const
+{
+    IDMLDevice* dml_device = device_->GetDmlDevice();
+
+    HRESULT create_hr = S_OK;
+    HRESULT compile_hr = S_OK;
+    ComPtr<IDMLCompiledOperator> compiled_op;
+
+    // The results are checked on the calling thread, so that failures are
+    // reported against the kernel being constructed
+    auto compile = [&]()
+    {
+        ComPtr<IDMLOperator> op;
+        create_hr = dml_device->CreateOperator(&op_desc, IID_PPV_ARGS(&op));
+        if (SUCCEEDED(create_hr))
+        {
+            compile_hr = dml_device->CompileOperator(
+                op.Get(),
+                execution_flags,
+                IID_PPV_ARGS(&compiled_op));
+        }
+    };
+
+    if (DmlCompilePool* compile_pool = device_->GetCompilePool())
+    {
+        compile_pool->Run(compile);
+    }
+    else
+    {
+        compile();
+    }
+
+    DML_CHECK_SUCCEEDED(create_hr);
+    DML_CHECK_SUCCEEDED(compile_hr);
+    return compiled_op;
+}
+
 TF_DataType DmlKernelConstruction::GetInputDataType(uint32_t index) const
 {
     return op_ctx_->input_dtype(index);
@@ -108,12 +148,25 @@ DmlKernelContext::DmlKernelContext(
     const InitializationHelper* init_helper,
     absl::Span<const TensorShape> output_shapes,
     absl::Span<const absl::optional<uint32_t>> output_refs_forwarding,
-    bool supports_in_place_execution)
+    bool supports_in_place_execution,
+    InputTensors inputs)
     : device_(device),
       op_ctx_(op_ctx),
-      init_helper_(init_helper)
+      init_helper_(init_helper),
+      input_tensors_(std::move(inputs))
 {
     assert(output_shapes.size() == op_ctx_->num_outputs());
+    assert(
+        input_tensors_.empty() ||
+        input_tensors_.size() == op_ctx_->num_inputs());
+
+    // TF only forwards an input's buffer to an output if nothing else
+    // references it, so in-place kernels let go of their inputs until the
+    // outputs have been allocated.
+    if (supports_in_place_execution)
+    {
+        input_tensors_.clear();
+    }
 
     // Allocate output tensors
     output_tensors_.reserve(output_shapes.size());
@@ -162,6 +215,15 @@ DmlKernelContext::DmlKernelContext(
             output_tensors_.push_back(status_or_tensor.ConsumeValueOrDie());
         }
     }
+
+    if (input_tensors_.empty())
+    {
+        input_tensors_.reserve(op_ctx_->num_inputs());
+        for (int i = 0; i < op_ctx_->num_inputs(); ++i)
+        {
+            input_tensors_.push_back(op_ctx_->input(i));
+        }
+    }
 }
 
 IDMLDevice* DmlKernelContext::GetDmlDevice() const
@@ -52,6 +52,12 @@ class DmlKernelConstruction
     DMLDeviceContext* GetDmlDeviceContext() const;
     std::shared_ptr<const InitializationHelper> GetInitializationHelper() const;
 
+    // Creates and compiles a DML operator. The compilation runs on the
+    // device's compile pool if it has one, and on the calling thread otherwise.
+    Microsoft::WRL::ComPtr<IDMLCompiledOperator> CompileOperator(
+        const DML_OPERATOR_DESC& op_desc,
+        DML_EXECUTION_FLAGS execution_flags) const;
+
     // Input tensors
     uint32_t GetInputCount() const { return op_ctx_->num_inputs(); }
     TF_DataType GetInputDataType(uint32_t index) const;
@@ -98,13 +104,18 @@ class DmlKernelConstruction
 class DmlKernelContext
 {
   public:
+    using InputTensors = absl::InlinedVector<Tensor, 6>;
+
+    // `inputs` are the input tensors of `op_ctx` if the caller has already
+    // retrieved them, or empty otherwise.
     DmlKernelContext(
         const DmlDevice* device,
         OpKernelContext* op_ctx,
         const InitializationHelper* init_helper,
         absl::Span<const TensorShape> output_shapes,
         absl::Span<const absl::optional<uint32_t>> output_refs_forwarding,
-        bool supports_in_place_execution);
+        bool supports_in_place_execution,
+        InputTensors inputs = {});
 
     IDMLDevice* GetDmlDevice() const;
     ID3D12Device* GetD3D12Device() const;
@@ -117,8 +128,14 @@ class DmlKernelContext
         return static_cast<const T*>(init_helper_);
     }
 
-    Tensor GetInputTensor(int index) const { return op_ctx_->input(index); }
-    uint32_t GetInputCount() const { return op_ctx_->num_inputs(); }
+    const Tensor& GetInputTensor(int index) const
+    {
+        return input_tensors_[index];
+    }
+    uint32_t GetInputCount() const
+    {
+        return static_cast<uint32_t>(input_tensors_.size());
+    }
 
     Tensor& GetOutputTensor(int index) { return output_tensors_[index]; }
     uint32_t GetOutputCount() const { return op_ctx_->num_outputs(); }
@@ -128,6 +145,10 @@ class DmlKernelContext
     OpKernelContext* op_ctx_;
     const InitializationHelper* init_helper_;
 
+    // Retrieving an input from TF allocates a new TF_Tensor, so each input is
+    // only retrieved once and kept here for the kernel.
+    InputTensors input_tensors_;
+
     // These output tensors are owned by the framework, because they're
     // allocated using OpKernelContext::allocate_output()
     absl::InlinedVector<Tensor, 4> output_tensors_;
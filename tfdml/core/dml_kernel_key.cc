@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tfdml/core/dml_kernel_key.h"
 
+#include "absl/hash/hash.h"
 #include "tfdml/runtime_adapter/tensor.h"
 
 namespace tfdml
@@ -45,6 +46,7 @@ DmlKernelKey DmlKernelKey::Clone() const
     DmlKernelKey clone = {};
     clone.op_type_name = this->op_type_name;
     clone.node_def = this->node_def;
+    clone.fingerprint = this->fingerprint;
 
     for (const auto& input : this->input_tensors)
     {
@@ -56,6 +58,11 @@ DmlKernelKey DmlKernelKey::Clone() const
 
 bool DmlKernelKey::operator==(const DmlKernelKey& other) const
 {
+    if (this->fingerprint != other.fingerprint)
+    {
+        return false;
+    }
+
     if (this->op_type_name != other.op_type_name)
     {
         return false;
@@ -78,6 +85,143 @@ bool DmlKernelKey::operator==(const DmlKernelKey& other) const
     return true;
 }
 
+uint64_t DmlKernelKey::HashAttributes(
+    absl::string_view op_type_name,
+    const NodeDef* node_def)
+{
+    if (node_def)
+    {
+        return absl::Hash<
+            std::tuple<absl::string_view, absl::Span<const AttributeValue>>>()(
+            std::make_tuple(op_type_name, node_def->GetAttributeValues()));
+    }
+
+    return absl::Hash<absl::string_view>()(op_type_name);
+}
+
+uint64_t DmlKernelKey::ComputeFingerprint(uint64_t attribute_hash) const
+{
+    DmlKernelFingerprintBuilder builder(attribute_hash);
+
+    for (const auto& input : this->input_tensors)
+    {
+        if (input.is_constant_cpu_input)
+        {
+            builder.AddInputTensor(absl::get<Tensor>(input.tensor), true);
+        }
+        else
+        {
+            const auto& shape_and_type =
+                absl::get<TensorShapeAndType>(input.tensor);
+            builder.AddInputShapeAndType(
+                shape_and_type.shape,
+                shape_and_type.dtype);
+        }
+    }
+
+    return builder.Finish();
+}
+
+void DmlKernelFingerprintBuilder::Add(uint64_t value)
+{
+    state_ = (state_ ^ value) * 0x9E3779B97F4A7C15ull;
+    state_ ^= state_ >> 29;
+}
+
+void DmlKernelFingerprintBuilder::AddInputTensor(
+    const Tensor& tensor,
+    bool is_constant_cpu_input)
+{
+    // Tensor::shape() returns a copy, so read the dimensions directly. This
+    // must produce the same sequence as AddInputShapeAndType for non-constant
+    // inputs.
+    Add(is_constant_cpu_input);
+    Add(tensor.dtype());
+    Add(tensor.dims());
+
+    for (int64_t i = 0; i < tensor.dims(); ++i)
+    {
+        Add(tensor.dim_size(i));
+    }
+
+    if (is_constant_cpu_input)
+    {
+        Add(absl::Hash<absl::string_view>()(tensor.tensor_data()));
+    }
+}
+
+void DmlKernelFingerprintBuilder::AddInputShapeAndType(
+    const TensorShape& shape,
+    TF_DataType dtype)
+{
+    Add(false);
+    Add(dtype);
+    Add(shape.dims());
+
+    for (int i = 0; i < shape.dims(); ++i)
+    {
+        Add(shape.dim_size(i));
+    }
+}
+
+uint64_t DmlKernelFingerprintBuilder::Finish() const
+{
+    // MurmurHash3's finalizer, so that every bit of the state affects the bits
+    // used by the hash table
+    uint64_t hash = state_;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Compares the dimensions of a Tensor or TensorShape against those of a tensor,
+// without copying either shape.
+template <typename TShape>
+static bool DimensionsMatch(const TShape& shape, const Tensor& tensor)
+{
+    if (shape.dims() != tensor.dims())
+    {
+        return false;
+    }
+
+    for (int i = 0; i < shape.dims(); ++i)
+    {
+        if (shape.dim_size(i) != tensor.dim_size(i))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool DmlInputTensorKey::Matches(
+    const Tensor& tensor,
+    bool is_constant_cpu_input) const
+{
+    if (this->is_constant_cpu_input != is_constant_cpu_input)
+    {
+        return false;
+    }
+
+    if (is_constant_cpu_input)
+    {
+        const auto& key_tensor = absl::get<Tensor>(this->tensor);
+
+        return key_tensor.dtype() == tensor.dtype() &&
+               DimensionsMatch(key_tensor, tensor) &&
+               key_tensor.tensor_data() == tensor.tensor_data();
+    }
+
+    const auto& shape_and_type = absl::get<TensorShapeAndType>(this->tensor);
+
+    return shape_and_type.dtype == tensor.dtype() &&
+           DimensionsMatch(shape_and_type.shape, tensor);
+}
+
 bool DmlInputTensorKey::operator==(const DmlInputTensorKey& other) const
 {
     if (this->is_constant_cpu_input != other.is_constant_cpu_input)
@@ -64,6 +64,10 @@ struct DmlInputTensorKey
     DmlInputTensorKey Clone() const; // Performs a deep copy
     bool operator==(const DmlInputTensorKey& other) const;
 
+    // Returns true if this key would be produced by the given input tensor,
+    // without constructing a key for it.
+    bool Matches(const Tensor& tensor, bool is_constant_cpu_input) const;
+
     template <typename H>
     friend H AbslHashValue(H h, const DmlInputTensorKey& input_tensor_key)
     {
@@ -72,6 +76,29 @@ struct DmlInputTensorKey
     }
 };
 
+// Incrementally computes the 64-bit fingerprint of a kernel key. Since this
+// only needs the input shapes and datatypes (and the contents of constant CPU
+// inputs), the fingerprint of the kernel needed by an OpKernelContext can be
+// computed on the stack without materializing a DmlKernelKey.
+class DmlKernelFingerprintBuilder
+{
+  public:
+    explicit DmlKernelFingerprintBuilder(uint64_t attribute_hash)
+        : state_(attribute_hash)
+    {
+    }
+
+    void AddInputTensor(const Tensor& tensor, bool is_constant_cpu_input);
+    void AddInputShapeAndType(const TensorShape& shape, TF_DataType dtype);
+
+    uint64_t Finish() const;
+
+  private:
+    void Add(uint64_t value);
+
+    uint64_t state_;
+};
+
 // Uniquely identifies a DML kernel instance. This is used for caching of
 // kernels, since DML kernels are immutable once constructed.
 struct DmlKernelKey
@@ -80,25 +107,85 @@ struct DmlKernelKey
     std::shared_ptr<const NodeDef> node_def;
     absl::InlinedVector<DmlInputTensorKey, 6> input_tensors;
 
+    // A fingerprint of all of the above. This is the hash of the key, and must
+    // be filled in with ComputeFingerprint() once the rest of the key has been
+    // built.
+    uint64_t fingerprint = 0;
+
     DmlKernelKey Clone() const; // Performs a deep copy
     bool operator==(const DmlKernelKey& other) const;
 
+    // Hashes the op type name and the attribute values of the node. Kernel
+    // wrappers compute this once at construction since it never changes for a
+    // given node.
+    static uint64_t HashAttributes(
+        absl::string_view op_type_name,
+        const NodeDef* node_def);
+
+    uint64_t ComputeFingerprint(uint64_t attribute_hash) const;
+
+    uint64_t ComputeFingerprint() const
+    {
+        return ComputeFingerprint(
+            HashAttributes(op_type_name, node_def.get()));
+    }
+
     template <typename H>
     friend H AbslHashValue(H h, const DmlKernelKey& kernel_key)
     {
-        if (kernel_key.node_def)
-        {
-            return H::combine(
-                std::move(h),
-                kernel_key.op_type_name,
-                kernel_key.node_def->GetAttributeValues(),
-                kernel_key.input_tensors);
-        }
-
-        return H::combine(
-            std::move(h),
-            kernel_key.op_type_name,
-            kernel_key.input_tensors);
+        return H::combine(std::move(h), kernel_key.fingerprint);
+    }
+};
+
+// Describes a kernel key without materializing it, so that the kernel cache
+// can be searched without building a DmlKernelKey. Matches() is only called on
+// keys whose fingerprint is equal to the query's.
+class DmlKernelKeyQuery
+{
+  public:
+    explicit DmlKernelKeyQuery(uint64_t fingerprint) : fingerprint(fingerprint)
+    {
+    }
+
+    virtual ~DmlKernelKeyQuery() = default;
+    virtual bool Matches(const DmlKernelKey& key) const = 0;
+
+    const uint64_t fingerprint;
+};
+
+// Hash and equality functors for containers keyed by DmlKernelKey which also
+// support lookups by DmlKernelKeyQuery.
+struct DmlKernelKeyHash
+{
+    using is_transparent = void;
+
+    size_t operator()(const DmlKernelKey& key) const { return key.fingerprint; }
+
+    size_t operator()(const DmlKernelKeyQuery& query) const
+    {
+        return query.fingerprint;
+    }
+};
+
+struct DmlKernelKeyEq
+{
+    using is_transparent = void;
+
+    bool operator()(const DmlKernelKey& a, const DmlKernelKey& b) const
+    {
+        return a == b;
+    }
+
+    bool operator()(const DmlKernelKey& key, const DmlKernelKeyQuery& query)
+        const
+    {
+        return key.fingerprint == query.fingerprint && query.Matches(key);
+    }
+
+    bool operator()(const DmlKernelKeyQuery& query, const DmlKernelKey& key)
+        const
+    {
+        return (*this)(key, query);
     }
 };
 
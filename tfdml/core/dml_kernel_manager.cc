@@ -15,6 +15,12 @@ limitations under the License.
 
 #include "tfdml/core/dml_kernel_manager.h"
 
+#include <algorithm>
+#include <thread>
+
+#include "absl/memory/memory.h"
+#include "tfdml/core/dml_ops_common.h"
+#include "tfdml/core/dml_tracing.h"
 #include "tfdml/runtime_adapter/env_var.h"
 
 namespace tfdml
@@ -34,111 +40,473 @@ static size_t GetMaxCacheSize()
     return DmlKernelManager::kDefaultMaxCacheSize;
 }
 
-DmlKernelManager::DmlKernelManager() : max_cache_size_(GetMaxCacheSize()) {}
+static uint64_t GetMaxCacheBytes()
+{
+    int64_t env_var = -1;
+    Status s = ReadInt64FromEnvVar(
+        "TF_DIRECTML_KERNEL_CACHE_MAX_BYTES",
+        -1,
+        &env_var);
 
-void DmlKernelManager::TrimCache() const
+    if (s.ok() && env_var >= 0)
+    {
+        return env_var;
+    }
+
+    return DmlKernelManager::kDefaultMaxCacheBytes;
+}
+
+// Returns the stripe of the reader counters used by the calling thread.
+static size_t GetReaderStripe(size_t stripe_count)
+{
+    static std::atomic<size_t> next_stripe = {0};
+    thread_local size_t stripe = next_stripe.fetch_add(1);
+    return stripe % stripe_count;
+}
+
+DmlKernelManager::DmlKernelManager(ID3D12Fence* fence, DmlCounters* counters)
+    : max_cache_size_(GetMaxCacheSize()),
+      max_cache_bytes_(GetMaxCacheBytes()),
+      fence_(fence),
+      counters_(counters)
+{
+    for (Shard& shard : shards_)
+    {
+        shard.snapshot.store(new CacheMap());
+    }
+}
+
+DmlKernelManager::~DmlKernelManager()
+{
+    for (Shard& shard : shards_)
+    {
+        delete shard.snapshot.load();
+    }
+}
+
+DmlKernelManager::Shard& DmlKernelManager::GetShard(uint64_t fingerprint) const
 {
-    assert(lru_list_.size() == kernel_cache_.size());
+    // Use the high bits of the fingerprint to select the shard: the hash map
+    // within the shard relies on the low bits, which would otherwise be
+    // identical for all of the keys in a shard.
+    return shards_[fingerprint >> (64 - kShardCountLog2)];
+}
+
+std::shared_ptr<DmlKernel> DmlKernelManager::LookupKernel(
+    const DmlKernelKey& key) const
+{
+    class KeyQuery final : public DmlKernelKeyQuery
+    {
+      public:
+        explicit KeyQuery(const DmlKernelKey& key)
+            : DmlKernelKeyQuery(key.fingerprint),
+              key_(key)
+        {
+        }
+
+        bool Matches(const DmlKernelKey& key) const final
+        {
+            return key == key_;
+        }
+
+      private:
+        const DmlKernelKey& key_;
+    };
+
+    return LookupKernel(KeyQuery(key));
+}
 
-    if (kernel_cache_.size() <= max_cache_size_)
+std::shared_ptr<DmlKernel> DmlKernelManager::LookupKernel(
+    const DmlKernelKeyQuery& query) const
+{
+    Shard& shard = GetShard(query.fingerprint);
+
+    // Register as a reader of the current epoch before loading the snapshot,
+    // so that a writer publishing a new snapshot waits for us to finish before
+    // freeing the one we're about to read. All of these operations must be
+    // sequentially consistent for that guarantee to hold.
+    //
+    // The epoch may advance between reading it and registering: a writer could
+    // then have drained the parity we registered in before we registered, and
+    // a second writer only drains the other parity. Publishes are serialized,
+    // so if the epoch is unchanged after registering, any writer replacing the
+    // snapshot we load is bound to wait for us. Otherwise, retry.
+    const size_t stripe = GetReaderStripe(kReaderStripeCount);
+    std::atomic<int64_t>* reader_count;
+    for (;;)
+    {
+        uint32_t epoch = shard.epoch.load();
+        reader_count = &shard.reader_counts[epoch & 1][stripe].value;
+        reader_count->fetch_add(1);
+
+        if (shard.epoch.load() == epoch)
+        {
+            break;
+        }
+
+        reader_count->fetch_sub(1);
+    }
+
+    const CacheMap* snapshot = shard.snapshot.load();
+
+    std::shared_ptr<DmlKernel> kernel;
+    auto it = snapshot->find(query);
+    if (it != snapshot->end())
+    {
+        const CacheEntry& entry = *it->second;
+
+        // Avoid dirtying the cache line when the bit is already set
+        if (!entry.referenced.load(std::memory_order_relaxed))
+        {
+            entry.referenced.store(true, std::memory_order_relaxed);
+        }
+
+        kernel = entry.kernel;
+    }
+
+    reader_count->fetch_sub(1);
+    return kernel;
+}
+
+std::shared_ptr<DmlKernel> DmlKernelManager::CountLookup(
+    std::shared_ptr<DmlKernel> kernel) const
+{
+    counters_->Increment(
+        kernel ? DmlCounter::KernelCacheHits : DmlCounter::KernelCacheMisses);
+    return kernel;
+}
+
+void DmlKernelManager::InsertKernel(
+    const DmlKernelKey& key,
+    std::shared_ptr<DmlKernel> kernel,
+    std::chrono::nanoseconds creation_time) const
+{
+    assert(key.fingerprint == key.ComputeFingerprint());
+    Shard& shard = GetShard(key.fingerprint);
+
+    // Make a deep copy of the key so that we own the memory
+    auto key_copy = key.Clone();
+
+    auto entry = std::make_shared<CacheEntry>();
+    entry->size_in_bytes =
+        kKernelOverheadBytes + kernel->GetPersistentResourceSize();
+    entry->kernel = std::move(kernel);
+    entry->creation_time = creation_time;
+    const uint64_t entry_size_in_bytes = entry->size_in_bytes;
+
+    std::unique_ptr<const CacheMap> old_snapshot;
+    {
+        std::unique_lock<std::mutex> lock(shard.writer_mutex);
+        const CacheMap* snapshot = shard.snapshot.load();
+
+        auto it = snapshot->find(key_copy);
+        if (it != snapshot->end())
+        {
+            it->second->referenced.store(true, std::memory_order_relaxed);
+            return;
+        }
+
+        auto new_snapshot = absl::make_unique<CacheMap>(*snapshot);
+        new_snapshot->emplace(std::move(key_copy), std::move(entry));
+        old_snapshot = PublishSnapshot(shard, std::move(new_snapshot));
+
+        // The totals are only updated under the shard's lock, along with the
+        // snapshot, so that a concurrent ClearCache or eviction never
+        // subtracts an entry before it has been added.
+        cache_size_.fetch_add(1);
+        cache_bytes_.fetch_add(entry_size_in_bytes);
+    }
+
+    TrimCache();
+}
+
+std::unique_ptr<const DmlKernelManager::CacheMap> DmlKernelManager::
+    PublishSnapshot(Shard& shard, std::unique_ptr<const CacheMap> new_snapshot)
+        const
+{
+    std::unique_ptr<const CacheMap> old_snapshot(
+        shard.snapshot.exchange(new_snapshot.release()));
+
+    // Readers which start from now on register in the new epoch, and can only
+    // observe the new snapshot. Readers registered in the old epoch may still
+    // be using the old snapshot, so wait for all of them to leave. Lookups are
+    // short and never block, so this wait is brief.
+    uint32_t old_epoch = shard.epoch.fetch_add(1) & 1;
+
+    for (ReaderCount& reader_count : shard.reader_counts[old_epoch])
+    {
+        while (reader_count.value.load() != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    return old_snapshot;
+}
+
+bool DmlKernelManager::IsOverBudget() const
+{
+    return cache_size_.load() > max_cache_size_ ||
+           cache_bytes_.load() > max_cache_bytes_;
+}
+
+void DmlKernelManager::TrimCache() const
+{
+    // If another thread is already trimming, let it do the work
+    std::unique_lock<std::mutex> lock(trim_mutex_, std::try_to_lock);
+    if (!lock.owns_lock())
     {
-        // The cache is within the maximum size; nothing to do
         return;
     }
 
-    // Find the least-recently used element
-    const DmlKernelKey* lru_key = lru_list_.back();
+    // A single pass of the CLOCK hand over every shard clears all reference
+    // bits, so after two passes something must have been evicted unless the
+    // kernels are being used concurrently; bound the sweep so that trimming
+    // never spins indefinitely.
+    size_t shards_remaining = 2 * kShardCount;
 
-    TF_VLog(
-        3,
-        "DmlKernelManager: evicting '%s' from cache, key=%#010x",
-        lru_key->op_type_name.c_str(),
-        lru_key);
+    while (IsOverBudget() && shards_remaining > 0)
+    {
+        Shard& shard = shards_[clock_hand_];
 
-    // Erase it from the LRU list and the cache
-    lru_list_.pop_back();
-    size_t elements_removed = kernel_cache_.erase(*lru_key);
+        if (!EvictFromShard(shard))
+        {
+            --shards_remaining;
+        }
 
-    assert(elements_removed == 1);
+        // Move on after every eviction as well: evicting from a shard clears
+        // all of its reference bits, so staying on it would evict its entries
+        // regardless of how recently they were used.
+        clock_hand_ = (clock_hand_ + 1) % kShardCount;
+    }
 }
 
-void DmlKernelManager::OnRecentlyUsed(
-    const DmlKernelKey* key,
-    CacheEntry* entry) const
+bool DmlKernelManager::EvictFromShard(Shard& shard) const
 {
-    if (entry->lru_iter == lru_list_.begin())
+    std::unique_ptr<const CacheMap> old_snapshot;
+    uint64_t victim_size_in_bytes = 0;
     {
-        return; // This entry is already the most-recently used
+        std::unique_lock<std::mutex> lock(shard.writer_mutex);
+        const CacheMap* snapshot = shard.snapshot.load();
+
+        auto victim = snapshot->end();
+        double victim_score = 0;
+        for (auto it = snapshot->begin(); it != snapshot->end(); ++it)
+        {
+            const CacheEntry& entry = *it->second;
+            if (entry.referenced.exchange(false, std::memory_order_relaxed))
+            {
+                continue;
+            }
+
+            // Kernels which hold a lot of memory but were quick to build are
+            // the cheapest to give up.
+            double score = static_cast<double>(entry.size_in_bytes) /
+                           std::max<int64_t>(entry.creation_time.count(), 1);
+
+            if (victim == snapshot->end() || score > victim_score)
+            {
+                victim = it;
+                victim_score = score;
+            }
+        }
+
+        if (victim == snapshot->end())
+        {
+            return false;
+        }
+
+        victim_size_in_bytes = victim->second->size_in_bytes;
+
+        TF_VLog(
+            3,
+            "DmlKernelManager: evicting '%s' from cache (%llu bytes, built in "
+            "%.3f ms), key=%#010x",
+            victim->first.op_type_name.c_str(),
+            victim_size_in_bytes,
+            victim->second->creation_time.count() / 1e6,
+            &victim->first);
+
+        auto new_snapshot = absl::make_unique<CacheMap>(*snapshot);
+        new_snapshot->erase(victim->first);
+        old_snapshot = PublishSnapshot(shard, std::move(new_snapshot));
+        cache_size_.fetch_sub(1);
+        cache_bytes_.fetch_sub(victim_size_in_bytes);
+    }
+
+    evicted_kernel_count_.fetch_add(1);
+    evicted_bytes_.fetch_add(victim_size_in_bytes);
+
+    // The old snapshot (and with it, possibly the evicted kernel) is freed
+    // here, outside of the lock, because kernel destructors can run arbitrary
+    // code.
+    old_snapshot.reset();
+    return true;
+}
+
+std::shared_ptr<DmlKernelManager::InFlightCreation> DmlKernelManager::
+    BeginKernelCreation(const DmlKernelKey& key, bool* is_creator) const
+{
+    std::unique_lock<std::mutex> lock(in_flight_mutex_);
+
+    auto it = in_flight_creations_.find(key);
+    if (it != in_flight_creations_.end())
+    {
+        *is_creator = false;
+        duplicate_creations_avoided_count_.fetch_add(1);
+
+        TF_VLog(
+            3,
+            "DmlKernelManager: waiting for in-flight creation of '%s' kernel",
+            key.op_type_name.c_str());
+
+        return it->second;
+    }
+
+    // The kernel may have been created by another thread (which has since
+    // retired its in-flight creation) after the caller missed in the cache.
+    // Kernels are cached before their in-flight creation is retired, so
+    // checking the cache under the lock is enough to catch this.
+    std::shared_ptr<DmlKernel> kernel = LookupKernel(key);
+    if (kernel)
+    {
+        *is_creator = false;
+        duplicate_creations_avoided_count_.fetch_add(1);
+
+        auto creation = std::make_shared<InFlightCreation>();
+        creation->completed = true;
+        creation->kernel = std::move(kernel);
+        return creation;
+    }
+
+    *is_creator = true;
+
+    auto creation = std::make_shared<InFlightCreation>();
+    in_flight_creations_.emplace(key, creation);
+    return creation;
+}
+
+void DmlKernelManager::EndKernelCreation(
+    const DmlKernelKey& key,
+    InFlightCreation* creation,
+    std::shared_ptr<DmlKernel> kernel,
+    std::chrono::nanoseconds creation_time) const
+{
+    if (kernel)
+    {
+        InsertKernel(key, kernel, creation_time);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(in_flight_mutex_);
+        in_flight_creations_.erase(key);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(creation->mutex);
+        creation->completed = true;
+        creation->kernel = std::move(kernel);
     }
 
-    // Remove it from the LRU list and re-insert it at the beginning (the list
-    // is ordered from most-recently to least-recently used)
-    lru_list_.erase(entry->lru_iter);
-    lru_list_.push_front(key);
-    entry->lru_iter = lru_list_.begin();
+    creation->completed_cv.notify_all();
+}
+
+std::shared_ptr<DmlKernel> DmlKernelManager::WaitForKernelCreation(
+    InFlightCreation* creation) const
+{
+    std::unique_lock<std::mutex> lock(creation->mutex);
+    creation->completed_cv.wait(
+        lock,
+        [creation] { return creation->completed; });
+    return creation->kernel;
+}
+
+bool DmlKernelManager::KernelConstructionSucceeded(DmlKernelConstruction* ctx)
+{
+    return ctx == nullptr || ctx->GetOpKernelContext()->status().ok();
 }
 
 void DmlKernelManager::OnKernelCreation(
     const DmlKernelKey* key,
-    DmlKernel* kernel) const
+    DmlKernel* kernel,
+    std::chrono::nanoseconds creation_time) const
 {
+    kernel_creation_count_.fetch_add(1);
+    total_kernel_creation_time_ns_.fetch_add(creation_time.count());
+    counters_->Increment(DmlCounter::KernelCreations);
+    counters_->Add(DmlCounter::KernelCreationTimeNs, creation_time.count());
+    DmlTracing::Instance().LogKernelCreation(key->op_type_name, creation_time);
+
     TF_VLog(
         3,
-        "DmlKernelManager: instantating '%s' kernel, key=%#010x, kernel=%#010x",
+        "DmlKernelManager: instantiated '%s' kernel in %.3f ms, key=%#010x, "
+        "kernel=%#010x",
         key->op_type_name.c_str(),
+        creation_time.count() / 1e6,
         key,
         kernel);
 }
 
 void DmlKernelManager::QueueReference(
     std::shared_ptr<DmlKernel> kernel,
-    DmlGpuEvent gpu_event) const
+    const DmlGpuEvent& gpu_event) const
 {
-    std::unique_lock<std::mutex> lock(mutex_);
+    assert(gpu_event.fence.Get() == fence_.Get());
+
+    std::unique_lock<std::mutex> lock(queued_references_mutex_);
+
+    // Fence values are queued in increasing order. A thread may queue its
+    // reference after another thread has already queued a later fence value,
+    // in which case the reference is added to the latest entry instead: that
+    // only delays its release, but keeps the queue sorted.
+    if (queued_references_.empty() ||
+        gpu_event.fence_value > queued_references_.back().fence_value)
+    {
+        QueuedReferences refs = {};
+        refs.fence_value = gpu_event.fence_value;
+        queued_references_.push_back(std::move(refs));
+    }
+
+    auto& kernels = queued_references_.back().kernels;
+
+    // Kernels that run repeatedly usually do so within the same fence value,
+    // and only need to be referenced once
+    if (kernels.empty() || kernels.back() != kernel)
+    {
+        kernels.push_back(std::move(kernel));
+    }
+
+    bool should_release = queued_references_.size() > kMaxQueuedFenceValues;
+    lock.unlock();
 
-    QueuedReference ref = {};
-    ref.kernel = std::move(kernel);
-    ref.gpu_event = std::move(gpu_event);
-    queued_references_.push_back(std::move(ref));
+    if (should_release)
+    {
+        ReleaseCompletedReferences();
+    }
 }
 
 void DmlKernelManager::ReleaseCompletedReferences() const
 {
-    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t completed_fence_value = fence_->GetCompletedValue();
+
+    std::vector<QueuedReferences> references_to_free;
 
-    std::vector<QueuedReference> references_to_free;
+    std::unique_lock<std::mutex> lock(queued_references_mutex_);
 
-    // Search the `queued_references_` for references that can be freed, and
-    // move them into `references_to_free`. While searching for freeable
-    // references, this loop also compacts the elements of `queued_references_`
-    // such that all remaining valid objects are at the beginning of the vector.
-    // The invalid, moved-from objects at the end are then erase()'d after the
-    // loop.
-    auto dst = queued_references_.begin();
-    for (auto it = dst; it != queued_references_.end(); ++it)
+    // Since the queue is sorted by fence value, the completed references are
+    // exactly its prefix
+    while (!queued_references_.empty() &&
+           queued_references_.front().fence_value <= completed_fence_value)
     {
-        if (it->gpu_event.IsSignaled())
-        {
-            // Move this reference into references_to_free
-            references_to_free.push_back(std::move(*it));
-        }
-        else
-        {
-            // Compact the queued_references_ vector
-            if (it != dst)
-            {
-                *dst = std::move(*it);
-            }
-            ++dst;
-        }
+        references_to_free.push_back(std::move(queued_references_.front()));
+        queued_references_.pop_front();
     }
 
-    queued_references_.erase(dst, queued_references_.end());
     lock.unlock();
 
     TF_VLog(
         2,
-        "DmlKernelManager: cleared %llu references.",
+        "DmlKernelManager: cleared references for %llu fence values.",
         references_to_free.size());
 
     // Clearing this vector releases the references. This is done outside the
@@ -149,15 +517,59 @@ void DmlKernelManager::ReleaseCompletedReferences() const
 
 size_t DmlKernelManager::GetCacheSize() const
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return kernel_cache_.size();
+    return cache_size_.load();
+}
+
+uint64_t DmlKernelManager::GetCacheSizeInBytes() const
+{
+    return cache_bytes_.load();
+}
+
+uint64_t DmlKernelManager::GetEvictedKernelCount() const
+{
+    return evicted_kernel_count_.load();
+}
+
+uint64_t DmlKernelManager::GetEvictedBytes() const
+{
+    return evicted_bytes_.load();
+}
+
+uint64_t DmlKernelManager::GetKernelCreationCount() const
+{
+    return kernel_creation_count_.load();
+}
+
+std::chrono::nanoseconds DmlKernelManager::GetTotalKernelCreationTime() const
+{
+    return std::chrono::nanoseconds(total_kernel_creation_time_ns_.load());
+}
+
+uint64_t DmlKernelManager::GetDuplicateCreationsAvoidedCount() const
+{
+    return duplicate_creations_avoided_count_.load();
 }
 
 void DmlKernelManager::ClearCache()
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-    lru_list_.clear();
-    kernel_cache_.clear();
+    for (Shard& shard : shards_)
+    {
+        std::unique_ptr<const CacheMap> old_snapshot;
+        {
+            std::unique_lock<std::mutex> lock(shard.writer_mutex);
+            old_snapshot =
+                PublishSnapshot(shard, absl::make_unique<CacheMap>());
+
+            uint64_t old_bytes = 0;
+            for (const auto& item : *old_snapshot)
+            {
+                old_bytes += item.second->size_in_bytes;
+            }
+
+            cache_size_.fetch_sub(old_snapshot->size());
+            cache_bytes_.fetch_sub(old_bytes);
+        }
+    }
 }
 
-} // namespace tfdml
\ No newline at end of file
+} // namespace tfdml
@@ -15,10 +15,17 @@ limitations under the License.
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <memory>
 
-#include "absl/container/node_hash_map.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
 #include "tfdml/core/dml_common.h"
+#include "tfdml/core/dml_counters.h"
 #include "tfdml/core/dml_gpu_event.h"
 #include "tfdml/core/dml_kernel_context.h"
 #include "tfdml/core/dml_kernel_key.h"
@@ -55,7 +62,20 @@ class DmlKernelManager
     // variable
     static constexpr size_t kDefaultMaxCacheSize = 1536;
 
-    DmlKernelManager();
+    // The budget for the total weight of the cached kernels, in bytes. Can be
+    // overridden by the TF_DIRECTML_KERNEL_CACHE_MAX_BYTES environment
+    // variable.
+    static constexpr uint64_t kDefaultMaxCacheBytes = 512ull * 1024 * 1024;
+
+    // The weight of a cached kernel in addition to its persistent resource,
+    // which accounts for the compiled operator and the cache entry itself.
+    static constexpr uint64_t kKernelOverheadBytes = 64 * 1024;
+
+    // `fence` is the fence signaled by the device's execution context, which
+    // the GPU events supplied to QueueReference must belong to. Cache lookups
+    // and kernel creations are tallied in `counters`.
+    DmlKernelManager(ID3D12Fence* fence, DmlCounters* counters);
+    ~DmlKernelManager();
 
     template <typename TKernel>
     std::shared_ptr<TKernel> CreateCachedKernel(
@@ -67,44 +87,47 @@ class DmlKernelManager
             std::is_base_of<DmlKernel, TKernel>::value,
             "Kernel type does not inherit from DmlKernel");
 
-        // Create a new kernel. Because this can potentially be
-        // slow, we don't hold the lock over the kernel creation.
-        auto kernel = std::make_shared<TKernel>(ctx, init_helper);
-        OnKernelCreation(&key, kernel.get());
-
-        // Make a deep copy of the key so that we own the memory
-        auto key_copy = key.Clone();
+        // Only one thread creates the kernel for a given key at a time. Other
+        // threads which miss on the same key in the meantime wait for that
+        // kernel instead of compiling a duplicate of it.
+        bool is_creator = false;
+        std::shared_ptr<InFlightCreation> creation =
+            BeginKernelCreation(key, &is_creator);
 
-        std::unique_lock<std::mutex> lock(mutex_);
-
-        CacheEntry entry = {};
-        entry.kernel = kernel;
-
-        // Another thread may have already inserted an instance of this kernel
-        // into the cache while we weren't holding the lock. That's okay; in
-        // this case, the .emplace() is a no-op and the kernel will not be
-        // cached.
-        auto result = kernel_cache_.emplace(key_copy, std::move(entry));
+        if (!is_creator)
+        {
+            std::shared_ptr<DmlKernel> kernel =
+                WaitForKernelCreation(creation.get());
 
-        // Retrieve the iterator to the newly-inserted element, or the existing
-        // element if another thread beat us to it.
-        auto it = result.first;
+            if (kernel)
+            {
+                return std::static_pointer_cast<TKernel>(kernel);
+            }
 
-        bool insertion_succeeded = result.second;
-        if (insertion_succeeded)
-        {
-            // If this was a newly-inserted cache entry, also add an LRU entry
-            lru_list_.push_front(&it->first);
-            it->second.lru_iter = lru_list_.begin();
+            // The creating thread failed to construct the kernel. Construct
+            // our own, uncached, so that the error is reported on our context.
+            return std::make_shared<TKernel>(ctx, init_helper);
         }
 
-        // Update the LRU cache
-        OnRecentlyUsed(&it->first, &it->second);
+        // Create a new kernel. Because this can potentially be slow, we don't
+        // hold any locks over the kernel creation. The kernel is constructed
+        // on the calling thread, since it needs the live OpKernelContext, but
+        // its operator compilation runs on the device's compile pool if there
+        // is one (see DmlKernelConstruction::CompileOperator).
+        auto start_time = std::chrono::steady_clock::now();
+        auto kernel = std::make_shared<TKernel>(ctx, init_helper);
+        auto creation_time =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_time);
 
-        if (insertion_succeeded)
-        {
-            TrimCache();
-        }
+        OnKernelCreation(&key, kernel.get(), creation_time);
+
+        // Kernels which failed validation during construction aren't cached
+        EndKernelCreation(
+            key,
+            creation.get(),
+            KernelConstructionSucceeded(ctx) ? kernel : nullptr,
+            creation_time);
 
         return kernel;
     }
@@ -116,27 +139,29 @@ class DmlKernelManager
             std::is_base_of<DmlKernel, TKernel>::value,
             "Kernel type does not inherit from DmlKernel");
 
-        std::unique_lock<std::mutex> lock(mutex_);
-
-        auto it = kernel_cache_.find(key);
-
-        if (it == kernel_cache_.end())
-        {
-            return nullptr;
-        }
+        return std::static_pointer_cast<TKernel>(
+            CountLookup(LookupKernel(key)));
+    }
 
-        // Update the LRU cache
-        OnRecentlyUsed(&it->first, &it->second);
+    // Same as above, but looks the kernel up by a query so that the caller
+    // doesn't need to build the full key.
+    template <typename TKernel>
+    std::shared_ptr<TKernel> TryGetCachedKernel(
+        const DmlKernelKeyQuery& query) const
+    {
+        static_assert(
+            std::is_base_of<DmlKernel, TKernel>::value,
+            "Kernel type does not inherit from DmlKernel");
 
-        auto kernel = std::static_pointer_cast<TKernel>(it->second.kernel);
-        return kernel;
+        return std::static_pointer_cast<TKernel>(
+            CountLookup(LookupKernel(query)));
     }
 
     // Ensures that a reference is maintained on a kernel at least until the
     // given GPU event enters the signaled state.
     void QueueReference(
         std::shared_ptr<DmlKernel> kernel,
-        DmlGpuEvent gpu_event) const;
+        const DmlGpuEvent& gpu_event) const;
 
     // Releases all shared_ptrs supplied to QueueReference which have had their
     // GPU event signaled.
@@ -145,53 +170,223 @@ class DmlKernelManager
     // Returns the number of cached kernels.
     size_t GetCacheSize() const;
 
+    // Returns the total weight of the cached kernels, in bytes.
+    uint64_t GetCacheSizeInBytes() const;
+
+    // Returns the number of kernels that were evicted from the cache, and
+    // their total weight in bytes.
+    uint64_t GetEvictedKernelCount() const;
+    uint64_t GetEvictedBytes() const;
+
+    // Returns the number of kernels that were created by CreateCachedKernel.
+    uint64_t GetKernelCreationCount() const;
+
+    // Returns the total time spent constructing (and compiling) the kernels
+    // created by CreateCachedKernel.
+    std::chrono::nanoseconds GetTotalKernelCreationTime() const;
+
+    // Returns the number of kernel creations that were avoided because another
+    // thread was already creating the same kernel.
+    uint64_t GetDuplicateCreationsAvoidedCount() const;
+
     // Frees all cached kernels which have completed execution on the GPU.
     void ClearCache();
 
   private:
-    // A non-owning pointer to the key for the kernel which is used to keep
-    // track of the least-recently-used kernel. This is a pointer into a
-    // kernel_cache_ element. This is okay because absl::node_hash_map is
-    // guaranteed never to invalidate pointers/references to elements.
-    using LruEntry = const DmlKernelKey*;
+    // The cache is split into independent shards (selected by the key's hash)
+    // so that insertions and evictions on one shard don't disturb lookups on
+    // the others.
+    static constexpr size_t kShardCountLog2 = 4;
+    static constexpr size_t kShardCount = size_t(1) << kShardCountLog2;
+
+    // Number of reader counters per shard and epoch. Reader threads are spread
+    // across the stripes so that concurrent lookups don't all contend on the
+    // same cache line.
+    static constexpr size_t kReaderStripeCount = 16;
 
     struct CacheEntry
     {
         std::shared_ptr<DmlKernel> kernel;
 
-        // An iterator into the lru_list_. The position of this iterator in the
-        // list indicates how recently used this cache entry is.
-        std::list<LruEntry>::iterator lru_iter;
+        // How long it took to construct the kernel.
+        std::chrono::nanoseconds creation_time;
+
+        // The weight of the entry against the cache budget: the kernel's
+        // persistent resource size plus kKernelOverheadBytes.
+        uint64_t size_in_bytes;
+
+        // CLOCK reference bit. This is set on every cache hit and cleared by
+        // the eviction sweep; entries which are found with this bit cleared
+        // haven't been used since the last sweep and are evicted. This stands
+        // in for a strict LRU ordering, which would require a lock on hits.
+        mutable std::atomic<bool> referenced = {true};
+    };
+
+    // Snapshots are immutable once published, so entries are held through
+    // shared_ptrs to let consecutive snapshots share them (and their reference
+    // bits).
+    using CacheMap = absl::flat_hash_map<
+        DmlKernelKey,
+        std::shared_ptr<const CacheEntry>,
+        DmlKernelKeyHash,
+        DmlKernelKeyEq>;
+
+    struct ReaderCount
+    {
+        std::atomic<int64_t> value = {0};
+
+        // Keeps each counter on its own cache line.
+        char padding[64 - sizeof(std::atomic<int64_t>)];
     };
 
-    struct QueuedReference
+    // Each shard is a read-copy-update map: readers access the currently
+    // published snapshot without taking any locks, while writers (which are
+    // serialized by writer_mutex) copy the snapshot, modify the copy, publish
+    // it, and then wait for readers of the old snapshot to drain before
+    // freeing it. Readers register themselves in reader_counts[epoch] for the
+    // duration of a lookup; publishing flips the epoch so that the writer only
+    // has to wait for readers which may have observed the old snapshot.
+    struct Shard
     {
+        std::mutex writer_mutex;
+        std::atomic<const CacheMap*> snapshot = {nullptr};
+        std::atomic<uint32_t> epoch = {0};
+        ReaderCount reader_counts[2][kReaderStripeCount];
+    };
+
+    // A kernel which is being created by one thread, which other threads
+    // needing the same kernel wait on.
+    struct InFlightCreation
+    {
+        std::mutex mutex;
+        std::condition_variable completed_cv;
+        bool completed = false;
+
+        // Null if the kernel failed to be constructed
         std::shared_ptr<DmlKernel> kernel;
-        DmlGpuEvent gpu_event;
     };
 
-    // Trims the cache by least recently used until it's below the max cache
-    // size.
+    // The kernels referenced until the fence reaches fence_value.
+    struct QueuedReferences
+    {
+        uint64_t fence_value;
+        absl::InlinedVector<std::shared_ptr<DmlKernel>, 4> kernels;
+    };
+
+    // Above this many distinct fence values in the queue, QueueReference
+    // releases the completed references itself instead of waiting for the
+    // next call to ReleaseCompletedReferences.
+    static constexpr size_t kMaxQueuedFenceValues = 256;
+
+    Shard& GetShard(uint64_t fingerprint) const;
+
+    // Returns the cached kernel matching the query, or nullptr if it isn't
+    // cached. This never blocks.
+    std::shared_ptr<DmlKernel> LookupKernel(
+        const DmlKernelKeyQuery& query) const;
+    std::shared_ptr<DmlKernel> LookupKernel(const DmlKernelKey& key) const;
+
+    // Inserts the kernel into the cache unless the key is already present.
+    void InsertKernel(
+        const DmlKernelKey& key,
+        std::shared_ptr<DmlKernel> kernel,
+        std::chrono::nanoseconds creation_time) const;
+
+    // Atomically replaces the shard's snapshot with `new_snapshot`, and returns
+    // the old snapshot once no reader can be accessing it anymore. The caller
+    // must hold the shard's writer_mutex.
+    std::unique_ptr<const CacheMap> PublishSnapshot(
+        Shard& shard,
+        std::unique_ptr<const CacheMap> new_snapshot) const;
+
+    // Returns true if the cache exceeds either its max size or its byte
+    // budget.
+    bool IsOverBudget() const;
+
+    // Sweeps the shards with the CLOCK hand, evicting entries that haven't been
+    // used since the previous sweep until the cache is within its budget. This
+    // only runs when new kernels are inserted, never on cache hits.
     void TrimCache() const;
 
-    // Marks the cache entry as being recently used, for the purposes of the LRU
-    // cache. `key` and `entry` must be pointers into elements of the
-    // kernel_cache_ map.
-    void OnRecentlyUsed(const DmlKernelKey* key, CacheEntry* entry) const;
+    // Evicts at most one unreferenced entry from the shard and clears the
+    // reference bits of the others. Among the unreferenced entries, the one
+    // that is the most expensive to keep relative to the cost of rebuilding it
+    // (i.e. with the most bytes per nanosecond of construction time) is
+    // evicted. Returns true if an entry was evicted.
+    bool EvictFromShard(Shard& shard) const;
+
+    // Returns the in-flight creation of the kernel for `key`. If no other
+    // thread is creating it, a new in-flight creation is registered and
+    // `is_creator` is set to true; the caller must then create the kernel and
+    // call EndKernelCreation.
+    std::shared_ptr<InFlightCreation> BeginKernelCreation(
+        const DmlKernelKey& key,
+        bool* is_creator) const;
+
+    // Caches the kernel (unless it's null, which indicates that its
+    // construction failed) and wakes up the threads waiting for it.
+    void EndKernelCreation(
+        const DmlKernelKey& key,
+        InFlightCreation* creation,
+        std::shared_ptr<DmlKernel> kernel,
+        std::chrono::nanoseconds creation_time) const;
+
+    // Blocks until the kernel has been created by another thread. Returns null
+    // if that thread failed to construct it.
+    std::shared_ptr<DmlKernel> WaitForKernelCreation(
+        InFlightCreation* creation) const;
 
-    void OnKernelCreation(const DmlKernelKey* key, DmlKernel* kernel) const;
+    static bool KernelConstructionSucceeded(DmlKernelConstruction* ctx);
+
+    // Tallies a lookup by TryGetCachedKernel as a cache hit or miss.
+    std::shared_ptr<DmlKernel> CountLookup(
+        std::shared_ptr<DmlKernel> kernel) const;
+
+    void OnKernelCreation(
+        const DmlKernelKey* key,
+        DmlKernel* kernel,
+        std::chrono::nanoseconds creation_time) const;
 
-    mutable std::mutex mutex_;
     const size_t max_cache_size_;
+    const uint64_t max_cache_bytes_;
+
+    mutable std::array<Shard, kShardCount> shards_;
+
+    // The total number of entries across all shards. Like cache_bytes_, it's
+    // only updated while holding the writer_mutex of the shard whose entries
+    // are added or removed, so it never drops below the true total.
+    mutable std::atomic<size_t> cache_size_ = {0};
+
+    // The total weight of the entries across all shards.
+    mutable std::atomic<uint64_t> cache_bytes_ = {0};
+
+    mutable std::atomic<uint64_t> evicted_kernel_count_ = {0};
+    mutable std::atomic<uint64_t> evicted_bytes_ = {0};
+
+    // Serializes TrimCache sweeps and protects clock_hand_.
+    mutable std::mutex trim_mutex_;
+    mutable size_t clock_hand_ = 0;
 
-    // All of these members are protected by mutex_
+    // Protects in_flight_creations_.
+    mutable std::mutex in_flight_mutex_;
+    mutable absl::flat_hash_map<
+        DmlKernelKey,
+        std::shared_ptr<InFlightCreation>,
+        DmlKernelKeyHash,
+        DmlKernelKeyEq>
+        in_flight_creations_;
 
-    mutable absl::node_hash_map<DmlKernelKey, CacheEntry> kernel_cache_;
+    mutable std::atomic<uint64_t> kernel_creation_count_ = {0};
+    mutable std::atomic<int64_t> total_kernel_creation_time_ns_ = {0};
+    mutable std::atomic<uint64_t> duplicate_creations_avoided_count_ = {0};
 
-    // Ordered by most-recently to least-recently used.
-    mutable std::list<LruEntry> lru_list_;
+    Microsoft::WRL::ComPtr<ID3D12Fence> fence_;
+    DmlCounters* counters_; // weak; owned by DmlDeviceState
 
-    mutable std::vector<QueuedReference> queued_references_;
+    // Protects queued_references_, which is ordered by fence value so that the
+    // completed references are always at its front.
+    mutable std::mutex queued_references_mutex_;
+    mutable std::deque<QueuedReferences> queued_references_;
 };
 
 } // namespace tfdml
\ No newline at end of file
@@ -15,6 +15,9 @@ limitations under the License.
 ==============================================================================*/
 
 #include "tfdml/core/dml_kernel_wrapper.h"
+
+#include <algorithm>
+
 #include "tfdml/core/dml_execution_context.h"
 #include "tfdml/core/dml_operator_helper.h"
 #include "tfdml/core/dml_tracing.h"
@@ -24,11 +27,59 @@ limitations under the License.
 namespace tfdml
 {
 
+// Looks up the kernel needed by an OpKernelContext in the kernel cache. The
+// inputs are retrieved once and shared between the fingerprint and the
+// comparison against candidate keys, and no DmlKernelKey is built.
+class DmlKernelWrapperBase::ContextKeyQuery final : public DmlKernelKeyQuery
+{
+  public:
+    ContextKeyQuery(
+        const DmlKernelWrapperBase* wrapper,
+        OpKernelContext* ctx,
+        absl::Span<const Tensor> inputs)
+        : DmlKernelKeyQuery(wrapper->ComputeKernelKeyFingerprint(ctx, inputs)),
+          wrapper_(wrapper),
+          ctx_(ctx),
+          inputs_(inputs)
+    {
+    }
+
+    bool Matches(const DmlKernelKey& key) const final
+    {
+        return wrapper_->KernelKeyMatches(ctx_, inputs_, key);
+    }
+
+  private:
+    const DmlKernelWrapperBase* wrapper_;
+    OpKernelContext* ctx_;
+    absl::Span<const Tensor> inputs_;
+};
+
+// Resource types cannot be hashed or copied, so they cannot form part of a
+// kernel key. Therefore, resource tensors cannot be used as constant CPU
+// inputs. This is okay because it's unlikely a kernel would ever want to take a
+// dependency on the value of a *resource handle*, rather than the contents of
+// the tensor the handle refers to.
+//
+// The datatype is read from the already retrieved input rather than with
+// OpKernelContext::input_dtype, which retrieves the input all over again.
+static bool IsConstantCpuInput(
+    OpKernelContext* ctx,
+    int index,
+    const Tensor& input)
+{
+    return ctx->input_memory_type(index) == HOST_MEMORY &&
+           input.dtype() != TF_RESOURCE;
+}
+
 DmlKernelWrapperBase::DmlKernelWrapperBase(
     DmlKernelCachePolicy cache_policy,
     std::shared_ptr<const NodeDef> node_def)
-    : OpKernel(std::move(node_def)),
-      cache_policy_(cache_policy)
+    : OpKernel(node_def),
+      cache_policy_(cache_policy),
+      attribute_hash_(DmlKernelKey::HashAttributes(
+          node_def->GetOpTypeName(),
+          node_def.get()))
 {
 }
 
@@ -44,24 +95,49 @@ void DmlKernelWrapperBase::ComputeImpl(OpKernelContext* ctx)
     std::shared_ptr<DmlKernel> kernel;
     std::vector<TensorShape> output_shapes;
     const InitializationHelper* init_helper = nullptr;
-    DmlKernelKey key;
+
+    // Set if the kernel was found in the inline cache, along with its output
+    // shapes if they can be reused
+    bool inline_cache_hit = false;
+    std::shared_ptr<const std::vector<TensorShape>> inline_output_shapes;
+
+    DmlKernelContext::InputTensors inputs;
+    absl::optional<DmlKernelKey> key;
 
     if (cache_policy_ != DmlKernelCachePolicy::Never)
     {
-        // Construct a kernel key which uniquely identifies the kernel instance
-        // we need
-        key = CreateKernelKey(ctx);
+        inputs.reserve(ctx->num_inputs());
+
+        for (int i = 0; i < ctx->num_inputs(); ++i)
+        {
+            inputs.push_back(ctx->input(i));
+        }
+
+        ContextKeyQuery query(this, ctx, inputs);
+
+        // Most nodes see the same inputs on every step, in which case the
+        // kernel and its output shapes can be reused directly
+        kernel = TryGetInlineCachedKernel(query, &inline_output_shapes);
+        inline_cache_hit = kernel != nullptr;
 
-        // Retrieve an appropriate DmlKernel from the cache. If the kernel
-        // hasn't been cached yet, it will be null
-        kernel = TryGetCachedKernel(kernel_manager, key);
+        // Otherwise, retrieve an appropriate DmlKernel from the cache. The
+        // full kernel key is only built if we need to create a new kernel. If
+        // the kernel hasn't been cached yet, it will be null
+        if (!kernel)
+        {
+            kernel = TryGetCachedKernel(kernel_manager, query);
+        }
     }
 
     // If we found a cached kernel, simply retrieve its initialization helper
     if (kernel)
     {
         init_helper = kernel->GetInitializationHelper();
-        output_shapes = shape_helper->GetOutputShapes(ctx, init_helper);
+
+        if (!inline_output_shapes)
+        {
+            output_shapes = shape_helper->GetOutputShapes(ctx, init_helper);
+        }
     }
     else
     {
@@ -182,10 +258,14 @@ void DmlKernelWrapperBase::ComputeImpl(OpKernelContext* ctx)
         }
         else
         {
+            // Construct a kernel key which uniquely identifies the kernel
+            // instance we need
+            key = CreateKernelKey(ctx);
+
             kernel = CreateCachedKernel(
                 &dml_construction,
                 kernel_manager,
-                key,
+                *key,
                 init_helper);
         }
 
@@ -198,14 +278,49 @@ void DmlKernelWrapperBase::ComputeImpl(OpKernelContext* ctx)
 
     assert(kernel != nullptr);
 
-    // Execute the kernel
+    if (cache_policy_ != DmlKernelCachePolicy::Never && !inline_cache_hit)
+    {
+        // Remember this kernel for the next time this node sees these inputs.
+        // Building the key here only happens when the node's inputs change.
+        if (!key)
+        {
+            key = CreateKernelKey(ctx);
+        }
+
+        // Output shapes are a function of the kernel key, except for shape
+        // helpers that look at resource inputs (e.g. the shape of a variable),
+        // since only the resource handle is part of the key. The output shapes
+        // of such nodes are computed every time.
+        bool has_resource_inputs = std::any_of(
+            inputs.begin(),
+            inputs.end(),
+            [](const Tensor& input) { return input.dtype() == TF_RESOURCE; });
+
+        if (!has_resource_inputs)
+        {
+            inline_output_shapes =
+                std::make_shared<const std::vector<TensorShape>>(
+                    std::move(output_shapes));
+        }
+
+        UpdateInlineCache(*key, kernel, inline_output_shapes);
+    }
+
+    absl::Span<const TensorShape> kernel_output_shapes =
+        inline_output_shapes ? absl::MakeConstSpan(*inline_output_shapes)
+                             : absl::MakeConstSpan(output_shapes);
+
+    // Execute the kernel. The inputs retrieved for the cache lookup are handed
+    // over to the kernel context, so that each input is only retrieved from
+    // TF once per Compute.
     DmlKernelContext dml_ctx(
         dml_device,
         ctx,
         init_helper,
-        output_shapes,
+        kernel_output_shapes,
         kernel->GetOutputRefsForwarding(),
-        kernel->SupportsInPlaceExecution());
+        kernel->SupportsInPlaceExecution(),
+        std::move(inputs));
 
     // Check for errors triggered during the kernel context's constructor (e.g.
     // OOM when allocating the output buffers)
@@ -221,6 +336,67 @@ void DmlKernelWrapperBase::ComputeImpl(OpKernelContext* ctx)
     kernel_manager.QueueReference(kernel, status_or_event.ConsumeValueOrDie());
 }
 
+std::shared_ptr<DmlKernel> DmlKernelWrapperBase::TryGetInlineCachedKernel(
+    const ContextKeyQuery& query,
+    std::shared_ptr<const std::vector<TensorShape>>* output_shapes)
+{
+    std::unique_lock<std::mutex> lock(inline_cache_mutex_);
+
+    for (size_t i = 0; i < inline_cache_.size(); ++i)
+    {
+        InlineCacheEntry& entry = inline_cache_[i];
+
+        if (!entry.key.node_def || entry.key.fingerprint != query.fingerprint ||
+            !query.Matches(entry.key))
+        {
+            continue;
+        }
+
+        // The kernel is only weakly referenced by the inline cache, so it may
+        // have been evicted from the kernel manager and freed
+        std::shared_ptr<DmlKernel> kernel = entry.kernel.lock();
+        if (!kernel)
+        {
+            entry = InlineCacheEntry();
+            return nullptr;
+        }
+
+        *output_shapes = entry.output_shapes;
+
+        // Keep the most recently used entry first, so that nodes whose inputs
+        // never change only ever check one entry
+        if (i != 0)
+        {
+            std::swap(inline_cache_[0], entry);
+        }
+
+        return kernel;
+    }
+
+    return nullptr;
+}
+
+void DmlKernelWrapperBase::UpdateInlineCache(
+    const DmlKernelKey& key,
+    std::weak_ptr<DmlKernel> kernel,
+    std::shared_ptr<const std::vector<TensorShape>> output_shapes)
+{
+    // The key is kept around for comparisons, so we need to own its memory
+    InlineCacheEntry new_entry = {};
+    new_entry.key = key.Clone();
+    new_entry.kernel = std::move(kernel);
+    new_entry.output_shapes = std::move(output_shapes);
+
+    std::unique_lock<std::mutex> lock(inline_cache_mutex_);
+
+    // Drop the least recently used entry and insert the new one first
+    std::rotate(
+        inline_cache_.begin(),
+        inline_cache_.end() - 1,
+        inline_cache_.end());
+    inline_cache_[0] = std::move(new_entry);
+}
+
 DmlKernelKey DmlKernelWrapperBase::CreateKernelKey(OpKernelContext* ctx) const
 {
     DmlKernelKey key = {};
@@ -229,17 +405,10 @@ DmlKernelKey DmlKernelWrapperBase::CreateKernelKey(OpKernelContext* ctx) const
 
     for (int i = 0; i < ctx->num_inputs(); ++i)
     {
-        // Resource types cannot be hashed or copied, so they cannot form part
-        // of a kernel key. Therefore, resource tensors cannot be used as
-        // constant CPU inputs. This is okay because it's unlikely a kernel
-        // would ever want to take a dependency on the value of a *resource
-        // handle*, rather than the contents of the tensor the handle refers to.
-        const bool is_resource_type = ctx->input_dtype(i) == TF_RESOURCE;
         Tensor tensor = ctx->input(i);
 
         DmlInputTensorKey tensor_key = {};
-        tensor_key.is_constant_cpu_input =
-            (ctx->input_memory_type(i) == HOST_MEMORY && !is_resource_type);
+        tensor_key.is_constant_cpu_input = IsConstantCpuInput(ctx, i, tensor);
 
         if (tensor_key.is_constant_cpu_input)
         {
@@ -254,7 +423,66 @@ DmlKernelKey DmlKernelWrapperBase::CreateKernelKey(OpKernelContext* ctx) const
         key.input_tensors.push_back(std::move(tensor_key));
     }
 
+    key.fingerprint = key.ComputeFingerprint(attribute_hash_);
     return key;
 }
 
-} // namespace tfdml
\ No newline at end of file
+uint64_t DmlKernelWrapperBase::ComputeKernelKeyFingerprint(
+    OpKernelContext* ctx,
+    absl::Span<const Tensor> inputs) const
+{
+    DmlKernelFingerprintBuilder builder(attribute_hash_);
+
+    for (int i = 0; i < inputs.size(); ++i)
+    {
+        builder.AddInputTensor(
+            inputs[i],
+            IsConstantCpuInput(ctx, i, inputs[i]));
+    }
+
+    return builder.Finish();
+}
+
+bool DmlKernelWrapperBase::KernelKeyMatches(
+    OpKernelContext* ctx,
+    absl::Span<const Tensor> inputs,
+    const DmlKernelKey& key) const
+{
+    if (key.input_tensors.size() != inputs.size() ||
+        !KernelKeyAttributesMatch(key))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < inputs.size(); ++i)
+    {
+        if (!key.input_tensors[i].Matches(
+                inputs[i],
+                IsConstantCpuInput(ctx, i, inputs[i])))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool DmlKernelWrapperBase::KernelKeyAttributesMatch(
+    const DmlKernelKey& key) const
+{
+    if (key.op_type_name != this->type_string())
+    {
+        return false;
+    }
+
+    // Kernels created by this node share its NodeDef, in which case the
+    // attributes don't need to be compared
+    const NodeDef* node_def = key.node_def.get();
+    const NodeDef* this_node_def = &this->node_def_ref();
+
+    return node_def == this_node_def ||
+           node_def->GetAttributeValues() ==
+               this_node_def->GetAttributeValues();
+}
+
+} // namespace tfdml
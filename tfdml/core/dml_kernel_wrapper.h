@@ -16,6 +16,8 @@ limitations under the License.
 
 #pragma once
 
+#include <array>
+
 #include "tfdml/core/dml_common.h"
 #include "tfdml/core/dml_device.h"
 #include "tfdml/core/dml_kernel_manager.h"
@@ -61,7 +63,7 @@ class DmlKernelWrapperBase : public OpKernel
 
     virtual std::shared_ptr<DmlKernel> TryGetCachedKernel(
         const DmlKernelManager& kernel_manager,
-        const DmlKernelKey& key) const = 0;
+        const DmlKernelKeyQuery& query) const = 0;
 
     virtual std::shared_ptr<DmlKernel> CreateKernel(
         DmlKernelConstruction* ctx,
@@ -77,10 +79,66 @@ class DmlKernelWrapperBase : public OpKernel
     // cache.
     virtual DmlKernelKey CreateKernelKey(OpKernelContext* ctx) const;
 
+    // Computes the fingerprint of the key that CreateKernelKey would return for
+    // the given inputs, without building the key. Wrappers which override
+    // CreateKernelKey must override this and KernelKeyMatches to match.
+    virtual uint64_t ComputeKernelKeyFingerprint(
+        OpKernelContext* ctx,
+        absl::Span<const Tensor> inputs) const;
+
+    // Returns true if `key` is equal to the key that CreateKernelKey would
+    // return for the given inputs.
+    virtual bool KernelKeyMatches(
+        OpKernelContext* ctx,
+        absl::Span<const Tensor> inputs,
+        const DmlKernelKey& key) const;
+
+    // Returns true if the op type and attributes of `key` are this node's.
+    bool KernelKeyAttributesMatch(const DmlKernelKey& key) const;
+
     DmlKernelCachePolicy cache_policy_;
 
+    // The hash of this node's op type and attributes, which seeds the
+    // fingerprint of every key created by this kernel.
+    const uint64_t attribute_hash_;
+
   private:
+    class ContextKeyQuery;
+
+    // A small per-node cache of the most recently used kernels and their
+    // output shapes, ordered from most to least recently used. Nodes whose
+    // inputs don't change between steps (or alternate between a few different
+    // shapes) find their kernel here without going through the kernel manager
+    // or the shape helper. Kernels are only weakly referenced, so evicting them
+    // from the kernel manager still frees them.
+    struct InlineCacheEntry
+    {
+        // Empty entries have a null key.node_def
+        DmlKernelKey key;
+        std::weak_ptr<DmlKernel> kernel;
+
+        // Null if the output shapes can't be reused, in which case the shape
+        // helper is still invoked on every execution
+        std::shared_ptr<const std::vector<TensorShape>> output_shapes;
+    };
+
+    static constexpr size_t kInlineCacheSize = 4;
+
+    std::shared_ptr<DmlKernel> TryGetInlineCachedKernel(
+        const ContextKeyQuery& query,
+        std::shared_ptr<const std::vector<TensorShape>>* output_shapes);
+
+    void UpdateInlineCache(
+        const DmlKernelKey& key,
+        std::weak_ptr<DmlKernel> kernel,
+        std::shared_ptr<const std::vector<TensorShape>> output_shapes);
+
     void ComputeImpl(OpKernelContext* raw_ctx) final;
+
+    // Protects inline_cache_. This is only held for a few comparisons, and
+    // is only contended if this node executes concurrently with itself.
+    std::mutex inline_cache_mutex_;
+    std::array<InlineCacheEntry, kInlineCacheSize> inline_cache_;
 };
 
 // Implements a (templated) GetOrCreateKernel and output shape computation for
@@ -141,14 +199,14 @@ class DmlKernelWrapper : public DmlKernelWrapperBase
 
     std::shared_ptr<DmlKernel> TryGetCachedKernel(
         const DmlKernelManager& kernel_manager,
-        const DmlKernelKey& key) const final
+        const DmlKernelKeyQuery& query) const final
     {
         // If the cache policy is "Never", the kernel wrapper should never try
         // to retrieved a cached kernel
         assert(cache_policy != DmlKernelCachePolicy::Never);
 
         // Retrieve the kernel from the cache
-        return kernel_manager.TryGetCachedKernel<TKernel>(key);
+        return kernel_manager.TryGetCachedKernel<TKernel>(query);
     }
 
     std::shared_ptr<DmlKernel> CreateKernel(
@@ -18,6 +18,7 @@ limitations under the License.
 
 #include <numeric>
 
+#include "absl/memory/memory.h"
 #include "tensorflow/c/kernels.h"
 #include "tensorflow/c/logging.h"
 #include "tfdml/core/dml_tracing.h"
@@ -213,21 +214,12 @@ void DmlKernel::Initialize(
     DmlKernelTensors&& tensor_descs,
     const DML_OPERATOR_DESC& op_desc)
 {
-    IDMLDevice* dml_device = ctx->GetDmlDevice();
-
-    ComPtr<IDMLOperator> op;
-    DML_CHECK_SUCCEEDED(
-        dml_device->CreateOperator(&op_desc, IID_PPV_ARGS(&op)));
-
     DML_EXECUTION_FLAGS execution_flags =
         DML_EXECUTION_FLAG_ALLOW_HALF_PRECISION_COMPUTATION;
 
-    // Compile the operator
-    ComPtr<IDMLCompiledOperator> compiled_op;
-    DML_CHECK_SUCCEEDED(dml_device->CompileOperator(
-        op.Get(),
-        execution_flags,
-        IID_PPV_ARGS(&compiled_op)));
+    // Create and compile the operator
+    ComPtr<IDMLCompiledOperator> compiled_op =
+        ctx->CompileOperator(op_desc, execution_flags);
 
     // Defer to the other overload of Initialize(), which does the actual work
     Initialize(ctx, std::move(tensor_descs), compiled_op.Get());
@@ -387,6 +379,18 @@ Status DmlKernel::Initialize(
     device_context->EnqueueCallbackForGpuEvent(
         init_gpu_event,
         on_initialize_completed);
+
+    // Create the first binding table slot up front, which binds the persistent
+    // resource once here instead of on every execution.
+    if (exec_binding_props.RequiredDescriptorCount != 0)
+    {
+        binding_table_pool_ = absl::make_unique<DmlBindingTablePool>(
+            dml_device,
+            compiled_op_.Get(),
+            GetPersistentResourceBinding());
+        binding_table_pool_->AddSlot(device_context);
+    }
+
     return Status::OK();
 }
 
@@ -429,42 +433,118 @@ StatusOr<DmlGpuEvent> DmlKernel::Compute(
     DML_BINDING_PROPERTIES exec_binding_props =
         compiled_op_->GetBindingProperties();
 
+    // Reuse one of this kernel's binding tables if the GPU is done with it.
+    DmlBindingTablePool::Slot* slot = nullptr;
+    if (binding_table_pool_)
+    {
+        slot = binding_table_pool_->TryAcquire(device_context);
+    }
+
+    absl::optional<DmlDescriptorRing::Allocation> ring_allocation;
+
     // Unfortunately we have to use make_shared here to make it copyable, so it
     // can be captured in the lambda below
-    auto descriptor_range = std::make_shared<DescriptorAllocation>(
-        device_context->AllocateDescriptors(
-            exec_binding_props.RequiredDescriptorCount));
+    std::shared_ptr<DescriptorAllocation> descriptor_range;
 
-    D3D12DescriptorHandles descriptor_handles =
-        descriptor_range->GetDescriptorHandles();
+    Microsoft::WRL::ComPtr<IDMLBindingTable> binding_table;
+    ID3D12DescriptorHeap* heap_for_binding_table = nullptr;
+    if (slot)
+    {
+        binding_table = slot->binding_table;
+        heap_for_binding_table =
+            slot->descriptor_range.GetDescriptorHandles().heap;
+    }
+    else
+    {
+        // The descriptors only need to live until the execution completes, so
+        // they're bumped from the descriptor ring when it has room. Otherwise
+        // fall back to the descriptor allocator.
+        if (exec_binding_props.RequiredDescriptorCount != 0)
+        {
+            ring_allocation = device_context->TryAllocateTransientDescriptors(
+                exec_binding_props.RequiredDescriptorCount);
+        }
 
-    DML_BINDING_TABLE_DESC bind_table_desc = {};
-    bind_table_desc.Dispatchable = compiled_op_.Get();
-    bind_table_desc.CPUDescriptorHandle = descriptor_handles.cpu;
-    bind_table_desc.GPUDescriptorHandle = descriptor_handles.gpu;
-    bind_table_desc.SizeInDescriptors =
-        exec_binding_props.RequiredDescriptorCount;
+        D3D12DescriptorHandles descriptor_handles = {};
+        if (ring_allocation)
+        {
+            descriptor_handles = ring_allocation->handles;
+        }
+        else
+        {
+            descriptor_range = std::make_shared<DescriptorAllocation>(
+                device_context->AllocateDescriptors(
+                    exec_binding_props.RequiredDescriptorCount));
+            descriptor_handles = descriptor_range->GetDescriptorHandles();
+        }
 
-    Microsoft::WRL::ComPtr<IDMLBindingTable> binding_table;
-    DML_CHECK_SUCCEEDED(dml_device->CreateBindingTable(
-        &bind_table_desc,
-        IID_PPV_ARGS(&binding_table)));
+        DML_BINDING_TABLE_DESC bind_table_desc = {};
+        bind_table_desc.Dispatchable = compiled_op_.Get();
+        bind_table_desc.CPUDescriptorHandle = descriptor_handles.cpu;
+        bind_table_desc.GPUDescriptorHandle = descriptor_handles.gpu;
+        bind_table_desc.SizeInDescriptors =
+            exec_binding_props.RequiredDescriptorCount;
+
+        DML_CHECK_SUCCEEDED(dml_device->CreateBindingTable(
+            &bind_table_desc,
+            IID_PPV_ARGS(&binding_table)));
+
+        heap_for_binding_table = descriptor_handles.heap;
+    }
+
+    auto execute = [&](const DML_BUFFER_BINDING* temp_resource_binding)
+    {
+        if (slot)
+        {
+            return device_context->RebindAndExecuteOperator(
+                compiled_op_.Get(),
+                std::move(binding_table),
+                heap_for_binding_table,
+                temp_resource_binding,
+                input_bindings,
+                output_bindings);
+        }
+
+        return device_context->BindAndExecuteOperator(
+            compiled_op_.Get(),
+            std::move(binding_table),
+            heap_for_binding_table,
+            temp_resource_binding,
+            GetPersistentResourceBinding(),
+            input_bindings,
+            output_bindings);
+    };
 
     // Create a temporary resource for executing the op, if it's required.
-    UINT64 temporary_resource_size = exec_binding_props.TemporaryResourceSize;
-    absl::optional<DmlBuffer> temp_resource;
-    absl::optional<DML_BUFFER_BINDING> temp_resource_binding;
-    if (temporary_resource_size > 0)
+    auto execute_with_temporary_resource = [&]() -> StatusOr<DmlGpuEvent>
     {
+        UINT64 temporary_resource_size =
+            exec_binding_props.TemporaryResourceSize;
+        if (temporary_resource_size == 0)
+        {
+            return execute(nullptr);
+        }
+
+        if (temporary_resource_size <=
+            DmlTemporaryHeap::kMaxAllocationSizeInBytes)
+        {
+            // Suballocate the temporary resource from the temporary heap,
+            // which recycles it as soon as the execution completes on the GPU.
+            return device_context->ExecuteWithTemporaryBuffer(
+                temporary_resource_size,
+                [&](const DML_BUFFER_BINDING& temp_resource_binding)
+                { return execute(&temp_resource_binding); });
+        }
+
         // Allocate a temporary buffer and keep a use on it until the end of
         // this method. The buffer resource will still be alive (managed by the
         // pool); freeing allows the resource to be shared with other operators,
         // but because the allocator is multi-threaded we need to at least keep
         // a use on it until we're done with it locally to prevent the buffer
         // being reused.
-        temp_resource =
+        DmlBuffer temp_resource =
             device_context->AllocateDefaultBuffer(ctx, temporary_resource_size);
-        if (!(*temp_resource))
+        if (!temp_resource)
         {
             return errors::ResourceExhausted(
                 "OOM when allocating a buffer of ",
@@ -472,28 +552,47 @@ StatusOr<DmlGpuEvent> DmlKernel::Compute(
                 " bytes");
         }
 
-        temp_resource_binding = temp_resource->GetBufferBinding();
+        DML_BUFFER_BINDING temp_resource_binding =
+            temp_resource.GetBufferBinding();
+        return execute(&temp_resource_binding);
+    };
+
+    auto status_or_event = execute_with_temporary_resource();
+
+    // If nothing was executed, the descriptors can be reused as soon as the
+    // work that's already queued completes.
+    DmlGpuEvent last_use_event =
+        status_or_event.ok() ? status_or_event.ValueOrDie()
+                             : device_context->GetCurrentCompletionEvent();
+
+    if (slot)
+    {
+        binding_table_pool_->Release(slot, last_use_event);
     }
 
-    DmlGpuEvent gpu_event = device_context->BindAndExecuteOperator(
-        compiled_op_.Get(),
-        std::move(binding_table),
-        descriptor_handles.heap,
-        temp_resource_binding ? &*temp_resource_binding : nullptr,
-        GetPersistentResourceBinding(),
-        input_bindings,
-        output_bindings);
+    if (ring_allocation)
+    {
+        device_context->ReleaseTransientDescriptors(
+            *ring_allocation,
+            last_use_event);
+    }
 
-    // Transfer ownership of the descriptor range to a lambda, and enqueue it to
-    // be released when the execution completes on the GPU. Note that we don't
-    // need to keep the binding table alive - recall that lifetime is tied to
-    // the underlying descriptors, not the binding table itself.
-    device_context->EnqueueCallbackForGpuEvent(
-        gpu_event,
-        [p = std::move(descriptor_range)]() mutable
-        {
-            p->Reset(); // Release the descriptor range
-        });
+    TF_RETURN_IF_ERROR(status_or_event.status());
+    DmlGpuEvent gpu_event = status_or_event.ConsumeValueOrDie();
+
+    if (descriptor_range)
+    {
+        // Transfer ownership of the descriptor range to a lambda, and enqueue
+        // it to be released when the execution completes on the GPU. Note that
+        // we don't need to keep the binding table alive - recall that lifetime
+        // is tied to the underlying descriptors, not the binding table itself.
+        device_context->EnqueueCallbackForGpuEvent(
+            gpu_event,
+            [p = std::move(descriptor_range)]() mutable
+            {
+                p->Reset(); // Release the descriptor range
+            });
+    }
 
     return gpu_event;
 }
@@ -559,6 +658,22 @@ const DML_BUFFER_BINDING* DmlKernel::GetPersistentResourceBinding() const
                                         : nullptr;
 }
 
+uint64_t DmlKernel::GetPersistentResourceSize() const
+{
+    uint64_t size_in_bytes = persistent_resource_binding_
+                                 ? persistent_resource_binding_->SizeInBytes
+                                 : 0;
+
+    // The binding tables are only released along with the kernel, so count
+    // their descriptors as if the pool was full
+    if (binding_table_pool_)
+    {
+        size_in_bytes += binding_table_pool_->GetMaxDescriptorSizeInBytes();
+    }
+
+    return size_in_bytes;
+}
+
 /*static*/ absl::InlinedVector<DML_TENSOR_DESC, 8> DmlKernel::GetDmlTensorDescs(
     absl::Span<absl::optional<DmlTensorInfo>> tensor_infos)
 {
@@ -22,6 +22,7 @@ limitations under the License.
 #include "tfdml/runtime_adapter/op_kernel_context.h"
 #include "tfdml/runtime_adapter/types.h"
 
+#include "tfdml/core/dml_binding_table_pool.h"
 #include "tfdml/core/dml_buffer.h"
 #include "tfdml/core/dml_common.h"
 #include "tfdml/core/dml_device.h"
@@ -131,6 +132,12 @@ class DmlKernel
         return init_helper_.get();
     }
 
+    // Returns the size, in bytes, of the GPU memory that this kernel keeps
+    // allocated for as long as it's alive (e.g. its persistent resource and the
+    // descriptors of its binding tables). The kernel manager uses this to weigh
+    // kernels against the cache budget.
+    virtual uint64_t GetPersistentResourceSize() const;
+
   protected:
     // A helper to set up the input and output tensor descs for this kernel in a
     // DirectML-canonical format (i.e. DmlTensorDesc). DmlTensorDesc handles
@@ -242,6 +249,10 @@ class DmlKernel
 
     Microsoft::WRL::ComPtr<ID3D12Resource> persistent_resource_;
     absl::optional<DML_BUFFER_BINDING> persistent_resource_binding_;
+
+    // Only set if the compiled operator requires descriptors. Compute is const
+    // and may be called concurrently, which the pool is safe for.
+    std::unique_ptr<DmlBindingTablePool> binding_table_pool_;
     std::shared_ptr<const InitializationHelper> init_helper_;
 
     // The order and count of these descs match the DML operator, which might be
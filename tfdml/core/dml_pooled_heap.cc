@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "dml_pooled_heap.h"
 
+#include "absl/memory/memory.h"
 #include "tfdml/core/dml_util.h"
 #include "tfdml/runtime_adapter/numbers.h"
 #include "tfdml/runtime_adapter/status.h"
@@ -25,10 +26,12 @@ namespace tfdml
 DmlPooledHeap::DmlPooledHeap(
     ID3D12Device* device,
     const D3D12_HEAP_PROPERTIES& heap_props,
-    D3D12_RESOURCE_STATES barrier_state)
+    D3D12_RESOURCE_STATES barrier_state,
+    D3D12_RESOURCE_FLAGS resource_flags)
     : device_(device),
       heap_props_(heap_props),
-      barrier_state_(barrier_state)
+      barrier_state_(barrier_state),
+      resource_flags_(resource_flags)
 {
 }
 
@@ -127,7 +130,8 @@ Status DmlPooledHeap::CreateChunk(
 {
     assert(chunk != nullptr);
 
-    auto resource_desc = CD3DX12_RESOURCE_DESC::Buffer(size_in_bytes);
+    auto resource_desc =
+        CD3DX12_RESOURCE_DESC::Buffer(size_in_bytes, resource_flags_);
     Microsoft::WRL::ComPtr<ID3D12Resource> upload_buffer;
     HRESULT hr = device->CreateCommittedResource(
         &heap_props_,
@@ -176,14 +180,14 @@ Status DmlPooledHeap::Reserve(
 
     // Try to find a chunk with enough free space to accommodate the requested
     // allocation size
-    for (Chunk& chunk : chunks_)
+    for (auto& chunk : chunks_)
     {
         absl::optional<uint64_t> offsetForAllocation =
-            FindOffsetForAllocation(chunk, size_in_bytes);
+            FindOffsetForAllocation(*chunk, size_in_bytes);
         if (offsetForAllocation)
         {
             // There's enough space in this chunk - return
-            *chunk_ptr = &chunk;
+            *chunk_ptr = chunk.get();
             *offset_in_chunk = *offsetForAllocation;
             return Status::OK();
         }
@@ -199,11 +203,11 @@ Status DmlPooledHeap::Reserve(
     DmlPooledHeap::Chunk chunk;
     TF_RETURN_IF_ERROR(CreateChunk(device_.Get(), new_chunk_size, &chunk));
 
-    chunks_.push_back(std::move(chunk));
+    chunks_.push_back(absl::make_unique<Chunk>(std::move(chunk)));
     total_capacity_ += new_chunk_size;
 
     // Allocate from the beginning of the new chunk
-    *chunk_ptr = &chunks_.back();
+    *chunk_ptr = chunks_.back().get();
     *offset_in_chunk = 0;
 
     TF_VLog(
@@ -216,19 +220,73 @@ Status DmlPooledHeap::Reserve(
     return Status::OK();
 }
 
+void DmlPooledHeap::CommitAllocation(Chunk* chunk, Allocation allocation)
+{
+    AddUsedBytes(allocation.size_in_bytes);
+    chunk->allocations.push_back(std::move(allocation));
+}
+
+DmlPooledHeap::Allocation* DmlPooledHeap::AddPendingAllocation(
+    Chunk* chunk,
+    uint64_t size_in_bytes,
+    uint64_t offset_in_chunk)
+{
+    AddUsedBytes(size_in_bytes);
+
+    Allocation allocation = {};
+    allocation.size_in_bytes = size_in_bytes;
+    allocation.offset_in_chunk = offset_in_chunk;
+    allocation.pending = true;
+    chunk->allocations.push_back(std::move(allocation));
+
+    // Nodes of a std::list never move, and the chunk can't be trimmed while
+    // it has allocations
+    return &chunk->allocations.back();
+}
+
+void DmlPooledHeap::CompletePendingAllocation(
+    Allocation* allocation,
+    DmlGpuEvent done_event)
+{
+    assert(allocation->pending);
+    allocation->done_event = std::move(done_event);
+    allocation->pending = false;
+}
+
+void DmlPooledHeap::AddUsedBytes(uint64_t size_in_bytes)
+{
+    uint64_t used_bytes =
+        used_bytes_.fetch_add(size_in_bytes) + size_in_bytes;
+
+    if (used_bytes > peak_used_bytes_.load())
+    {
+        peak_used_bytes_.store(used_bytes);
+
+        TF_VLog(
+            3,
+            "Pooled heap %#010x (%s) reached a new peak usage of %s",
+            this,
+            HeapTypeString(heap_props_.Type),
+            strings::HumanReadableNumBytes(used_bytes).c_str());
+    }
+}
+
 void DmlPooledHeap::ReclaimAllocations()
 {
-    for (Chunk& chunk : chunks_)
+    for (auto& chunk : chunks_)
     {
-        auto* allocs = &chunk.allocations;
+        auto* allocs = &chunk->allocations;
 
         // Remove all allocations which have had their fences signaled - this
-        // indicates that they are no longer being used by the GPU. We can stop
-        // as soon as we find an allocation which is still in use, because we
-        // only use a single command queue and executions always complete in the
-        // order they were submitted.
-        while (!allocs->empty() && allocs->front().done_event.IsSignaled())
+        // indicates that they are no longer being used by the GPU. We have to
+        // stop as soon as we find an allocation which is still in use (or
+        // whose work hasn't been queued yet), since the chunk is a ring
+        // buffer: allocations after it are only reclaimed once it is, even if
+        // their own work was queued, and has completed, earlier.
+        while (!allocs->empty() && !allocs->front().pending &&
+               allocs->front().done_event.IsSignaled())
         {
+            used_bytes_.fetch_sub(allocs->front().size_in_bytes);
             allocs->pop_front();
         }
     }
@@ -244,14 +302,15 @@ void DmlPooledHeap::Trim()
     auto it = std::remove_if(
         chunks_.begin(),
         chunks_.end(),
-        [](const Chunk& c) { return c.allocations.empty(); });
+        [](const std::unique_ptr<Chunk>& chunk)
+        { return chunk->allocations.empty(); });
     chunks_.erase(it, chunks_.end());
 
     // Re-calculate total capacity
     total_capacity_ = 0;
     for (const auto& chunk : chunks_)
     {
-        total_capacity_ += chunk.capacity_in_bytes;
+        total_capacity_ += chunk->capacity_in_bytes;
     }
 }
 
@@ -259,8 +318,9 @@ void DmlPooledHeap::AssertInvariants()
 {
 #ifdef _DEBUG
 
-    auto chunk_capacity_comparer = [](const Chunk& lhs, const Chunk& rhs)
-    { return lhs.capacity_in_bytes < rhs.capacity_in_bytes; };
+    auto chunk_capacity_comparer =
+        [](const std::unique_ptr<Chunk>& lhs, const std::unique_ptr<Chunk>& rhs)
+    { return lhs->capacity_in_bytes < rhs->capacity_in_bytes; };
 
     // Chunks should be sorted by ascending capacity
     assert(std::is_sorted(
@@ -268,33 +328,21 @@ void DmlPooledHeap::AssertInvariants()
         chunks_.end(),
         chunk_capacity_comparer));
 
-    // Allocations in a chunk should be sorted by ascending fence value
-    for (const auto& chunk : chunks_)
-    {
-        auto alloc_fence_value_comparer =
-            [](const Allocation& lhs, const Allocation& rhs)
-        { return lhs.done_event.fence_value < rhs.done_event.fence_value; };
-        assert(std::is_sorted(
-            chunk.allocations.begin(),
-            chunk.allocations.end(),
-            alloc_fence_value_comparer));
-    }
-
     // Validate chunk properties
     for (const auto& chunk : chunks_)
     {
-        assert(chunk.resource != nullptr);
-        assert(chunk.capacity_in_bytes == chunk.resource->GetDesc().Width);
+        assert(chunk->resource != nullptr);
+        assert(chunk->capacity_in_bytes == chunk->resource->GetDesc().Width);
     }
 
     // Validate allocation properties
     for (const auto& chunk : chunks_)
     {
-        for (const auto& alloc : chunk.allocations)
+        for (const auto& alloc : chunk->allocations)
         {
             assert(
                 alloc.offset_in_chunk + alloc.size_in_bytes <=
-                chunk.capacity_in_bytes);
+                chunk->capacity_in_bytes);
             assert(
                 alloc.offset_in_chunk % kAllocationAlignment ==
                 0); // Validate alignment
@@ -309,8 +357,8 @@ void DmlPooledHeap::AssertInvariants()
         { return lhs.offset_in_chunk < rhs.offset_in_chunk; };
 
         std::vector<Allocation> allocations_sorted_by_offset(
-            chunk.allocations.begin(),
-            chunk.allocations.end());
+            chunk->allocations.begin(),
+            chunk->allocations.end());
         std::sort(
             allocations_sorted_by_offset.begin(),
             allocations_sorted_by_offset.end(),
@@ -330,7 +378,7 @@ void DmlPooledHeap::AssertInvariants()
     uint64_t calculated_capacity = 0;
     for (const auto& chunk : chunks_)
     {
-        calculated_capacity += chunk.capacity_in_bytes;
+        calculated_capacity += chunk->capacity_in_bytes;
     }
     assert(calculated_capacity == total_capacity_);
 
@@ -15,6 +15,9 @@ limitations under the License.
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include "dml_common.h"
 #include "dml_gpu_event.h"
 #include "tfdml/runtime_adapter/status.h"
@@ -33,6 +36,10 @@ class DmlPooledHeap
 
     uint64_t Capacity() const { return total_capacity_; }
 
+    // Returns the largest number of bytes that were in use by the GPU at any
+    // one time.
+    uint64_t PeakUsage() const { return peak_used_bytes_.load(); }
+
   protected:
     static constexpr uint64_t kMinChunkSize = 1024 * 1024; // 1MB
 
@@ -51,6 +58,10 @@ class DmlPooledHeap
         // The event that will be signaled to when the GPU is done executing
         // work that uses this allocation
         DmlGpuEvent done_event;
+
+        // Whether the work that uses this allocation hasn't been queued yet,
+        // in which case done_event isn't set
+        bool pending = false;
     };
 
     // Represents a single contiguous heap from which we carve out
@@ -61,8 +72,9 @@ class DmlPooledHeap
         uint64_t capacity_in_bytes; // The total size of the heap, in bytes
         Microsoft::WRL::ComPtr<ID3D12Resource> resource;
 
-        // Allocations are sorted by ascending fence value - that is, least to
-        // most recently allocated
+        // Allocations are sorted from least to most recently reserved, which
+        // is their order in the ring buffer. Work may be queued in a different
+        // order, so their fence values aren't necessarily ascending.
         std::list<Allocation> allocations;
     };
 
@@ -84,7 +96,8 @@ class DmlPooledHeap
     DmlPooledHeap(
         ID3D12Device* device,
         const D3D12_HEAP_PROPERTIES& heap_props,
-        D3D12_RESOURCE_STATES barrier_state);
+        D3D12_RESOURCE_STATES barrier_state,
+        D3D12_RESOURCE_FLAGS resource_flags = D3D12_RESOURCE_FLAG_NONE);
 
     // Finds or creates a chunk with enough space to accommodate an allocation
     // of the given size, and returns a pointer to the chunk and allocation
@@ -94,6 +107,24 @@ class DmlPooledHeap
         /*out*/ DmlPooledHeap::Chunk** chunk_ptr,
         /*out*/ uint64_t* offset_in_chunk);
 
+    // Adds an allocation to a chunk, at the offset returned by Reserve.
+    void CommitAllocation(Chunk* chunk, Allocation allocation);
+
+    // Adds an allocation to a chunk, at the offset returned by Reserve, before
+    // the work that uses it has been queued. The range can't be reserved
+    // again, nor can later allocations of the chunk be reclaimed, until the
+    // allocation is completed with CompletePendingAllocation and its
+    // done_event is signaled. The returned pointer remains valid until then,
+    // so the derived class may release its lock while queuing the work.
+    Allocation* AddPendingAllocation(
+        Chunk* chunk,
+        uint64_t size_in_bytes,
+        uint64_t offset_in_chunk);
+
+    void CompletePendingAllocation(
+        Allocation* allocation,
+        DmlGpuEvent done_event);
+
     void ReclaimAllocations(); // Frees all allocations which are no longer
                                // being used by the GPU.
 
@@ -111,13 +142,24 @@ class DmlPooledHeap
         /*out*/ DmlPooledHeap::Chunk* chunk);
     void AssertInvariants();
 
+    // Adds to the number of bytes in use, updating the peak usage.
+    void AddUsedBytes(uint64_t size_in_bytes);
+
     Microsoft::WRL::ComPtr<ID3D12Device> device_;
     D3D12_HEAP_PROPERTIES heap_props_;
     D3D12_RESOURCE_STATES barrier_state_;
+    D3D12_RESOURCE_FLAGS resource_flags_;
 
-    // sorted ascending by capacity (heap size)
-    std::vector<Chunk> chunks_;
+    // sorted ascending by capacity (heap size). Chunks are allocated
+    // individually so that pending allocations stay put when chunks are added.
+    std::vector<std::unique_ptr<Chunk>> chunks_;
     uint64_t total_capacity_ = 0; // Total size of all chunks, in bytes
+
+    // Total size of all allocations which haven't been reclaimed yet, and the
+    // highest that value has been. These are only modified by the derived
+    // class while holding its lock, but may be read from any thread.
+    std::atomic<uint64_t> used_bytes_ = {0};
+    std::atomic<uint64_t> peak_used_bytes_ = {0};
 };
 
 } // namespace tfdml
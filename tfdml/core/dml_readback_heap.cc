@@ -15,6 +15,9 @@ limitations under the License.
 
 #include "dml_readback_heap.h"
 
+#include <algorithm>
+
+#include "dml_host_staging_pool.h"
 #include "tfdml/runtime_adapter/macros.h"
 #include "tfdml/runtime_adapter/status.h"
 
@@ -29,13 +32,17 @@ static D3D12_HEAP_PROPERTIES ReadbackHeapProps()
 DmlReadbackHeap::DmlReadbackHeap(
     ID3D12Device* device,
     DmlExecutionContext* execution_context,
-    DmlEventQueue* event_queue)
+    DmlEventQueue* event_queue,
+    DmlHostStagingPool* host_staging_pool,
+    DmlCounters* counters)
     : DmlPooledHeap(
           device,
           ReadbackHeapProps(),
           D3D12_RESOURCE_STATE_COPY_DEST),
       execution_context_(execution_context),
-      event_queue_(event_queue)
+      event_queue_(event_queue),
+      host_staging_pool_(host_staging_pool),
+      counters_(counters)
 {
     current_completion_event_.fence_value = 0;
     DML_CHECK_SUCCEEDED(device->CreateFence(
@@ -55,6 +62,27 @@ StatusOr<DmlGpuEvent> DmlReadbackHeap::ReadbackFromGpu(
         src.ResourceInUavState()->GetDesc().Dimension ==
         D3D12_RESOURCE_DIMENSION_BUFFER);
 
+    counters_->Increment(DmlCounter::Readbacks);
+    counters_->Add(DmlCounter::ReadbackBytes, dst.size());
+
+    // The GPU can copy into the staging pool's memory directly, in which case
+    // the readback is complete as soon as the copy is
+    if (host_staging_pool_)
+    {
+        auto staging_buffer = host_staging_pool_->Find(dst.data(), dst.size());
+        if (staging_buffer)
+        {
+            DmlGpuEvent done_event = execution_context_->CopyToStagingBuffer(
+                staging_buffer->buffer,
+                staging_buffer->offset,
+                src.Subregion(0, dst.size()));
+
+            host_staging_pool_->AddGpuUse(dst.data(), done_event);
+            counters_->Increment(DmlCounter::ReadbacksToStagingPool);
+            return done_event;
+        }
+    }
+
     InvariantChecker checker(this);
 
     ReclaimAllocations();
@@ -91,6 +119,15 @@ StatusOr<DmlGpuEvent> DmlReadbackHeap::ReadbackFromGpu(
     ++current_completion_event_.fence_value;
     DmlGpuEvent done_event = current_completion_event_;
 
+    uint64_t completed_readback_fence_value =
+        current_completion_event_.fence->GetCompletedValue();
+    while (!pending_copy_events_.empty() &&
+           pending_copy_events_.front().first <= completed_readback_fence_value)
+    {
+        pending_copy_events_.pop_front();
+    }
+    pending_copy_events_.emplace_back(done_event.fence_value, gpu_done_event);
+
     // Note that we don't need to keep a ref on the readback_heap, because the
     // pooled allocator guarantees it'll live until we give the signal
     auto done_callback = [this, dst, readback_heap, offset_in_chunk, done_event]
@@ -111,10 +148,12 @@ StatusOr<DmlGpuEvent> DmlReadbackHeap::ReadbackFromGpu(
     };
 
     // Add an allocation entry to the chunk
-    chunk->allocations.push_back(Allocation{
-        static_cast<uint64_t>(dst.size()),
-        offset_in_chunk,
-        done_event});
+    CommitAllocation(
+        chunk,
+        Allocation{
+            static_cast<uint64_t>(dst.size()),
+            offset_in_chunk,
+            done_event});
 
     // Enqueue the done_callback to fire once the copy from src -> readback_heap
     // completes on the GPU. The callback will then perform the copy
@@ -123,4 +162,35 @@ StatusOr<DmlGpuEvent> DmlReadbackHeap::ReadbackFromGpu(
     return done_event;
 }
 
+Status DmlReadbackHeap::FlushReadback(const DmlGpuEvent& readback_event)
+{
+    // Readbacks into the staging pool complete along with their copy, so
+    // their event is the copy's
+    DmlGpuEvent copy_event = readback_event;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (readback_event.fence.Get() == current_completion_event_.fence.Get())
+        {
+            auto it = std::lower_bound(
+                pending_copy_events_.begin(),
+                pending_copy_events_.end(),
+                readback_event.fence_value,
+                [](const std::pair<uint64_t, DmlGpuEvent>& entry,
+                   uint64_t fence_value) { return entry.first < fence_value; });
+
+            // Entries are only removed once their readback has completed
+            if (it == pending_copy_events_.end() ||
+                it->first != readback_event.fence_value)
+            {
+                return Status::OK();
+            }
+
+            copy_event = it->second;
+        }
+    }
+
+    return execution_context_->FlushUntil(copy_event);
+}
+
 } // namespace tfdml
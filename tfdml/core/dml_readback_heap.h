@@ -15,6 +15,8 @@ limitations under the License.
 
 #pragma once
 
+#include <deque>
+
 #include "dml_common.h"
 #include "dml_event_queue.h"
 #include "dml_execution_context.h"
@@ -23,6 +25,7 @@ limitations under the License.
 namespace tfdml
 {
 class DmlExecutionContext;
+class DmlHostStagingPool;
 
 // Performs non-blocking readback from GPU resources. This class is thread-safe.
 class DmlReadbackHeap : public DmlPooledHeap
@@ -31,26 +34,41 @@ class DmlReadbackHeap : public DmlPooledHeap
     DmlReadbackHeap(
         ID3D12Device* device,
         DmlExecutionContext* execution_context,
-        DmlEventQueue* event_queue);
+        DmlEventQueue* event_queue,
+        DmlHostStagingPool* host_staging_pool,
+        DmlCounters* counters);
 
     // Copies data from the specified GPU resource into CPU memory pointed-to by
     // the span. This is non-blocking; the copy is not complete until the
     // returned event becomes signaled. Both the dst buffer and src resource
-    // must stay alive until the copy is complete.
+    // must stay alive until the copy is complete. A dst buffer in the host
+    // staging pool is copied into directly.
     StatusOr<DmlGpuEvent> ReadbackFromGpu(
         absl::Span<uint8_t> dst,
         const D3D12BufferRegion& src);
 
+    // Makes sure that the GPU copy of a readback returned by ReadbackFromGpu
+    // gets executed, without flushing any work that was recorded after it.
+    // This doesn't wait for the readback to complete.
+    Status FlushReadback(const DmlGpuEvent& readback_event);
+
   private:
     std::mutex mutex_;
     DmlExecutionContext* execution_context_; // weak; owned by DmlDeviceState
     DmlEventQueue* event_queue_;             // weak; owned by DmlDeviceState
+    DmlHostStagingPool* host_staging_pool_;  // weak; owned by DmlDeviceState
+    DmlCounters* counters_;                  // weak; owned by DmlDeviceState
 
     // We maintain a completion event independent of the execution context,
     // because the execution context's completion event only tells you when the
     // copy to the readback heap has completed, whereas what the caller cares
     // about is whether the copy to the `dst` buffer is complete.
     DmlGpuEvent current_completion_event_;
+
+    // The events of the copies into the readback heap, along with the fence
+    // values of the readbacks they belong to, in the order of the readbacks.
+    // Entries are only removed once their readback has completed.
+    std::deque<std::pair<uint64_t, DmlGpuEvent>> pending_copy_events_;
 };
 
 } // namespace tfdml
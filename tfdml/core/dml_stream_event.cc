@@ -0,0 +1,74 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#include "dml_stream_event.h"
+
+namespace tfdml
+{
+
+void DmlStreamEvent::Record(
+    absl::Span<const DmlGpuEvent> gpu_events,
+    const DmlDevice* device)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    gpu_events_.assign(gpu_events.begin(), gpu_events.end());
+    recorded_ = true;
+    device_ = device;
+}
+
+bool DmlStreamEvent::IsRecorded() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return recorded_;
+}
+
+const DmlDevice* DmlStreamEvent::GetDevice() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return device_;
+}
+
+bool DmlStreamEvent::IsComplete() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (const DmlGpuEvent& gpu_event : gpu_events_)
+    {
+        if (!gpu_event.IsSignaled())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void DmlStreamEvent::WaitForCompletion() const
+{
+    // Wait on a copy of the events, so that the event can be recorded again by
+    // another thread in the meantime
+    for (const DmlGpuEvent& gpu_event : GetGpuEvents())
+    {
+        gpu_event.WaitForSignal();
+    }
+}
+
+absl::InlinedVector<DmlGpuEvent, 2> DmlStreamEvent::GetGpuEvents() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return gpu_events_;
+}
+
+} // namespace tfdml
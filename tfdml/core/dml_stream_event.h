@@ -0,0 +1,64 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#pragma once
+
+#include <mutex>
+
+#include "dml_common.h"
+#include "dml_gpu_event.h"
+
+namespace tfdml
+{
+
+class DmlDevice;
+
+// Backs an SP_Event. Recording the event captures the completion events of the
+// work queued on a device so far (one per execution context), and the event is
+// complete once all of that work has completed on the GPU. This class is
+// thread-safe.
+class DmlStreamEvent
+{
+  public:
+    // Replaces the work tracked by the event with work queued on `device`.
+    // Like a CUDA event, an event may be recorded again before the previously
+    // recorded work completes.
+    void Record(
+        absl::Span<const DmlGpuEvent> gpu_events,
+        const DmlDevice* device);
+
+    bool IsRecorded() const;
+
+    // The device of the recorded work, or null if the event wasn't recorded
+    const DmlDevice* GetDevice() const;
+
+    // An event that was never recorded is complete.
+    bool IsComplete() const;
+
+    // Blocks until IsComplete returns true. The caller must make sure that the
+    // recorded work gets flushed to the GPU.
+    void WaitForCompletion() const;
+
+    absl::InlinedVector<DmlGpuEvent, 2> GetGpuEvents() const;
+
+  private:
+    mutable std::mutex mutex_;
+    bool recorded_ = false;
+    const DmlDevice* device_ = nullptr;
+    absl::InlinedVector<DmlGpuEvent, 2> gpu_events_;
+};
+
+} // namespace tfdml
@@ -0,0 +1,82 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#include "dml_temporary_heap.h"
+
+#include "tfdml/runtime_adapter/macros.h"
+#include "tfdml/runtime_adapter/status.h"
+
+namespace tfdml
+{
+
+static D3D12_HEAP_PROPERTIES TemporaryHeapProps()
+{
+    return CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+}
+
+DmlTemporaryHeap::DmlTemporaryHeap(ID3D12Device* device)
+    : DmlPooledHeap(
+          device,
+          TemporaryHeapProps(),
+          D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+          D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS)
+{
+}
+
+StatusOr<DmlGpuEvent> DmlTemporaryHeap::ExecuteWithTemporaryBuffer(
+    uint64_t size_in_bytes,
+    ExecuteFn execute)
+{
+    assert(size_in_bytes != 0);
+
+    DML_BUFFER_BINDING binding = {};
+    Allocation* allocation = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        InvariantChecker checker(this);
+
+        ReclaimAllocations();
+
+        // Allocate space from the temporary heap
+        Chunk* chunk = nullptr;
+        uint64_t offset_in_chunk = 0;
+        TF_RETURN_IF_ERROR(Reserve(size_in_bytes, &chunk, &offset_in_chunk));
+
+        assert(chunk != nullptr);
+        assert(offset_in_chunk + size_in_bytes <= chunk->capacity_in_bytes);
+
+        binding.Buffer = chunk->resource.Get();
+        binding.Offset = offset_in_chunk;
+        binding.SizeInBytes = size_in_bytes;
+
+        // Claim the range before releasing the lock, so that nothing else can
+        // reserve it until the work that uses it has completed
+        allocation =
+            AddPendingAllocation(chunk, size_in_bytes, offset_in_chunk);
+    }
+
+    // Queuing the work may block until the execution context has flushed, so
+    // the lock isn't held while doing so.
+    DmlGpuEvent done_event = execute(binding);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    CompletePendingAllocation(allocation, done_event);
+
+    return done_event;
+}
+
+} // namespace tfdml
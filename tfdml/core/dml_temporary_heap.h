@@ -0,0 +1,59 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+
+#pragma once
+
+#include "absl/functional/function_ref.h"
+#include "dml_common.h"
+#include "dml_pooled_heap.h"
+#include "tfdml/runtime_adapter/statusor.h"
+
+namespace tfdml
+{
+
+// Provides the temporary resources that DML operators need while they execute.
+// Temporary resources never outlive the execution that uses them, so they're
+// suballocated from ring-buffer style UAV buffers and reclaimed as soon as the
+// execution completes on the GPU, rather than being allocated from (and freed
+// back to) the BFC allocator on every dispatch. This class is thread-safe.
+class DmlTemporaryHeap : public DmlPooledHeap
+{
+  public:
+    // Temporary resources larger than this aren't suballocated from the heap,
+    // since the heap retains its capacity and a batch of such executions
+    // would require many times their size to be resident at once.
+    static constexpr uint64_t kMaxAllocationSizeInBytes = 16 * 1024 * 1024;
+
+    using ExecuteFn = absl::FunctionRef<DmlGpuEvent(const DML_BUFFER_BINDING&)>;
+
+    explicit DmlTemporaryHeap(ID3D12Device* device);
+
+    // Reserves a temporary buffer of the given size, and calls `execute` with
+    // its binding to queue the work which uses it. The buffer is reclaimed
+    // once the event returned by `execute` becomes signaled, which must be an
+    // event of the device's execution context. The work must be queued from
+    // within `execute`, which is invoked without holding this heap's lock, so
+    // concurrent executions may queue their work in a different order than
+    // they reserved their buffers.
+    StatusOr<DmlGpuEvent> ExecuteWithTemporaryBuffer(
+        uint64_t size_in_bytes,
+        ExecuteFn execute);
+
+  private:
+    std::mutex mutex_;
+};
+
+} // namespace tfdml
@@ -0,0 +1,437 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "dml_trace_file_sink.h"
+
+#include <atomic>
+#include <chrono>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "tensorflow/c/logging.h"
+#include "tfdml/runtime_adapter/env_var.h"
+#include "tfdml/runtime_adapter/status.h"
+
+#if _WIN32
+#include <process.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace tfdml
+{
+
+thread_local std::vector<DmlTraceFileSink::Event>
+    DmlTraceFileSink::open_events_;
+
+// How long the writer waits for more events before writing what it has
+static constexpr auto write_interval = std::chrono::milliseconds(100);
+
+// Set by the SIGUSR1 handler, and polled by the writer
+static std::atomic<bool> flush_signaled = {false};
+
+static std::atomic<uint32_t> next_thread_index = {1};
+
+static uint32_t GetThreadIndex()
+{
+    static thread_local uint32_t thread_index = next_thread_index++;
+    return thread_index;
+}
+
+static uint32_t GetProcessId()
+{
+#if _WIN32
+    return static_cast<uint32_t>(_getpid());
+#else
+    return static_cast<uint32_t>(getpid());
+#endif
+}
+
+#if !_WIN32
+static void HandleFlushSignal(int)
+{
+    flush_signaled.store(true, std::memory_order_relaxed);
+}
+
+static void InstallFlushSignalHandler()
+{
+    // Don't take over the signal if the application handles it already
+    struct sigaction previous_action = {};
+    if (sigaction(SIGUSR1, nullptr, &previous_action) != 0 ||
+        previous_action.sa_handler != SIG_DFL)
+    {
+        TF_Log(
+            TF_WARNING,
+            "SIGUSR1 is already handled, so it won't flush the DirectML trace "
+            "file.");
+        return;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = HandleFlushSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, nullptr);
+}
+#endif
+
+// Appends a string as a quoted JSON string
+static void AppendJsonString(std::string* out, absl::string_view value)
+{
+    static constexpr char hex_digits[] = "0123456789abcdef";
+
+    out->push_back('"');
+    for (char c : value)
+    {
+        switch (c)
+        {
+        case '"':
+            out->append("\\\"");
+            break;
+        case '\\':
+            out->append("\\\\");
+            break;
+        case '\n':
+            out->append("\\n");
+            break;
+        case '\r':
+            out->append("\\r");
+            break;
+        case '\t':
+            out->append("\\t");
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                out->append("\\u00");
+                out->push_back(hex_digits[(c >> 4) & 0xf]);
+                out->push_back(hex_digits[c & 0xf]);
+            }
+            else
+            {
+                out->push_back(c);
+            }
+        }
+    }
+    out->push_back('"');
+}
+
+// Appends a timestamp or duration in microseconds, the unit of the format
+static void AppendMicroseconds(std::string* out, int64_t nanoseconds)
+{
+    if (nanoseconds < 0)
+    {
+        out->push_back('-');
+        nanoseconds = -nanoseconds;
+    }
+
+    absl::StrAppend(
+        out,
+        nanoseconds / 1000,
+        ".",
+        absl::Dec(nanoseconds % 1000, absl::kZeroPad3));
+}
+
+/*static*/ std::unique_ptr<DmlTraceFileSink> DmlTraceFileSink::
+    TryCreateFromEnvironment()
+{
+    std::string path;
+    Status s = ReadStringFromEnvVar("TF_DIRECTML_TRACE_FILE", "", &path);
+    if (!s.ok() || path.empty())
+    {
+        return nullptr;
+    }
+
+    int64_t capacity = 0;
+    s = ReadInt64FromEnvVar(
+        "TF_DIRECTML_TRACE_FILE_CAPACITY",
+        kDefaultCapacity,
+        &capacity);
+    if (!s.ok() || capacity <= 0)
+    {
+        TF_Log(
+            TF_WARNING,
+            "The 'TF_DIRECTML_TRACE_FILE_CAPACITY' environment variable, if "
+            "defined, must be a positive number of events.");
+        capacity = kDefaultCapacity;
+    }
+
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file)
+    {
+        TF_Log(
+            TF_WARNING,
+            "Could not open the DirectML trace file '%s'.",
+            path.c_str());
+        return nullptr;
+    }
+
+#if !_WIN32
+    InstallFlushSignalHandler();
+#endif
+
+    TF_Log(TF_INFO, "Writing DirectML trace events to '%s'.", path.c_str());
+    return absl::make_unique<DmlTraceFileSink>(
+        std::move(file),
+        static_cast<size_t>(capacity));
+}
+
+DmlTraceFileSink::DmlTraceFileSink(std::ofstream file, size_t capacity)
+    : capacity_(capacity),
+      process_id_(GetProcessId()),
+      file_(std::move(file))
+{
+    events_.reserve(capacity_);
+
+    // Names the process in the viewer; this also means every other event is
+    // preceded by a separator.
+    std::string header = "[\n";
+    absl::StrAppend(
+        &header,
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":",
+        process_id_,
+        ",\"args\":{\"name\":\"DirectML\"}}");
+    file_ << header;
+
+    writer_thread_ = std::thread([this] { WriterThreadProc(); });
+}
+
+DmlTraceFileSink::~DmlTraceFileSink()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    writer_wakeup_.notify_all();
+    writer_thread_.join();
+
+    file_ << "\n]\n";
+    file_.close();
+}
+
+void DmlTraceFileSink::BeginEvent(
+    const char* category,
+    absl::string_view name,
+    Args args)
+{
+    Event event;
+    event.category = category;
+    event.name.assign(name.data(), name.size());
+    event.timestamp_ns = absl::GetCurrentTimeNanos();
+    event.thread_index = GetThreadIndex();
+    event.args = std::move(args);
+    open_events_.push_back(std::move(event));
+}
+
+void DmlTraceFileSink::EndEvent()
+{
+    if (open_events_.empty())
+    {
+        return;
+    }
+
+    Event event = std::move(open_events_.back());
+    open_events_.pop_back();
+    event.duration_ns = absl::GetCurrentTimeNanos() - event.timestamp_ns;
+    Push(std::move(event));
+}
+
+void DmlTraceFileSink::AddCompleteEvent(
+    const char* category,
+    absl::string_view name,
+    int64_t start_timestamp_ns,
+    int64_t end_timestamp_ns,
+    Args args)
+{
+    Event event;
+    event.category = category;
+    event.name.assign(name.data(), name.size());
+    event.timestamp_ns = start_timestamp_ns;
+    event.duration_ns = end_timestamp_ns - start_timestamp_ns;
+    event.thread_index = GetThreadIndex();
+    event.args = std::move(args);
+    Push(std::move(event));
+}
+
+void DmlTraceFileSink::AddInstantEvent(
+    const char* category,
+    absl::string_view name,
+    Args args)
+{
+    Event event;
+    event.category = category;
+    event.name.assign(name.data(), name.size());
+    event.is_instant = true;
+    event.timestamp_ns = absl::GetCurrentTimeNanos();
+    event.thread_index = GetThreadIndex();
+    event.args = std::move(args);
+    Push(std::move(event));
+}
+
+void DmlTraceFileSink::Push(Event&& event)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (events_.size() >= capacity_)
+    {
+        ++dropped_event_count_;
+        ++unwritten_dropped_event_count_;
+        return;
+    }
+
+    events_.push_back(std::move(event));
+
+    // Wake the writer early so that the buffer rarely fills up
+    if (events_.size() == capacity_ / 2 + 1)
+    {
+        writer_wakeup_.notify_one();
+    }
+}
+
+void DmlTraceFileSink::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t flush_id = ++flushes_requested_;
+    writer_wakeup_.notify_one();
+    flushed_.wait(lock, [&] { return flushes_completed_ >= flush_id; });
+}
+
+uint64_t DmlTraceFileSink::GetDroppedEventCount() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return dropped_event_count_;
+}
+
+void DmlTraceFileSink::WriterThreadProc()
+{
+    std::vector<Event> events;
+    events.reserve(capacity_);
+
+    bool stop = false;
+    while (!stop)
+    {
+        uint64_t dropped_event_count = 0;
+        uint64_t flushes_requested = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            writer_wakeup_.wait_for(
+                lock,
+                write_interval,
+                [&]
+                {
+                    return stop_ || flushes_requested_ > flushes_completed_ ||
+                           events_.size() > capacity_ / 2;
+                });
+
+            stop = stop_;
+            flushes_requested = flushes_requested_;
+            dropped_event_count = unwritten_dropped_event_count_;
+            unwritten_dropped_event_count_ = 0;
+            events_.swap(events);
+        }
+
+        Write(events, dropped_event_count);
+        events.clear();
+
+        bool signaled = flush_signaled.exchange(false);
+        if (signaled || flushes_requested > flushes_completed_)
+        {
+            file_.flush();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            flushes_completed_ = flushes_requested;
+        }
+        flushed_.notify_all();
+    }
+}
+
+void DmlTraceFileSink::Write(
+    const std::vector<Event>& events,
+    uint64_t dropped_event_count)
+{
+    std::string json;
+    for (const Event& event : events)
+    {
+        json.append(",\n{\"name\":");
+        AppendJsonString(&json, event.name);
+        json.append(",\"cat\":");
+        AppendJsonString(&json, event.category);
+        if (event.is_instant)
+        {
+            json.append(",\"ph\":\"i\",\"s\":\"t\",\"ts\":");
+            AppendMicroseconds(&json, event.timestamp_ns);
+        }
+        else
+        {
+            json.append(",\"ph\":\"X\",\"ts\":");
+            AppendMicroseconds(&json, event.timestamp_ns);
+            json.append(",\"dur\":");
+            AppendMicroseconds(&json, event.duration_ns);
+        }
+        absl::StrAppend(
+            &json,
+            ",\"pid\":",
+            process_id_,
+            ",\"tid\":",
+            event.thread_index);
+
+        if (!event.args.empty())
+        {
+            json.append(",\"args\":{");
+            for (size_t i = 0; i < event.args.size(); ++i)
+            {
+                const Arg& arg = event.args[i];
+                if (i > 0)
+                {
+                    json.push_back(',');
+                }
+                AppendJsonString(&json, arg.name);
+                json.push_back(':');
+                if (arg.is_string)
+                {
+                    AppendJsonString(&json, arg.string_value);
+                }
+                else
+                {
+                    absl::StrAppend(&json, arg.int_value);
+                }
+            }
+            json.push_back('}');
+        }
+        json.push_back('}');
+    }
+
+    // Marks where events were lost, since the viewer can't show gaps
+    if (dropped_event_count > 0)
+    {
+        json.append(",\n{\"name\":\"DroppedEvents\",\"cat\":\"dml\",");
+        json.append("\"ph\":\"i\",\"s\":\"p\",\"ts\":");
+        AppendMicroseconds(&json, absl::GetCurrentTimeNanos());
+        absl::StrAppend(
+            &json,
+            ",\"pid\":",
+            process_id_,
+            ",\"tid\":0,\"args\":{\"count\":",
+            dropped_event_count,
+            "}}");
+    }
+
+    file_.write(json.data(), json.size());
+}
+
+} // namespace tfdml
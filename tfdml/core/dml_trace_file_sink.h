@@ -0,0 +1,143 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+
+namespace tfdml
+{
+
+// Streams trace events to a file in the Chrome trace event JSON format, which
+// chrome://tracing and the Perfetto UI can open. Events are buffered up to a
+// fixed capacity and written by a background thread, so recording never
+// touches the file; events that arrive while the buffer is full are dropped
+// and counted. The file stays loadable if the process dies before the sink is
+// destroyed, since the format allows the closing bracket to be missing. This
+// class is thread-safe.
+class DmlTraceFileSink
+{
+  public:
+    static constexpr size_t kDefaultCapacity = 64 * 1024;
+
+    // A named argument of an event, which is either a string or an integer.
+    struct Arg
+    {
+        Arg(const char* name, absl::string_view value)
+            : name(name),
+              string_value(value),
+              is_string(true)
+        {
+        }
+
+        Arg(const char* name, uint64_t value) : name(name), int_value(value) {}
+
+        const char* name;
+        std::string string_value;
+        uint64_t int_value = 0;
+        bool is_string = false;
+    };
+
+    using Args = absl::InlinedVector<Arg, 3>;
+
+    // Creates a sink for the file named by TF_DIRECTML_TRACE_FILE, or returns
+    // null if the variable isn't set or the file can't be opened. Up to
+    // TF_DIRECTML_TRACE_FILE_CAPACITY events are buffered. On POSIX
+    // platforms, SIGUSR1 makes the sink write all buffered events and flush
+    // the file.
+    static std::unique_ptr<DmlTraceFileSink> TryCreateFromEnvironment();
+
+    // The file must be open for writing. Up to `capacity` events are buffered
+    // between writes.
+    DmlTraceFileSink(std::ofstream file, size_t capacity);
+
+    // Writes the remaining events and closes the file.
+    ~DmlTraceFileSink();
+
+    // Starts an event on the calling thread, which lasts until the matching
+    // EndEvent call on the same thread. Events may nest.
+    void BeginEvent(const char* category, absl::string_view name, Args args);
+    void EndEvent();
+
+    // Records an event that has already ended.
+    void AddCompleteEvent(
+        const char* category,
+        absl::string_view name,
+        int64_t start_timestamp_ns,
+        int64_t end_timestamp_ns,
+        Args args);
+
+    // Records an event without a duration at the current time.
+    void AddInstantEvent(
+        const char* category,
+        absl::string_view name,
+        Args args);
+
+    // Writes all buffered events and flushes the file before returning.
+    void Flush();
+
+    uint64_t GetDroppedEventCount() const;
+
+  private:
+    struct Event
+    {
+        const char* category = nullptr;
+        std::string name;
+        bool is_instant = false;
+        int64_t timestamp_ns = 0;
+        int64_t duration_ns = 0;
+        uint32_t thread_index = 0;
+        Args args;
+    };
+
+    void Push(Event&& event);
+
+    // The events that started on each thread but haven't ended yet
+    static thread_local std::vector<Event> open_events_;
+
+    // Writes the buffered events whenever the buffer is half full, a flush is
+    // requested, or a short interval has passed. The file is only accessed by
+    // this thread.
+    void WriterThreadProc();
+    void Write(const std::vector<Event>& events, uint64_t dropped_event_count);
+
+    const size_t capacity_;
+    const uint32_t process_id_;
+    std::ofstream file_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable writer_wakeup_;
+    std::condition_variable flushed_;
+    std::vector<Event> events_;
+    uint64_t dropped_event_count_ = 0;
+    uint64_t unwritten_dropped_event_count_ = 0;
+    uint64_t flushes_requested_ = 0;
+    uint64_t flushes_completed_ = 0;
+    bool stop_ = false;
+
+    std::thread writer_thread_;
+};
+
+} // namespace tfdml
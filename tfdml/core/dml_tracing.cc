@@ -126,6 +126,8 @@ extern "C" UINT64 WINAPI PIXEventsReplaceBlock(
 #endif
 
 #include "dml_tracing.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "tfdml/core/dml_device_cache.h"
 #include "tfdml/runtime_adapter/env_var.h"
 #include "tfdml/runtime_adapter/status.h"
@@ -155,6 +157,9 @@ TRACELOGGING_DEFINE_PROVIDER(
      0x77),
     TfdmlTraceLoggingOptionGroup(DIRECTML_TELEMETRY_PROVIDER_GROUP_GUID));
 
+// The id of the host plane in the TF profiler
+static constexpr int64_t kHostPlaneId = 49;
+
 // {D113B493-BBA2-4993-8608-D706A73B91CE}
 static constexpr GUID PIX_EVAL_CAPTURABLE_WORK_GUID = {
     0xd113b493,
@@ -186,7 +191,13 @@ void MaybeOverrideTraceLevelFromEnvVar(
     level = static_cast<DmlTracing::TraceLevel>(trace_level);
 }
 
-DmlTracing::DmlTracing()
+constexpr uint32_t DmlTracing::kTraceFileOnlyEventId;
+
+thread_local uint64_t DmlTracing::current_correlation_id_ = 0;
+thread_local std::shared_ptr<DmlTracing::ThreadEvents>
+    DmlTracing::thread_events_;
+
+DmlTracing::DmlTracing() : session_id_(0), next_correlation_id_(1)
 {
     TraceLoggingRegister(g_providerHandle);
 
@@ -200,7 +211,12 @@ DmlTracing::DmlTracing()
         "TF_DIRECTML_TRACE_PROFILER_LEVEL",
         trace_profiler_level_);
 
-    device_events_.resize(tfdml::DmlDeviceCache::Instance().GetAdapterCount());
+    device_count_ = tfdml::DmlDeviceCache::Instance().GetAdapterCount();
+    gpu_events_.resize(device_count_);
+    start_counter_values_.resize(device_count_);
+    stop_counter_values_.resize(device_count_);
+
+    trace_file_sink_ = tfdml::DmlTraceFileSink::TryCreateFromEnvironment();
 
 #if _WIN32
     if (trace_pix_level_ > TraceLevel::None)
@@ -248,12 +264,25 @@ void DmlTracing::StartProfiler()
     assert(!profiler_active_);
     profiler_active_ = true;
 
-    // Reset previously collected events for the TF profiler.
+    // Reset previously collected events for the TF profiler. Threads start
+    // new event buffers when they see that the session changed, and the old
+    // ones are released once the threads no longer reference them.
     profiler_start_timestamp_ns_ = absl::GetCurrentTimeNanos();
-    xspace_dirty_ = true;
-    for (auto& device_events : device_events_)
     {
-        device_events.Clear();
+        std::unique_lock<std::mutex> lock(mutex_);
+        xspace_dirty_ = true;
+        registered_thread_events_.clear();
+        for (auto& gpu_events : gpu_events_)
+        {
+            gpu_events.clear();
+        }
+        memory_events_.clear();
+        ++session_id_;
+    }
+
+    if (trace_profiler_level_ >= TraceLevel::Standard)
+    {
+        tfdml::SetMemoryTraceListener(&memory_listener_);
     }
 
     if (trace_etw_level_ >= TraceLevel::Standard)
@@ -280,6 +309,19 @@ void DmlTracing::StartProfiler()
             state->sharing_contract->BeginCapturableWork(
                 PIX_EVAL_CAPTURABLE_WORK_GUID);
         }
+
+        start_counter_values_[i] = state->counters->GetValues();
+
+        // GPU clocks drift from the CPU clock, so the timestamps of each
+        // session are converted using a fresh calibration.
+        if (trace_profiler_level_ >= TraceLevel::Standard)
+        {
+            state->execution_context->CalibrateGpuTimeline();
+            if (state->copy_execution_context)
+            {
+                state->copy_execution_context->CalibrateGpuTimeline();
+            }
+        }
     }
 }
 
@@ -311,9 +353,50 @@ void DmlTracing::StopProfiler()
             state->sharing_contract->EndCapturableWork(
                 PIX_EVAL_CAPTURABLE_WORK_GUID);
         }
+
+        stop_counter_values_[i] = state->counters->GetValues();
     }
 
+    tfdml::SetMemoryTraceListener(nullptr);
     profiler_active_ = false;
+
+    // Collect the GPU execution of the work recorded during the session,
+    // which requires waiting for it to complete.
+    if (trace_profiler_level_ >= TraceLevel::Standard)
+    {
+        for (uint32_t i = 0; i < device_cache.GetAdapterCount(); ++i)
+        {
+            const auto* state = device_cache.GetOrCreateDeviceState(i);
+
+            auto gpu_events = state->execution_context->TakeGpuTimelineEvents();
+            if (state->copy_execution_context)
+            {
+                auto copy_gpu_events =
+                    state->copy_execution_context->TakeGpuTimelineEvents();
+                gpu_events.insert(
+                    gpu_events.end(),
+                    copy_gpu_events.begin(),
+                    copy_gpu_events.end());
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            gpu_events_[i] = std::move(gpu_events);
+            xspace_dirty_ = true;
+        }
+    }
+}
+
+void DmlTracing::MemoryListener::OnMemoryEvent(tfdml::MemoryTraceEvent&& event)
+{
+    auto& tracing = DmlTracing::Instance();
+    std::unique_lock<std::mutex> lock(tracing.mutex_);
+
+    // Events may still arrive shortly after the session stopped
+    if (tracing.profiler_active_)
+    {
+        tracing.memory_events_.push_back(std::move(event));
+        tracing.xspace_dirty_ = true;
+    }
 }
 
 void DmlTracing::LogExecutionContextCopyBufferRegion()
@@ -334,7 +417,9 @@ void DmlTracing::LogExecutionContextFillBufferWithPattern()
     }
 }
 
-void DmlTracing::LogExecutionContextFlush()
+void DmlTracing::LogExecutionContextFlush(
+    uint64_t command_count,
+    uint64_t fence_value)
 {
     if (trace_etw_level_ >= TraceLevel::Verbose)
     {
@@ -345,6 +430,75 @@ void DmlTracing::LogExecutionContextFlush()
     {
         PIXSetMarker(0, "EC Flush");
     }
+
+    if (trace_file_sink_)
+    {
+        trace_file_sink_->AddInstantEvent(
+            "execution_context",
+            "BatchFlush",
+            {{"commands", command_count}, {"fence_value", fence_value}});
+    }
+}
+
+void DmlTracing::LogFenceSignal(
+    D3D12_COMMAND_LIST_TYPE queue_type,
+    uint64_t fence_value)
+{
+    if (trace_file_sink_)
+    {
+        const char* queue_name =
+            queue_type == D3D12_COMMAND_LIST_TYPE_COPY      ? "copy"
+            : queue_type == D3D12_COMMAND_LIST_TYPE_COMPUTE ? "compute"
+                                                            : "direct";
+        trace_file_sink_->AddInstantEvent(
+            "command_queue",
+            "FenceSignal",
+            {{"queue", queue_name}, {"fence_value", fence_value}});
+    }
+}
+
+void DmlTracing::LogKernelCreation(
+    const absl::string_view op_type,
+    std::chrono::nanoseconds creation_time)
+{
+    if (trace_file_sink_)
+    {
+        int64_t end_timestamp_ns = absl::GetCurrentTimeNanos();
+        trace_file_sink_->AddCompleteEvent(
+            "kernel_compile",
+            op_type,
+            end_timestamp_ns - creation_time.count(),
+            end_timestamp_ns,
+            {});
+    }
+}
+
+DmlTracing::ThreadEvents& DmlTracing::GetThreadEvents()
+{
+    uint64_t session_id = session_id_.load();
+    if (!thread_events_ || thread_events_->session_id != session_id)
+    {
+        auto thread_events =
+            std::make_shared<ThreadEvents>(session_id, device_count_);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        registered_thread_events_.push_back(thread_events);
+        lock.unlock();
+
+        thread_events_ = std::move(thread_events);
+    }
+
+    return *thread_events_;
+}
+
+DmlTracing::ThreadEvents* DmlTracing::TryGetThreadEvents() const
+{
+    if (!thread_events_ || thread_events_->session_id != session_id_.load())
+    {
+        return nullptr;
+    }
+
+    return thread_events_.get();
 }
 
 absl::optional<uint32_t> DmlTracing::TryLogMemcpyStart(
@@ -357,13 +511,33 @@ absl::optional<uint32_t> DmlTracing::TryLogMemcpyStart(
     {
         auto timestamp = absl::GetCurrentTimeNanos();
 
-        // Locking here is not ideal and can be avoided with TLS.
-        std::unique_lock<std::mutex> lock(mutex_);
-        auto& events = device_events_[device_ordinal].memcpy_events;
-        profiler_event_id = events.size();
-        events.push_back(
-            MemcpyEvent{memcpy_type, data_size, timestamp, timestamp});
-        lock.unlock();
+        auto& events =
+            GetThreadEvents().device_events[device_ordinal].memcpy_events;
+        auto& event = events.Next();
+        event.memcpy_type = memcpy_type;
+        event.size = data_size;
+        event.start_timestamp_ns = timestamp;
+        event.end_timestamp_ns.store(timestamp, std::memory_order_relaxed);
+        event.correlation_id = next_correlation_id_++;
+        event.parent_correlation_id = current_correlation_id_;
+        profiler_event_id = events.Publish();
+
+        current_correlation_id_ = event.correlation_id;
+    }
+
+    if (trace_file_sink_)
+    {
+        const char* name = memcpy_type == MemcpyType::H2D   ? "MemcpyH2D"
+                           : memcpy_type == MemcpyType::D2H ? "MemcpyD2H"
+                                                            : "MemcpyD2D";
+        trace_file_sink_->BeginEvent(
+            "memcpy",
+            name,
+            {{"device", device_ordinal}, {"size", data_size}});
+        if (!profiler_event_id)
+        {
+            profiler_event_id = kTraceFileOnlyEventId;
+        }
     }
 
     return profiler_event_id;
@@ -371,14 +545,30 @@ absl::optional<uint32_t> DmlTracing::TryLogMemcpyStart(
 
 void DmlTracing::LogMemcpyEnd(uint32_t device_id, uint32_t event_id)
 {
-    if (profiler_active_ && trace_profiler_level_ >= TraceLevel::Standard)
+    if (trace_file_sink_)
     {
-        // Locking here is not ideal and can be avoided with TLS.
-        std::unique_lock<std::mutex> lock(mutex_);
-        auto& event = device_events_[device_id].memcpy_events[event_id];
-        event.end_timestamp_ns = absl::GetCurrentTimeNanos();
-        lock.unlock();
+        trace_file_sink_->EndEvent();
+        if (event_id == kTraceFileOnlyEventId)
+        {
+            return;
+        }
+    }
+
+    // The events are gone if a new profiler session started since the memcpy
+    // started.
+    ThreadEvents* thread_events = TryGetThreadEvents();
+    if (!thread_events)
+    {
+        current_correlation_id_ = 0;
+        return;
     }
+
+    auto& event =
+        thread_events->device_events[device_id].memcpy_events[event_id];
+    event.end_timestamp_ns.store(
+        absl::GetCurrentTimeNanos(),
+        std::memory_order_relaxed);
+    current_correlation_id_ = event.parent_correlation_id;
 }
 
 absl::optional<uint32_t> DmlTracing::TryLogKernelComputeStart(
@@ -391,16 +581,31 @@ absl::optional<uint32_t> DmlTracing::TryLogKernelComputeStart(
     {
         auto timestamp = absl::GetCurrentTimeNanos();
 
-        // Locking here is not ideal and can be avoided with TLS.
-        std::unique_lock<std::mutex> lock(mutex_);
-        auto& events = device_events_[device_ordinal].kernel_compute_events;
-        profiler_event_id = events.size();
-        events.push_back(KernelComputeEvent{
-            op_type.data(),
-            op_name.data(),
-            timestamp,
-            timestamp});
-        lock.unlock();
+        auto& events = GetThreadEvents()
+                           .device_events[device_ordinal]
+                           .kernel_compute_events;
+        auto& event = events.Next();
+        event.op_type.assign(op_type.data(), op_type.size());
+        event.op_name.assign(op_name.data(), op_name.size());
+        event.start_timestamp_ns = timestamp;
+        event.end_timestamp_ns.store(timestamp, std::memory_order_relaxed);
+        event.correlation_id = next_correlation_id_++;
+        event.parent_correlation_id = current_correlation_id_;
+        profiler_event_id = events.Publish();
+
+        current_correlation_id_ = event.correlation_id;
+    }
+
+    if (trace_file_sink_)
+    {
+        trace_file_sink_->BeginEvent(
+            "kernel",
+            op_type,
+            {{"op_name", op_name}, {"device", device_ordinal}});
+        if (!profiler_event_id)
+        {
+            profiler_event_id = kTraceFileOnlyEventId;
+        }
     }
 
     return profiler_event_id;
@@ -408,14 +613,30 @@ absl::optional<uint32_t> DmlTracing::TryLogKernelComputeStart(
 
 void DmlTracing::LogKernelComputeEnd(uint32_t device_id, uint32_t event_id)
 {
-    if (profiler_active_ && trace_profiler_level_ >= TraceLevel::Standard)
+    if (trace_file_sink_)
     {
-        // Locking here is not ideal and can be avoided with TLS.
-        std::unique_lock<std::mutex> lock(mutex_);
-        auto& event = device_events_[device_id].kernel_compute_events[event_id];
-        event.end_timestamp_ns = absl::GetCurrentTimeNanos();
-        lock.unlock();
+        trace_file_sink_->EndEvent();
+        if (event_id == kTraceFileOnlyEventId)
+        {
+            return;
+        }
+    }
+
+    // The events are gone if a new profiler session started since the kernel
+    // compute started.
+    ThreadEvents* thread_events = TryGetThreadEvents();
+    if (!thread_events)
+    {
+        current_correlation_id_ = 0;
+        return;
     }
+
+    auto& event =
+        thread_events->device_events[device_id].kernel_compute_events[event_id];
+    event.end_timestamp_ns.store(
+        absl::GetCurrentTimeNanos(),
+        std::memory_order_relaxed);
+    current_correlation_id_ = event.parent_correlation_id;
 }
 
 void DmlTracing::LogExecuteOperatorStart(
@@ -448,6 +669,10 @@ const tsl::profiler::XSpace& DmlTracing::GetXSpace()
 {
     using namespace tsl::profiler;
 
+    // Threads only take the lock to register their events, so holding it
+    // doesn't block recording.
+    std::unique_lock<std::mutex> lock(mutex_);
+
     if (!xspace_dirty_)
     {
         return xspace_;
@@ -456,11 +681,30 @@ const tsl::profiler::XSpace& DmlTracing::GetXSpace()
     xspace_.Clear();
 
     auto& device_cache = tfdml::DmlDeviceCache::Instance();
+    uint64_t session_id = session_id_.load();
 
-    for (uint32_t i = 0; i < device_events_.size(); i++)
+    for (uint32_t i = 0; i < device_count_; i++)
     {
-        auto& device_events = device_events_[i];
-        if (device_events.kernel_compute_events.empty())
+        // Merge the events that each thread recorded for the device.
+        std::vector<const KernelComputeEvent*> kernel_compute_events;
+        std::vector<const MemcpyEvent*> memcpy_events;
+        for (const auto& thread_events : registered_thread_events_)
+        {
+            if (thread_events->session_id != session_id)
+            {
+                continue;
+            }
+
+            const auto& device_events = thread_events->device_events[i];
+            device_events.kernel_compute_events.ForEach(
+                [&](const KernelComputeEvent& event)
+                { kernel_compute_events.push_back(&event); });
+            device_events.memcpy_events.ForEach(
+                [&](const MemcpyEvent& event)
+                { memcpy_events.push_back(&event); });
+        }
+
+        if (kernel_compute_events.empty())
         {
             continue;
         }
@@ -484,6 +728,24 @@ const tsl::profiler::XSpace& DmlTracing::GetXSpace()
         plane.SetName(
             absl::StrCat("/device:GPU:", i, " (DirectML) - ", adapter.Name()));
 
+        // Running totals are reported for the session, and gauges as of its
+        // end.
+        for (size_t c = 0; c < tfdml::DmlCounters::kCounterCount; ++c)
+        {
+            auto counter = static_cast<tfdml::DmlCounter>(c);
+            uint64_t value = stop_counter_values_[i][c];
+            if (!tfdml::DmlCounters::IsGauge(counter))
+            {
+                value -= start_counter_values_[i][c];
+            }
+
+            plane.AddStatValue(
+                *plane.GetOrCreateStatMetadata(absl::StrCat(
+                    "dml_",
+                    tfdml::DmlCounters::GetName(counter))),
+                value);
+        }
+
         auto memcpy_h2d_line = plane.GetOrCreateLine(0);
         memcpy_h2d_line.SetName("MemcpyH2D (CPU Timeline)");
 
@@ -496,7 +758,36 @@ const tsl::profiler::XSpace& DmlTracing::GetXSpace()
         auto kernels_line = plane.GetOrCreateLine(3);
         kernels_line.SetName("Kernels (CPU Timeline)");
 
-        for (auto& memcpy_event : device_events.memcpy_events)
+        auto gpu_memcpy_line = plane.GetOrCreateLine(4);
+        gpu_memcpy_line.SetName("Memcpy (GPU Timeline)");
+
+        auto gpu_kernels_line = plane.GetOrCreateLine(5);
+        gpu_kernels_line.SetName("Kernels (GPU Timeline)");
+
+        // The CPU events that recorded GPU work, by correlation id.
+        absl::flat_hash_map<uint64_t, const MemcpyEvent*> memcpy_events_by_id;
+        for (const MemcpyEvent* memcpy_event : memcpy_events)
+        {
+            memcpy_events_by_id[memcpy_event->correlation_id] = memcpy_event;
+        }
+
+        absl::flat_hash_map<uint64_t, const KernelComputeEvent*>
+            kernel_events_by_id;
+        for (const KernelComputeEvent* kernel_event : kernel_compute_events)
+        {
+            kernel_events_by_id[kernel_event->correlation_id] = kernel_event;
+        }
+
+        // Kernels that were timed on the GPU are only attributed their GPU
+        // duration, rather than also the duration of the compute call, in the
+        // tools that aggregate the events tagged with the "tf_op" stat.
+        absl::flat_hash_set<uint64_t> timed_correlation_ids;
+        for (auto& gpu_event : gpu_events_[i])
+        {
+            timed_correlation_ids.insert(gpu_event.correlation_id);
+        }
+
+        for (const MemcpyEvent* memcpy_event : memcpy_events)
         {
             // WARNING: The pluggable profiler interface doesn't guarantee
             // events from the plugin will be reflected in all the various
@@ -506,7 +797,7 @@ const tsl::profiler::XSpace& DmlTracing::GetXSpace()
             const char* event_name;
             absl::optional<XLineBuilder> memcpy_line;
 
-            switch (memcpy_event.memcpy_type)
+            switch (memcpy_event->memcpy_type)
             {
             case MemcpyType::H2D:
                 event_name = "MemcpyH2D";
@@ -525,17 +816,20 @@ const tsl::profiler::XSpace& DmlTracing::GetXSpace()
             auto event_metadata = plane.GetOrCreateEventMetadata(event_name);
             event_metadata->set_display_name(event_name);
             auto event = memcpy_line->AddEvent(*event_metadata);
-            event.SetTimestampNs(memcpy_event.start_timestamp_ns);
-            event.SetEndTimestampNs(memcpy_event.end_timestamp_ns);
+            event.SetTimestampNs(memcpy_event->start_timestamp_ns);
+            event.SetEndTimestampNs(memcpy_event->end_timestamp_ns.load());
             event.AddStatValue(
                 *plane.GetOrCreateStatMetadata("tf_op"),
                 *plane.GetOrCreateStatMetadata(""));
             event.AddStatValue(
                 *plane.GetOrCreateStatMetadata("size"),
-                memcpy_event.size);
+                memcpy_event->size);
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("correlation_id"),
+                memcpy_event->correlation_id);
         }
 
-        for (auto& kernel_event : device_events.kernel_compute_events)
+        for (const KernelComputeEvent* kernel_event : kernel_compute_events)
         {
             // WARNING: The pluggable profiler interface doesn't guarantee
             // events from the plugin will be reflected in all the various
@@ -543,16 +837,139 @@ const tsl::profiler::XSpace& DmlTracing::GetXSpace()
             // events tagged with the "tf_op" stat and named <op_name>:<op_type>
             // (e.g. "MyMatrixMultiply:MatMul") will be parsed correctly.
             auto event_name =
-                absl::StrCat(kernel_event.op_name, ":", kernel_event.op_type);
+                absl::StrCat(kernel_event->op_name, ":", kernel_event->op_type);
 
             auto event_metadata = plane.GetOrCreateEventMetadata(event_name);
-            event_metadata->set_display_name(kernel_event.op_type);
+            event_metadata->set_display_name(kernel_event->op_type);
             auto event = kernels_line.AddEvent(*event_metadata);
-            event.SetTimestampNs(kernel_event.start_timestamp_ns);
-            event.SetEndTimestampNs(kernel_event.end_timestamp_ns);
+            event.SetTimestampNs(kernel_event->start_timestamp_ns);
+            event.SetEndTimestampNs(kernel_event->end_timestamp_ns.load());
+            if (!timed_correlation_ids.contains(kernel_event->correlation_id))
+            {
+                event.AddStatValue(
+                    *plane.GetOrCreateStatMetadata("tf_op"),
+                    *plane.GetOrCreateStatMetadata(event_name));
+            }
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("correlation_id"),
+                kernel_event->correlation_id);
+        }
+
+        for (auto& gpu_event : gpu_events_[i])
+        {
+            std::string event_name;
+            std::string display_name;
+            absl::optional<XLineBuilder> gpu_line;
+
+            auto kernel_event =
+                kernel_events_by_id.find(gpu_event.correlation_id);
+            auto memcpy_event =
+                memcpy_events_by_id.find(gpu_event.correlation_id);
+            if (kernel_event != kernel_events_by_id.end())
+            {
+                event_name = absl::StrCat(
+                    kernel_event->second->op_name,
+                    ":",
+                    kernel_event->second->op_type);
+                display_name = kernel_event->second->op_type;
+                gpu_line = gpu_kernels_line;
+            }
+            else if (memcpy_event != memcpy_events_by_id.end())
+            {
+                switch (memcpy_event->second->memcpy_type)
+                {
+                case MemcpyType::H2D:
+                    display_name = "MemcpyH2D";
+                    break;
+                case MemcpyType::D2D:
+                    display_name = "MemcpyD2D";
+                    break;
+                case MemcpyType::D2H:
+                    display_name = "MemcpyD2H";
+                    break;
+                }
+                gpu_line = gpu_memcpy_line;
+            }
+            else
+            {
+                continue;
+            }
+
+            auto event_metadata = plane.GetOrCreateEventMetadata(
+                event_name.empty() ? display_name : event_name);
+            event_metadata->set_display_name(display_name);
+            auto event = gpu_line->AddEvent(*event_metadata);
+            event.SetTimestampNs(gpu_event.start_timestamp_ns);
+            event.SetEndTimestampNs(gpu_event.end_timestamp_ns);
             event.AddStatValue(
                 *plane.GetOrCreateStatMetadata("tf_op"),
                 *plane.GetOrCreateStatMetadata(event_name));
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("correlation_id"),
+                gpu_event.correlation_id);
+        }
+
+        plane.ForEachLine(
+            [&](XLineBuilder line)
+            { line.SetTimestampNs(profiler_start_timestamp_ns_); });
+    }
+
+    if (!memory_events_.empty())
+    {
+        // TensorBoard's memory profile tool reads the MemoryAllocation and
+        // MemoryDeallocation events of the host plane, which the TF runtime
+        // merges this plane into.
+        auto xplane = xspace_.add_planes();
+        XPlaneBuilder plane(xplane);
+        plane.SetId(kHostPlaneId);
+        plane.SetName("/host:CPU");
+
+        // Each allocator gets its own line
+        absl::flat_hash_map<std::string, int64_t> line_ids;
+        for (const auto& memory_event : memory_events_)
+        {
+            auto line_id = line_ids.emplace(
+                memory_event.allocator_name,
+                static_cast<int64_t>(line_ids.size()));
+            auto line = plane.GetOrCreateLine(line_id.first->second);
+            line.SetNameIfEmpty(memory_event.allocator_name);
+
+            auto event_metadata = plane.GetOrCreateEventMetadata(
+                memory_event.is_allocation ? "MemoryAllocation"
+                                           : "MemoryDeallocation");
+            auto event = line.AddEvent(*event_metadata);
+            event.SetTimestampNs(memory_event.timestamp_ns);
+            event.SetDurationNs(0);
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("allocator_name"),
+                *plane.GetOrCreateStatMetadata(memory_event.allocator_name));
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("tf_op"),
+                *plane.GetOrCreateStatMetadata(memory_event.tf_op));
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("requested_bytes"),
+                memory_event.requested_bytes);
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("allocation_bytes"),
+                memory_event.allocation_bytes);
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("addr"),
+                memory_event.address);
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("bytes_allocated"),
+                memory_event.bytes_allocated);
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("bytes_reserved"),
+                memory_event.bytes_reserved);
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("bytes_available"),
+                memory_event.bytes_available);
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("peak_bytes_in_use"),
+                memory_event.peak_bytes_in_use);
+            event.AddStatValue(
+                *plane.GetOrCreateStatMetadata("fragmentation"),
+                memory_event.fragmentation);
         }
 
         plane.ForEachLine(
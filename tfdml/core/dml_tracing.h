@@ -15,17 +15,28 @@ limitations under the License.
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+
 #include "dml_common.h"
 #include "tfdml/core/dml_adapter.h"
+#include "tfdml/core/dml_counters.h"
+#include "tfdml/core/dml_gpu_timeline.h"
+#include "tfdml/core/dml_trace_file_sink.h"
 
+#include "absl/memory/memory.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
+#include "tfdml/runtime_adapter/memory_trace.h"
 #include "tfdml/runtime_adapter/xplane_builder.h"
 
 // DirectML tracer that emits the following types of events:
 // - ETW: for analysis in GPUView and WPA
 // - PIX: for analysis in PIX timing and GPU captures
 // - TF Profiler: for analysis in TensorBoard
+// - Trace file: for analysis in chrome://tracing or Perfetto, without a TF
+//   profiler session (see DmlTraceFileSink)
 class DmlTracing
 {
   public:
@@ -98,13 +109,19 @@ class DmlTracing
     TraceLevel trace_etw_level_ = None;
     TraceLevel trace_profiler_level_ = Standard;
 
-    // Tracks a DML kernel compute call on the CPU timeline.
+    // Tracks a DML kernel compute call on the CPU timeline. The correlation id
+    // identifies the GPU work recorded by the call, and the parent correlation
+    // id is the one that was active on the thread when the call started. The
+    // end timestamp is written after the event is published (see EventBuffer),
+    // so it may be read concurrently.
     struct KernelComputeEvent
     {
         std::string op_type;
         std::string op_name;
         int64_t start_timestamp_ns;
-        int64_t end_timestamp_ns;
+        std::atomic<int64_t> end_timestamp_ns;
+        uint64_t correlation_id;
+        uint64_t parent_correlation_id;
     };
 
     struct MemcpyEvent
@@ -112,28 +129,164 @@ class DmlTracing
         MemcpyType memcpy_type;
         uint64_t size;
         int64_t start_timestamp_ns;
-        int64_t end_timestamp_ns;
+        std::atomic<int64_t> end_timestamp_ns;
+        uint64_t correlation_id;
+        uint64_t parent_correlation_id;
+    };
+
+    // An append-only sequence of events that is written by a single thread
+    // without locking, and may be read by any thread at the same time. Events
+    // are stored in blocks that never move, and only become visible to readers
+    // once they're published.
+    template <typename T>
+    class EventBuffer
+    {
+      public:
+        // Returns the slot of the next event, which the writer fills before
+        // publishing it.
+        T& Next()
+        {
+            size_t index = size_.load(std::memory_order_relaxed);
+            if (index == blocks_.size() * kEventsPerBlock)
+            {
+                auto block = absl::make_unique<Block>();
+                Block* new_block = block.get();
+                if (blocks_.empty())
+                {
+                    head_ = std::move(block);
+                }
+                else
+                {
+                    blocks_.back()->next = std::move(block);
+                }
+                blocks_.push_back(new_block);
+            }
+            return (*this)[index];
+        }
+
+        // Makes the event returned by Next visible to readers, and returns its
+        // index.
+        uint32_t Publish()
+        {
+            size_t index = size_.load(std::memory_order_relaxed);
+            size_.store(index + 1, std::memory_order_release);
+            return static_cast<uint32_t>(index);
+        }
+
+        // Returns an event by index. Only the writer may call this.
+        T& operator[](size_t index)
+        {
+            return blocks_[index / kEventsPerBlock]
+                ->events[index % kEventsPerBlock];
+        }
+
+        // Calls `visit` with each published event.
+        template <typename F>
+        void ForEach(F visit) const
+        {
+            size_t size = size_.load(std::memory_order_acquire);
+            if (size == 0)
+            {
+                return;
+            }
+
+            const Block* block = head_.get();
+            for (size_t i = 0; i < size; ++i)
+            {
+                if (i > 0 && i % kEventsPerBlock == 0)
+                {
+                    block = block->next.get();
+                }
+                visit(block->events[i % kEventsPerBlock]);
+            }
+        }
+
+      private:
+        static constexpr size_t kEventsPerBlock = 256;
+
+        struct Block
+        {
+            T events[kEventsPerBlock];
+            std::unique_ptr<Block> next;
+        };
+
+        std::unique_ptr<Block> head_;
+        std::atomic<size_t> size_{0};
+
+        // Only accessed by the writer
+        std::vector<Block*> blocks_;
     };
 
-    // Data collected for the TF profiler.
+    // Data collected for the TF profiler by a single thread.
     struct DeviceEvents
     {
-        std::vector<KernelComputeEvent> kernel_compute_events;
-        std::vector<MemcpyEvent> memcpy_events;
+        EventBuffer<KernelComputeEvent> kernel_compute_events;
+        EventBuffer<MemcpyEvent> memcpy_events;
+    };
 
-        inline void Clear()
+    // The events recorded by a thread during a profiler session. Each thread
+    // registers its events with the tracer the first time it records an event
+    // in a session, which is the only time recording takes the lock.
+    struct ThreadEvents
+    {
+        ThreadEvents(uint64_t session_id, size_t device_count)
+            : session_id(session_id),
+              device_events(absl::make_unique<DeviceEvents[]>(device_count))
         {
-            kernel_compute_events.clear();
-            memcpy_events.clear();
         }
+
+        uint64_t session_id;
+        std::unique_ptr<DeviceEvents[]> device_events;
+    };
+
+    // Returns the calling thread's events for the current session.
+    ThreadEvents& GetThreadEvents();
+
+    // Returns the calling thread's events if they belong to the current
+    // session, or null otherwise.
+    ThreadEvents* TryGetThreadEvents() const;
+
+    static thread_local std::shared_ptr<ThreadEvents> thread_events_;
+    std::vector<std::shared_ptr<ThreadEvents>> registered_thread_events_;
+    std::atomic<uint64_t> session_id_;
+    size_t device_count_ = 0;
+
+    // The execution of the copies and operators recorded by the CPU events,
+    // which they're matched to by correlation id.
+    std::vector<std::vector<tfdml::DmlGpuTimeline::Event>> gpu_events_;
+
+    // The dispatch pipeline counters of each device when the session started
+    // and stopped, which are emitted as stats of the device planes.
+    std::vector<tfdml::DmlCounters::Values> start_counter_values_;
+    std::vector<tfdml::DmlCounters::Values> stop_counter_values_;
+
+    // Receives the allocations and deallocations of the allocators while the
+    // profiler is active.
+    class MemoryListener final : public tfdml::MemoryTraceListener
+    {
+      public:
+        void OnMemoryEvent(tfdml::MemoryTraceEvent&& event) override;
     };
-    std::vector<DeviceEvents> device_events_;
+
+    MemoryListener memory_listener_;
+    std::vector<tfdml::MemoryTraceEvent> memory_events_;
+
+    // Null unless TF_DIRECTML_TRACE_FILE is set. When only the trace file
+    // records a kernel compute or memcpy event, its start returns this id so
+    // that the caller still ends it.
+    std::unique_ptr<tfdml::DmlTraceFileSink> trace_file_sink_;
+    static constexpr uint32_t kTraceFileOnlyEventId = UINT32_MAX;
+
     tsl::profiler::XSpace xspace_;
     bool xspace_dirty_ = true;
     int64_t profiler_start_timestamp_ns_ = 0;
     std::mutex mutex_;
     bool profiler_active_ = false;
 
+    // Correlation ids are unique across devices; 0 means there's no event.
+    std::atomic<uint64_t> next_correlation_id_;
+    static thread_local uint64_t current_correlation_id_;
+
   public:
     static DmlTracing& Instance();
 
@@ -143,7 +296,13 @@ class DmlTracing
     // CPU timeline
     void LogExecutionContextCopyBufferRegion();
     void LogExecutionContextFillBufferWithPattern();
-    void LogExecutionContextFlush();
+    void LogExecutionContextFlush(uint64_t command_count, uint64_t fence_value);
+    void LogFenceSignal(
+        D3D12_COMMAND_LIST_TYPE queue_type,
+        uint64_t fence_value);
+    void LogKernelCreation(
+        const absl::string_view op_type,
+        std::chrono::nanoseconds creation_time);
 
     absl::optional<uint32_t> TryLogKernelComputeStart(
         uint32_t device_ordinal,
@@ -157,6 +316,14 @@ class DmlTracing
         uint64_t data_size);
     void LogMemcpyEnd(uint32_t device_id, uint32_t event_id);
 
+    // Returns the correlation id of the kernel compute or memcpy event that is
+    // in progress on the calling thread, or 0 if there is none. GPU work
+    // recorded with this id is attributed to the event on the GPU timeline.
+    uint64_t GetCurrentCorrelationId() const
+    {
+        return profiler_active_ ? current_correlation_id_ : 0;
+    }
+
     // GPU timeline
     void LogExecuteOperatorStart(
         IDMLCompiledOperator* op,
@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "dml_upload_heap.h"
 
+#include "dml_host_staging_pool.h"
 #include "tfdml/runtime_adapter/macros.h"
 #include "tfdml/runtime_adapter/status.h"
 
@@ -28,18 +29,37 @@ static D3D12_HEAP_PROPERTIES UploadHeapProps()
 
 DmlUploadHeap::DmlUploadHeap(
     ID3D12Device* device,
-    DmlExecutionContext* execution_context)
+    DmlExecutionContext* execution_context,
+    DmlHostStagingPool* host_staging_pool,
+    DmlCounters* counters)
     : DmlPooledHeap(
           device,
           UploadHeapProps(),
           D3D12_RESOURCE_STATE_GENERIC_READ),
-      execution_context_(execution_context)
+      execution_context_(execution_context),
+      host_staging_pool_(host_staging_pool),
+      counters_(counters)
 {
 }
 
 StatusOr<DmlGpuEvent> DmlUploadHeap::BeginUploadToGpu(
     const D3D12BufferRegion& dst,
     absl::Span<const uint8_t> src)
+{
+    return BeginUpload(dst, src, false);
+}
+
+StatusOr<DmlGpuEvent> DmlUploadHeap::BeginStreamOrderedUploadToGpu(
+    const D3D12BufferRegion& dst,
+    absl::Span<const uint8_t> src)
+{
+    return BeginUpload(dst, src, true);
+}
+
+StatusOr<DmlGpuEvent> DmlUploadHeap::BeginUpload(
+    const D3D12BufferRegion& dst,
+    absl::Span<const uint8_t> src,
+    bool allow_staging_pool_src)
 {
     std::unique_lock<std::mutex> lock(mutex_);
     TF_RETURN_IF_ERROR(execution_context_->GetCommandRecorderStatus());
@@ -49,6 +69,28 @@ StatusOr<DmlGpuEvent> DmlUploadHeap::BeginUploadToGpu(
         dst.ResourceInUavState()->GetDesc().Dimension ==
         D3D12_RESOURCE_DIMENSION_BUFFER);
 
+    counters_->Increment(DmlCounter::Uploads);
+    counters_->Add(DmlCounter::UploadBytes, src.size());
+
+    // The GPU can copy from the staging pool's memory directly, which saves
+    // copying it into the upload heap first. Only the caller knows whether the
+    // memory stays unchanged until the GPU gets to it.
+    if (host_staging_pool_ && allow_staging_pool_src)
+    {
+        auto staging_buffer = host_staging_pool_->Find(src.data(), src.size());
+        if (staging_buffer)
+        {
+            DmlGpuEvent done_event = execution_context_->CopyFromStagingBuffer(
+                dst.Subregion(0, src.size()),
+                staging_buffer->buffer,
+                staging_buffer->offset);
+
+            host_staging_pool_->AddGpuUse(src.data(), done_event);
+            counters_->Increment(DmlCounter::UploadsFromStagingPool);
+            return done_event;
+        }
+    }
+
     InvariantChecker checker(this);
 
     ReclaimAllocations();
@@ -85,10 +127,12 @@ StatusOr<DmlGpuEvent> DmlUploadHeap::BeginUploadToGpu(
         execution_context_->CopyBufferRegion(dst, upload_resource);
 
     // Add an allocation entry to the chunk
-    chunk->allocations.push_back(Allocation{
-        static_cast<uint64_t>(src.size()),
-        offset_in_chunk,
-        done_event});
+    CommitAllocation(
+        chunk,
+        Allocation{
+            static_cast<uint64_t>(src.size()),
+            offset_in_chunk,
+            done_event});
 
     return done_event;
 }
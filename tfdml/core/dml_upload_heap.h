@@ -23,25 +23,47 @@ namespace tfdml
 {
 
 class DmlExecutionContext;
+class DmlHostStagingPool;
 
 // Implements a non-blocking, ring-buffer style upload heap for copying CPU data
 // to GPU resources. This class is thread-safe.
 class DmlUploadHeap : public DmlPooledHeap
 {
   public:
-    DmlUploadHeap(ID3D12Device* device, DmlExecutionContext* execution_context);
+    DmlUploadHeap(
+        ID3D12Device* device,
+        DmlExecutionContext* execution_context,
+        DmlHostStagingPool* host_staging_pool,
+        DmlCounters* counters);
 
     // Makes a copy of the source data and begins copying it into the
     // destination resource, and returns a DmlGpuEvent which will become
     // signaled when the copy is complete. The destination resource must be a
-    // default or readback buffer.
+    // default or readback buffer. The source data can be released or modified
+    // as soon as this returns.
     StatusOr<DmlGpuEvent> BeginUploadToGpu(
         const D3D12BufferRegion& dst,
         absl::Span<const uint8_t> src);
 
+    // Same as BeginUploadToGpu, except that source data in the host staging
+    // pool is copied by the GPU directly instead of being copied into the
+    // upload heap first. The caller must keep the source data alive and
+    // unchanged until the returned event is signaled, which stream-ordered
+    // copies guarantee.
+    StatusOr<DmlGpuEvent> BeginStreamOrderedUploadToGpu(
+        const D3D12BufferRegion& dst,
+        absl::Span<const uint8_t> src);
+
   private:
+    StatusOr<DmlGpuEvent> BeginUpload(
+        const D3D12BufferRegion& dst,
+        absl::Span<const uint8_t> src,
+        bool allow_staging_pool_src);
+
     std::mutex mutex_;
     DmlExecutionContext* execution_context_; // weak; owned by DmlDeviceState
+    DmlHostStagingPool* host_staging_pool_;   // weak; owned by DmlDeviceState
+    DmlCounters* counters_;                   // weak; owned by DmlDeviceState
 };
 
 } // namespace tfdml
@@ -306,6 +306,7 @@ class DmlBinaryAddVariantKernelWrapper : public OpKernel
         key.input_tensors.push_back(tensor_key);
         key.input_tensors.push_back(std::move(tensor_key));
 
+        key.fingerprint = key.ComputeFingerprint();
         return key;
     }
 
@@ -738,9 +738,46 @@ class DmlAdamKernelWrapper
         key.input_tensors.push_back(
             {TensorShapeAndType{grad.shape(), grad.dtype()}, false});
 
+        key.fingerprint = key.ComputeFingerprint(this->attribute_hash_);
         return key;
     }
 
+    uint64_t ComputeKernelKeyFingerprint(
+        OpKernelContext* ctx,
+        absl::Span<const Tensor> inputs) const override
+    {
+        using TensorIndices =
+            typename DmlApplyAdamKernel<num_input_refs>::TensorIndices;
+
+        // This must match the key built by CreateKernelKey
+        DmlKernelFingerprintBuilder builder(this->attribute_hash_);
+        builder.AddInputTensor(inputs[TensorIndices::kLR], true);
+        builder.AddInputTensor(inputs[TensorIndices::kBeta1], true);
+        builder.AddInputTensor(inputs[TensorIndices::kBeta2], true);
+        builder.AddInputTensor(inputs[TensorIndices::kEpsilon], true);
+        builder.AddInputTensor(inputs[TensorIndices::kGrad], false);
+        return builder.Finish();
+    }
+
+    bool KernelKeyMatches(
+        OpKernelContext* ctx,
+        absl::Span<const Tensor> inputs,
+        const DmlKernelKey& key) const override
+    {
+        using TensorIndices =
+            typename DmlApplyAdamKernel<num_input_refs>::TensorIndices;
+
+        const auto& input_keys = key.input_tensors;
+
+        return input_keys.size() == 5 &&
+               this->KernelKeyAttributesMatch(key) &&
+               input_keys[0].Matches(inputs[TensorIndices::kLR], true) &&
+               input_keys[1].Matches(inputs[TensorIndices::kBeta1], true) &&
+               input_keys[2].Matches(inputs[TensorIndices::kBeta2], true) &&
+               input_keys[3].Matches(inputs[TensorIndices::kEpsilon], true) &&
+               input_keys[4].Matches(inputs[TensorIndices::kGrad], false);
+    }
+
   private:
     std::shared_ptr<const NodeDef> node_def_;
 };
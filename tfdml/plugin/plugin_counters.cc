@@ -0,0 +1,61 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tfdml/plugin/plugin_counters.h"
+
+#include <algorithm>
+
+#include "tfdml/core/dml_counters.h"
+#include "tfdml/core/dml_device_cache.h"
+#include "tfdml/core/dml_device_state.h"
+
+using tfdml::DmlCounter;
+using tfdml::DmlCounters;
+
+extern "C"
+{
+    TFDML_EXPORT size_t TFDML_GetCounterCount()
+    {
+        return DmlCounters::kCounterCount;
+    }
+
+    TFDML_EXPORT const char* TFDML_GetCounterName(size_t counter_index)
+    {
+        if (counter_index >= DmlCounters::kCounterCount)
+        {
+            return nullptr;
+        }
+
+        return DmlCounters::GetName(static_cast<DmlCounter>(counter_index));
+    }
+
+    TFDML_EXPORT size_t TFDML_GetCounterValues(
+        uint32_t device_index,
+        uint64_t* values,
+        size_t value_count)
+    {
+        const auto* state =
+            tfdml::DmlDeviceCache::Instance().TryGetDeviceState(device_index);
+        if (!state || !values)
+        {
+            return 0;
+        }
+
+        DmlCounters::Values counter_values = state->counters->GetValues();
+        size_t copy_count = std::min(value_count, counter_values.size());
+        std::copy_n(counter_values.begin(), copy_count, values);
+        return copy_count;
+    }
+} // extern "C"
@@ -0,0 +1,50 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tfdml/runtime_adapter/macros.h"
+
+// Functions for monitoring agents to read the dispatch pipeline counters of
+// the DirectML devices while a process runs. They can be called from any
+// thread, and never create a device.
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // Returns the number of counters of each device.
+    TFDML_EXPORT size_t TFDML_GetCounterCount();
+
+    // Returns the name of a counter, e.g. "batches_flushed", or null if the
+    // index is out of range. The string is valid for the lifetime of the
+    // plugin.
+    TFDML_EXPORT const char* TFDML_GetCounterName(size_t counter_index);
+
+    // Copies up to value_count counter values of a device into values, in the
+    // order of their names, and returns the number of values copied. Returns 0
+    // if the device doesn't exist or hasn't been created yet.
+    TFDML_EXPORT size_t TFDML_GetCounterValues(
+        uint32_t device_index,
+        uint64_t* values,
+        size_t value_count);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -35,6 +35,9 @@ limitations under the License.
 #include "tfdml/core/dml_device_cache.h"
 #include "tfdml/core/dml_device_context.h"
 #include "tfdml/core/dml_device_manager.h"
+#include "tfdml/core/dml_gpu_timer.h"
+#include "tfdml/core/dml_host_staging_pool.h"
+#include "tfdml/core/dml_stream_event.h"
 #include "tfdml/core/dml_tagged_pointer.h"
 #include "tfdml/core/dml_tracing.h"
 #include "tfdml/core/dml_util.h"
@@ -138,6 +141,19 @@ void plugin_deallocate(const SP_Device* device, SP_DeviceMemoryBase* mem)
 
 void* plugin_host_memory_allocate(const SP_Device* device, uint64_t size)
 {
+    // Memory from the staging pool can be copied to and from by the GPU
+    // directly, without going through the upload and readback heaps
+    DmlDevice* dml_device = static_cast<DmlDevice*>(device->device_handle);
+    DmlHostStagingPool* host_staging_pool = dml_device->GetHostStagingPool();
+    if (host_staging_pool)
+    {
+        void* ptr = host_staging_pool->Allocate(size);
+        if (ptr)
+        {
+            return ptr;
+        }
+    }
+
 #if _WIN32
     void* ptr = _aligned_malloc(size, 64);
 #else
@@ -148,6 +164,13 @@ void* plugin_host_memory_allocate(const SP_Device* device, uint64_t size)
 
 void plugin_host_memory_deallocate(const SP_Device* device, void* mem)
 {
+    DmlDevice* dml_device = static_cast<DmlDevice*>(device->device_handle);
+    DmlHostStagingPool* host_staging_pool = dml_device->GetHostStagingPool();
+    if (host_staging_pool && host_staging_pool->Free(mem))
+    {
+        return;
+    }
+
 #if _WIN32
     _aligned_free(mem);
 #else
@@ -220,21 +243,42 @@ void plugin_get_stream_status(
 {
 }
 
+// Flushes the work recorded into the event to the GPU and blocks the host
+// until it completes.
+static Status WaitForStreamEvent(const DmlStreamEvent& stream_event)
+{
+    const DmlDevice* dml_device = stream_event.GetDevice();
+    if (dml_device)
+    {
+        TF_RETURN_IF_ERROR(dml_device->FlushEvent(stream_event));
+    }
+
+    stream_event.WaitForCompletion();
+    return Status::OK();
+}
+
 void plugin_create_event(
     const SP_Device* device,
     SP_Event* event,
     TF_Status* status)
 {
+    *event = new SP_Event_st(new DmlStreamEvent());
+    TF_SetStatus(status, TF_OK, "");
 }
 
 // Destroy SE_Event and perform any platform-specific deallocation and
 // cleanup of an event.
-void plugin_destroy_event(const SP_Device* device, SP_Event event) {}
+void plugin_destroy_event(const SP_Device* device, SP_Event event)
+{
+    delete static_cast<DmlStreamEvent*>(event->event_handle);
+    delete event;
+}
 
 // Requests the current status of the event from the underlying platform.
 SE_EventStatus plugin_get_event_status(const SP_Device* device, SP_Event event)
 {
-    return SE_EVENT_COMPLETE;
+    auto* stream_event = static_cast<DmlStreamEvent*>(event->event_handle);
+    return stream_event->IsComplete() ? SE_EVENT_COMPLETE : SE_EVENT_PENDING;
 }
 
 // Inserts the specified event at the end of the specified stream.
@@ -244,6 +288,10 @@ void plugin_record_event(
     SP_Event event,
     TF_Status* status)
 {
+    DmlDevice* dml_device = static_cast<DmlDevice*>(device->device_handle);
+    auto* stream_event = static_cast<DmlStreamEvent*>(event->event_handle);
+    dml_device->RecordEvent(stream_event);
+    TF_SetStatus(status, TF_OK, "");
 }
 
 // Wait for the specified event at the end of the specified stream.
@@ -253,6 +301,22 @@ void plugin_wait_for_event(
     SP_Event event,
     TF_Status* const status)
 {
+    auto* stream_event = static_cast<DmlStreamEvent*>(event->event_handle);
+
+    // Each device executes the work of its stream in order, and orders its own
+    // queues against each other, so only work of another device needs to be
+    // waited for. The queues of different devices can't wait for each other's
+    // fences, so the host waits instead.
+    const DmlDevice* recording_device = stream_event->GetDevice();
+    if (recording_device && recording_device != device->device_handle &&
+        !stream_event->IsComplete())
+    {
+        Status wait_status = WaitForStreamEvent(*stream_event);
+        TF_SetStatus(status, wait_status.code(), wait_status.error_message());
+        return;
+    }
+
+    TF_SetStatus(status, TF_OK, "");
 }
 
 /*** TIMER CALLBACKS ***/
@@ -264,10 +328,19 @@ void plugin_create_timer(
     SP_Timer* timer,
     TF_Status* status)
 {
+    DmlDevice* dml_device = static_cast<DmlDevice*>(device->device_handle);
+    *timer = new SP_Timer_st(new DmlGpuTimer(
+        dml_device->GetD3D12Device(),
+        dml_device->GetExecutionContext()));
+    TF_SetStatus(status, TF_OK, "");
 }
 
 // Destroy timer and deallocates timer resources on the underlying platform.
-void plugin_destroy_timer(const SP_Device* device, SP_Timer timer) {}
+void plugin_destroy_timer(const SP_Device* device, SP_Timer timer)
+{
+    delete static_cast<DmlGpuTimer*>(timer->timer_handle);
+    delete timer;
+}
 
 // Records a start event for an interval timer.
 void plugin_start_timer(
@@ -276,6 +349,8 @@ void plugin_start_timer(
     SP_Timer timer,
     TF_Status* status)
 {
+    static_cast<DmlGpuTimer*>(timer->timer_handle)->Start();
+    TF_SetStatus(status, TF_OK, "");
 }
 
 // Records a stop event for an interval timer.
@@ -285,6 +360,8 @@ void plugin_stop_timer(
     SP_Timer timer,
     TF_Status* status)
 {
+    static_cast<DmlGpuTimer*>(timer->timer_handle)->Stop();
+    TF_SetStatus(status, TF_OK, "");
 }
 
 /*** MEMCPY CALLBACKS ***/
@@ -318,21 +395,15 @@ void plugin_memcpy_dtoh(
         return;
     }
 
-    Status sync_status = dml_device->Sync();
-
-    if (!sync_status.ok())
-    {
-        TF_SetStatus(status, sync_status.code(), sync_status.error_message());
-        return;
-    }
-
     // Even though this function doesn't say that it should block the caller,
     // plugin_synchronize_all_activity is called before and therefore we need a
     // way to tell the caller that all data has been downloaded back to the CPU.
     // For this reason, we avoid implementing plugin_synchronize_all_activity
-    // and just sync here instead.
-    copy_status_or_event.ConsumeValueOrDie().WaitForSignal();
-    TF_SetStatus(status, TF_OK, "");
+    // and just wait for the readback here instead.
+    Status wait_status = dml_device->GetDeviceContext()->WaitForReadback(
+        dml_device,
+        copy_status_or_event.ConsumeValueOrDie());
+    TF_SetStatus(status, wait_status.code(), wait_status.error_message());
 }
 
 // Enqueues a memcpy operation onto stream, with a device destination
@@ -353,11 +424,14 @@ void plugin_memcpy_htod(
 
     DmlDevice* dml_device = static_cast<DmlDevice*>(device->device_handle);
 
+    // TensorFlow keeps the host memory of a stream's copies alive until the
+    // stream has completed them
     Status copy_status = dml_device->GetDeviceContext()->CopyCPUMemoryToDevice(
         dml_device,
         host_src,
         device_dst,
-        size);
+        size,
+        true);
 
     TF_SetStatus(status, copy_status.code(), copy_status.error_message());
 }
@@ -428,14 +502,27 @@ void plugin_memcpy_dtod(
             return;
         }
 
-        status_or_event.ValueOrDie().WaitForSignal();
+        Status wait_status =
+            dml_device_src->GetDeviceContext()->WaitForReadback(
+                dml_device_src,
+                status_or_event.ValueOrDie());
+
+        if (!wait_status.ok())
+        {
+            TF_SetStatus(
+                status,
+                wait_status.code(),
+                wait_status.error_message());
+            return;
+        }
 
         auto cpu_gpu_copy_status =
             dml_device_dst->GetDeviceContext()->CopyCPUMemoryToDevice(
                 dml_device_dst,
                 cpu_memory,
                 device_dst,
-                size);
+                size,
+                false);
 
         if (!cpu_gpu_copy_status.ok())
         {
@@ -479,16 +566,10 @@ void plugin_sync_memcpy_dtoh(
         return;
     }
 
-    Status sync_status = dml_device->Sync();
-
-    if (!sync_status.ok())
-    {
-        TF_SetStatus(status, sync_status.code(), sync_status.error_message());
-        return;
-    }
-
-    copy_status_or_event.ConsumeValueOrDie().WaitForSignal();
-    TF_SetStatus(status, TF_OK, "");
+    Status wait_status = dml_device->GetDeviceContext()->WaitForReadback(
+        dml_device,
+        copy_status_or_event.ConsumeValueOrDie());
+    TF_SetStatus(status, wait_status.code(), wait_status.error_message());
 }
 
 // Blocks the caller while a data segment of the given size is
@@ -508,11 +589,13 @@ void plugin_sync_memcpy_htod(
 
     DmlDevice* dml_device = static_cast<DmlDevice*>(device->device_handle);
 
+    // The host memory is only read by the GPU before the sync below returns
     Status copy_status = dml_device->GetDeviceContext()->CopyCPUMemoryToDevice(
         dml_device,
         host_src,
         device_dst,
-        size);
+        size,
+        true);
 
     if (!copy_status.ok())
     {
@@ -553,6 +636,9 @@ void plugin_block_host_for_event(
     SP_Event event,
     TF_Status* status)
 {
+    auto* stream_event = static_cast<DmlStreamEvent*>(event->event_handle);
+    Status wait_status = WaitForStreamEvent(*stream_event);
+    TF_SetStatus(status, wait_status.code(), wait_status.error_message());
 }
 
 void plugin_block_host_until_done(
@@ -560,6 +646,9 @@ void plugin_block_host_until_done(
     SP_Stream stream,
     TF_Status* status)
 {
+    DmlDevice* dml_device = static_cast<DmlDevice*>(device->device_handle);
+    Status sync_status = dml_device->Sync();
+    TF_SetStatus(status, sync_status.code(), sync_status.error_message());
 }
 
 // Zero out `size` bytes starting at the location.
@@ -650,7 +739,11 @@ TF_Bool plugin_host_callback(
 }
 
 /*Timer Backer Impl*/
-uint64_t nanoseconds(SP_Timer timer) { return timer->timer_handle; }
+uint64_t nanoseconds(SP_Timer timer)
+{
+    return static_cast<DmlGpuTimer*>(timer->timer_handle)
+        ->GetElapsedNanoseconds();
+}
 
 void plugin_create_timer_fns(
     const SP_Platform* platform,
@@ -16,9 +16,12 @@ limitations under the License.
 #include "bfc_allocator.h"
 
 #include <atomic>
+#include <limits>
 
+#include "absl/time/clock.h"
 #include "tensorflow/c/logging.h"
 #include "tfdml/runtime_adapter/macros.h"
+#include "tfdml/runtime_adapter/memory_trace.h"
 #include "tfdml/runtime_adapter/numbers.h"
 
 namespace tfdml
@@ -646,6 +649,7 @@ void* BFCAllocator::FindChunkPtr(
 
                 TF_VLog(4, "Returning: %p", chunk->ptr);
                 TF_VLog(4, "A: %s", RenderOccupancy().c_str());
+                AddTraceMe("MemoryAllocation", chunk->ptr);
                 return chunk->ptr;
             }
         }
@@ -726,9 +730,68 @@ void BFCAllocator::DeallocateRawInternal(void* ptr)
     MarkFree(h);
     InsertFreeChunkIntoBin(TryToCoalesce(h, false));
 
+    // The event is recorded after the chunk is freed and coalesced, so that
+    // the stats reflect the state after the deallocation.
+    AddTraceMe("MemoryDeallocation", chunk_ptr, req_bytes, alloc_bytes);
+
     TF_VLog(4, "F: %s", RenderOccupancy().c_str());
 }
 
+void BFCAllocator::AddTraceMe(absl::string_view traceme_name, const void* ptr)
+{
+    if (!GetMemoryTraceListener())
+    {
+        return;
+    }
+
+    const Chunk* chunk = ChunkFromHandle(region_manager_.get_handle(ptr));
+    AddTraceMe(traceme_name, chunk->ptr, chunk->requested_size, chunk->size);
+}
+
+void BFCAllocator::AddTraceMe(
+    absl::string_view traceme_name,
+    const void* chunk_ptr,
+    int64_t req_bytes,
+    int64_t alloc_bytes)
+{
+    MemoryTraceListener* listener = GetMemoryTraceListener();
+    if (!listener)
+    {
+        return;
+    }
+
+    // The memory limit is unbounded for some allocators (e.g. descriptors), so
+    // the available bytes are clamped instead of overflowing.
+    int64_t bytes_used = stats_.bytes_reserved + stats_.bytes_in_use;
+    constexpr int64_t max_bytes = std::numeric_limits<int64_t>::max();
+    int64_t bytes_available =
+        memory_limit_ > static_cast<size_t>(max_bytes)
+            ? max_bytes - bytes_used
+            : static_cast<int64_t>(memory_limit_) - bytes_used;
+
+    MemoryTraceEvent event;
+    event.is_allocation = traceme_name == "MemoryAllocation";
+    event.timestamp_ns = absl::GetCurrentTimeNanos();
+    event.allocator_name = name_;
+    event.tf_op = std::string(ScopedMemoryDebugAnnotation::CurrentOpName());
+    event.requested_bytes = req_bytes;
+    event.allocation_bytes = alloc_bytes;
+    event.address = reinterpret_cast<uint64_t>(chunk_ptr);
+    event.bytes_allocated = stats_.bytes_in_use;
+    event.bytes_reserved = stats_.bytes_reserved;
+    event.bytes_available = bytes_available;
+    event.peak_bytes_in_use = stats_.peak_bytes_in_use;
+
+    // GetFragmentation is only defined while part of the regions is free
+    if (total_region_allocated_bytes_ >
+        static_cast<size_t>(stats_.bytes_in_use))
+    {
+        event.fragmentation = GetFragmentation();
+    }
+
+    listener->OnMemoryEvent(std::move(event));
+}
+
 // Merges h1 and h2 when Chunk(h1)->next is h2 and Chunk(h2)->prev is c1.
 // We merge Chunk(h2) into Chunk(h1).
 void BFCAllocator::Merge(
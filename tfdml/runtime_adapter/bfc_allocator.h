@@ -145,9 +145,9 @@ class BFCAllocator : public Allocator
     // time. The free chunks are sorted by size (and then address) in a bin.
     int64_t LargestFreeChunk() EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
-    // Add TraceMe (in memory allocation and deallocation) for memory stats
-    // profiling. The chunk_ptr is passed to get information such as address,
-    // chunk size and requested_size.
+    // Reports a memory allocation or deallocation to the MemoryTraceListener,
+    // if one is installed, for memory profiling. The chunk_ptr is passed to get
+    // information such as address, chunk size and requested_size.
     void AddTraceMe(absl::string_view traceme_name, const void* ptr)
         EXCLUSIVE_LOCKS_REQUIRED(lock_);
 
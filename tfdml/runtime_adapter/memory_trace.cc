@@ -0,0 +1,54 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "memory_trace.h"
+
+#include <atomic>
+
+namespace tfdml
+{
+
+static std::atomic<MemoryTraceListener*> memory_trace_listener = {nullptr};
+
+static thread_local absl::string_view current_op_name;
+
+void SetMemoryTraceListener(MemoryTraceListener* listener)
+{
+    memory_trace_listener.store(listener, std::memory_order_release);
+}
+
+MemoryTraceListener* GetMemoryTraceListener()
+{
+    return memory_trace_listener.load(std::memory_order_acquire);
+}
+
+ScopedMemoryDebugAnnotation::ScopedMemoryDebugAnnotation(
+    absl::string_view op_name)
+    : previous_op_name_(current_op_name)
+{
+    current_op_name = op_name;
+}
+
+ScopedMemoryDebugAnnotation::~ScopedMemoryDebugAnnotation()
+{
+    current_op_name = previous_op_name_;
+}
+
+/*static*/ absl::string_view ScopedMemoryDebugAnnotation::CurrentOpName()
+{
+    return current_op_name;
+}
+
+} // namespace tfdml
@@ -0,0 +1,89 @@
+/* Copyright (c) Microsoft Corporation.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace tfdml
+{
+
+// An allocation or deallocation made by an allocator, along with the state of
+// the allocator after it. The field names follow the stats of the
+// MemoryAllocation and MemoryDeallocation events that TensorBoard's memory
+// profile tool reads.
+struct MemoryTraceEvent
+{
+    bool is_allocation = false;
+    int64_t timestamp_ns = 0;
+    std::string allocator_name;
+
+    // The op that was executing on the calling thread, or empty.
+    std::string tf_op;
+
+    int64_t requested_bytes = 0;
+    int64_t allocation_bytes = 0;
+    uint64_t address = 0;
+
+    int64_t bytes_allocated = 0;
+    int64_t bytes_reserved = 0;
+    int64_t bytes_available = 0;
+    int64_t peak_bytes_in_use = 0;
+    double fragmentation = 0;
+};
+
+// Receives the memory events of all allocators while it's installed. Methods
+// may be called concurrently from any thread, and possibly shortly after the
+// listener is uninstalled. Allocators call it while holding their locks, so it
+// must not allocate memory from them.
+class MemoryTraceListener
+{
+  public:
+    virtual ~MemoryTraceListener() = default;
+    virtual void OnMemoryEvent(MemoryTraceEvent&& event) = 0;
+};
+
+// Installs the listener, or uninstalls the current one if null. The listener
+// must outlive any allocation made while it's installed.
+void SetMemoryTraceListener(MemoryTraceListener* listener);
+
+// Returns the installed listener, or null. Allocators check this before doing
+// any work to record an event, so it's cheap when no profiler is active.
+MemoryTraceListener* GetMemoryTraceListener();
+
+// Attributes the memory events on the calling thread to an op for as long as
+// the annotation is alive. Annotations nest, and the innermost one wins.
+class ScopedMemoryDebugAnnotation
+{
+  public:
+    explicit ScopedMemoryDebugAnnotation(absl::string_view op_name);
+    ~ScopedMemoryDebugAnnotation();
+
+    ScopedMemoryDebugAnnotation(const ScopedMemoryDebugAnnotation&) = delete;
+    ScopedMemoryDebugAnnotation& operator=(
+        const ScopedMemoryDebugAnnotation&) = delete;
+
+    // Returns the name of the op of the innermost annotation on the calling
+    // thread, or an empty string.
+    static absl::string_view CurrentOpName();
+
+  private:
+    absl::string_view previous_op_name_;
+};
+
+} // namespace tfdml
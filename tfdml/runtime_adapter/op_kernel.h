@@ -40,6 +40,9 @@ class OpKernel
 
     std::shared_ptr<const NodeDef> node_def() const { return node_def_; }
 
+    // Same as node_def(), without adding a reference.
+    const NodeDef& node_def_ref() const { return *node_def_; }
+
     const absl::string_view type_string() const
     {
         return node_def_->GetOpTypeName();
@@ -51,7 +51,8 @@ OpKernelContext::OpKernelContext(
     TF_OpKernelContext* context,
     OpKernel* op_kernel)
     : context_(context),
-      op_kernel_(op_kernel)
+      op_kernel_(op_kernel),
+      memory_annotation_(op_kernel->name())
 {
     Status status;
     SP_Stream stream = TF_GetStream(context, status.raw());
@@ -16,6 +16,7 @@ limitations under the License.
 #pragma once
 
 #include "absl/types/span.h"
+#include "tfdml/runtime_adapter/memory_trace.h"
 #include "tfdml/runtime_adapter/status.h"
 #include "tfdml/runtime_adapter/statusor.h"
 #include "tfdml/runtime_adapter/tensor.h"
@@ -99,5 +100,8 @@ class OpKernelContext
     Status status_;
     Device* device_;
     OpKernel* const op_kernel_;
+
+    // Attributes the allocations made while the op executes to it
+    ScopedMemoryDebugAnnotation memory_annotation_;
 };
 } // namespace tfdml
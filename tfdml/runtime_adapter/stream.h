@@ -29,6 +29,6 @@ struct SP_Event_st
 
 struct SP_Timer_st
 {
-    explicit SP_Timer_st(int id) : timer_handle(id) {}
-    int timer_handle;
+    explicit SP_Timer_st(void* timer_h) : timer_handle(timer_h) {}
+    void* timer_handle;
 };